@@ -45,11 +45,14 @@
 #define APPT_TIME_LENGTH 25
 
 llist_ts_t alist_p;
+static struct dayidx *alist_idx;
 
 void apoint_free(struct apoint *apt)
 {
 	mem_free(apt->mesg);
 	erase_note(&apt->note);
+	if (apt->hash)
+		mem_free(apt->hash);
 	mem_free(apt);
 }
 
@@ -66,6 +69,7 @@ struct apoint *apoint_dup(struct apoint *in)
 		apt->note = mem_strdup(in->note);
 	else
 		apt->note = NULL;
+	apt->hash = NULL;
 
 	return apt;
 }
@@ -73,6 +77,7 @@ struct apoint *apoint_dup(struct apoint *in)
 void apoint_llist_init(void)
 {
 	LLIST_TS_INIT(&alist_p);
+	alist_idx = dayidx_new();
 }
 
 /*
@@ -84,6 +89,8 @@ void apoint_llist_free(void)
 {
 	LLIST_TS_FREE_INNER(&alist_p, apoint_free);
 	LLIST_TS_FREE(&alist_p);
+	dayidx_free(alist_idx);
+	alist_idx = NULL;
 }
 
 static int apoint_cmp(struct apoint *a, struct apoint *b)
@@ -100,8 +107,8 @@ static int apoint_cmp(struct apoint *a, struct apoint *b)
 	return strcmp(a->mesg, b->mesg);
 }
 
-struct apoint *apoint_new(char *mesg, char *note, time_t start, long dur,
-			  char state)
+struct apoint *apoint_alloc(char *mesg, char *note, time_t start, long dur,
+			    char state)
 {
 	struct apoint *apt;
 
@@ -111,14 +118,42 @@ struct apoint *apoint_new(char *mesg, char *note, time_t start, long dur,
 	apt->state = state;
 	apt->start = start;
 	apt->dur = dur;
+	apt->hash = NULL;
+
+	return apt;
+}
+
+struct apoint *apoint_new(char *mesg, char *note, time_t start, long dur,
+			  char state)
+{
+	struct apoint *apt = apoint_alloc(mesg, note, start, dur, state);
 
 	LLIST_TS_LOCK(&alist_p);
 	LLIST_TS_ADD_SORTED(&alist_p, apt, apoint_cmp);
+	dayidx_add(alist_idx, apt, apt->start, apt->dur);
 	LLIST_TS_UNLOCK(&alist_p);
 
 	return apt;
 }
 
+/*
+ * Insert the appointments collected by apoint_scan() in the list, all at
+ * once. The vector is left sorted.
+ */
+void apoint_add_all(vector_t *v)
+{
+	struct apoint *apt;
+	unsigned i;
+
+	LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_ADD_SORTED_ALL(&alist_p, v->data, VECTOR_COUNT(v), apoint_cmp);
+	VECTOR_FOREACH(v, i) {
+		apt = VECTOR_NTH(v, i);
+		dayidx_add(alist_idx, apt, apt->start, apt->dur);
+	}
+	LLIST_TS_UNLOCK(&alist_p);
+}
+
 unsigned apoint_inday(struct apoint *i, time_t *start)
 {
 	return (date_cmp_day(i->start, *start) == 0 ||
@@ -126,6 +161,45 @@ unsigned apoint_inday(struct apoint *i, time_t *start)
 		 date_cmp_day(i->start + i->dur - 1, *start) >= 0));
 }
 
+/*
+ * Return the first appointment of the given day, using the day index instead
+ * of going through the whole list. The list must be locked by the caller.
+ */
+struct apoint *apoint_first_inday(time_t day, struct dayidx_iter *it)
+{
+	struct apoint *apt;
+
+	DAYIDX_FOREACH(alist_idx, day, it, apt) {
+		if (apoint_inday(apt, &day))
+			return apt;
+	}
+	return NULL;
+}
+
+/* Return the next appointment of the day given to apoint_first_inday(). */
+struct apoint *apoint_next_inday(time_t day, struct dayidx_iter *it)
+{
+	struct apoint *apt;
+
+	while ((apt = dayidx_next(it))) {
+		if (apoint_inday(apt, &day))
+			return apt;
+	}
+	return NULL;
+}
+
+/*
+ * Update the day index after the start time or the duration of an appointment
+ * has been changed in place.
+ */
+void apoint_reindex(struct apoint *apt, time_t start, long dur)
+{
+	LLIST_TS_LOCK(&alist_p);
+	dayidx_remove(alist_idx, apt, start, dur);
+	dayidx_add(alist_idx, apt, apt->start, apt->dur);
+	LLIST_TS_UNLOCK(&alist_p);
+}
+
 void apoint_sec2str(struct apoint *o, time_t day, char *start, char *end)
 {
 	struct tm lt;
@@ -178,14 +252,12 @@ char *apoint_tostr(struct apoint *o)
 	return string_buf(&s);
 }
 
-char *apoint_hash(struct apoint *apt)
+/* Return the digest of an item, which is cached until the item changes. */
+const char *apoint_hash(struct apoint *apt)
 {
-	char *raw = apoint_tostr(apt);
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
-	sha1_digest(raw, sha1);
-	mem_free(raw);
+	const char *hash = item_hash_get(apt->hash);
 
-	return sha1;
+	return hash ? hash : item_hash_set(&apt->hash, apoint_tostr(apt));
 }
 
 void apoint_write(struct apoint *o, FILE * f)
@@ -195,10 +267,12 @@ void apoint_write(struct apoint *o, FILE * f)
 	mem_free(str);
 }
 
-char *apoint_scan(FILE * f, struct tm start, struct tm end,
-			   char state, char *note, struct item_filter *filter)
+char *apoint_scan(char *buf, struct tm start, struct tm end,
+			   char state, char *note, struct item_filter *filter,
+			   vector_t *items)
 {
-	char buf[BUFSIZ], *newline;
+	struct date dstart = { start.tm_mday, start.tm_mon, start.tm_year };
+	struct date dend = { end.tm_mday, end.tm_mon, end.tm_year };
 	time_t tstart, tend;
 	struct apoint *apt = NULL;
 	int cond;
@@ -209,52 +283,40 @@ char *apoint_scan(FILE * f, struct tm start, struct tm end,
 	    !check_time(end.tm_hour, end.tm_min))
 		return _("illegal date in appointment");
 
-	/* Read the appointment description */
-	if (!fgets(buf, sizeof buf, f))
+	if (!buf)
 		return _("error in appointment description");
 
-	newline = strchr(buf, '\n');
-	if (newline)
-		*newline = '\0';
-
-	start.tm_sec = end.tm_sec = 0;
-	start.tm_isdst = end.tm_isdst = -1;
-	start.tm_year -= 1900;
-	start.tm_mon--;
-	end.tm_year -= 1900;
-	end.tm_mon--;
-
-	tstart = mktime(&start);
-	tend = mktime(&end);
-	if (tstart == -1 || tend == -1 || tstart > tend)
+	tstart = date2sec(dstart, start.tm_hour, start.tm_min);
+	tend = date2sec(dend, end.tm_hour, end.tm_min);
+	if (tstart > tend)
 		return _("date error in appointment");
 
 	/* Filter item. */
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_APPT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->pattern && !pattern_match(filter->pattern, buf)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			apt = apoint_new(
+			apt = apoint_alloc(
 				buf, note, tstart, tend - tstart, state);
-			char *hash = apoint_hash(apt);
-			cond = cond || !hash_matches(filter->hash, hash);
-			mem_free(hash);
+			cond = cond || !hash_matches(filter->hash,
+						     apoint_hash(apt));
 		}
 
 		if ((!filter->invert && cond) || (filter->invert && !cond)) {
 			if (filter->hash)
-				apoint_delete(apt);
+				apoint_free(apt);
 			return NULL;
 		}
 	}
 	if (!apt)
-		apt = apoint_new(buf, note, tstart, tend - tstart, state);
+		apt = apoint_alloc(buf, note, tstart, tend - tstart, state);
+	VECTOR_ADD(items, apt);
 	return NULL;
 }
 
@@ -271,12 +333,31 @@ void apoint_delete(struct apoint *apt)
 	if (notify_bar())
 		need_check_notify = notify_same_item(apt->start);
 	LLIST_TS_REMOVE(&alist_p, i);
+	dayidx_remove(alist_idx, apt, apt->start, apt->dur);
 	if (need_check_notify)
 		notify_check_next_app(0);
 
 	LLIST_TS_UNLOCK(&alist_p);
 }
 
+/*
+ * Remove several appointments from the list at once. The vector must be in
+ * list order. The appointments are not freed.
+ */
+void apoint_remove_all(vector_t *v)
+{
+	struct apoint *apt;
+	unsigned i;
+
+	LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_REMOVE_ALL(&alist_p, v->data, VECTOR_COUNT(v));
+	VECTOR_FOREACH(v, i) {
+		apt = VECTOR_NTH(v, i);
+		dayidx_remove(alist_idx, apt, apt->start, apt->dur);
+	}
+	LLIST_TS_UNLOCK(&alist_p);
+}
+
 static int apoint_starts_after(struct apoint *apt, time_t *time)
 {
 	return apt->start > *time;
@@ -332,6 +413,7 @@ void apoint_paste_item(struct apoint *apt, time_t date)
 
 	LLIST_TS_LOCK(&alist_p);
 	LLIST_TS_ADD_SORTED(&alist_p, apt, apoint_cmp);
+	dayidx_add(alist_idx, apt, apt->start, apt->dur);
 	LLIST_TS_UNLOCK(&alist_p);
 
 	if (notify_bar())
@@ -41,9 +41,13 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "calcurse.h"
 
+/* Size of the stdout buffer when printing to a file or a pipe. */
+#define OUTPUT_BUFSIZE 65536
+
 /* Input types for parse_datetimearg() */
 enum {
 	ARG_DATE,
@@ -84,8 +88,12 @@ enum {
 	OPT_READ_ONLY,
 	OPT_STATUS,
 	OPT_DAEMON,
+	OPT_PACK_NOTES,
+	OPT_SERVE,
+	OPT_CLIENT,
 	OPT_INPUT_DATEFMT,
-	OPT_OUTPUT_DATEFMT
+	OPT_OUTPUT_DATEFMT,
+	OPT_JOBS
 };
 
 /*
@@ -97,7 +105,7 @@ static void usage(void)
 			 "calcurse [-D <directory>] [-C <directory>] [-c <calendar file>]\n"
 			 "calcurse -Q [--from <date>] [--to <date>] [--days <number>]\n"
 			 "calcurse -a | -d <date> | -d <number> | -n | -r[<number>] | -s[<date>] | -t[<number>]\n"
-			 "calcurse -h | -v | --status | -G | -P | -g | -i <file> | -x[<format>] | --daemon"));
+			 "calcurse -h | -v | --status | -G | -P | -g | --pack-notes | -i <file> | -x[<format>] | --daemon | --serve"));
 }
 
 static void usage_try(void)
@@ -137,6 +145,7 @@ static void help_arg(void)
 	printf("%s\n", _("  --to <date>             Limit day range of -Q."));
 	printf("%s\n", _("  --days <number>         Limit day range of -Q."));
 	putchar('\n');
+	printf("%s\n", _("  --jobs <number>         Number of threads printing a query range"));
 	printf("%s\n", _("  --limit, -l <number>    Limit number of query results"));
 	printf("%s\n", _("  --search, -S <regexp>   Match regular expression in queries"));
 	printf("%s\n", _("Consult the man page for details."));
@@ -144,13 +153,16 @@ static void help_arg(void)
 	printf("%s\n", _("Miscellaneous:"));
 	printf("%s\n", _("  -c, --calendar <file>   The calendar data file to use"));
 	printf("%s\n", _("  -C, --confdir <dir>     The configuration directory to use"));
+	printf("%s\n", _("  --client                Have the query server run the command"));
 	printf("%s\n", _("  --daemon                Run notification daemon in the background"));
 	printf("%s\n", _("  -D, --datadir <dir>     The data directory to use"));
 	printf("%s\n", _("  -g, --gc                Run the garbage collector"));
 	printf("%s\n", _("  -h, --help              Show this help text"));
 	printf("%s\n", _("  -i, --import <file>     Import iCal data from file"));
+	printf("%s\n", _("  --pack-notes            Move note files into the note pack"));
 	printf("%s\n", _("  -q, --quiet             Suppress import/export result message"));
 	printf("%s\n", _("  --read-only             Do not save configuration or data files"));
+	printf("%s\n", _("  --serve                 Run the query server in the background"));
 	printf("%s\n", _("  --status                Display status of running instances"));
 	printf("%s\n", _("  -v, --version           Show version information"));
 	printf("%s\n", _("  -x, --export[<format>]  Export to stdout in ical (default) or pcal format"));
@@ -212,7 +224,7 @@ static int todo_arg(const char *format, int *limit, struct item_filter *filter)
 			fputs(titlestr, stdout);
 			title = 0;
 		}
-		print_todo(format, todo);
+		print_todo(NULL, format, todo);
 		n++;
 		(*limit)--;
 	}
@@ -249,19 +261,249 @@ static void next_arg(void)
 }
 
 /*
- * Print the date on stdout.
+ * Print the date on stdout, or append it to a string if one is given.
  */
-static void arg_print_date(long date)
+static void arg_print_date(struct string *out, long date)
 {
 	char date_str[BUFSIZ];
 	struct tm lt;
 
 	localtime_r((time_t *) & date, &lt);
 	strftime(date_str, BUFSIZ, conf.output_datefmt, &lt);
+	if (out) {
+		string_catf(out, "%s:\n", date_str);
+		return;
+	}
 	fputs(date_str, stdout);
 	fputs(":\n", stdout);
 }
 
+/*
+ * Parallel queries (see the --jobs option).
+ *
+ * The query range is cut into slices of consecutive days, a few per thread,
+ * which the threads take in date order. The output of a slice is kept in a
+ * string, cut into pieces that are each either the heading of a day or an
+ * item, and written out by the main thread once all slices before it are.
+ * The result limit is applied then, so that the output is the same as that of
+ * a single thread; no slice prints more items than the limit, though.
+ * Threads do not take slices too far ahead of the output.
+ */
+#define QUERY_SLICES_PER_JOB	4
+
+struct query_piece {
+	int end;		/* offset of the end of the piece */
+	int item;		/* is the piece an item? */
+};
+
+struct query_slice {
+	time_t from, to;
+	struct day_range *range;
+	struct string out;
+	struct query_piece *pieces;
+	unsigned npieces, piecesz;
+	int done;
+};
+
+struct query {
+	struct query_slice *slices;
+	unsigned nslices;
+	unsigned next;		/* first slice not yet taken */
+	unsigned written;	/* number of slices written out */
+	unsigned window;	/* slices that can be taken ahead of the output */
+	int limit;
+	const char *fmt_apt, *fmt_rapt, *fmt_ev, *fmt_rev;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static void query_slice_cut(struct query_slice *s, int item)
+{
+	if (s->npieces == s->piecesz) {
+		s->piecesz = s->piecesz ? 2 * s->piecesz : 64;
+		s->pieces = mem_realloc(s->pieces, s->piecesz,
+					sizeof(struct query_piece));
+	}
+	s->pieces[s->npieces].end = s->out.len;
+	s->pieces[s->npieces].item = item;
+	s->npieces++;
+}
+
+static void query_slice_print(struct query *q, struct query_slice *s)
+{
+	vector_t *items;
+	time_t date;
+	int i, n = 0;
+
+	if (!s->range)
+		s->range = day_range_new(s->from, s->to);
+	string_init(&s->out);
+	while ((items = day_range_next(s->range, &date))) {
+		if (s->npieces > 0)
+			string_catn(&s->out, "\n", 1);
+		arg_print_date(&s->out, date);
+		query_slice_cut(s, 0);
+		VECTOR_FOREACH(items, i) {
+			if (n == q->limit)
+				break;
+			day_item_print(&s->out, VECTOR_NTH(items, i), date,
+				       q->fmt_apt, q->fmt_rapt, q->fmt_ev,
+				       q->fmt_rev);
+			query_slice_cut(s, 1);
+			n++;
+		}
+	}
+	day_range_free(s->range);
+	s->range = NULL;
+}
+
+/* Write the output of a slice to stdout, leaving out items past the limit. */
+static void query_slice_write(struct query_slice *s, int *add_line,
+			      int *limit)
+{
+	int start = 0, end = 0;
+	unsigned i;
+
+	if (s->npieces > 0 && *add_line)
+		fputs("\n", stdout);
+	for (i = 0; i < s->npieces; i++) {
+		if (s->pieces[i].item && *limit == 0) {
+			fwrite(s->out.buf + start, 1, end - start, stdout);
+			start = s->pieces[i].end;
+		} else if (s->pieces[i].item) {
+			(*limit)--;
+		}
+		end = s->pieces[i].end;
+	}
+	fwrite(s->out.buf + start, 1, end - start, stdout);
+	if (s->npieces > 0)
+		*add_line = 1;
+
+	mem_free(s->out.buf);
+	if (s->pieces)
+		mem_free(s->pieces);
+}
+
+static void *query_thread(void *arg)
+{
+	struct query *q = arg;
+	struct query_slice *s;
+
+	for (;;) {
+		pthread_mutex_lock(&q->mutex);
+		while (q->next < q->nslices &&
+		       q->next >= q->written + q->window)
+			pthread_cond_wait(&q->cond, &q->mutex);
+		if (q->next == q->nslices) {
+			pthread_mutex_unlock(&q->mutex);
+			return NULL;
+		}
+		s = &q->slices[q->next++];
+		pthread_mutex_unlock(&q->mutex);
+
+		query_slice_print(q, s);
+
+		pthread_mutex_lock(&q->mutex);
+		s->done = 1;
+		pthread_cond_broadcast(&q->cond);
+		pthread_mutex_unlock(&q->mutex);
+	}
+}
+
+/*
+ * Print the query range with the given number of threads, the main thread
+ * included. Return 0 if the range is too short to be split.
+ */
+static int
+date_arg_from_to_parallel(long from, long to, int add_line,
+			  const char *fmt_apt, const char *fmt_rapt,
+			  const char *fmt_ev, const char *fmt_rev, int *limit,
+			  int jobs)
+{
+	struct query q;
+	struct query_slice *s;
+	pthread_t *threads;
+	unsigned i, nthreads;
+	long ndays, len;
+	time_t day;
+
+#ifdef CALCURSE_MEMORY_DEBUG
+	/* The memory debugging code is not thread-safe. */
+	return 0;
+#endif
+
+	for (ndays = 0, day = from; day <= to; day = NEXTDAY(day))
+		ndays++;
+	if (jobs < 2 || ndays < 2)
+		return 0;
+
+	q.nslices = MIN(ndays, (long)jobs * QUERY_SLICES_PER_JOB);
+	q.slices = mem_calloc(q.nslices, sizeof(struct query_slice));
+	for (i = 0, day = from; i < q.nslices; i++) {
+		s = &q.slices[i];
+		s->from = day;
+		len = ndays / q.nslices + (i < ndays % q.nslices);
+		while (len-- > 0) {
+			s->to = day;
+			day = NEXTDAY(day);
+		}
+	}
+	q.next = q.written = 0;
+	q.window = 2 * MIN((unsigned)jobs, q.nslices);
+	q.limit = *limit;
+	q.fmt_apt = fmt_apt;
+	q.fmt_rapt = fmt_rapt;
+	q.fmt_ev = fmt_ev;
+	q.fmt_rev = fmt_rev;
+	pthread_mutex_init(&q.mutex, NULL);
+	pthread_cond_init(&q.cond, NULL);
+
+	/* Shared state is prepared before any thread is started. */
+	print_prepare_format(fmt_apt);
+	print_prepare_format(fmt_rapt);
+	print_prepare_format(fmt_ev);
+	print_prepare_format(fmt_rev);
+	q.slices[0].range = day_range_new(q.slices[0].from, q.slices[0].to);
+
+	/* The main thread prints the slices no other thread has taken. */
+	nthreads = MIN((unsigned)jobs, q.nslices) - 1;
+	threads = mem_calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, query_thread, &q))
+			break;
+	}
+	nthreads = i;
+
+	for (i = 0; i < q.nslices; i++) {
+		s = &q.slices[i];
+		pthread_mutex_lock(&q.mutex);
+		if (q.next == i) {
+			q.next++;
+			pthread_mutex_unlock(&q.mutex);
+			query_slice_print(&q, s);
+		} else {
+			while (!s->done)
+				pthread_cond_wait(&q.cond, &q.mutex);
+			pthread_mutex_unlock(&q.mutex);
+		}
+		query_slice_write(s, &add_line, limit);
+
+		pthread_mutex_lock(&q.mutex);
+		q.written = i + 1;
+		pthread_cond_broadcast(&q.cond);
+		pthread_mutex_unlock(&q.mutex);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	mem_free(threads);
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.mutex);
+	mem_free(q.slices);
+
+	return 1;
+}
+
 /*
  * Print appointments inside the given query range.
  * If no start day is given (-1), today is considered.
@@ -270,21 +512,32 @@ static void arg_print_date(long date)
 static void
 date_arg_from_to(long from, long to, int add_line, const char *fmt_apt,
 		 const char *fmt_rapt, const char *fmt_ev, const char *fmt_rev,
-		 int *limit)
+		 int *limit, int jobs)
 {
-	long date;
+	struct day_range *r;
+	vector_t *items;
+	time_t date;
+	int i;
 
-	for (date = from; date <= to; date = date_sec_change(date, 0, 1)) {
-		day_store_items(date, 0, 1);
-		if (day_item_count(0) == 0)
-			continue;
+	if (date_arg_from_to_parallel(from, to, add_line, fmt_apt, fmt_rapt,
+				      fmt_ev, fmt_rev, limit, jobs))
+		return;
+
+	r = day_range_new(from, to);
+	while ((items = day_range_next(r, &date))) {
 		if (add_line)
 			fputs("\n", stdout);
-		arg_print_date(date);
-		day_write_stdout(date, fmt_apt, fmt_rapt, fmt_ev,
-				 fmt_rev, limit);
+		arg_print_date(NULL, date);
+		VECTOR_FOREACH(items, i) {
+			if (*limit == 0)
+				break;
+			day_item_print(NULL, VECTOR_NTH(items, i), date,
+				       fmt_apt, fmt_rapt, fmt_ev, fmt_rev);
+			(*limit)--;
+		}
 		add_line = 1;
 	}
+	day_range_free(r);
 }
 
 /*
@@ -395,6 +648,18 @@ cleanup:
 	return mask;
 }
 
+/*
+ * Load the items matching a filter. The items of a request to the server are
+ * in memory already.
+ */
+static void load_data(struct item_filter *filter)
+{
+	if (serve_request())
+		serve_filter(filter);
+	else
+		io_load_data(filter, FORCE);
+}
+
 /*
  * Parse the command-line arguments and call the appropriate
  * routines to handle those arguments. Also initialize the data paths.
@@ -405,6 +670,7 @@ int parse_args(int argc, char **argv)
 	/* Command-line flags - NOTE that read_only is global */
 	int grep = 0, grep_filter = 0, purge = 0, query = 0, next = 0;
 	int status = 0, gc = 0, import = 0, export = 0, daemon = 0;
+	int pack_notes = 0, serve = 0, client = 0;
 	/* Command line invocation */
 	int filter_opt = 0, format_opt = 0, query_range = 0, cmd_line = 0;
 	int start_from = 0, start_to = 0, end_from = 0, end_to = 0;
@@ -412,6 +678,7 @@ int parse_args(int argc, char **argv)
 	time_t from = -1, to = -1;
 	int range = 0;
 	int limit = INT_MAX;
+	int jobs = 1;
 	/* Filters */
 	struct item_filter filter = { 0, 0, NULL, NULL, -1, -1, -1, -1, 0, 0, 0 };
 	/* Format strings */
@@ -430,8 +697,8 @@ int parse_args(int argc, char **argv)
 
 	int ret, non_interactive = 1;
 	int ch, cpid, type;
-	regex_t reg;
 	char buf[BUFSIZ];
+	static char outbuf[OUTPUT_BUFSIZE];
 	struct tm tm;
 	time_t t;
 
@@ -495,8 +762,12 @@ int parse_args(int argc, char **argv)
 		{"read-only", no_argument, NULL, OPT_READ_ONLY},
 		{"status", no_argument, NULL, OPT_STATUS},
 		{"daemon", no_argument, NULL, OPT_DAEMON},
+		{"pack-notes", no_argument, NULL, OPT_PACK_NOTES},
+		{"serve", no_argument, NULL, OPT_SERVE},
+		{"client", no_argument, NULL, OPT_CLIENT},
 		{"input-datefmt", required_argument, NULL, OPT_INPUT_DATEFMT},
 		{"output-datefmt", required_argument, NULL, OPT_OUTPUT_DATEFMT},
+		{"jobs", required_argument, NULL, OPT_JOBS},
 		{NULL, no_argument, NULL, 0}
 	};
 
@@ -515,17 +786,25 @@ int parse_args(int argc, char **argv)
 		case 'c':
 			cfile = optarg;
 			break;
+		case OPT_CLIENT:
+			client = 1;
+			break;
 		case '?':
 			usage();
 			usage_try();
 			exit(EXIT_FAILURE);                                             \
 		}
 	}
-	io_init(cfile, datadir, confdir);
-	vars_init();
-	notify_init_vars();
-	if (io_file_exists(path_conf))
-		config_load();
+	/* A request process of the server is set up already. */
+	if (!serve_request()) {
+		io_init(cfile, datadir, confdir);
+		if (client)
+			serve_client(argc, argv);
+		vars_init();
+		notify_init_vars();
+		if (io_file_exists(path_conf))
+			config_load();
+	}
 
 	/* Parse the remaining options. */
 	optind = 1;
@@ -654,11 +933,10 @@ int parse_args(int argc, char **argv)
 			break;
 		case 'S':
 		case OPT_FILTER_PATTERN:
-			EXIT_IF(filter.regex,
+			EXIT_IF(filter.pattern,
 				_("cannot handle more than one regular expression"));
-			if (regcomp(&reg, optarg, REG_EXTENDED))
+			if (!(filter.pattern = pattern_new(optarg)))
 				EXIT(_("could not compile regular expression: %s"), optarg);
-			filter.regex = &reg;
 			filter_opt = 1;
 			break;
 		/*
@@ -847,6 +1125,14 @@ int parse_args(int argc, char **argv)
 			daemon = 1;
 			filter.type_mask = TYPE_MASK_APPT | TYPE_MASK_RECUR_APPT;
 			break;
+		case OPT_PACK_NOTES:
+			pack_notes = 1;
+			break;
+		case OPT_SERVE:
+			serve = 1;
+			break;
+		case OPT_CLIENT:
+			break;
 		case OPT_INPUT_DATEFMT:
 			conf.input_datefmt = atoi(optarg);
 			EXIT_IF(conf.input_datefmt < 1 || conf.input_datefmt > 4,
@@ -864,13 +1150,19 @@ int parse_args(int argc, char **argv)
 				'\0';
 			cmd_line = 1;
 			break;
+		case OPT_JOBS:
+			jobs = atoi(optarg);
+			EXIT_IF(jobs < 1, _("invalid number of jobs: %s"),
+				optarg);
+			break;
 		}
 	}
 
 	if (filter.type_mask == 0)
 		filter.type_mask = TYPE_MASK_ALL;
 
-	if (status + grep + query + next + gc + import + export + daemon > 1 ||
+	if (status + grep + query + next + gc + import + export + daemon +
+	    pack_notes + serve > 1 ||
 	    optind < argc ||
 	    (filter_opt && !(grep + query + export)) ||
 	    (format_opt && !(grep + query + dump_imported)) ||
@@ -879,6 +1171,11 @@ int parse_args(int argc, char **argv)
 	   )
 		EXIT(_("invalid argument combination"));
 
+	/* Leave the commands which modify the data files to the client. */
+	if (serve_request() && !(status || query || next || export ||
+				 (grep && !purge && !grep_filter)))
+		return 0;
+
 	EXIT_IF(to >= 0 && range, _("cannot specify a range and an end date"));
 	if (from == -1)
 		from = get_today();
@@ -895,13 +1192,18 @@ int parse_args(int argc, char **argv)
 	io_check_dir(path_cdir);
 	io_check_dir(path_hooks);
 
+	/* Queries and exports may print many items, write them in blocks. */
+	if ((grep || query || export || dump_imported) &&
+	    !isatty(STDOUT_FILENO))
+		setvbuf(stdout, outbuf, _IOFBF, OUTPUT_BUFSIZE);
+
 	if (status) {
 		status_arg();
 	} else if (grep) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_check_file(path_conf);
-		io_load_data(&filter, FORCE);
+		load_data(&filter);
 		if (purge || grep_filter) {
 			io_save_todo(path_todo);
 			io_save_apts(path_apts);
@@ -922,7 +1224,7 @@ int parse_args(int argc, char **argv)
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_check_file(path_conf);
-		io_load_data(&filter, FORCE);
+		load_data(&filter);
 
 		/* Use default values for non-specified format strings. */
 		fmt_apt = fmt_apt ? fmt_apt : " - %S -> %E\n\t%m\n";
@@ -933,16 +1235,26 @@ int parse_args(int argc, char **argv)
 
 		int add_line = todo_arg(fmt_todo, &limit, &filter);
 		date_arg_from_to(from, to, add_line, fmt_apt, fmt_rapt, fmt_ev,
-				 fmt_rev, &limit);
+				 fmt_rev, &limit, jobs);
 	} else if (next) {
 		io_check_file(path_apts);
-		io_load_app(&filter);
+		if (serve_request()) {
+			serve_filter(&filter);
+		} else {
+			apoint_llist_init();
+			event_llist_init();
+			recur_apoint_llist_init();
+			recur_event_llist_init();
+			io_load_app(&filter);
+		}
 		next_arg();
 	} else if (gc) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
 		io_load_data(NULL, FORCE);
 		note_gc();
+	} else if (pack_notes) {
+		note_pack_files();
 	} else if (import) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
@@ -965,26 +1277,32 @@ int parse_args(int argc, char **argv)
 		}
 		ret = io_import_data(IO_IMPORT_ICAL, ifile, fmt_ev, fmt_rev,
 				     fmt_apt, fmt_rapt, fmt_todo);
-		io_save_apts(path_apts);
-		io_save_todo(path_todo);
+		io_save_files();
 		if (!ret)
 			exit_calcurse(EXIT_FAILURE);
 	} else if (export) {
 		io_check_file(path_apts);
 		io_check_file(path_todo);
-		io_load_data(&filter, FORCE);
+		load_data(&filter);
 		io_export_data(xfmt, export_uid);
 	} else if (daemon) {
 		dmon_stop();
 		dmon_start(0);
+	} else if (serve) {
+		io_check_file(path_apts);
+		io_check_file(path_todo);
+		io_check_file(path_conf);
+		serve_start();
 	} else if (!cmd_line) {
 		/* interactive mode */
 		non_interactive = 0;
 	}
 
 	/* Free filter parameters. */
-	if (filter.regex)
-		regfree(filter.regex);
+	if (filter.pattern) {
+		pattern_stats(filter.pattern);
+		pattern_free(filter.pattern);
+	}
 
 	return non_interactive;
 }
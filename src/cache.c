@@ -0,0 +1,922 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+#include "sha1.h"
+
+/*
+ * Binary cache of the data files (see the general.datacache option).
+ *
+ * The cache of a data file is an image of its items, written next to it and
+ * mapped into memory when it is loaded. It consists of a header followed by
+ * sections of fixed-size records and a pool holding the strings they refer
+ * to. Dates are kept as local dates and times, as in the text file, so that
+ * the cache does not depend on the time zone.
+ *
+ * The header holds the hash and the status of the data file the cache was
+ * built from. The cache is used if the data file still has that status or,
+ * once the file has been read, if it has that hash. Otherwise the file is
+ * parsed as usual and, once all of its items are in memory, the cache is
+ * rebuilt: the image is built from the item lists and written by a separate
+ * thread. A cache that cannot be used for any reason is simply ignored.
+ */
+
+#define CACHE_MAGIC	"calcurse-cache\n"
+#define CACHE_VERSION	1
+#define CACHE_ORDER	0x01020304
+#define CACHE_NONE	UINT32_MAX
+
+#define CACHE_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+enum cache_section {
+	CACHE_APOINT,
+	CACHE_EVENT,
+	CACHE_RECUR_APOINT,
+	CACHE_RECUR_EVENT,
+	CACHE_TODO_ITEM,
+	CACHE_INT,
+	CACHE_DATE,
+	CACHE_POOL,
+	CACHE_NSECTIONS
+};
+
+/* The part of the header rewritten by cache_touch(). */
+struct cache_key {
+	char sha1[SHA1_DIGESTLEN * 2];
+	int64_t valid;
+	int64_t dev;
+	int64_t ino;
+	int64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	int64_t checked;
+};
+
+struct cache_header {
+	char magic[16];
+	uint32_t version;
+	uint32_t order;		/* detects a different byte order */
+	uint32_t size;		/* of the header */
+	uint32_t type;		/* enum data_file */
+	struct cache_key key;
+	uint64_t off[CACHE_NSECTIONS];
+	uint64_t len[CACHE_NSECTIONS];
+	uint64_t total;		/* length of the image */
+	uint64_t sum;		/* checksum of everything after the header */
+};
+
+/* Local date and time. */
+struct cache_tm {
+	uint16_t yyyy;
+	uint8_t mm;
+	uint8_t dd;
+	uint8_t hh;
+	uint8_t mi;
+};
+
+/* Recurrence rule and exceptions, as ranges of the integer and date arrays. */
+struct cache_rpt {
+	int32_t type;
+	int32_t freq;
+	struct cache_tm until;	/* all zero if there is none */
+	uint32_t bymonth, nbymonth;
+	uint32_t bywday, nbywday;
+	uint32_t bymonthday, nbymonthday;
+	uint32_t exc, nexc;
+};
+
+struct cache_apoint {
+	struct cache_tm start;
+	struct cache_tm end;
+	uint32_t state;
+	uint32_t mesg;		/* offsets in the string pool */
+	uint32_t note;
+};
+
+struct cache_event {
+	struct cache_tm day;
+	int32_t id;
+	uint32_t mesg;
+	uint32_t note;
+};
+
+struct cache_recur_apoint {
+	struct cache_rpt rpt;
+	struct cache_tm start;
+	struct cache_tm end;
+	uint32_t state;
+	uint32_t mesg;
+	uint32_t note;
+};
+
+struct cache_recur_event {
+	struct cache_rpt rpt;
+	struct cache_tm day;
+	int32_t id;
+	uint32_t mesg;
+	uint32_t note;
+};
+
+struct cache_todo {
+	int32_t id;
+	int32_t completed;
+	uint32_t mesg;
+	uint32_t note;
+};
+
+static const size_t cache_recsize[CACHE_NSECTIONS] = {
+	sizeof(struct cache_apoint),
+	sizeof(struct cache_event),
+	sizeof(struct cache_recur_apoint),
+	sizeof(struct cache_recur_event),
+	sizeof(struct cache_todo),
+	sizeof(int32_t),
+	sizeof(struct cache_tm),
+	1
+};
+
+/* A cache file mapped into memory. */
+struct cache_map {
+	int fd;
+	char *data;
+	size_t len;
+	struct cache_header *hdr;
+	struct cache_tm day;	/* last day converted, see cache_tm2sec() */
+	time_t midnight;
+	int plain;
+};
+
+#define CACHE_SEC(m, s) ((void *)((m)->data + (m)->hdr->off[s]))
+#define CACHE_COUNT(m, s) ((m)->hdr->len[s] / cache_recsize[s])
+
+/* Growable buffer, used to build the image. */
+struct cache_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/* Image being written by the writer thread. */
+struct cache_job {
+	struct cache_buf img;
+	char *path;
+};
+
+static pthread_t cache_t_write;
+static int cache_writing = 0;
+
+static char *cache_path(enum data_file type)
+{
+	char *path;
+
+	asprintf(&path, "%s.cache", type == DATA_APTS ? path_apts : path_todo);
+	return path;
+}
+
+/* FNV-1a, applied to 64-bit words. */
+static uint64_t cache_sum(const char *p, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL, w;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 1099511628211ULL;
+	}
+	return h;
+}
+
+/*
+ * Return the item types which can be taken from the cache with the given
+ * filter, or 0 if the filter cannot be applied to the cache.
+ */
+static int cache_filter_mask(struct item_filter *filter)
+{
+	if (!filter)
+		return TYPE_MASK_ALL;
+	if (filter->invert || filter->hash || filter->pattern ||
+	    filter->start_from != -1 || filter->start_to != -1 ||
+	    filter->end_from != -1 || filter->end_to != -1 ||
+	    filter->priority || filter->completed || filter->uncompleted)
+		return 0;
+	return filter->type_mask;
+}
+
+static void cache_unmap(struct cache_map *m)
+{
+	munmap(m->data, m->len);
+	close(m->fd);
+}
+
+/* Map a cache file and check that its layout is sound. */
+static int cache_map(struct cache_map *m, enum data_file type)
+{
+	char *path = cache_path(type);
+	struct cache_header *hdr;
+	struct stat st;
+	unsigned i;
+
+	m->day.yyyy = 0;
+	m->fd = open(path, O_RDWR);
+	if (m->fd < 0)
+		m->fd = open(path, O_RDONLY);
+	mem_free(path);
+	if (m->fd < 0)
+		return 0;
+
+	if (fstat(m->fd, &st) != 0 ||
+	    st.st_size < (off_t)sizeof(struct cache_header) ||
+	    (uintmax_t)st.st_size > SIZE_MAX) {
+		close(m->fd);
+		return 0;
+	}
+	m->len = st.st_size;
+	m->data = mmap(NULL, m->len, PROT_READ, MAP_PRIVATE, m->fd, 0);
+	if (m->data == MAP_FAILED) {
+		close(m->fd);
+		return 0;
+	}
+
+	hdr = m->hdr = (struct cache_header *)m->data;
+	if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != CACHE_VERSION || hdr->order != CACHE_ORDER ||
+	    hdr->size != sizeof(struct cache_header) || hdr->type != type ||
+	    hdr->total != m->len)
+		goto invalid;
+	for (i = 0; i < CACHE_NSECTIONS; i++) {
+		if (hdr->off[i] % 8 != 0 ||
+		    hdr->off[i] < CACHE_ALIGN(sizeof(struct cache_header)) ||
+		    hdr->off[i] > m->len || hdr->len[i] > m->len - hdr->off[i] ||
+		    hdr->len[i] % cache_recsize[i] != 0)
+			goto invalid;
+	}
+	return 1;
+
+invalid:
+	cache_unmap(m);
+	return 0;
+}
+
+static int cache_str_valid(struct cache_map *m, uint32_t off, int null)
+{
+	if (off == CACHE_NONE)
+		return null;
+	return off < m->hdr->len[CACHE_POOL];
+}
+
+static char *cache_str(struct cache_map *m, uint32_t off)
+{
+	if (off == CACHE_NONE)
+		return NULL;
+	return (char *)CACHE_SEC(m, CACHE_POOL) + off;
+}
+
+static int cache_tm_valid(struct cache_tm *ct)
+{
+	return check_date(ct->yyyy, ct->mm, ct->dd) &&
+	       check_time(ct->hh, ct->mi);
+}
+
+/*
+ * Convert a local date to a time. Items mostly come in date order, so the
+ * start of the last day seen is kept, and times on days without a UTC offset
+ * change are derived from it.
+ */
+static time_t cache_tm2sec(struct cache_map *m, struct cache_tm *ct)
+{
+	struct date d = { ct->dd, ct->mm, ct->yyyy };
+
+	if (ct->yyyy != m->day.yyyy || ct->mm != m->day.mm ||
+	    ct->dd != m->day.dd) {
+		m->day = *ct;
+		m->midnight = date2sec(d, 0, 0);
+		m->plain = NEXTDAY(m->midnight) - m->midnight == DAYINSEC;
+	}
+	if (!m->plain)
+		return date2sec(d, ct->hh, ct->mi);
+	return m->midnight + ct->hh * HOURINSEC + ct->mi * MININSEC;
+}
+
+static int cache_range_valid(uint32_t first, uint32_t n, uint64_t count)
+{
+	return (uint64_t)first + n <= count;
+}
+
+static int cache_rpt_valid(struct cache_map *m, struct cache_rpt *cr)
+{
+	uint64_t nint = CACHE_COUNT(m, CACHE_INT);
+	uint64_t ndate = CACHE_COUNT(m, CACHE_DATE);
+	struct cache_tm *dates = CACHE_SEC(m, CACHE_DATE);
+	uint32_t i;
+
+	if (cr->type < 0 || cr->type >= NBRECUR ||
+	    (cr->until.yyyy && !cache_tm_valid(&cr->until)) ||
+	    !cache_range_valid(cr->bymonth, cr->nbymonth, nint) ||
+	    !cache_range_valid(cr->bywday, cr->nbywday, nint) ||
+	    !cache_range_valid(cr->bymonthday, cr->nbymonthday, nint) ||
+	    !cache_range_valid(cr->exc, cr->nexc, ndate))
+		return 0;
+	for (i = 0; i < cr->nexc; i++) {
+		if (!cache_tm_valid(&dates[cr->exc + i]))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Check the whole contents of a cache, so that the items can then be loaded
+ * without any further test.
+ */
+static int cache_verify(struct cache_map *m)
+{
+	size_t body = CACHE_ALIGN(sizeof(struct cache_header));
+	uint64_t npool = m->hdr->len[CACHE_POOL];
+	char *pool = CACHE_SEC(m, CACHE_POOL);
+	struct cache_apoint *apt = CACHE_SEC(m, CACHE_APOINT);
+	struct cache_event *ev = CACHE_SEC(m, CACHE_EVENT);
+	struct cache_recur_apoint *rapt = CACHE_SEC(m, CACHE_RECUR_APOINT);
+	struct cache_recur_event *rev = CACHE_SEC(m, CACHE_RECUR_EVENT);
+	struct cache_todo *todo = CACHE_SEC(m, CACHE_TODO_ITEM);
+	uint64_t i;
+
+	if (cache_sum(m->data + body, m->len - body) != m->hdr->sum)
+		return 0;
+	if (npool > 0 && pool[npool - 1] != '\0')
+		return 0;
+
+	for (i = 0; i < CACHE_COUNT(m, CACHE_APOINT); i++, apt++) {
+		if (!cache_tm_valid(&apt->start) ||
+		    !cache_tm_valid(&apt->end) ||
+		    !cache_str_valid(m, apt->mesg, 0) ||
+		    !cache_str_valid(m, apt->note, 1))
+			return 0;
+	}
+	for (i = 0; i < CACHE_COUNT(m, CACHE_EVENT); i++, ev++) {
+		if (!cache_tm_valid(&ev->day) ||
+		    !cache_str_valid(m, ev->mesg, 0) ||
+		    !cache_str_valid(m, ev->note, 1))
+			return 0;
+	}
+	for (i = 0; i < CACHE_COUNT(m, CACHE_RECUR_APOINT); i++, rapt++) {
+		if (!cache_rpt_valid(m, &rapt->rpt) ||
+		    !cache_tm_valid(&rapt->start) ||
+		    !cache_tm_valid(&rapt->end) ||
+		    !cache_str_valid(m, rapt->mesg, 0) ||
+		    !cache_str_valid(m, rapt->note, 1))
+			return 0;
+	}
+	for (i = 0; i < CACHE_COUNT(m, CACHE_RECUR_EVENT); i++, rev++) {
+		if (!cache_rpt_valid(m, &rev->rpt) ||
+		    !cache_tm_valid(&rev->day) ||
+		    !cache_str_valid(m, rev->mesg, 0) ||
+		    !cache_str_valid(m, rev->note, 1))
+			return 0;
+	}
+	for (i = 0; i < CACHE_COUNT(m, CACHE_TODO_ITEM); i++, todo++) {
+		if (!cache_str_valid(m, todo->mesg, 0) ||
+		    !cache_str_valid(m, todo->note, 1))
+			return 0;
+	}
+	return 1;
+}
+
+static void cache_get_ints(llist_t *l, int32_t *v, uint32_t n)
+{
+	uint32_t i;
+	int *p;
+
+	LLIST_INIT(l);
+	for (i = 0; i < n; i++) {
+		p = mem_malloc(sizeof(int));
+		*p = v[i];
+		LLIST_ADD(l, p);
+	}
+}
+
+static void cache_get_rpt(struct cache_map *m, struct cache_rpt *cr,
+			  struct rpt *rpt)
+{
+	int32_t *ints = CACHE_SEC(m, CACHE_INT);
+	struct cache_tm *dates = CACHE_SEC(m, CACHE_DATE);
+	uint32_t i;
+
+	rpt->type = cr->type;
+	rpt->freq = cr->freq;
+	rpt->until = cr->until.yyyy ? cache_tm2sec(m, &cr->until) : 0;
+	cache_get_ints(&rpt->bymonth, ints + cr->bymonth, cr->nbymonth);
+	cache_get_ints(&rpt->bywday, ints + cr->bywday, cr->nbywday);
+	cache_get_ints(&rpt->bymonthday, ints + cr->bymonthday,
+		       cr->nbymonthday);
+	recur_exc_init(&rpt->exc);
+	for (i = 0; i < cr->nexc; i++)
+		recur_add_exc(&rpt->exc, cache_tm2sec(m, &dates[cr->exc + i]));
+}
+
+/* Add the items of a verified cache to the lists. */
+static void cache_get_apts(struct cache_map *m, int mask)
+{
+	struct cache_apoint *apt = CACHE_SEC(m, CACHE_APOINT);
+	struct cache_event *ev = CACHE_SEC(m, CACHE_EVENT);
+	struct cache_recur_apoint *rapt = CACHE_SEC(m, CACHE_RECUR_APOINT);
+	struct cache_recur_event *rev = CACHE_SEC(m, CACHE_RECUR_EVENT);
+	uint64_t i, n;
+	time_t start;
+	struct rpt rpt;
+	vector_t v;
+
+	if (mask & TYPE_MASK_APPT) {
+		n = CACHE_COUNT(m, CACHE_APOINT);
+		VECTOR_INIT(&v, n ? n : 1);
+		for (i = 0; i < n; i++, apt++) {
+			start = cache_tm2sec(m, &apt->start);
+			VECTOR_ADD(&v, apoint_alloc(cache_str(m, apt->mesg),
+				   cache_str(m, apt->note), start,
+				   cache_tm2sec(m, &apt->end) - start,
+				   apt->state));
+		}
+		apoint_add_all(&v);
+		VECTOR_FREE(&v);
+	}
+
+	if (mask & TYPE_MASK_EVNT) {
+		n = CACHE_COUNT(m, CACHE_EVENT);
+		VECTOR_INIT(&v, n ? n : 1);
+		for (i = 0; i < n; i++, ev++) {
+			VECTOR_ADD(&v, event_alloc(cache_str(m, ev->mesg),
+				   cache_str(m, ev->note),
+				   cache_tm2sec(m, &ev->day), ev->id));
+		}
+		event_add_all(&v);
+		VECTOR_FREE(&v);
+	}
+
+	if (mask & TYPE_MASK_RECUR_APPT) {
+		n = CACHE_COUNT(m, CACHE_RECUR_APOINT);
+		VECTOR_INIT(&v, n ? n : 1);
+		for (i = 0; i < n; i++, rapt++) {
+			cache_get_rpt(m, &rapt->rpt, &rpt);
+			start = cache_tm2sec(m, &rapt->start);
+			VECTOR_ADD(&v, recur_apoint_alloc(
+				   cache_str(m, rapt->mesg),
+				   cache_str(m, rapt->note), start,
+				   cache_tm2sec(m, &rapt->end) - start,
+				   rapt->state, &rpt));
+		}
+		recur_apoint_add_all(&v);
+		VECTOR_FREE(&v);
+	}
+
+	if (mask & TYPE_MASK_RECUR_EVNT) {
+		n = CACHE_COUNT(m, CACHE_RECUR_EVENT);
+		VECTOR_INIT(&v, n ? n : 1);
+		for (i = 0; i < n; i++, rev++) {
+			cache_get_rpt(m, &rev->rpt, &rpt);
+			VECTOR_ADD(&v, recur_event_alloc(
+				   cache_str(m, rev->mesg),
+				   cache_str(m, rev->note),
+				   cache_tm2sec(m, &rev->day), rev->id, &rpt));
+		}
+		recur_event_add_all(&v);
+		VECTOR_FREE(&v);
+	}
+}
+
+static void cache_get_todo(struct cache_map *m, int mask)
+{
+	struct cache_todo *todo = CACHE_SEC(m, CACHE_TODO_ITEM);
+	uint64_t i;
+
+	if (!(mask & TYPE_MASK_TODO))
+		return;
+	for (i = 0; i < CACHE_COUNT(m, CACHE_TODO_ITEM); i++, todo++) {
+		todo_add(cache_str(m, todo->mesg), todo->id, todo->completed,
+			 cache_str(m, todo->note));
+	}
+}
+
+static void cache_key_set(struct cache_key *key, const char *sha1,
+			  struct io_fstat *fs)
+{
+	memset(key, 0, sizeof(*key));
+	memcpy(key->sha1, sha1, sizeof(key->sha1));
+	key->valid = fs->valid;
+	key->dev = fs->dev;
+	key->ino = fs->ino;
+	key->size = fs->size;
+	key->mtime = fs->mtime;
+	key->mtime_nsec = fs->mtime_nsec;
+	key->checked = fs->checked;
+}
+
+static void cache_key_get(struct cache_key *key, char *sha1,
+			  struct io_fstat *fs)
+{
+	memcpy(sha1, key->sha1, sizeof(key->sha1));
+	sha1[sizeof(key->sha1)] = '\0';
+	fs->valid = key->valid;
+	fs->dev = key->dev;
+	fs->ino = key->ino;
+	fs->size = key->size;
+	fs->mtime = key->mtime;
+	fs->mtime_nsec = key->mtime_nsec;
+	fs->checked = key->checked;
+}
+
+/*
+ * Record a new status of the data file in a cache which is still valid, so
+ * that it can be used without reading the data file next time. The file is
+ * written through the descriptor it was mapped from: if it has been replaced
+ * in the meantime, the new one is left alone.
+ */
+static int cache_touch(struct cache_map *m, const char *sha1,
+		       struct io_fstat *fs)
+{
+	struct cache_key key;
+
+	cache_key_set(&key, sha1, fs);
+	return pwrite(m->fd, &key, sizeof(key),
+		      offsetof(struct cache_header, key)) == sizeof(key);
+}
+
+/*
+ * Load the items of a data file from its cache, if possible. Without a hash
+ * (key), the cache is used if the data file still has the status recorded in
+ * it; the hash and the status of the file are then taken from the cache.
+ * Otherwise, the cache is used if it was built from data with the given hash,
+ * and the status of the file (which is left alone) is recorded in it.
+ * Return 1 if the items were loaded.
+ */
+int cache_load(enum data_file type, struct item_filter *filter,
+	       const char *key, char *sha1, struct io_fstat *fs)
+{
+	struct cache_map m;
+	struct io_fstat cfs;
+	struct stat st;
+	char csha1[SHA1_DIGESTLEN * 2 + 1];
+	int mask = cache_filter_mask(filter);
+
+	if (!conf.data_cache || !mask)
+		return 0;
+	if (!cache_map(&m, type))
+		return 0;
+
+	cache_key_get(&m.hdr->key, csha1, &cfs);
+	if (key) {
+		if (strncmp(csha1, key, SHA1_DIGESTLEN * 2) != 0)
+			goto fail;
+	} else {
+		if (stat(type == DATA_APTS ? path_apts : path_todo, &st) ||
+		    !io_fstat_same(&cfs, &st))
+			goto fail;
+	}
+	if (!cache_verify(&m))
+		goto fail;
+
+	if (type == DATA_APTS)
+		cache_get_apts(&m, mask);
+	else
+		cache_get_todo(&m, mask);
+
+	if (key) {
+		if (!read_only)
+			cache_touch(&m, key, fs);
+	} else {
+		strcpy(sha1, csha1);
+		*fs = cfs;
+	}
+	cache_unmap(&m);
+	return 1;
+
+fail:
+	cache_unmap(&m);
+	return 0;
+}
+
+static size_t cache_buf_add(struct cache_buf *b, const void *p, size_t n)
+{
+	size_t off = b->len;
+
+	if (b->len + n > b->size) {
+		b->size = b->size ? 2 * b->size : BUFSIZ;
+		if (b->size < b->len + n)
+			b->size = b->len + n;
+		b->data = mem_realloc(b->data, b->size, 1);
+	}
+	if (n > 0)
+		memcpy(b->data + b->len, p, n);
+	b->len += n;
+	return off;
+}
+
+static void cache_buf_pad(struct cache_buf *b)
+{
+	static const char zero[8];
+
+	cache_buf_add(b, zero, CACHE_ALIGN(b->len) - b->len);
+}
+
+/* Sections of the cache being written. */
+struct cache_writer {
+	struct cache_buf sec[CACHE_NSECTIONS];
+	int error;
+};
+
+static uint32_t cache_put_str(struct cache_writer *w, const char *s)
+{
+	size_t off;
+
+	if (!s)
+		return CACHE_NONE;
+	off = cache_buf_add(&w->sec[CACHE_POOL], s, strlen(s) + 1);
+	if (off >= CACHE_NONE)
+		w->error = 1;
+	return off;
+}
+
+static void cache_put_tm(struct cache_tm *ct, time_t t)
+{
+	struct tm lt;
+
+	localtime_r(&t, &lt);
+	ct->yyyy = lt.tm_year + 1900;
+	ct->mm = lt.tm_mon + 1;
+	ct->dd = lt.tm_mday;
+	ct->hh = lt.tm_hour;
+	ct->mi = lt.tm_min;
+}
+
+static void cache_put_ints(struct cache_writer *w, llist_t *l,
+			   uint32_t *first, uint32_t *n)
+{
+	struct cache_buf *b = &w->sec[CACHE_INT];
+	llist_item_t *i;
+	int32_t v;
+
+	*first = b->len / sizeof(int32_t);
+	*n = 0;
+	LLIST_FOREACH(l, i) {
+		v = *(int *)LLIST_GET_DATA(i);
+		cache_buf_add(b, &v, sizeof(v));
+		(*n)++;
+	}
+}
+
+static void cache_put_rpt(struct cache_writer *w, struct cache_rpt *cr,
+			  struct rpt *rpt, exc_list_t *exc)
+{
+	struct cache_buf *b = &w->sec[CACHE_DATE];
+	struct cache_tm ct;
+	unsigned i;
+
+	cr->type = rpt->type;
+	cr->freq = rpt->freq;
+	if (rpt->until)
+		cache_put_tm(&cr->until, rpt->until);
+	cache_put_ints(w, &rpt->bymonth, &cr->bymonth, &cr->nbymonth);
+	cache_put_ints(w, &rpt->bywday, &cr->bywday, &cr->nbywday);
+	cache_put_ints(w, &rpt->bymonthday, &cr->bymonthday,
+		       &cr->nbymonthday);
+	cr->exc = b->len / sizeof(struct cache_tm);
+	cr->nexc = exc->count;
+	for (i = 0; i < exc->count; i++) {
+		memset(&ct, 0, sizeof(ct));
+		cache_put_tm(&ct, exc->tab[i].st);
+		cache_buf_add(b, &ct, sizeof(ct));
+	}
+}
+
+static void cache_put_apts(struct cache_writer *w)
+{
+	llist_item_t *i;
+
+	LLIST_TS_FOREACH(&alist_p, i) {
+		struct apoint *apt = LLIST_TS_GET_DATA(i);
+		struct cache_apoint r;
+
+		memset(&r, 0, sizeof(r));
+		cache_put_tm(&r.start, apt->start);
+		cache_put_tm(&r.end, apt->start + apt->dur);
+		r.state = apt->state & APOINT_NOTIFY;
+		r.mesg = cache_put_str(w, apt->mesg);
+		r.note = cache_put_str(w, apt->note);
+		cache_buf_add(&w->sec[CACHE_APOINT], &r, sizeof(r));
+	}
+
+	LLIST_FOREACH(&eventlist, i) {
+		struct event *ev = LLIST_GET_DATA(i);
+		struct cache_event r;
+
+		memset(&r, 0, sizeof(r));
+		cache_put_tm(&r.day, ev->day);
+		r.id = ev->id;
+		r.mesg = cache_put_str(w, ev->mesg);
+		r.note = cache_put_str(w, ev->note);
+		cache_buf_add(&w->sec[CACHE_EVENT], &r, sizeof(r));
+	}
+
+	LLIST_TS_FOREACH(&recur_alist_p, i) {
+		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+		struct cache_recur_apoint r;
+
+		memset(&r, 0, sizeof(r));
+		cache_put_rpt(w, &r.rpt, rapt->rpt, &rapt->exc);
+		cache_put_tm(&r.start, rapt->start);
+		cache_put_tm(&r.end, rapt->start + rapt->dur);
+		r.state = rapt->state & APOINT_NOTIFY;
+		r.mesg = cache_put_str(w, rapt->mesg);
+		r.note = cache_put_str(w, rapt->note);
+		cache_buf_add(&w->sec[CACHE_RECUR_APOINT], &r, sizeof(r));
+	}
+
+	LLIST_FOREACH(&recur_elist, i) {
+		struct recur_event *rev = LLIST_GET_DATA(i);
+		struct cache_recur_event r;
+
+		memset(&r, 0, sizeof(r));
+		cache_put_rpt(w, &r.rpt, rev->rpt, &rev->exc);
+		cache_put_tm(&r.day, rev->day);
+		r.id = rev->id;
+		r.mesg = cache_put_str(w, rev->mesg);
+		r.note = cache_put_str(w, rev->note);
+		cache_buf_add(&w->sec[CACHE_RECUR_EVENT], &r, sizeof(r));
+	}
+}
+
+static void cache_put_todo(struct cache_writer *w)
+{
+	llist_item_t *i;
+
+	LLIST_FOREACH(&todolist, i) {
+		struct todo *todo = LLIST_GET_DATA(i);
+		struct cache_todo r;
+
+		memset(&r, 0, sizeof(r));
+		r.id = todo->id;
+		r.completed = todo->completed;
+		r.mesg = cache_put_str(w, todo->mesg);
+		r.note = cache_put_str(w, todo->note);
+		cache_buf_add(&w->sec[CACHE_TODO_ITEM], &r, sizeof(r));
+	}
+}
+
+/*
+ * Build the cache image of a data file from the item lists.
+ * Return 1 on success.
+ */
+static int cache_build(enum data_file type, const char *sha1,
+		       struct io_fstat *fs, struct cache_buf *img)
+{
+	struct cache_writer w;
+	struct cache_header hdr;
+	size_t body = CACHE_ALIGN(sizeof(struct cache_header));
+	unsigned i;
+
+	memset(&w, 0, sizeof(w));
+	if (type == DATA_APTS)
+		cache_put_apts(&w);
+	else
+		cache_put_todo(&w);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CACHE_VERSION;
+	hdr.order = CACHE_ORDER;
+	hdr.size = sizeof(hdr);
+	hdr.type = type;
+	cache_key_set(&hdr.key, sha1, fs);
+
+	cache_buf_add(img, &hdr, sizeof(hdr));
+	for (i = 0; i < CACHE_NSECTIONS; i++) {
+		cache_buf_pad(img);
+		hdr.off[i] = img->len;
+		hdr.len[i] = w.sec[i].len;
+		cache_buf_add(img, w.sec[i].data, w.sec[i].len);
+		mem_free(w.sec[i].data);
+	}
+	cache_buf_pad(img);
+	hdr.total = img->len;
+	hdr.sum = cache_sum(img->data + body, img->len - body);
+	memcpy(img->data, &hdr, sizeof(hdr));
+	return !w.error;
+}
+
+/*
+ * Thread writing a cache image. The image is written to a temporary file
+ * first, which then replaces the previous cache.
+ */
+static void *cache_write_thread(void *arg)
+{
+	struct cache_job *job = arg;
+	size_t n;
+	ssize_t r;
+	char *tmp;
+	int fd;
+
+	asprintf(&tmp, "%s.XXXXXX", job->path);
+	if ((fd = mkstemp(tmp)) >= 0) {
+		for (n = 0; n < job->img.len; n += r) {
+			r = write(fd, job->img.data + n, job->img.len - n);
+			if (r <= 0)
+				break;
+		}
+		if (close(fd) != 0 || n != job->img.len ||
+		    rename(tmp, job->path) != 0)
+			unlink(tmp);
+	}
+	mem_free(tmp);
+	mem_free(job->path);
+	mem_free(job->img.data);
+	mem_free(job);
+	return NULL;
+}
+
+/*
+ * Rebuild the cache of a data file after it has been loaded with the given
+ * filter. Nothing is done if only some of the items were loaded. The image is
+ * built here, as the item lists may change afterwards, and written by a
+ * separate thread, see cache_wait().
+ */
+void cache_update(enum data_file type, struct item_filter *filter,
+		  const char *sha1, struct io_fstat *fs)
+{
+	struct cache_job *job;
+	int mask;
+
+	if (!conf.data_cache || read_only)
+		return;
+
+	mask = cache_filter_mask(filter);
+	if (type == DATA_APTS && (mask & TYPE_MASK_CAL) != TYPE_MASK_CAL)
+		return;
+	if (type == DATA_TODO && !(mask & TYPE_MASK_TODO))
+		return;
+
+	cache_wait();
+	job = mem_malloc(sizeof(struct cache_job));
+	memset(&job->img, 0, sizeof(job->img));
+	if (!cache_build(type, sha1, fs, &job->img)) {
+		mem_free(job->img.data);
+		mem_free(job);
+		return;
+	}
+	job->path = cache_path(type);
+	if (pthread_create(&cache_t_write, NULL, cache_write_thread, job)) {
+		mem_free(job->path);
+		mem_free(job->img.data);
+		mem_free(job);
+		return;
+	}
+	cache_writing = 1;
+}
+
+/*
+ * Wait until the cache being written, if any, is in place. This is needed
+ * before exiting and before forking a process which uses calcurse itself.
+ */
+void cache_wait(void)
+{
+	if (!cache_writing)
+		return;
+	pthread_join(cache_t_write, NULL);
+	cache_writing = 0;
+}
@@ -284,9 +284,30 @@ static inline void key_generic_save(void)
 	status_mesg(msg, "");
 }
 
+/* Apply changes made to the configuration file by another program. */
+static void reload_config(void)
+{
+	int periodic_save = conf.periodic_save;
+
+	config_load();
+	if (notify_bar())
+		notify_start_main_thread();
+	else
+		notify_stop_main_thread();
+	if (conf.periodic_save != periodic_save) {
+		io_stop_psave_thread();
+		if (conf.periodic_save > 0)
+			io_start_psave_thread();
+	}
+	wins_reset();
+	ui_calendar_monthly_view_cache_set_invalid();
+	day_do_storage(0);
+}
+
 static inline void key_generic_reload(void)
 {
 	char *msg = NULL;
+	time_t start, end, day;
 	int ret;
 
 	ret = io_reload_data();
@@ -295,9 +316,14 @@ static inline void key_generic_reload(void)
 	    ret == IO_RELOAD_MERGE) {
 		ui_todo_load_items();
 		ui_todo_sel_reset();
-		day_do_storage(0);
+		/* Only refresh the days which may have changed. */
+		io_reload_span(&start, &end);
+		day = get_slctd_day();
+		if (start <= day + (day_get_days() + 1) * DAYINSEC &&
+		    end >= day - DAYINSEC)
+			day_do_storage(0);
 		notify_check_next_app(1);
-		ui_calendar_monthly_view_cache_set_invalid();
+		ui_calendar_monthly_view_cache_invalidate(start, end);
 	}
 	wins_update(FLAG_ALL);
 	switch (ret) {
@@ -792,10 +818,11 @@ int main(int argc, char **argv)
 	ui_calendar_start_date_thread();
 	if (conf.periodic_save > 0)
 		io_start_psave_thread();
+	watch_start_thread();
 
 	/* User input */
 	for (;;) {
-		int key;
+		int key, changes;
 
 		while (que_ued()) {
 			que_show();
@@ -816,10 +843,18 @@ int main(int argc, char **argv)
 			}
 		}
 
-		if (want_reload) {
-			want_reload = 0;
+		/*
+		 * A reload asked for with SIGUSR1 is done in any case, one
+		 * following changes noticed by the watcher only if the data
+		 * files did change, e.g. not after our own saves.
+		 */
+		changes = watch_changes();
+		if (changes & WATCH_CONF)
+			reload_config();
+		if ((want_reload && !changes) ||
+		    ((changes & WATCH_DATA) && io_data_changed()))
 			key_generic_reload();
-		}
+		want_reload = 0;
 
 		/* Check input loop once every minute. */
 		wtimeout(win[KEY].p, 60000);
@@ -51,6 +51,8 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <regex.h>
@@ -93,6 +95,8 @@
 #define CPID_PATH_NAME   ".calcurse.pid"
 #define DPID_PATH_NAME   ".daemon.pid"
 #define DLOG_PATH_NAME   "daemon.log"
+#define SPID_PATH_NAME   ".server.pid"
+#define SSOCK_PATH_NAME  ".server.sock"
 #define NOTES_DIR_NAME   "notes/"
 #define HOOKS_DIR_NAME   "hooks/"
 
@@ -172,9 +176,6 @@
  */
 #define REG_BLACK_HOLE 36
 
-/* Size of the hash table the note garbage collector uses. */
-#define NOTE_GC_HSIZE 1024
-
 /* Mnemonics */
 #define NOHILT		0 	/* 'No highlight' argument */
 #define NOFORCE		0
@@ -286,6 +287,9 @@ struct conf {
 	unsigned auto_gc;
 	unsigned periodic_save;
 	unsigned systemevents;
+	unsigned data_cache;
+	unsigned journal;
+	unsigned note_pack;
 	unsigned confirm_quit;
 	unsigned confirm_delete;
 	enum win default_panel;
@@ -353,6 +357,12 @@ struct date {
 
 #define ISLEAP(y) ((((y) % 4) == 0 && ((y) % 100) != 0) || ((y) % 400) == 0)
 
+/* Cached SHA1 digest of an item, see item_hash_get(). */
+struct item_hash {
+	unsigned gen;		/* generation it was computed in */
+	char digest[41];	/* hexadecimal digest */
+};
+
 /* Appointment definition. */
 struct apoint {
 	time_t start;		/* seconds since 1 jan 1970 */
@@ -365,6 +375,7 @@ struct apoint {
 
 	char *mesg;
 	char *note;
+	struct item_hash *hash;
 };
 
 /* Event definition. */
@@ -373,18 +384,42 @@ struct event {
 	time_t day;		/* seconds since 1 jan 1970 */
 	char *mesg;
 	char *note;
+	struct item_hash *hash;
+};
+
+/* Iterator over the candidate items of a day in a day index (see dayidx.c). */
+struct dayidx_iter {
+	vector_t *v[2];
+	unsigned n;
+	unsigned i;
 };
 
+#define DAYIDX_FOREACH(idx, day, it, p)                                       \
+  for ((p) = dayidx_first(idx, day, it); (p); (p) = dayidx_next(it))
+
 /* Todo item definition. */
 struct todo {
 	char *mesg;
 	int id;
 	int completed;
 	char *note;
+	struct item_hash *hash;
 };
 
 struct excp {
 	time_t st;		/* beggining of the considered day, in seconds */
+	long day;		/* the same day, counted as in date2days() */
+};
+
+/*
+ * Exception days, kept in an array sorted by day so that membership can be
+ * decided by binary search, see recur_add_exc().
+ */
+typedef struct exc_list exc_list_t;
+struct exc_list {
+	struct excp *tab;
+	unsigned count;
+	unsigned size;
 };
 
 enum recur_type {
@@ -407,7 +442,18 @@ struct rpt {
 	llist_t bymonth;	/* BYMONTH list */
 	llist_t bywday;		/* BY(WEEK)DAY list */
 	llist_t bymonthday;	/* BYMONTHDAY list */
-	llist_t exc;		/* EXDATE's */
+	exc_list_t exc;		/* EXDATE's */
+
+	/*
+	 * The BY-lists compiled into bit masks, see recur_rpt_compile(). A
+	 * BYDAY value v = n * 7 + w (or -(n * 7 + w)) with 0 <= w <= 6 is
+	 * bit n of bywday_pmask[w] (or bywday_nmask[w]).
+	 */
+	unsigned bymonth_mask;			/* bit m: month m */
+	unsigned bymonthday_pmask;		/* bit d: month day d */
+	unsigned bymonthday_nmask;		/* bit d: month day -d */
+	unsigned long long bywday_pmask[WEEKINDAYS];
+	unsigned long long bywday_nmask[WEEKINDAYS];
 };
 
 /* Types of integers in rrule lists. */
@@ -423,22 +469,57 @@ typedef enum {
 /* Recurrent appointment definition. */
 struct recur_apoint {
 	struct rpt *rpt;	/* recurrence rule */
-	llist_t exc;		/* recurrence exceptions (NOT rpt->exc) */
+	exc_list_t exc;		/* recurrence exceptions (NOT rpt->exc) */
+	struct recur_cache *cache;	/* occurrence cache */
 	time_t start;		/* start time */
 	long dur;		/* duration */
 	char state;		/* item state */
 	char *mesg;		/* description */
 	char *note;		/* attached note */
+	struct item_hash *hash;	/* cached digest */
 };
 
 /* Recurrent event definition. */
 struct recur_event {
 	struct rpt *rpt;	/* recurrence rule */
-	llist_t exc;		/* recurrence exceptions (NOT rpt->exc) */
+	exc_list_t exc;		/* recurrence exceptions (NOT rpt->exc) */
+	struct recur_cache *cache;	/* occurrence cache */
 	int id;			/* event type */
 	time_t day;		/* day of the event */
 	char *mesg;		/* description */
 	char *note;		/* attached note */
+	struct item_hash *hash;	/* cached digest */
+};
+
+/* Callback for the occurrences of a rule, see recur_expand_window(). */
+typedef void (*recur_window_fn_t) (time_t, time_t, void *);
+
+/*
+ * Occurrence iterator for a recurrence rule, see recur_iter_init(). Days are
+ * counted as in date2days().
+ */
+struct recur_iter {
+	time_t start;		/* rrule start */
+	long dur;		/* rrule duration (-1 for events) */
+	struct rpt *rpt;	/* rrule */
+	exc_list_t *exc;	/* rrule exceptions */
+	struct date sdate;	/* start date */
+	long first;		/* start day */
+	long week;		/* first day of the start week */
+	long day;		/* current position */
+	unsigned wdays;		/* week days of the BYDAY list */
+};
+
+/* Occurrences of an rrule in a range of days, see recur_window_init(). */
+struct recur_window {
+	struct recur_iter it;
+	time_t from;		/* first day of the range */
+	long last;		/* last day of the range */
+	time_t next;		/* occurrence at the iterator position */
+	time_t prev;		/* occurrence before that */
+	int more;		/* is next valid? */
+	int span;		/* can an occurrence reach into the next day? */
+	int expand;		/* may a day not show the latest occurrence? */
 };
 
 /* Generic pointer data type for appointments and events. */
@@ -485,7 +566,7 @@ struct item_filter {
 	int invert;
 	int type_mask;
 	char *hash;
-	regex_t *regex;
+	struct pattern *pattern;
 	time_t start_from;
 	time_t start_to;
 	time_t end_from;
@@ -709,6 +790,27 @@ enum {
 	IO_SAVE_ERROR
 };
 
+/*
+ * Status of a data file when it was last loaded, saved or found to be
+ * unchanged. As long as it stays the same, the file is not hashed again to
+ * look for external changes.
+ */
+struct io_fstat {
+	int valid;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	time_t checked;		/* when the status was recorded */
+};
+
+/* Data files, see cache.c and journal.c. */
+enum data_file {
+	DATA_APTS,
+	DATA_TODO
+};
+
 /* Return codes for the io_reload_data() function. */
 enum {
 	IO_RELOAD_LOAD,
@@ -719,6 +821,10 @@ enum {
 	IO_RELOAD_ERROR
 };
 
+/* Changes reported by watch_changes(). */
+#define WATCH_DATA	(1 << 0)
+#define WATCH_CONF	(1 << 1)
+
 /* Week days. */
 enum wday {
 	SUNDAY,
@@ -782,15 +888,21 @@ struct apoint *apoint_dup(struct apoint *);
 void apoint_free(struct apoint *);
 void apoint_llist_init(void);
 void apoint_llist_free(void);
+struct apoint *apoint_alloc(char *, char *, time_t, long, char);
 struct apoint *apoint_new(char *, char *, time_t, long, char);
+void apoint_add_all(vector_t *);
 unsigned apoint_inday(struct apoint *, time_t *);
+struct apoint *apoint_first_inday(time_t, struct dayidx_iter *);
+struct apoint *apoint_next_inday(time_t, struct dayidx_iter *);
+void apoint_reindex(struct apoint *, time_t, long);
 void apoint_sec2str(struct apoint *, time_t, char *, char *);
 char *apoint_tostr(struct apoint *);
-char *apoint_hash(struct apoint *);
+const char *apoint_hash(struct apoint *);
 void apoint_write(struct apoint *, FILE *);
-char *apoint_scan(FILE *, struct tm, struct tm, char, char *,
-			   struct item_filter *);
+char *apoint_scan(char *, struct tm, struct tm, char, char *,
+			   struct item_filter *, vector_t *);
 void apoint_delete(struct apoint *);
+void apoint_remove_all(vector_t *);
 struct notify_app *apoint_check_next(struct notify_app *, time_t);
 void apoint_switch_notify(struct apoint *);
 void apoint_paste_item(struct apoint *, time_t);
@@ -798,6 +910,13 @@ void apoint_paste_item(struct apoint *, time_t);
 /* args.c */
 int parse_args(int, char **);
 
+/* cache.c */
+int cache_load(enum data_file, struct item_filter *, const char *, char *,
+	       struct io_fstat *);
+void cache_update(enum data_file, struct item_filter *, const char *,
+		  struct io_fstat *);
+void cache_wait(void);
+
 /* calendar.c */
 extern struct day_item empty_day;
 
@@ -818,6 +937,7 @@ void ui_calendar_init_slctd_day(void);
 struct date *ui_calendar_get_slctd_day(void);
 void ui_calendar_set_slctd_day(struct date);
 void ui_calendar_monthly_view_cache_set_invalid(void);
+void ui_calendar_monthly_view_cache_invalidate(time_t, time_t);
 void ui_calendar_update_panel(void);
 void ui_calendar_goto_today(void);
 void ui_calendar_change_day(int);
@@ -856,11 +976,15 @@ void day_item_fork(struct day_item *, struct day_item *);
 void day_store_items(time_t, int, int);
 void day_display_item_date(struct day_item *, WINDOW *, int, time_t, int, int);
 void day_display_item(struct day_item *, WINDOW *, int, int, int, int);
-void day_write_stdout(time_t, const char *, const char *, const char *,
-		      const char *, int *);
+struct day_range *day_range_new(time_t, time_t);
+vector_t *day_range_next(struct day_range *, time_t *);
+void day_range_free(struct day_range *);
+void day_item_print(struct string *, struct day_item *, time_t, const char *,
+		    const char *, const char *, const char *);
 void day_do_storage(int day_changed);
 void day_popup_item(struct day_item *);
 int day_check_if_item(struct date);
+void day_check_if_items(struct date, int, int *);
 unsigned day_chk_busy_slices(struct date, int, int *);
 struct day_item *day_cut_item(int);
 int day_paste_item(struct day_item *, time_t);
@@ -870,7 +994,16 @@ void day_edit_note(struct day_item *, const char *);
 void day_view_note(struct day_item *, const char *);
 void day_item_switch_notify(struct day_item *);
 
+/* dayidx.c */
+struct dayidx *dayidx_new(void);
+void dayidx_free(struct dayidx *);
+void dayidx_add(struct dayidx *, void *, time_t, long);
+void dayidx_remove(struct dayidx *, void *, time_t, long);
+void *dayidx_first(struct dayidx *, time_t, struct dayidx_iter *);
+void *dayidx_next(struct dayidx_iter *);
+
 /* dmon.c */
+unsigned dmon_daemonize(int);
 void dmon_start(int);
 void dmon_stop(void);
 
@@ -882,13 +1015,19 @@ struct event *event_dup(struct event *);
 void event_free(struct event *);
 void event_llist_init(void);
 void event_llist_free(void);
+struct event *event_alloc(char *, char *, time_t, int);
 struct event *event_new(char *, char *, time_t, int);
+void event_add_all(vector_t *);
 unsigned event_inday(struct event *, time_t *);
+struct event *event_first_inday(time_t, struct dayidx_iter *);
+struct event *event_next_inday(time_t, struct dayidx_iter *);
 char *event_tostr(struct event *);
-char *event_hash(struct event *);
+const char *event_hash(struct event *);
 void event_write(struct event *, FILE *);
-char *event_scan(FILE *, struct tm, int, char *, struct item_filter *);
+char *event_scan(char *, struct tm, int, char *, struct item_filter *,
+		 vector_t *);
 void event_delete(struct event *);
+void event_remove_all(vector_t *);
 void event_paste_item(struct event *, time_t);
 int event_dummy(struct day_item *);
 
@@ -896,6 +1035,13 @@ int event_dummy(struct day_item *);
 enum getstr getstring(WINDOW *, char *, int, int, int);
 int updatestring(WINDOW *, char **, int, int);
 
+/* hashidx.c */
+struct hashidx *hashidx_new(void);
+void hashidx_free(struct hashidx *);
+void hashidx_add(struct hashidx *, const char *, void *);
+void hashidx_sort(struct hashidx *);
+void hashidx_find(struct hashidx *, const char *, vector_t *);
+
 /* help.c */
 int display_help(const char *);
 
@@ -912,16 +1058,29 @@ void ical_export_data(FILE *, int);
 unsigned io_fprintln(const char *, const char *, ...);
 void io_init(const char *, const char *, const char *);
 void io_extract_data(char *, const char *, int);
+void io_scan_space(char **);
+int io_scan_char(char **, char);
+int io_scan_int(char **, int *);
+int io_scan_date(char **, int *, int *, int *);
+void io_fstat_set(struct io_fstat *, struct stat *);
+int io_fstat_same(struct io_fstat *, struct stat *);
 void io_dump_apts(const char *, const char *, const char *, const char *);
+char *io_follow_links(const char *);
+int io_write_file(const char *, const char *, size_t, struct stat *);
 unsigned io_save_apts(const char *);
 void io_dump_todo(const char *);
 unsigned io_save_todo(const char *);
 unsigned io_save_keys(void);
+int io_file_changed(const char *, const char *, struct io_fstat *);
+unsigned io_save_files(void);
 int io_save_cal(enum save_type);
+void io_compact_data(void);
 void io_load_app(struct item_filter *);
 void io_load_todo(struct item_filter *);
 int io_load_data(struct item_filter *, int);
 int io_reload_data(void);
+int io_data_changed(void);
+void io_reload_span(time_t *, time_t *);
 void io_load_keys(const char *);
 int io_check_dir(const char *);
 unsigned io_dir_exists(const char *);
@@ -940,12 +1099,23 @@ void io_stop_psave_thread(void);
 void io_set_lock(void);
 unsigned io_dump_pid(char *);
 unsigned io_get_pid(char *);
-int io_files_equal(const char *, const char *);
 int io_file_cp(const char *, const char *);
 void io_unset_modified(void);
 void io_set_modified(void);
 int io_get_modified(void);
 
+/* journal.c */
+int journal_open(enum data_file);
+void journal_replay(enum data_file, const char *, char **, size_t *);
+int journal_pending(enum data_file);
+int journal_changed(enum data_file);
+void journal_cancel(enum data_file);
+int journal_prepare(enum data_file, const char *, struct io_fstat *,
+		    vector_t *);
+int journal_commit(enum data_file);
+void journal_remove(enum data_file);
+void journal_compact(enum data_file);
+
 /* keys.c */
 void keys_init(void);
 void keys_free(void);
@@ -1024,8 +1194,10 @@ char *generate_note(const char *);
 void edit_note(char **, const char *);
 void view_note(const char *, const char *);
 void erase_note(char **);
-void note_read(char *, FILE *);
-void note_read_contents(char *, size_t, FILE *);
+char *note_read(char **);
+char *note_get(const char *, size_t *);
+int note_read_contents(const char *, char *, size_t);
+unsigned note_pack_files(void);
 void note_gc(void);
 
 /* notify.c */
@@ -1051,6 +1223,12 @@ int notify_same_item(time_t);
 int notify_same_recur_item(struct recur_apoint *);
 void notify_config_bar(void);
 
+/* pattern.c */
+struct pattern *pattern_new(const char *);
+void pattern_free(struct pattern *);
+int pattern_match(struct pattern *, const char *);
+void pattern_stats(struct pattern *);
+
 /* pcal.c */
 void pcal_export_data(FILE *);
 
@@ -1059,10 +1237,13 @@ extern llist_ts_t recur_alist_p;
 extern llist_t recur_elist;
 void recur_free_int_list(llist_t *);
 void recur_int_list_dup(llist_t *, llist_t *);
-void recur_free_exc_list(llist_t *);
-void recur_exc_dup(llist_t *, llist_t *);
-int recur_str2exc(llist_t *, char *);
-char *recur_exc2str(llist_t *);
+void recur_rpt_compile(struct rpt *);
+void recur_exc_init(exc_list_t *);
+void recur_free_exc_list(exc_list_t *);
+void recur_add_exc(exc_list_t *, time_t);
+void recur_exc_dup(exc_list_t *, exc_list_t *);
+int recur_str2exc(exc_list_t *, char *);
+char *recur_exc2str(exc_list_t *);
 struct recur_event *recur_event_dup(struct recur_event *);
 struct recur_apoint *recur_apoint_dup(struct recur_apoint *);
 void recur_event_free_bkp(void);
@@ -1073,47 +1254,75 @@ void recur_apoint_llist_init(void);
 void recur_event_llist_init(void);
 void recur_apoint_llist_free(void);
 void recur_event_llist_free(void);
+void recur_invalidate_caches(void);
+void recur_cache_stats(void);
+void recur_apoint_find_candidates(time_t, time_t, vector_t *);
+void recur_event_find_candidates(time_t, time_t, vector_t *);
+struct recur_apoint *recur_apoint_alloc(char *, char *, time_t, long, char,
+					struct rpt *);
 struct recur_apoint *recur_apoint_new(char *, char *, time_t, long, char,
 				      struct rpt *);
+struct recur_event *recur_event_alloc(char *, char *, time_t, int,
+				      struct rpt *);
 struct recur_event *recur_event_new(char *, char *, time_t, int,
 				     struct rpt *);
+void recur_apoint_add_all(vector_t *);
+void recur_event_add_all(vector_t *);
 char recur_def2char(enum recur_type);
 int recur_char2def(char);
-char *recur_apoint_scan(FILE *, struct tm, struct tm, char,
+char *recur_apoint_scan(char *, struct tm, struct tm, char,
 				       char *, struct item_filter *,
-				       struct rpt *);
-char *recur_event_scan(FILE *, struct tm, int, char *,
-				     struct item_filter *, struct rpt *);
+				       struct rpt *, vector_t *);
+char *recur_event_scan(char *, struct tm, int, char *,
+				     struct item_filter *, struct rpt *,
+				     vector_t *);
 char *recur_apoint_tostr(struct recur_apoint *);
-char *recur_apoint_hash(struct recur_apoint *);
+const char *recur_apoint_hash(struct recur_apoint *);
 void recur_apoint_write(struct recur_apoint *, FILE *);
 char *recur_event_tostr(struct recur_event *);
-char *recur_event_hash(struct recur_event *);
+const char *recur_event_hash(struct recur_event *);
 void recur_event_write(struct recur_event *, FILE *);
-void recur_save_data(FILE *);
-unsigned recur_item_find_occurrence(time_t, long, struct rpt *, llist_t *,
+unsigned recur_item_find_occurrence(time_t, long, struct rpt *, exc_list_t *,
 				    time_t, time_t *);
 unsigned recur_apoint_find_occurrence(struct recur_apoint *, time_t, time_t *);
 unsigned recur_event_find_occurrence(struct recur_event *, time_t, time_t *);
-unsigned recur_item_inday(time_t, long, struct rpt *, llist_t *, time_t);
+unsigned recur_item_inday(time_t, long, struct rpt *, exc_list_t *, time_t);
 unsigned recur_apoint_inday(struct recur_apoint *, time_t *);
 unsigned recur_event_inday(struct recur_event *, time_t *);
 void recur_event_add_exc(struct recur_event *, time_t);
 void recur_apoint_add_exc(struct recur_apoint *, time_t);
 void recur_event_erase(struct recur_event *);
 void recur_apoint_erase(struct recur_apoint *);
-void recur_bymonth(llist_t *, FILE *);
-void recur_bywday(enum recur_type, llist_t *, FILE *);
-void recur_bymonthday(llist_t *, FILE *);
-void recur_exc_scan(llist_t *, FILE *);
+void recur_event_remove_all(vector_t *);
+void recur_apoint_remove_all(vector_t *);
+char *recur_bymonth(llist_t *, char **);
+char *recur_bywday(enum recur_type, llist_t *, char **);
+char *recur_bymonthday(llist_t *, char **);
+char *recur_exc_scan(exc_list_t *, char **);
 void recur_apoint_check_next(struct notify_app *, time_t, time_t);
 void recur_apoint_switch_notify(struct recur_apoint *);
 void recur_event_paste_item(struct recur_event *, time_t);
 void recur_apoint_paste_item(struct recur_apoint *, time_t);
-int recur_next_occurrence(time_t, long, struct rpt *, llist_t *, time_t, time_t *);
-int recur_nth_occurrence(time_t, long, struct rpt *, llist_t *, int, time_t *);
-int recur_prev_occurrence(time_t, long, struct rpt *, llist_t *, time_t, time_t *);
-
+int recur_next_occurrence(time_t, long, struct rpt *, exc_list_t *, time_t, time_t *);
+int recur_nth_occurrence(time_t, long, struct rpt *, exc_list_t *, int, time_t *);
+int recur_prev_occurrence(time_t, long, struct rpt *, exc_list_t *, time_t, time_t *);
+void recur_iter_init(struct recur_iter *, time_t, long, struct rpt *, exc_list_t *);
+void recur_iter_seek(struct recur_iter *, time_t);
+int recur_iter_next(struct recur_iter *, time_t *);
+int recur_iter_prev(struct recur_iter *, time_t *);
+void recur_window_init(struct recur_window *, time_t, long, struct rpt *,
+		       exc_list_t *, time_t, time_t);
+int recur_window_day(struct recur_window *, time_t, time_t *);
+long recur_window_due(struct recur_window *, long);
+void recur_expand_window(time_t, long, struct rpt *, exc_list_t *, time_t,
+			 time_t, recur_window_fn_t, void *);
+
+
+/* serve.c */
+int serve_request(void);
+void serve_filter(struct item_filter *);
+void serve_client(int, char **);
+void serve_start(void);
 
 /* sigs.c */
 void sigs_init(void);
@@ -1126,6 +1335,7 @@ void string_init(struct string *);
 void string_reset(struct string *);
 int string_grow(struct string *, int);
 char *string_buf(struct string *);
+int string_catn(struct string *, const char *, int);
 int string_catf(struct string *, const char *, ...);
 int string_vcatf(struct string *, const char *, va_list);
 int string_printf(struct string *, const char *, ...);
@@ -1137,10 +1347,11 @@ extern llist_t todolist;
 struct todo *todo_get_item(int, int);
 struct todo *todo_add(char *, int, int, char *);
 char *todo_tostr(struct todo *);
-char *todo_hash(struct todo *);
+const char *todo_hash(struct todo *);
 void todo_write(struct todo *, FILE *);
 void todo_delete_note(struct todo *);
 void todo_delete(struct todo *);
+void todo_remove_all(vector_t *);
 void todo_resort(struct todo *);
 void todo_flag(struct todo *);
 int todo_get_position(struct todo *, int);
@@ -1229,10 +1440,17 @@ struct date sec2date(time_t);
 time_t tzdate2sec(struct date, unsigned, unsigned, char *);
 int date_cmp(struct date *, struct date *);
 int date_cmp_day(time_t, time_t);
+long date2days(struct date);
+struct date days2date(long);
+int days2wday(long);
+long sec2days(time_t);
+time_t days2sec(long, unsigned, unsigned);
+long tz_max_gain(time_t, time_t);
 char *date_sec2date_str(time_t, const char *);
 void date_sec2date_fmt(time_t, const char *, char *);
 int date_change(struct tm *, int, int);
 time_t date_sec_change(time_t, int, int);
+time_t tm2sec(struct tm *);
 time_t update_time_in_date(time_t, unsigned, unsigned);
 time_t get_sec_date(struct date);
 long min2sec(unsigned);
@@ -1262,16 +1480,24 @@ int fork_exec(int *, int *, int *, int, const char *, const char *const *);
 int shell_exec(int *, int *, int *, int, const char *, const char *const *);
 int child_wait(int *, int *, int *, int);
 void press_any_key(void);
-void print_apoint(const char *, time_t, struct apoint *);
-void print_event(const char *, time_t, struct event *);
-void print_recur_apoint(const char *, time_t, time_t, struct recur_apoint *);
-void print_recur_event(const char *, time_t, struct recur_event *);
-void print_todo(const char *, struct todo *);
+void print_prepare_format(const char *);
+void print_apoint(struct string *, const char *, time_t, struct apoint *);
+void print_event(struct string *, const char *, time_t, struct event *);
+void print_recur_apoint(struct string *, const char *, time_t, time_t,
+			struct recur_apoint *);
+void print_recur_event(struct string *, const char *, time_t,
+		       struct recur_event *);
+void print_todo(struct string *, const char *, struct todo *);
+void print_free_formats(void);
 int vasprintf(char **, const char *, va_list);
 int asprintf(char **, const char *, ...);
 int starts_with(const char *, const char *);
 int starts_with_ci(const char *, const char *);
 int hash_matches(const char *, const char *);
+void item_hash_invalidate(void);
+const char *item_hash_get(struct item_hash *);
+const char *item_hash_set(struct item_hash **, char *);
+uint64_t line_hash(const char *, size_t);
 long overflow_add(long, long, long *);
 long overflow_mul(long, long, long *);
 time_t next_wday(time_t, int);
@@ -1300,6 +1526,8 @@ extern char *path_notes;
 extern char *path_cpid;
 extern char *path_dpid;
 extern char *path_dmon_log;
+extern char *path_spid;
+extern char *path_ssock;
 extern char *path_hooks;
 extern struct conf conf;
 extern struct pad apad;
@@ -1308,6 +1536,11 @@ extern struct dmon_conf dmon;
 void vars_init(void);
 extern pthread_t notify_t_main, io_t_psave, ui_calendar_t_date;
 
+/* watch.c */
+void watch_start_thread(void);
+void watch_stop_thread(void);
+int watch_changes(void);
+
 /* wins.c */
 extern struct window win[NBWINS];
 extern struct scrollwin sw_cal;
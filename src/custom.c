@@ -539,6 +539,9 @@ enum {
 	AUTO_GC,
 	PERIODIC_SAVE,
 	SYSTEM_EVENTS,
+	DATA_CACHE,
+	JOURNAL,
+	NOTE_PACK,
 	CONFIRM_QUIT,
 	CONFIRM_DELETE,
 	FIRST_DAY_OF_WEEK,
@@ -569,6 +572,9 @@ static void print_general_option(int i, WINDOW *win, int y, int hilt, void *cb_d
 		"general.autogc = ",
 		"general.periodicsave = ",
 		"general.systemevents = ",
+		"general.datacache = ",
+		"general.journal = ",
+		"general.notepack = ",
 		"general.confirmquit = ",
 		"general.confirmdelete = ",
 		"general.firstdayofweek = ",
@@ -687,6 +693,27 @@ static void print_general_option(int i, WINDOW *win, int y, int hilt, void *cb_d
 			  _("(if YES, system events are turned into "
 			  "appointments (or else deleted))"));
 		break;
+	case DATA_CACHE:
+		print_bool_option_incolor(win, conf.data_cache, y,
+					  XPOS + strlen(opt[DATA_CACHE]));
+		mvwaddstr(win, y + 1, XPOS,
+			  _("(if set to YES, a binary cache of the data files "
+			  "is kept)"));
+		break;
+	case JOURNAL:
+		print_bool_option_incolor(win, conf.journal, y,
+					  XPOS + strlen(opt[JOURNAL]));
+		mvwaddstr(win, y + 1, XPOS,
+			  _("(if set to YES, saves only append the changes to a "
+			  "journal)"));
+		break;
+	case NOTE_PACK:
+		print_bool_option_incolor(win, conf.note_pack, y,
+					  XPOS + strlen(opt[NOTE_PACK]));
+		mvwaddstr(win, y + 1, XPOS,
+			  _("(if set to YES, new notes are stored in a single "
+			  "pack file)"));
+		break;
 	case CONFIRM_QUIT:
 		print_bool_option_incolor(win, conf.confirm_quit, y,
 					  XPOS + strlen(opt[CONFIRM_QUIT]));
@@ -870,6 +897,15 @@ static void general_option_edit(int i)
 	case SYSTEM_EVENTS:
 		conf.systemevents = !conf.systemevents;
 		break;
+	case DATA_CACHE:
+		conf.data_cache = !conf.data_cache;
+		break;
+	case JOURNAL:
+		conf.journal = !conf.journal;
+		break;
+	case NOTE_PACK:
+		conf.note_pack = !conf.note_pack;
+		break;
 	case CONFIRM_QUIT:
 		conf.confirm_quit = !conf.confirm_quit;
 		break;
@@ -38,6 +38,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
 
 #include "calcurse.h"
@@ -336,13 +337,13 @@ void day_item_fork(struct day_item *day_in, struct day_item *day_out)
  */
 static int day_store_events(time_t date)
 {
-	llist_item_t *i;
+	struct dayidx_iter it;
+	struct event *ev;
 	union aptev_ptr p;
 	int e_nb = 0;
 
-	LLIST_FIND_FOREACH_CONT(&eventlist, &date, event_inday, i) {
-		struct event *ev = LLIST_TS_GET_DATA(i);
-
+	for (ev = event_first_inday(date, &it); ev;
+	     ev = event_next_inday(date, &it)) {
 		p.ev = ev;
 		day_add_item(EVNT, ev->day, ev->day, p);
 		e_nb++;
@@ -351,28 +352,146 @@ static int day_store_events(time_t date)
 	return e_nb;
 }
 
+/*
+ * Occurrences of the recurrent items in a range of days, see
+ * day_recur_expand(). They are sorted by day and, for each day, in the order of
+ * the item lists.
+ */
+struct day_recur {
+	time_t day;		/* day of the occurrence */
+	time_t start;		/* start of the occurrence */
+	unsigned seq;		/* position of the item in its list */
+	union aptev_ptr item;
+};
+
+struct day_window {
+	time_t from;
+	time_t to;
+	vector_t events;	/* recurrent events */
+	vector_t apoints;	/* recurrent appointments */
+};
+
+/* Item being expanded by day_recur_expand(). */
+struct day_recur_arg {
+	vector_t *v;
+	unsigned seq;
+	union aptev_ptr item;
+};
+
+static void day_recur_add(time_t occurrence, time_t day, void *arg)
+{
+	struct day_recur_arg *a = arg;
+	struct day_recur *r = mem_malloc(sizeof(struct day_recur));
+
+	r->day = day;
+	r->start = occurrence;
+	r->seq = a->seq;
+	r->item = a->item;
+	VECTOR_ADD(a->v, r);
+}
+
+static int day_recur_cmp(struct day_recur **pa, struct day_recur **pb)
+{
+	struct day_recur *a = *pa;
+	struct day_recur *b = *pb;
+
+	if (a->day != b->day)
+		return a->day < b->day ? -1 : 1;
+	return a->seq < b->seq ? -1 : (a->seq > b->seq);
+}
+
+/*
+ * Expand all recurrent items over the days from, NEXTDAY(from), ... before to,
+ * each in a single pass.
+ */
+static void day_recur_expand(struct day_window *w, time_t from, time_t to)
+{
+	vector_t cand;
+	struct day_recur_arg a;
+
+	w->from = from;
+	w->to = to;
+	VECTOR_INIT(&w->events, 16);
+	VECTOR_INIT(&w->apoints, 16);
+	VECTOR_INIT(&cand, 16);
+
+	a.v = &w->events;
+	recur_event_find_candidates(from, to, &cand);
+	VECTOR_FOREACH(&cand, a.seq) {
+		struct recur_event *rev = VECTOR_NTH(&cand, a.seq);
+
+		a.item.rev = rev;
+		recur_expand_window(rev->day, -1, rev->rpt, &rev->exc, from,
+				    to, day_recur_add, &a);
+	}
+	VECTOR_SORT(&w->events, day_recur_cmp);
+
+	a.v = &w->apoints;
+	cand.count = 0;
+	LLIST_TS_LOCK(&recur_alist_p);
+	recur_apoint_find_candidates(from, to, &cand);
+	VECTOR_FOREACH(&cand, a.seq) {
+		struct recur_apoint *rapt = VECTOR_NTH(&cand, a.seq);
+
+		a.item.rapt = rapt;
+		recur_expand_window(rapt->start, rapt->dur, rapt->rpt,
+				    &rapt->exc, from, to, day_recur_add, &a);
+	}
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	VECTOR_SORT(&w->apoints, day_recur_cmp);
+	VECTOR_FREE(&cand);
+}
+
+static void day_recur_free_item(struct day_recur *r)
+{
+	mem_free(r);
+}
+
+static void day_recur_free(struct day_window *w)
+{
+	VECTOR_FREE_INNER(&w->events, day_recur_free_item);
+	VECTOR_FREE(&w->events);
+	VECTOR_FREE_INNER(&w->apoints, day_recur_free_item);
+	VECTOR_FREE(&w->apoints);
+}
+
+/* Return the position of the first occurrence on the given day. */
+static unsigned day_recur_find(vector_t *v, time_t date)
+{
+	unsigned lo = 0, hi = VECTOR_COUNT(v), mid;
+	struct day_recur *r;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		r = VECTOR_NTH(v, mid);
+		if (r->day < date)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 /*
  * Store the recurrent events for the selected day in structure pointed
  * by day_items. This is done by copying the recurrent events
- * from the general structure pointed by recur_elist to the structure
+ * from the occurrences expanded for a range of days to the structure
  * dedicated to the selected day.
  * Returns the number of recurrent events for the selected day.
  */
-static int day_store_recur_events(time_t date)
+static int day_store_recur_events(struct day_window *w, time_t date)
 {
-	llist_item_t *i;
-	union aptev_ptr p;
+	unsigned i;
 	int e_nb = 0;
 
-	LLIST_FIND_FOREACH(&recur_elist, &date, recur_event_inday, i) {
-		struct recur_event *rev = LLIST_TS_GET_DATA(i);
+	for (i = day_recur_find(&w->events, date);
+	     i < VECTOR_COUNT(&w->events); i++) {
+		struct day_recur *r = VECTOR_NTH(&w->events, i);
 
-		p.rev = rev;
-		time_t occurrence;
-		if (recur_event_find_occurrence(rev, date, &occurrence)) {
-			day_add_item(RECUR_EVNT, occurrence, occurrence, p);
-			e_nb++;
-		}
+		if (r->day != date)
+			break;
+		day_add_item(RECUR_EVNT, r->start, r->start, r->item);
+		e_nb++;
 	}
 
 	return e_nb;
@@ -387,14 +506,14 @@ static int day_store_recur_events(time_t date)
  */
 static int day_store_apoints(time_t date)
 {
-	llist_item_t *i;
+	struct dayidx_iter it;
+	struct apoint *apt;
 	union aptev_ptr p;
 	int a_nb = 0;
 
 	LLIST_TS_LOCK(&alist_p);
-	LLIST_TS_FIND_FOREACH(&alist_p, &date, apoint_inday, i) {
-		struct apoint *apt = LLIST_TS_GET_DATA(i);
-
+	for (apt = apoint_first_inday(date, &it); apt;
+	     apt = apoint_next_inday(date, &it)) {
 		p.apt = apt;
 		/*
 		 * For appointments continuing from the previous day, order is
@@ -414,32 +533,28 @@ static int day_store_apoints(time_t date)
 /*
  * Store the recurrent apoints for the selected day in structure pointed
  * by day_items. This is done by copying the appointments
- * from the general structure pointed by recur_alist_p to the
+ * from the occurrences expanded for a range of days to the
  * structure dedicated to the selected day.
  * Returns the number of recurrent appointments for the selected day.
  */
-static int day_store_recur_apoints(time_t date)
+static int day_store_recur_apoints(struct day_window *w, time_t date)
 {
-	llist_item_t *i;
-	union aptev_ptr p;
-	time_t occurrence;
+	unsigned i;
 	int a_nb = 0;
 
-	LLIST_TS_LOCK(&recur_alist_p);
-	LLIST_TS_FIND_FOREACH(&recur_alist_p, &date, recur_apoint_inday, i) {
-		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+	for (i = day_recur_find(&w->apoints, date);
+	     i < VECTOR_COUNT(&w->apoints); i++) {
+		struct day_recur *r = VECTOR_NTH(&w->apoints, i);
 
-		p.rapt = rapt;
+		if (r->day != date)
+			break;
 		/* As for appointments */
-		if (recur_apoint_find_occurrence(rapt, date, &occurrence)) {
-			day_add_item(RECUR_APPT,
-				     occurrence,
-				     occurrence < date ? date : occurrence,
-				     p);
-			a_nb++;
-		}
+		day_add_item(RECUR_APPT,
+			     r->start,
+			     r->start < date ? date : r->start,
+			     r->item);
+		a_nb++;
 	}
-	LLIST_TS_UNLOCK(&recur_alist_p);
 
 	return a_nb;
 }
@@ -456,11 +571,17 @@ day_store_items(time_t date, int include_captions, int n)
 {
 	unsigned apts, events;
 	union aptev_ptr p = { NULL }, d;
+	struct day_window window, *w = &window;
+	time_t end;
 	int i;
 
 	day_free_vector();
 	day_init_vector();
 
+	for (i = 0, end = date; i < n; i++)
+		end = NEXTDAY(end);
+	day_recur_expand(&window, date, end);
+
 	for (i = 0; i < n; i++, date = NEXTDAY(date)) {
 		if (YEAR1902_2037 && !check_sec(&date))
 			break;
@@ -468,9 +589,9 @@ day_store_items(time_t date, int include_captions, int n)
 		if (include_captions)
 			day_add_item(DAY_HEADING, 0, date, p);
 
-		events = day_store_recur_events(date);
+		events = day_store_recur_events(w, date);
 		events += day_store_events(date);
-		apts = day_store_recur_apoints(date);
+		apts = day_store_recur_apoints(w, date);
 		apts += day_store_apoints(date);
 
 		if (include_captions && events > 0 && apts > 0)
@@ -494,6 +615,8 @@ day_store_items(time_t date, int include_captions, int n)
 		}
 	}
 
+	day_recur_free(&window);
+
 	VECTOR_SORT(&day_items, day_cmp);
 }
 
@@ -555,36 +678,310 @@ day_display_item(struct day_item *day, WINDOW *win, int incolor, int width,
 		custom_remove_attr(win, ATTR_HIGHEST);
 }
 
-/* Write the appointments and events for the selected day to stdout. */
-void day_write_stdout(time_t date, const char *fmt_apt, const char *fmt_rapt,
-		      const char *fmt_ev, const char *fmt_rev, int *limit)
+/*
+ * Streaming of the items of a range of days, see day_range_new().
+ *
+ * Every recurrent item gets a window (see recur_window_init()) in a priority
+ * queue ordered by the next day on which it may occur; events and
+ * appointments are looked up in their day indexes. A day is thus only charged
+ * for the items occurring on it, and only the items of the current day are
+ * held in memory, in storage that is reused from one day to the next.
+ */
+struct day_range_rule {
+	struct recur_window w;
+	union aptev_ptr item;
+	unsigned seq;		/* recurrent events come first */
+	long due;		/* next day with a possible occurrence */
+};
+
+struct day_range {
+	time_t day;		/* next day to be stored */
+	time_t to;
+	struct day_range_rule *rules;
+	unsigned nrules, nrevents;
+	struct day_range_rule **queue;
+	unsigned nqueue;
+	struct day_item *items;	/* items of the current day */
+	unsigned nitems, itemsz;
+	vector_t sorted;	/* the same, in display order */
+};
+
+/* Is rule a to be looked at before rule b? */
+static int day_range_before(struct day_range_rule *a,
+			    struct day_range_rule *b)
 {
-	int i;
+	if (a->due != b->due)
+		return a->due < b->due;
+	return a->seq < b->seq;
+}
 
-	VECTOR_FOREACH(&day_items, i) {
-		if (*limit == 0)
-			break;
-		struct day_item *day = VECTOR_NTH(&day_items, i);
+/* Move the rule at position i of the queue down to its place. */
+static void day_range_sift(struct day_range *r, unsigned i)
+{
+	struct day_range_rule **q = r->queue, *rule = q[i];
+	unsigned c;
 
-		switch (day->type) {
-		case APPT:
-			print_apoint(fmt_apt, date, day->item.apt);
+	while ((c = 2 * i + 1) < r->nqueue) {
+		if (c + 1 < r->nqueue && day_range_before(q[c + 1], q[c]))
+			c++;
+		if (!day_range_before(q[c], rule))
 			break;
-		case EVNT:
-			print_event(fmt_ev, date, day->item.ev);
-			break;
-		case RECUR_APPT:
-			print_recur_apoint(fmt_rapt, date, day->start,
-					   day->item.rapt);
-			break;
-		case RECUR_EVNT:
-			print_recur_event(fmt_rev, date, day->item.rev);
+		q[i] = q[c];
+		i = c;
+	}
+	q[i] = rule;
+}
+
+/* Put all rules with a day left back into the queue. */
+static void day_range_queue_all(struct day_range *r)
+{
+	unsigned i;
+
+	r->nqueue = 0;
+	for (i = 0; i < r->nrules; i++) {
+		if (r->rules[i].due != LONG_MAX)
+			r->queue[r->nqueue++] = &r->rules[i];
+	}
+	for (i = r->nqueue / 2; i-- > 0;)
+		day_range_sift(r, i);
+}
+
+static void day_range_add(struct day_range *r, int type, time_t start,
+			  time_t order, union aptev_ptr item)
+{
+	struct day_item *day;
+
+	if (r->nitems == r->itemsz) {
+		r->itemsz = r->itemsz ? 2 * r->itemsz : 16;
+		r->items = mem_realloc(r->items, r->itemsz,
+				       sizeof(struct day_item));
+	}
+	day = &r->items[r->nitems++];
+	day->type = type;
+	day->start = start;
+	day->order = order;
+	day->item = item;
+}
+
+/* Store the occurrence of a recurrent item on a day, if any. */
+static void day_range_store_rule(struct day_range *r,
+				 struct day_range_rule *rule, time_t date,
+				 long n)
+{
+	time_t occ;
+
+	if (recur_window_day(&rule->w, date, &occ)) {
+		if (rule->seq < r->nrevents)
+			day_range_add(r, RECUR_EVNT, occ, occ, rule->item);
+		else	/* As for appointments, see below. */
+			day_range_add(r, RECUR_APPT, occ,
+				      occ < date ? date : occ, rule->item);
+	}
+	rule->due = recur_window_due(&rule->w, n);
+}
+
+/*
+ * Store the recurrent items of the queue that may occur on a day, up to the
+ * rule with sequence number seq.
+ */
+static void day_range_store_queue(struct day_range *r, time_t date, long n,
+				  unsigned seq)
+{
+	struct day_range_rule *rule;
+
+	while (r->nqueue > 0) {
+		rule = r->queue[0];
+		if (rule->due > n || rule->seq >= seq)
 			break;
-		default:
-			EXIT(_("unknown item type"));
-			/* NOTREACHED */
+		day_range_store_rule(r, rule, date, n);
+		if (rule->due == LONG_MAX)
+			r->queue[0] = r->queue[--r->nqueue];
+		day_range_sift(r, 0);
+	}
+}
+
+/*
+ * Store the recurrent items with sequence numbers from first up to seq. Used
+ * for days that do not start at midnight, on which rules cannot be skipped.
+ */
+static void day_range_store_rules(struct day_range *r, time_t date, long n,
+				  unsigned first, unsigned seq)
+{
+	unsigned i;
+
+	for (i = first; i < seq; i++)
+		day_range_store_rule(r, &r->rules[i], date, n);
+}
+
+static void day_range_store_events(struct day_range *r, time_t date)
+{
+	struct dayidx_iter it;
+	struct event *ev;
+	union aptev_ptr p;
+
+	for (ev = event_first_inday(date, &it); ev;
+	     ev = event_next_inday(date, &it)) {
+		p.ev = ev;
+		day_range_add(r, EVNT, ev->day, ev->day, p);
+	}
+}
+
+static void day_range_store_apoints(struct day_range *r, time_t date)
+{
+	struct dayidx_iter it;
+	struct apoint *apt;
+	union aptev_ptr p;
+
+	LLIST_TS_LOCK(&alist_p);
+	for (apt = apoint_first_inday(date, &it); apt;
+	     apt = apoint_next_inday(date, &it)) {
+		p.apt = apt;
+		/* As in day_store_apoints(). */
+		day_range_add(r, APPT, apt->start,
+			      apt->start < date ? date : apt->start, p);
+	}
+	LLIST_TS_UNLOCK(&alist_p);
+}
+
+/*
+ * Prepare to store the items of the days from, NEXTDAY(from), ... up to and
+ * including to, one day at a time, with day_range_next(). The items are the
+ * same as those stored by day_store_items() for each of the days.
+ *
+ * Must be freed with day_range_free() before any item is changed. Ranges can
+ * be read by several threads at once, one thread per range, provided that the
+ * first of them was set up before the others were started.
+ */
+struct day_range *day_range_new(time_t from, time_t to)
+{
+	struct day_range *r = mem_calloc(1, sizeof(struct day_range));
+	struct day_range_rule *rule;
+	vector_t cand;
+	unsigned i;
+
+	r->day = from;
+	r->to = to;
+	VECTOR_INIT(&r->sorted, 16);
+
+	/* The candidate lookup prepares its prefilters on the first call. */
+	VECTOR_INIT(&cand, 16);
+	recur_event_find_candidates(from, to + 1, &cand);
+	r->nrevents = VECTOR_COUNT(&cand);
+	LLIST_TS_LOCK(&recur_alist_p);
+	recur_apoint_find_candidates(from, to + 1, &cand);
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	r->nrules = VECTOR_COUNT(&cand);
+	if (r->nrules > 0) {
+		r->rules = mem_calloc(r->nrules,
+				      sizeof(struct day_range_rule));
+		r->queue = mem_calloc(r->nrules,
+				      sizeof(struct day_range_rule *));
+	}
+
+	VECTOR_FOREACH(&cand, i) {
+		rule = &r->rules[i];
+		rule->seq = i;
+		rule->due = sec2days(from);
+		if (i < r->nrevents) {
+			rule->item.rev = VECTOR_NTH(&cand, i);
+			recur_window_init(&rule->w, rule->item.rev->day, -1,
+					  rule->item.rev->rpt,
+					  &rule->item.rev->exc, from, to + 1);
+		} else {
+			rule->item.rapt = VECTOR_NTH(&cand, i);
+			recur_window_init(&rule->w, rule->item.rapt->start,
+					  rule->item.rapt->dur,
+					  rule->item.rapt->rpt,
+					  &rule->item.rapt->exc, from, to + 1);
+		}
+	}
+	VECTOR_FREE(&cand);
+	day_range_queue_all(r);
+
+	return r;
+}
+
+/*
+ * Store the items of the next day of the range which has any, and return the
+ * day in date and the items, sorted as by day_store_items(). The items are
+ * valid until the next call. Return NULL at the end of the range.
+ */
+vector_t *day_range_next(struct day_range *r, time_t *date)
+{
+	time_t day;
+	long n;
+	unsigned i;
+
+	for (; r->day <= r->to; r->day = NEXTDAY(r->day)) {
+		day = r->day;
+		n = sec2days(day);
+		r->nitems = 0;
+
+		if (day == days2sec(n, 0, 0)) {
+			day_range_store_queue(r, day, n, r->nrevents);
+			day_range_store_events(r, day);
+			day_range_store_queue(r, day, n, r->nrules);
+		} else {
+			day_range_store_rules(r, day, n, 0, r->nrevents);
+			day_range_store_events(r, day);
+			day_range_store_rules(r, day, n, r->nrevents,
+					      r->nrules);
+			day_range_queue_all(r);
 		}
-		(*limit)--;
+		day_range_store_apoints(r, day);
+
+		if (r->nitems == 0 || (YEAR1902_2037 && !check_sec(&day)))
+			continue;
+
+		r->sorted.count = 0;
+		for (i = 0; i < r->nitems; i++)
+			VECTOR_ADD(&r->sorted, &r->items[i]);
+		VECTOR_SORT(&r->sorted, day_cmp);
+
+		*date = day;
+		r->day = NEXTDAY(day);
+		return &r->sorted;
+	}
+	return NULL;
+}
+
+void day_range_free(struct day_range *r)
+{
+	if (r->rules) {
+		mem_free(r->rules);
+		mem_free(r->queue);
+	}
+	if (r->items)
+		mem_free(r->items);
+	VECTOR_FREE(&r->sorted);
+	mem_free(r);
+}
+
+/*
+ * Print an item stored for a day with the format for its type, to a string or,
+ * if that is NULL, to stdout.
+ */
+void day_item_print(struct string *out, struct day_item *day, time_t date,
+		    const char *fmt_apt, const char *fmt_rapt,
+		    const char *fmt_ev, const char *fmt_rev)
+{
+	switch (day->type) {
+	case APPT:
+		print_apoint(out, fmt_apt, date, day->item.apt);
+		break;
+	case EVNT:
+		print_event(out, fmt_ev, date, day->item.ev);
+		break;
+	case RECUR_APPT:
+		print_recur_apoint(out, fmt_rapt, date, day->start,
+				   day->item.rapt);
+		break;
+	case RECUR_EVNT:
+		print_recur_event(out, fmt_rev, date, day->item.rev);
+		break;
+	default:
+		EXIT(_("unknown item type"));
+		/* NOTREACHED */
 	}
 }
 
@@ -629,18 +1026,13 @@ void day_popup_item(struct day_item *day)
 	if (day->type == EVNT || day->type == RECUR_EVNT) {
 		if (day_item_get_note(day)) {
 			char note[note_size];
-			char *notepath, *msg;
-			FILE *fp;
+			char *msg;
 
-			asprintf(&notepath, "%s%s", path_notes, day_item_get_note(day));
-			fp = fopen(notepath, "r");
-			if (fp == NULL) {
+			if (!note_read_contents(day_item_get_note(day), note,
+						note_size)) {
 				item_in_popup(NULL, NULL, day_item_get_mesg(day), _("Event:"));
 				return;
 			}
-			note_read_contents(note, note_size, fp);
-			fclose(fp);
-			mem_free(notepath);
 
 			asprintf(&msg, "%s\n\n%s\n%s", day_item_get_display_mesg(day), note_heading, note);
 			item_in_popup(NULL, NULL, msg, _("Event:"));
@@ -660,18 +1052,13 @@ void day_popup_item(struct day_item *day)
 
 		if (day_item_get_note(day)) {
 			char note[note_size];
-			char *notepath, *msg;
-			FILE *fp;
+			char *msg;
 
-			asprintf(&notepath, "%s%s", path_notes, day_item_get_note(day));
-			fp = fopen(notepath, "r");
-			if (fp == NULL) {
+			if (!note_read_contents(day_item_get_note(day), note,
+						note_size)) {
 				item_in_popup(a_st, a_end, day_item_get_mesg(day), _("Appointment:"));
 				return;
 			}
-			note_read_contents(note, note_size, fp);
-			fclose(fp);
-			mem_free(notepath);
 
 			asprintf(&msg, "%s\n\n%s\n%s", day_item_get_display_mesg(day), note_heading, note);
 			item_in_popup(a_st, a_end, msg, _("Appointment:"));
@@ -692,34 +1079,130 @@ void day_popup_item(struct day_item *day)
  * ATTR_LOW if the selected day does not contain a regular event or
  * appointment but an occurrence of a recurrent item. Returns 0 otherwise.
  */
-int day_check_if_item(struct date day)
+static int day_check_if_regular(time_t t)
 {
-	const time_t t = date2sec(day, 0, 0);
+	struct dayidx_iter it;
 
-	if (LLIST_FIND_FIRST(&eventlist, (time_t *)&t, event_inday))
-		return ATTR_TRUE;
+	if (event_first_inday(t, &it))
+		return 1;
 
 	LLIST_TS_LOCK(&alist_p);
-	if (LLIST_TS_FIND_FIRST(&alist_p, (time_t *)&t, apoint_inday)) {
+	if (apoint_first_inday(t, &it)) {
 		LLIST_TS_UNLOCK(&alist_p);
-		return ATTR_TRUE;
+		return 1;
 	}
 	LLIST_TS_UNLOCK(&alist_p);
 
-	if (LLIST_FIND_FIRST(&recur_elist, (time_t *)&t, recur_event_inday))
-		return ATTR_LOW;
+	return 0;
+}
 
+static int day_check_if_recur(time_t t)
+{
+	vector_t cand;
+	unsigned i;
+	int found = 0;
+
+	VECTOR_INIT(&cand, 16);
+	recur_event_find_candidates(t, t + 1, &cand);
+	VECTOR_FOREACH(&cand, i) {
+		if (recur_event_inday(VECTOR_NTH(&cand, i), &t)) {
+			found = 1;
+			break;
+		}
+	}
+
+	cand.count = 0;
 	LLIST_TS_LOCK(&recur_alist_p);
-	if (LLIST_TS_FIND_FIRST(&recur_alist_p, (time_t *)&t,
-				recur_apoint_inday)) {
-		LLIST_TS_UNLOCK(&recur_alist_p);
-		return ATTR_LOW;
+	if (!found)
+		recur_apoint_find_candidates(t, t + 1, &cand);
+	VECTOR_FOREACH(&cand, i) {
+		if (recur_apoint_inday(VECTOR_NTH(&cand, i), &t)) {
+			found = 1;
+			break;
+		}
 	}
 	LLIST_TS_UNLOCK(&recur_alist_p);
+	VECTOR_FREE(&cand);
+
+	return found;
+}
+
+int day_check_if_item(struct date day)
+{
+	const time_t t = date2sec(day, 0, 0);
+
+	if (day_check_if_regular(t))
+		return ATTR_TRUE;
+
+	if (day_check_if_recur(t))
+		return ATTR_LOW;
 
 	return 0;
 }
 
+/* Days checked by day_check_if_items(). */
+struct day_check_arg {
+	int *attrs;
+	long first;
+	int n;
+};
+
+static void day_check_recur(time_t occurrence, time_t day, void *arg)
+{
+	struct day_check_arg *a = arg;
+	long k = sec2days(day) - a->first;
+
+	if (k >= 0 && k < a->n && !a->attrs[k])
+		a->attrs[k] = ATTR_LOW;
+}
+
+/*
+ * Same as day_check_if_item() for the n days starting with the given one, the
+ * result for each day being stored in attrs. Recurrent items are expanded once
+ * over the whole range instead of being looked up day by day.
+ */
+void day_check_if_items(struct date day, int n, int *attrs)
+{
+	struct day_check_arg a;
+	vector_t cand;
+	time_t from, to, t;
+	unsigned i;
+	int k;
+
+	if (n <= 0)
+		return;
+
+	from = date2sec(day, 0, 0);
+	a.attrs = attrs;
+	a.first = sec2days(from);
+	a.n = n;
+
+	for (k = 0; k < n; k++) {
+		t = days2sec(a.first + k, 0, 0);
+		attrs[k] = day_check_if_regular(t) ? ATTR_TRUE : 0;
+	}
+
+	to = days2sec(a.first + n, 0, 0);
+	VECTOR_INIT(&cand, 16);
+	recur_event_find_candidates(from, to, &cand);
+	VECTOR_FOREACH(&cand, i) {
+		struct recur_event *rev = VECTOR_NTH(&cand, i);
+		recur_expand_window(rev->day, -1, rev->rpt, &rev->exc, from,
+				    to, day_check_recur, &a);
+	}
+
+	cand.count = 0;
+	LLIST_TS_LOCK(&recur_alist_p);
+	recur_apoint_find_candidates(from, to, &cand);
+	VECTOR_FOREACH(&cand, i) {
+		struct recur_apoint *rapt = VECTOR_NTH(&cand, i);
+		recur_expand_window(rapt->start, rapt->dur, rapt->rpt,
+				    &rapt->exc, from, to, day_check_recur, &a);
+	}
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	VECTOR_FREE(&cand);
+}
+
 static unsigned fill_slices(int *slices, int slicesno, int first, int last)
 {
 	int i;
@@ -744,17 +1227,21 @@ static unsigned fill_slices(int *slices, int slicesno, int first, int last)
 unsigned day_chk_busy_slices(struct date day, int slicesno, int *slices)
 {
 	const time_t t = date2sec(day, 0, 0);
-	llist_item_t *i;
+	vector_t cand;
+	unsigned i;
+	struct dayidx_iter it;
+	struct apoint *apt;
 	int slicelen;
 
 	slicelen = DAYINSEC / slicesno;
 
 #define  SLICENUM(tsec)  ((tsec) / slicelen % slicesno)
 
+	VECTOR_INIT(&cand, 16);
 	LLIST_TS_LOCK(&recur_alist_p);
-	LLIST_TS_FIND_FOREACH(&recur_alist_p, (time_t *)&t,
-			      recur_apoint_inday, i) {
-		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+	recur_apoint_find_candidates(t, t + 1, &cand);
+	VECTOR_FOREACH(&cand, i) {
+		struct recur_apoint *rapt = VECTOR_NTH(&cand, i);
 		time_t occurrence;
 		time_t start, end;
 
@@ -781,14 +1268,16 @@ unsigned day_chk_busy_slices(struct date day, int slicesno, int *slices)
 		if (!fill_slices(slices, slicesno, SLICENUM(start),
 					SLICENUM(end))) {
 			LLIST_TS_UNLOCK(&recur_alist_p);
+			VECTOR_FREE(&cand);
 			return 0;
 		}
 	}
 	LLIST_TS_UNLOCK(&recur_alist_p);
+	VECTOR_FREE(&cand);
 
 	LLIST_TS_LOCK(&alist_p);
-	LLIST_TS_FIND_FOREACH(&alist_p, (time_t *)&t, apoint_inday, i) {
-		struct apoint *apt = LLIST_TS_GET_DATA(i);
+	for (apt = apoint_first_inday(t, &it); apt;
+	     apt = apoint_next_inday(t, &it)) {
 		time_t start = get_item_time(apt->start);
 		time_t end = get_item_time(apt->start + apt->dur);
 
@@ -0,0 +1,220 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include "calcurse.h"
+
+/*
+ * Index of non-recurrent items by local day, so that the items of a given day
+ * can be found without going through the whole item list.
+ *
+ * Each day that has items gets a bucket in a hash table, holding every item
+ * that starts on or spans that day. Items spanning a very long period would
+ * need many buckets and are kept in a separate list instead, which is
+ * returned along with the bucket of any day.
+ *
+ * The index only narrows down the candidates: callers still need to check
+ * whether each of them actually occurs on the day they are looking at.
+ */
+
+#define DAYIDX_HSIZE    4096
+#define DAYIDX_MAXSPAN  62
+
+struct dayidx_bkt {
+	long day;
+	vector_t items;
+	 HTABLE_ENTRY(dayidx_bkt);
+};
+
+static void dayidx_extract_key(struct dayidx_bkt *, const char **, int *);
+static int dayidx_cmp(struct dayidx_bkt *, struct dayidx_bkt *);
+
+HTABLE_HEAD(htd, DAYIDX_HSIZE, dayidx_bkt);
+HTABLE_PROTOTYPE(htd, dayidx_bkt)
+    HTABLE_GENERATE(htd, dayidx_bkt, dayidx_extract_key, dayidx_cmp)
+
+struct dayidx {
+	struct htd days;
+	vector_t spanning;
+};
+
+static void
+dayidx_extract_key(struct dayidx_bkt *data, const char **key, int *len)
+{
+	*key = (const char *)&data->day;
+	*len = sizeof(data->day);
+}
+
+static int dayidx_cmp(struct dayidx_bkt *a, struct dayidx_bkt *b)
+{
+	return a->day != b->day;
+}
+
+/* Get the first and the last day an item occurs on. */
+static void dayidx_span(time_t start, long dur, long *first, long *last)
+{
+	*first = sec2days(start);
+	*last = dur > 0 ? sec2days(start + dur - 1) : *first;
+	if (*last < *first)
+		*last = *first;
+}
+
+static struct dayidx_bkt *dayidx_lookup(struct dayidx *idx, long day)
+{
+	struct dayidx_bkt tmp;
+
+	tmp.day = day;
+	return HTABLE_LOOKUP(htd, &idx->days, &tmp);
+}
+
+/* Remove an item from a vector, return 1 if it was found. */
+static int dayidx_vector_remove(vector_t *v, void *item)
+{
+	unsigned i;
+
+	VECTOR_FOREACH(v, i) {
+		if (VECTOR_NTH(v, i) == item) {
+			VECTOR_REMOVE(v, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+struct dayidx *dayidx_new(void)
+{
+	struct dayidx *idx = mem_malloc(sizeof(struct dayidx));
+	unsigned i;
+
+	idx->days.noitems = idx->days.nosingle = 0;
+	idx->days.nofreebkts = HTABLE_SIZE(&idx->days);
+	for (i = 0; i < HTABLE_SIZE(&idx->days); i++)
+		idx->days.bkts[i] = NULL;
+	VECTOR_INIT(&idx->spanning, 4);
+
+	return idx;
+}
+
+void dayidx_free(struct dayidx *idx)
+{
+	struct dayidx_bkt *b, *next;
+	unsigned i;
+
+	if (!idx)
+		return;
+
+	for (i = 0; i < HTABLE_SIZE(&idx->days); i++) {
+		for (b = idx->days.bkts[i]; b; b = next) {
+			next = b->next;
+			VECTOR_FREE(&b->items);
+			mem_free(b);
+		}
+	}
+	VECTOR_FREE(&idx->spanning);
+	mem_free(idx);
+}
+
+/* Add an item starting at the given time and lasting dur seconds. */
+void dayidx_add(struct dayidx *idx, void *item, time_t start, long dur)
+{
+	struct dayidx_bkt *b;
+	long day, first, last;
+
+	dayidx_span(start, dur, &first, &last);
+	if (last - first >= DAYIDX_MAXSPAN) {
+		VECTOR_ADD(&idx->spanning, item);
+		return;
+	}
+
+	for (day = first; day <= last; day++) {
+		if (!(b = dayidx_lookup(idx, day))) {
+			b = mem_malloc(sizeof(struct dayidx_bkt));
+			b->day = day;
+			VECTOR_INIT(&b->items, 2);
+			HTABLE_INSERT(htd, &idx->days, b);
+		}
+		VECTOR_ADD(&b->items, item);
+	}
+}
+
+/*
+ * Remove an item from the index. The start time and duration must be the same
+ * as the ones the item was added with.
+ */
+void dayidx_remove(struct dayidx *idx, void *item, time_t start, long dur)
+{
+	struct dayidx_bkt *b;
+	long day, first, last;
+
+	dayidx_span(start, dur, &first, &last);
+	if (last - first >= DAYIDX_MAXSPAN) {
+		dayidx_vector_remove(&idx->spanning, item);
+		return;
+	}
+
+	for (day = first; day <= last; day++) {
+		if (!(b = dayidx_lookup(idx, day)))
+			continue;
+		dayidx_vector_remove(&b->items, item);
+		if (VECTOR_COUNT(&b->items) == 0) {
+			HTABLE_REMOVE(htd, &idx->days, b);
+			VECTOR_FREE(&b->items);
+			mem_free(b);
+		}
+	}
+}
+
+/* Return the first candidate item for the given day. */
+void *dayidx_first(struct dayidx *idx, time_t day, struct dayidx_iter *it)
+{
+	struct dayidx_bkt *b = dayidx_lookup(idx, sec2days(day));
+
+	it->v[0] = b ? &b->items : NULL;
+	it->v[1] = &idx->spanning;
+	it->n = 0;
+	it->i = 0;
+
+	return dayidx_next(it);
+}
+
+/* Return the next candidate item, or NULL if there are no more. */
+void *dayidx_next(struct dayidx_iter *it)
+{
+	for (; it->n < 2; it->n++, it->i = 0) {
+		if (it->v[it->n] && it->i < VECTOR_COUNT(it->v[it->n]))
+			return VECTOR_NTH(it->v[it->n], it->i++);
+	}
+	return NULL;
+}
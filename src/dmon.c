@@ -85,7 +85,7 @@ static void dmon_sigs_hdlr(int sig)
 	exit(EXIT_SUCCESS);
 }
 
-static unsigned daemonize(int status)
+unsigned dmon_daemonize(int status)
 {
 	int fd;
 
@@ -139,19 +139,17 @@ static unsigned daemonize(int status)
 	/* Write access for the owner only. */
 	umask(0022);
 
-	if (!sigs_set_hdlr(SIGINT, dmon_sigs_hdlr)
-	    || !sigs_set_hdlr(SIGTERM, dmon_sigs_hdlr)
-	    || !sigs_set_hdlr(SIGALRM, dmon_sigs_hdlr)
-	    || !sigs_set_hdlr(SIGQUIT, dmon_sigs_hdlr)
-	    || !sigs_set_hdlr(SIGUSR1, dmon_sigs_hdlr))
-		return 0;
-
 	return 1;
 }
 
 void dmon_start(int parent_exit_status)
 {
-	if (!daemonize(parent_exit_status))
+	if (!dmon_daemonize(parent_exit_status) ||
+	    !sigs_set_hdlr(SIGINT, dmon_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGTERM, dmon_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGALRM, dmon_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGQUIT, dmon_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGUSR1, dmon_sigs_hdlr))
 		DMON_ABRT(_("Cannot daemonize, aborting\n"));
 
 	if (!io_dump_pid(path_dpid))
@@ -172,6 +170,7 @@ void dmon_start(int parent_exit_status)
 	todo_init_list();
 	io_load_app(NULL);
 	data_loaded = 1;
+	watch_start_thread();
 
 	DMON_LOG(_("started at %s\n"), nowstr());
 	for (;;) {
@@ -179,6 +178,8 @@ void dmon_start(int parent_exit_status)
 
 		if (want_reload) {
 			want_reload = 0;
+			if (watch_changes() & WATCH_CONF)
+				config_load();
 			io_reload_data();
 			notify_check_next_app(1);
 		}
@@ -200,7 +201,9 @@ void dmon_start(int parent_exit_status)
 				  "sleeping at %s for %d seconds\n",
 				  DMON_SLEEP_TIME), nowstr(),
 			 DMON_SLEEP_TIME);
-		psleep(DMON_SLEEP_TIME);
+		/* Wake up early to reload the data. */
+		for (left = sleep(DMON_SLEEP_TIME); left && !want_reload;
+		     left = sleep(left)) ;
 		DMON_LOG(_("awakened at %s\n"), nowstr());
 		/* Reap the user-defined notifications. */
 		while (waitpid(0, NULL, WNOHANG) > 0)
@@ -43,13 +43,16 @@
 #include "sha1.h"
 
 llist_t eventlist;
+static struct dayidx *eventlist_idx;
 /* Dummy event for the APP panel for an otherwise empty day. */
-struct event dummy = { DUMMY, 0, "", NULL };
+struct event dummy = { DUMMY, 0, "", NULL, NULL };
 
 void event_free(struct event *ev)
 {
 	mem_free(ev->mesg);
 	erase_note(&ev->note);
+	if (ev->hash)
+		mem_free(ev->hash);
 	mem_free(ev);
 }
 
@@ -65,6 +68,7 @@ struct event *event_dup(struct event *in)
 		ev->note = mem_strdup(in->note);
 	else
 		ev->note = NULL;
+	ev->hash = NULL;
 
 	return ev;
 }
@@ -72,12 +76,15 @@ struct event *event_dup(struct event *in)
 void event_llist_init(void)
 {
 	LLIST_INIT(&eventlist);
+	eventlist_idx = dayidx_new();
 }
 
 void event_llist_free(void)
 {
 	LLIST_FREE_INNER(&eventlist, event_free);
 	LLIST_FREE(&eventlist);
+	dayidx_free(eventlist_idx);
+	eventlist_idx = NULL;
 }
 
 static int event_cmp(struct event *a, struct event *b)
@@ -91,7 +98,7 @@ static int event_cmp(struct event *a, struct event *b)
 }
 
 /* Create a new event */
-struct event *event_new(char *mesg, char *note, time_t day, int id)
+struct event *event_alloc(char *mesg, char *note, time_t day, int id)
 {
 	struct event *ev;
 
@@ -100,18 +107,67 @@ struct event *event_new(char *mesg, char *note, time_t day, int id)
 	ev->day = day;
 	ev->id = id;
 	ev->note = (note != NULL) ? mem_strdup(note) : NULL;
+	ev->hash = NULL;
+
+	return ev;
+}
+
+struct event *event_new(char *mesg, char *note, time_t day, int id)
+{
+	struct event *ev = event_alloc(mesg, note, day, id);
 
 	LLIST_ADD_SORTED(&eventlist, ev, event_cmp);
+	dayidx_add(eventlist_idx, ev, ev->day, 0);
 
 	return ev;
 }
 
+/*
+ * Insert the events collected by event_scan() in the list, all at once. The
+ * vector is left sorted.
+ */
+void event_add_all(vector_t *v)
+{
+	struct event *ev;
+	unsigned i;
+
+	LLIST_ADD_SORTED_ALL(&eventlist, v->data, VECTOR_COUNT(v), event_cmp);
+	VECTOR_FOREACH(v, i) {
+		ev = VECTOR_NTH(v, i);
+		dayidx_add(eventlist_idx, ev, ev->day, 0);
+	}
+}
+
 /* Check if the event belongs to the selected day */
 unsigned event_inday(struct event *i, time_t *start)
 {
 	return (date_cmp_day(i->day, *start) == 0);
 }
 
+/* Return the first event of the given day, using the day index. */
+struct event *event_first_inday(time_t day, struct dayidx_iter *it)
+{
+	struct event *ev;
+
+	DAYIDX_FOREACH(eventlist_idx, day, it, ev) {
+		if (event_inday(ev, &day))
+			return ev;
+	}
+	return NULL;
+}
+
+/* Return the next event of the day given to event_first_inday(). */
+struct event *event_next_inday(time_t day, struct dayidx_iter *it)
+{
+	struct event *ev;
+
+	while ((ev = dayidx_next(it))) {
+		if (event_inday(ev, &day))
+			return ev;
+	}
+	return NULL;
+}
+
 char *event_tostr(struct event *o)
 {
 	struct string s;
@@ -131,14 +187,12 @@ char *event_tostr(struct event *o)
 	return string_buf(&s);
 }
 
-char *event_hash(struct event *ev)
+/* Same as apoint_hash(), for events. */
+const char *event_hash(struct event *ev)
 {
-	char *raw = event_tostr(ev);
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
-	sha1_digest(raw, sha1);
-	mem_free(raw);
+	const char *hash = item_hash_get(ev->hash);
 
-	return sha1;
+	return hash ? hash : item_hash_set(&ev->hash, event_tostr(ev));
 }
 
 void event_write(struct event *o, FILE * f)
@@ -149,10 +203,10 @@ void event_write(struct event *o, FILE * f)
 }
 
 /* Load the events from file */
-char *event_scan(FILE * f, struct tm start, int id, char *note,
-			 struct item_filter *filter)
+char *event_scan(char *buf, struct tm start, int id, char *note,
+			 struct item_filter *filter, vector_t *items)
 {
-	char buf[BUFSIZ], *nl;
+	struct date dstart = { start.tm_mday, start.tm_mon, start.tm_year };
 	time_t tstart, tend;
 	struct event *ev = NULL;
 	int cond;
@@ -161,51 +215,37 @@ char *event_scan(FILE * f, struct tm start, int id, char *note,
 	    !check_time(start.tm_hour, start.tm_min))
 		return _("illegal date in event");
 
-	/* Read the event description */
-	if (!fgets(buf, sizeof buf, f))
+	if (!buf)
 		return _("error in appointment description");
 
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
-	start.tm_hour = 0;
-	start.tm_min = 0;
-	start.tm_sec = 0;
-	start.tm_isdst = -1;
-	start.tm_year -= 1900;
-	start.tm_mon--;
-
-	tstart = mktime(&start);
-	if (tstart == -1)
-		return _("date error in event\n");
+	tstart = date2sec(dstart, 0, 0);
 	tend = ENDOFDAY(tstart);
 
 	/* Filter item. */
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_EVNT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->pattern && !pattern_match(filter->pattern, buf)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			ev = event_new(buf, note, tstart, id);
-			char *hash = event_hash(ev);
-			cond = cond || !hash_matches(filter->hash, hash);
-			mem_free(hash);
+			ev = event_alloc(buf, note, tstart, id);
+			cond = cond || !hash_matches(filter->hash,
+						     event_hash(ev));
 		}
 
 		if ((!filter->invert && cond) || (filter->invert && !cond)) {
 			if (filter->hash)
-				event_delete(ev);
+				event_free(ev);
 			return NULL;
 		}
 	}
 	if (!ev)
-		ev = event_new(buf, note, tstart, id);
+		ev = event_alloc(buf, note, tstart, id);
+	VECTOR_ADD(items, ev);
 	return NULL;
 }
 
@@ -218,12 +258,27 @@ void event_delete(struct event *ev)
 		EXIT(_("no such appointment"));
 
 	LLIST_REMOVE(&eventlist, i);
+	dayidx_remove(eventlist_idx, ev, ev->day, 0);
+}
+
+/* Remove several events from the list at once, see apoint_remove_all(). */
+void event_remove_all(vector_t *v)
+{
+	struct event *ev;
+	unsigned i;
+
+	LLIST_REMOVE_ALL(&eventlist, v->data, VECTOR_COUNT(v));
+	VECTOR_FOREACH(v, i) {
+		ev = VECTOR_NTH(v, i);
+		dayidx_remove(eventlist_idx, ev, ev->day, 0);
+	}
 }
 
 void event_paste_item(struct event *ev, time_t date)
 {
 	ev->day = date;
 	LLIST_ADD_SORTED(&eventlist, ev, event_cmp);
+	dayidx_add(eventlist_idx, ev, ev->day, 0);
 }
 
 /* Return true if the day_item is the dummy event. */
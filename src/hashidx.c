@@ -0,0 +1,162 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include "calcurse.h"
+
+/*
+ * Index of items by digest (see apoint_hash() and the like), so that the items
+ * whose digest starts with a given prefix can be found by a binary search
+ * instead of going through the whole item list.
+ *
+ * The index points to the digests cached in the items: it has to be rebuilt
+ * when any item is changed or freed. Items are found in the order they were
+ * added in.
+ */
+
+struct hashidx_entry {
+	const char *hash;
+	void *item;
+	unsigned seq;
+};
+
+struct hashidx {
+	struct hashidx_entry *entries;
+	unsigned n, size;
+	int sorted;
+};
+
+static int hashidx_cmp(const void *a, const void *b)
+{
+	const struct hashidx_entry *ea = a, *eb = b;
+	int cmp = strcmp(ea->hash, eb->hash);
+
+	if (cmp)
+		return cmp;
+	return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq);
+}
+
+static int hashidx_seq_cmp(const void *a, const void *b)
+{
+	const struct hashidx_entry *ea = a, *eb = b;
+
+	return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq);
+}
+
+struct hashidx *hashidx_new(void)
+{
+	struct hashidx *idx = mem_malloc(sizeof(struct hashidx));
+
+	idx->entries = NULL;
+	idx->n = idx->size = 0;
+	idx->sorted = 1;
+
+	return idx;
+}
+
+void hashidx_free(struct hashidx *idx)
+{
+	if (!idx)
+		return;
+
+	if (idx->entries)
+		mem_free(idx->entries);
+	mem_free(idx);
+}
+
+/* Add an item with the given digest, which must outlive the index. */
+void hashidx_add(struct hashidx *idx, const char *hash, void *item)
+{
+	struct hashidx_entry *e;
+
+	if (idx->n == idx->size) {
+		idx->size = idx->size ? 2 * idx->size : 64;
+		idx->entries = mem_realloc(idx->entries, idx->size,
+					   sizeof(struct hashidx_entry));
+	}
+	e = &idx->entries[idx->n];
+	e->hash = hash;
+	e->item = item;
+	e->seq = idx->n++;
+	idx->sorted = 0;
+}
+
+/*
+ * Sort an index once all items have been added. Otherwise, this is done by the
+ * next lookup.
+ */
+void hashidx_sort(struct hashidx *idx)
+{
+	if (idx->sorted)
+		return;
+
+	qsort(idx->entries, idx->n, sizeof(struct hashidx_entry), hashidx_cmp);
+	idx->sorted = 1;
+}
+
+/* Add the items whose digest starts with the given prefix to a vector. */
+void hashidx_find(struct hashidx *idx, const char *prefix, vector_t *v)
+{
+	struct hashidx_entry *match;
+	size_t len = strlen(prefix);
+	unsigned lo, hi, mid, n;
+
+	hashidx_sort(idx);
+
+	/* Find the first digest not lower than the prefix. */
+	lo = 0;
+	hi = idx->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strncmp(idx->entries[mid].hash, prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (hi = lo; hi < idx->n; hi++) {
+		if (strncmp(idx->entries[hi].hash, prefix, len) != 0)
+			break;
+	}
+	if ((n = hi - lo) == 0)
+		return;
+
+	/* Give the matches back in their original order. */
+	match = mem_malloc(n * sizeof(struct hashidx_entry));
+	memcpy(match, idx->entries + lo, n * sizeof(struct hashidx_entry));
+	qsort(match, n, sizeof(struct hashidx_entry), hashidx_seq_cmp);
+	for (hi = 0; hi < n; hi++)
+		VECTOR_ADD(v, match[hi].item);
+	mem_free(match);
+}
@@ -298,6 +298,258 @@ name##_HTABLE_NEXT(struct name *head, struct type *elm)                       \
        (x) != NULL;                                                           \
        (x) = HTABLE_NEXT(name, head, x))
 
+/*
+ * Self-resizing hash tables.
+ *
+ * The tables above have a fixed number of buckets, which has to be chosen at
+ * compile time. The variant below grows with its contents instead, so it is
+ * suitable for indexes whose size is not known in advance.
+ *
+ * It uses open addressing with linear probing: the table is an array of slots,
+ * each holding the hash of an element and a pointer to it, so that elements
+ * do not need an HTABLE_ENTRY() field. The number of slots is a power of two.
+ * It doubles whenever an insertion would raise the load of the table above
+ * the limit given at initialization, as a percentage of the slots in use.
+ * Since lookups stop at a free slot, the limit must be below 100, otherwise
+ * HTABLE_DYN_MAXLOAD is used.
+ * Removal shifts the following elements of a run back rather than leaving
+ * deleted markers, so lookups never get slower after removals.
+ *
+ * Elements must not be inserted or removed while iterating over a table.
+ * The slot array is allocated with mem_calloc() and released by
+ * HTABLE_DYN_FREE(), the elements themselves are owned by the caller.
+ */
+#define HTABLE_DYN_MINSIZE 16
+#define HTABLE_DYN_MAXLOAD 75
+
+/* Value to pass to the hash functions to get the whole 32-bit hash. */
+#define HTABLE_DYN_FULLHASH ((uint64_t)1 << 32)
+
+#define HTABLE_DYN_HEAD(name, type)                                           \
+struct name##_slot {                                                          \
+  uint32_t      hash;                                                         \
+  struct type  *elm;         /* NULL if the slot is free. */                  \
+};                                                                            \
+struct name {                                                                 \
+  uint32_t      noitems;     /* Number of items stored in hash table. */      \
+  uint32_t      size;        /* Number of slots, zero or a power of two. */   \
+  uint32_t      maxload;     /* Maximum load, in percent. */                  \
+  uint32_t      maxprobe;    /* Longest insertion probe since last resize. */ \
+  uint64_t      nolookups;   /* Number of lookups, for statistics. */         \
+  uint64_t      noprobes;    /* Number of slots examined by lookups. */       \
+  struct name##_slot *slots;                                                  \
+}
+
+#define HTABLE_DYN_INITIALIZER(load)                                          \
+  { 0,                    /* noitems */                                       \
+    0,                    /* size */                                          \
+    (load),               /* maxload */                                       \
+    0,                    /* maxprobe */                                      \
+    0,                    /* nolookups */                                     \
+    0,                    /* noprobes */                                      \
+    NULL                  /* slots */                                         \
+  }
+
+#define HTABLE_DYN_INIT(head, load) do {                                      \
+  memset ((head), 0, sizeof (*(head)));                                       \
+  (head)->maxload = (load);                                                   \
+} while (0)
+
+#define HTABLE_DYN_COUNT(head)     ((head)->noitems)
+#define HTABLE_DYN_SIZE(head)      ((head)->size)
+#define HTABLE_DYN_EMPTY(head)     (HTABLE_DYN_COUNT((head)) == 0)
+
+#define HTABLE_DYN_LOAD(head)                                                 \
+  ((head)->size ? 100.0 * (head)->noitems / (head)->size : 0)
+
+/* Average number of slots examined per lookup. */
+#define HTABLE_DYN_PROBES(head)                                               \
+  ((head)->nolookups ? (double)(head)->noprobes / (head)->nolookups : 0)
+
+#define HTABLE_DYN_MAXPROBE(head)  ((head)->maxprobe)
+
+#define HTABLE_DYN_PROTOTYPE(name, type)                                      \
+void name##_HTABLE_DYN_RESERVE(struct name *, uint32_t);                      \
+struct type *name##_HTABLE_DYN_INSERT(struct name *, struct type *);          \
+struct type *name##_HTABLE_DYN_REMOVE(struct name *, struct type *);          \
+struct type *name##_HTABLE_DYN_LOOKUP(struct name *, struct type *);          \
+struct type *name##_HTABLE_DYN_ITER(struct name *, uint32_t *);               \
+void name##_HTABLE_DYN_FREE(struct name *);
+
+#define HTABLE_DYN_GENERATE(name, type, key, cmp)                             \
+static uint32_t                                                               \
+name##_HTABLE_DYN_HASH(struct type *elm)                                      \
+{                                                                             \
+  uint32_t __hash;                                                            \
+  const char *__key;                                                          \
+  int __len;                                                                  \
+                                                                              \
+  (key) (elm, &__key, &__len);                                                \
+  HTABLE_HASH(__key, __len, HTABLE_DYN_FULLHASH, __hash);                     \
+                                                                              \
+  return __hash;                                                              \
+}                                                                             \
+                                                                              \
+static void                                                                   \
+name##_HTABLE_DYN_PLACE(struct name *head, uint32_t hash, struct type *elm)   \
+{                                                                             \
+  uint32_t __mask, __pos, __dist;                                             \
+                                                                              \
+  __mask = head->size - 1;                                                    \
+  for (__pos = hash & __mask, __dist = 0; head->slots[__pos].elm;             \
+       __pos = (__pos + 1) & __mask)                                          \
+    __dist++;                                                                 \
+  head->slots[__pos].hash = hash;                                             \
+  head->slots[__pos].elm = elm;                                               \
+  if (__dist > head->maxprobe)                                                \
+    head->maxprobe = __dist;                                                  \
+}                                                                             \
+                                                                              \
+static void                                                                   \
+name##_HTABLE_DYN_RESIZE(struct name *head, uint32_t size)                    \
+{                                                                             \
+  struct name##_slot *__slots;                                                \
+  uint32_t __size, __i;                                                       \
+                                                                              \
+  __slots = head->slots;                                                      \
+  __size = head->size;                                                        \
+  head->slots = mem_calloc (size, sizeof (struct name##_slot));               \
+  head->size = size;                                                          \
+  head->maxprobe = 0;                                                         \
+  for (__i = 0; __i < __size; __i++)                                          \
+    {                                                                         \
+      if (__slots[__i].elm)                                                   \
+        name##_HTABLE_DYN_PLACE(head, __slots[__i].hash, __slots[__i].elm);   \
+    }                                                                         \
+  if (__slots)                                                                \
+    mem_free (__slots);                                                       \
+}                                                                             \
+                                                                              \
+void                                                                          \
+name##_HTABLE_DYN_RESERVE(struct name *head, uint32_t n)                      \
+{                                                                             \
+  uint32_t __size;                                                            \
+                                                                              \
+  if (!head->maxload || head->maxload >= 100)                                 \
+    head->maxload = HTABLE_DYN_MAXLOAD;                                       \
+  __size = head->size ? head->size : HTABLE_DYN_MINSIZE;                      \
+  while ((uint64_t)n * 100 > (uint64_t)__size * head->maxload)                \
+    __size *= 2;                                                              \
+  if (__size != head->size)                                                   \
+    name##_HTABLE_DYN_RESIZE(head, __size);                                   \
+}                                                                             \
+                                                                              \
+struct type *                                                                 \
+name##_HTABLE_DYN_INSERT(struct name *head, struct type *elm)                 \
+{                                                                             \
+  uint32_t __hash, __mask, __pos;                                             \
+                                                                              \
+  name##_HTABLE_DYN_RESERVE(head, head->noitems + 1);                         \
+  __hash = name##_HTABLE_DYN_HASH(elm);                                       \
+  __mask = head->size - 1;                                                    \
+  for (__pos = __hash & __mask; head->slots[__pos].elm;                       \
+       __pos = (__pos + 1) & __mask)                                          \
+    {                                                                         \
+      if (head->slots[__pos].hash == __hash                                   \
+          && !(cmp)(elm, head->slots[__pos].elm))                             \
+        return NULL;                                                          \
+    }                                                                         \
+  name##_HTABLE_DYN_PLACE(head, __hash, elm);                                 \
+  head->noitems++;                                                            \
+                                                                              \
+  return elm;                                                                 \
+}                                                                             \
+                                                                              \
+static int32_t                                                                \
+name##_HTABLE_DYN_FIND(struct name *head, struct type *elm)                   \
+{                                                                             \
+  uint32_t __hash, __mask, __pos;                                             \
+                                                                              \
+  if (!head->noitems)                                                         \
+    return -1;                                                                \
+  __hash = name##_HTABLE_DYN_HASH(elm);                                       \
+  __mask = head->size - 1;                                                    \
+  head->nolookups++;                                                          \
+  for (__pos = __hash & __mask; head->slots[__pos].elm;                       \
+       __pos = (__pos + 1) & __mask)                                          \
+    {                                                                         \
+      head->noprobes++;                                                       \
+      if (head->slots[__pos].hash == __hash                                   \
+          && !(cmp)(elm, head->slots[__pos].elm))                             \
+        return __pos;                                                         \
+    }                                                                         \
+  head->noprobes++;                                                           \
+                                                                              \
+  return -1;                                                                  \
+}                                                                             \
+                                                                              \
+struct type *                                                                 \
+name##_HTABLE_DYN_LOOKUP(struct name *head, struct type *elm)                 \
+{                                                                             \
+  int32_t __pos;                                                              \
+                                                                              \
+  __pos = name##_HTABLE_DYN_FIND(head, elm);                                  \
+  return __pos < 0 ? NULL : head->slots[__pos].elm;                           \
+}                                                                             \
+                                                                              \
+struct type *                                                                 \
+name##_HTABLE_DYN_REMOVE(struct name *head, struct type *elm)                 \
+{                                                                             \
+  uint32_t __mask, __pos, __next, __home;                                     \
+  int32_t __found;                                                            \
+                                                                              \
+  if ((__found = name##_HTABLE_DYN_FIND(head, elm)) < 0)                      \
+    return NULL;                                                              \
+  elm = head->slots[__found].elm;                                             \
+  __mask = head->size - 1;                                                    \
+  __pos = __found;                                                            \
+  /* Move back the items of the run that would not be found otherwise. */     \
+  for (__next = (__pos + 1) & __mask; head->slots[__next].elm;                \
+       __next = (__next + 1) & __mask)                                        \
+    {                                                                         \
+      __home = head->slots[__next].hash & __mask;                             \
+      if (((__next - __home) & __mask) >= ((__next - __pos) & __mask))        \
+        {                                                                     \
+          head->slots[__pos] = head->slots[__next];                           \
+          __pos = __next;                                                     \
+        }                                                                     \
+    }                                                                         \
+  head->slots[__pos].elm = NULL;                                              \
+  head->noitems--;                                                            \
+                                                                              \
+  return elm;                                                                 \
+}                                                                             \
+                                                                              \
+struct type *                                                                 \
+name##_HTABLE_DYN_ITER(struct name *head, uint32_t *pos)                      \
+{                                                                             \
+  while (*pos < head->size)                                                   \
+    {                                                                         \
+      if (head->slots[(*pos)++].elm)                                          \
+        return head->slots[*pos - 1].elm;                                     \
+    }                                                                         \
+                                                                              \
+  return NULL;                                                                \
+}                                                                             \
+                                                                              \
+void                                                                          \
+name##_HTABLE_DYN_FREE(struct name *head)                                     \
+{                                                                             \
+  if (head->slots)                                                            \
+    mem_free (head->slots);                                                   \
+  head->slots = NULL;                                                         \
+  head->size = head->noitems = head->maxprobe = 0;                            \
+}
+
+#define HTABLE_DYN_RESERVE(name, x, n)   name##_HTABLE_DYN_RESERVE(x, n)
+#define HTABLE_DYN_INSERT(name, x, y)    name##_HTABLE_DYN_INSERT(x, y)
+#define HTABLE_DYN_REMOVE(name, x, y)    name##_HTABLE_DYN_REMOVE(x, y)
+#define HTABLE_DYN_LOOKUP(name, x, y)    name##_HTABLE_DYN_LOOKUP(x, y)
+#define HTABLE_DYN_FREE(name, x)         name##_HTABLE_DYN_FREE(x)
+
+#define HTABLE_DYN_FOREACH(x, name, head, pos)                                \
+  for ((pos) = 0; ((x) = name##_HTABLE_DYN_ITER((head), &(pos))) != NULL; )
+
 /*
  * Hash functions.
  */
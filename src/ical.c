@@ -197,7 +197,7 @@ static char *ical_unindent(char *a, char *z)
 
 static void ical_export_note(FILE *stream, char *name)
 {
-	char *note_file, *p, *q, *r, *rest;
+	char *note, *p, *q, *r, *rest;
 	char *property[] = {
 		"Location: ",
 		"Comment: ",
@@ -207,38 +207,32 @@ static void ical_export_note(FILE *stream, char *name)
 		"LOCATION:",
 		"COMMENT:"
 	};
-	struct string note;
-	char lbuf[BUFSIZ];
-	FILE *fp;
+	size_t len;
 	int has_desc, has_prop, i;
 
-	asprintf(&note_file, "%s/%s", path_notes, name);
-	if (!(fp = fopen(note_file, "r")) || ungetc(getc(fp), fp) == EOF) {
-		if (fp)
-			fclose(fp);
+	if (!(note = note_get(name, &len)))
+		return;
+	if (len == 0) {
+		mem_free(note);
 		return;
 	}
-	string_init(&note);
-	while (fgets(lbuf, BUFSIZ, fp))
-		string_catf(&note, "%s", lbuf);
-	fclose(fp);
 
 	has_desc = has_prop = 0;
-	rest = note.buf;
-	if ((p = strstr(note.buf, SEPARATOR))) {
+	rest = note;
+	if ((p = strstr(note, SEPARATOR))) {
 		has_prop = 1;
 		rest = p + strlen(SEPARATOR);
-		if (p != note.buf) {
+		if (p != note) {
 			has_desc = 1;
 			*(--p) = '\0';
 		}
 	} else {
 		has_desc = 1;
-		note.buf[strlen(note.buf) - 1] = '\0';
+		note[strlen(note) - 1] = '\0';
 	}
 
 	if (has_desc)
-		ical_format_line(stream, "DESCRIPTION:", note.buf);
+		ical_format_line(stream, "DESCRIPTION:", note);
 
 	if (!has_prop)
 		goto cleanup;
@@ -257,7 +251,7 @@ static void ical_export_note(FILE *stream, char *name)
 		mem_free(r);
 	}
 cleanup:
-	mem_free(note.buf);
+	mem_free(note);
 }
 
 /* Export header. */
@@ -277,28 +271,26 @@ static void ical_export_footer(FILE * stream)
 /* Export recurrent events. */
 static void ical_export_recur_events(FILE * stream, int export_uid)
 {
-	llist_item_t *i, *j;
-	char ical_date[BUFSIZ], *hash;
+	llist_item_t *i;
+	unsigned j;
+	char ical_date[BUFSIZ];
 
 	LLIST_FOREACH(&recur_elist, i) {
 		struct recur_event *rev = LLIST_GET_DATA(i);
 		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = recur_event_hash(rev);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
+		if (export_uid)
+			fprintf(stream, "UID:%s\n", recur_event_hash(rev));
 		date_sec2date_fmt(rev->day, ICALDATEFMT, ical_date);
 		fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
 		ical_export_rrule(stream, rev->rpt, EVENT, ical_date);
-		if (LLIST_FIRST(&rev->exc)) {
+		if (rev->exc.count) {
 			fputs("EXDATE;VALUE=DATE:", stream);
-			LLIST_FOREACH(&rev->exc, j) {
-				struct excp *exc = LLIST_GET_DATA(j);
+			for (j = 0; j < rev->exc.count; j++) {
+				struct excp *exc = &rev->exc.tab[j];
 				date_sec2date_fmt(exc->st, ICALDATETIMEFMT,
 						  ical_date);
 				fprintf(stream, "%s", ical_date);
-				fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
+				fputc(j + 1 < rev->exc.count ? ',' : '\n', stream);
 			}
 		}
 		ical_format_line(stream, "SUMMARY:", rev->mesg);
@@ -312,16 +304,13 @@ static void ical_export_recur_events(FILE * stream, int export_uid)
 static void ical_export_events(FILE * stream, int export_uid)
 {
 	llist_item_t *i;
-	char ical_date[BUFSIZ], *hash;
+	char ical_date[BUFSIZ];
 
 	LLIST_FOREACH(&eventlist, i) {
 		struct event *ev = LLIST_TS_GET_DATA(i);
 		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = event_hash(ev);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
+		if (export_uid)
+			fprintf(stream, "UID:%s\n", event_hash(ev));
 		date_sec2date_fmt(ev->day, ICALDATEFMT, ical_date);
 		fprintf(stream, "DTSTART;VALUE=DATE:%s\n", ical_date);
 		ical_format_line(stream, "SUMMARY:", ev->mesg);
@@ -334,8 +323,9 @@ static void ical_export_events(FILE * stream, int export_uid)
 /* Export recurrent appointments. */
 static void ical_export_recur_apoints(FILE * stream, int export_uid)
 {
-	llist_item_t *i, *j;
-	char ical_datetime[BUFSIZ], *hash;
+	llist_item_t *i;
+	unsigned j;
+	char ical_datetime[BUFSIZ];
 	time_t tod;
 
 	LLIST_TS_LOCK(&recur_alist_p);
@@ -354,11 +344,8 @@ static void ical_export_recur_apoints(FILE * stream, int export_uid)
 		date_sec2date_fmt(rapt->start, ICALDATETIMEFMT,
 				  ical_datetime);
 		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = recur_apoint_hash(rapt);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
+		if (export_uid)
+			fprintf(stream, "UID:%s\n", recur_apoint_hash(rapt));
 		fprintf(stream, "DTSTART:%s\n", ical_datetime);
 		if (rapt->dur > 0) {
 			fprintf(stream, "DURATION:P%ldDT%ldH%ldM%ldS\n",
@@ -368,14 +355,14 @@ static void ical_export_recur_apoints(FILE * stream, int export_uid)
 				rapt->dur % MININSEC);
 		}
 		ical_export_rrule(stream, rapt->rpt, APPOINTMENT, ical_datetime);
-		if (LLIST_FIRST(&rapt->exc)) {
+		if (rapt->exc.count) {
 			fputs("EXDATE:", stream);
-			LLIST_FOREACH(&rapt->exc, j) {
-				struct excp *exc = LLIST_GET_DATA(j);
+			for (j = 0; j < rapt->exc.count; j++) {
+				struct excp *exc = &rapt->exc.tab[j];
 				date_sec2date_fmt(exc->st + tod, ICALDATETIMEFMT,
 						  ical_datetime);
 				fprintf(stream, "%s", ical_datetime);
-				fputc(LLIST_NEXT(j) ? ',' : '\n', stream);
+				fputc(j + 1 < rapt->exc.count ? ',' : '\n', stream);
 			}
 		}
 		ical_format_line(stream, "SUMMARY:", rapt->mesg);
@@ -392,17 +379,14 @@ static void ical_export_recur_apoints(FILE * stream, int export_uid)
 static void ical_export_apoints(FILE * stream, int export_uid)
 {
 	llist_item_t *i;
-	char ical_datetime[BUFSIZ], *hash;
+	char ical_datetime[BUFSIZ];
 
 	LLIST_TS_LOCK(&alist_p);
 	LLIST_TS_FOREACH(&alist_p, i) {
 		struct apoint *apt = LLIST_TS_GET_DATA(i);
 		fputs("BEGIN:VEVENT\n", stream);
-		if (export_uid) {
-			hash = apoint_hash(apt);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
+		if (export_uid)
+			fprintf(stream, "UID:%s\n", apoint_hash(apt));
 		date_sec2date_fmt(apt->start, ICALDATETIMEFMT,
 				  ical_datetime);
 		fprintf(stream, "DTSTART:%s\n", ical_datetime);
@@ -427,17 +411,13 @@ static void ical_export_apoints(FILE * stream, int export_uid)
 static void ical_export_todo(FILE * stream, int export_uid)
 {
 	llist_item_t *i;
-	char *hash;
 
 	LLIST_FOREACH(&todolist, i) {
 		struct todo *todo = LLIST_TS_GET_DATA(i);
 
 		fputs("BEGIN:VTODO\n", stream);
-		if (export_uid) {
-			hash = todo_hash(todo);
-			fprintf(stream, "UID:%s\n", hash);
-			mem_free(hash);
-		}
+		if (export_uid)
+			fprintf(stream, "UID:%s\n", todo_hash(todo));
 		fprintf(stream, "PRIORITY:%d\n", todo->id);
 		ical_format_line(stream, "SUMMARY:", todo->mesg);
 		if (todo->note)
@@ -503,7 +483,7 @@ static void ical_store_todo(int priority, int completed, char *mesg,
 {
 	struct todo *todo = todo_add(mesg, priority, completed, note);
 	if (fmt_todo)
-		print_todo(fmt_todo, todo);
+		print_todo(NULL, fmt_todo, todo);
 	mem_free(mesg);
 	erase_note(&note);
 }
@@ -514,7 +494,7 @@ static void ical_store_todo(int priority, int completed, char *mesg,
  */
 static void
 ical_store_event(char *mesg, char *note, time_t day, time_t end,
-		 struct rpt *rpt, llist_t *exc, const char *fmt_ev,
+		 struct rpt *rpt, exc_list_t *exc, const char *fmt_ev,
 		 const char *fmt_rev)
 {
 	const int EVENTID = 1;
@@ -533,7 +513,7 @@ ical_store_event(char *mesg, char *note, time_t day, time_t end,
 		rpt->exc = *exc;
 		rev = recur_event_new(mesg, note, day, EVENTID, rpt);
 		if (fmt_rev)
-			print_recur_event(fmt_rev, day, rev);
+			print_recur_event(NULL, fmt_rev, day, rev);
 		goto cleanup;
 	}
 
@@ -541,7 +521,7 @@ ical_store_event(char *mesg, char *note, time_t day, time_t end,
 	if (end - day <= DAYINSEC) {
 		ev = event_new(mesg, note, day, EVENTID);
 		if (fmt_ev)
-			print_event(fmt_ev, day, ev);
+			print_event(NULL, fmt_ev, day, ev);
 		goto cleanup;
 	}
 
@@ -557,10 +537,11 @@ ical_store_event(char *mesg, char *note, time_t day, time_t end,
 	LLIST_INIT(&tmp.bymonth);
 	LLIST_INIT(&tmp.bywday);
 	LLIST_INIT(&tmp.bymonthday);
+	recur_rpt_compile(&tmp);
 	tmp.exc = *exc;
 	rev = recur_event_new(mesg, note, day, EVENTID, &tmp);
 	if (fmt_rev)
-		print_recur_event(fmt_rev, day, rev);
+		print_recur_event(NULL, fmt_rev, day, rev);
 
 cleanup:
 	mem_free(mesg);
@@ -569,7 +550,7 @@ cleanup:
 
 static void
 ical_store_apoint(char *mesg, char *note, time_t start, long dur,
-		  struct rpt *rpt, llist_t *exc, int has_alarm,
+		  struct rpt *rpt, exc_list_t *exc, int has_alarm,
 		  const char *fmt_apt, const char *fmt_rapt)
 {
 	char state = 0L;
@@ -604,11 +585,12 @@ ical_store_apoint(char *mesg, char *note, time_t start, long dur,
 		rpt->exc = *exc;
 		rapt = recur_apoint_new(mesg, note, start, dur, state, rpt);
 		if (fmt_rapt)
-			print_recur_apoint(fmt_rapt, start, rapt->start, rapt);
+			print_recur_apoint(NULL, fmt_rapt, start, rapt->start,
+					   rapt);
 	} else {
 		apt = apoint_new(mesg, note, start, dur, state);
 		if (fmt_apt)
-			print_apoint(fmt_apt, start, apt);
+			print_apoint(NULL, fmt_apt, start, apt);
 	}
 	mem_free(mesg);
 	erase_note(&note);
@@ -1212,24 +1194,17 @@ static struct rpt *ical_read_rrule(FILE *log, char *rrulestr,
 			return NULL;
 		}
 	}
+	recur_rpt_compile(rpt);
 
 	return rpt;
 }
 
-static void ical_add_exc(llist_t * exc_head, time_t date)
-{
-	struct excp *exc = mem_malloc(sizeof(struct excp));
-	exc->st = date;
-
-	LLIST_ADD(exc_head, exc);
-}
-
 /*
  * This property defines a comma-separated list of date/time exceptions for a
  * recurring calendar component.
  */
 static int
-ical_read_exdate(llist_t * exc, FILE * log, char *exstr, unsigned *noskipped,
+ical_read_exdate(exc_list_t *exc, FILE * log, char *exstr, unsigned *noskipped,
 		 const int itemline, ical_vevent_e type)
 {
 	char *p, *q, *tzid = NULL;
@@ -1257,7 +1232,7 @@ ical_read_exdate(llist_t * exc, FILE * log, char *exstr, unsigned *noskipped,
 				 _("invalid exception."));
 			goto cleanup;
 		}
-		ical_add_exc(exc, t);
+		recur_add_exc(exc, t);
 		p = strchr(p, '\0') + 1;
 		n--;
 	}
@@ -1360,7 +1335,7 @@ ical_read_event(FILE * fdi, FILE * log, unsigned *noevents,
 	char *dtstart, *dtend, *duration, *rrule;
 	struct string s, exdate;
 	struct {
-		llist_t exc;
+		exc_list_t exc;
 		struct rpt *rpt;
 		int count;
 		char *mesg, *desc, *loc, *comm, *imp, *note;
@@ -1372,7 +1347,7 @@ ical_read_event(FILE * fdi, FILE * log, unsigned *noevents,
 
 	vevent_type = UNDEFINED;
 	memset(&vevent, 0, sizeof vevent);
-	LLIST_INIT(&vevent.exc);
+	recur_exc_init(&vevent.exc);
 	note = dtstart = dtend = duration = rrule = NULL;
 	skip_alarm = has_note = separator = has_exdate =0;
 	while (ical_readline(fdi, buf, lstore, lineno)) {
@@ -1712,7 +1687,7 @@ cleanup:
 		mem_free(vevent.mesg);
 	if (vevent.rpt)
 		mem_free(vevent.rpt);
-	LLIST_FREE(&vevent.exc);
+	recur_free_exc_list(&vevent.exc);
 }
 
 static void
@@ -34,6 +34,9 @@
  *
  */
 
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -68,6 +71,8 @@ HTABLE_PROTOTYPE(ht_keybindings, ht_keybindings_s)
 static int modified = 0;
 static char apts_sha1[SHA1_DIGESTLEN * 2 + 1];
 static char todo_sha1[SHA1_DIGESTLEN * 2 + 1];
+static struct io_fstat apts_fstat, todo_fstat;
+static mode_t io_umask;
 
 /* Ask user for a file name to export data to. */
 static FILE *get_export_stream(enum export_type type)
@@ -147,6 +152,13 @@ void io_init(const char *cfile, const char *datadir, const char *confdir)
 	char* home_dir = getenv("HOME");
 	char* legacy_dir = NULL;
 
+	/*
+	 * The umask can only be read by setting it, which must not happen once
+	 * other threads might create files. See io_write_file().
+	 */
+	io_umask = umask(0);
+	umask(io_umask);
+
 	if (home_dir) {
 		asprintf(&legacy_dir, "%s%s", home_dir, "/" DIR_NAME_LEGACY);
 		if (!io_dir_exists(legacy_dir)) {
@@ -196,6 +208,8 @@ void io_init(const char *cfile, const char *datadir, const char *confdir)
 	asprintf(&path_dpid, "%s%s", path_ddir, DPID_PATH_NAME);
 	asprintf(&path_notes, "%s%s", path_ddir, NOTES_DIR_NAME);
 	asprintf(&path_dmon_log, "%s%s", path_ddir, DLOG_PATH_NAME);
+	asprintf(&path_spid, "%s%s", path_ddir, SPID_PATH_NAME);
+	asprintf(&path_ssock, "%s%s", path_ddir, SSOCK_PATH_NAME);
 
 	/* Configuration files */
 	asprintf(&path_conf, "%s%s", path_cdir, CONF_PATH_NAME);
@@ -216,6 +230,156 @@ void io_extract_data(char *dst_data, const char *org, int len)
 	*dst_data = '\0';
 }
 
+/*
+ * Scanning helpers for the data file loaders. They work on a NUL-terminated
+ * in-memory copy of the file and behave like the fscanf() directives they
+ * replace: leading white space (including newlines) is skipped.
+ */
+void io_scan_space(char **s)
+{
+	while (isspace((unsigned char)**s))
+		(*s)++;
+}
+
+/* Skip white space and match the given character. */
+int io_scan_char(char **s, char c)
+{
+	io_scan_space(s);
+	if (**s != c)
+		return 0;
+	(*s)++;
+	return 1;
+}
+
+/* Read a decimal integer with an optional sign. */
+int io_scan_int(char **s, int *n)
+{
+	char *p = *s;
+	long long v = 0;
+	int neg = 0;
+
+	io_scan_space(&p);
+	if (*p == '-' || *p == '+')
+		neg = (*p++ == '-');
+	if (!isdigit((unsigned char)*p))
+		return 0;
+	for (; isdigit((unsigned char)*p); p++) {
+		if (v <= INT_MAX)
+			v = v * 10 + (*p - '0');
+	}
+	if (v > INT_MAX)
+		v = INT_MAX;
+
+	*n = neg ? -v : v;
+	*s = p;
+	return 1;
+}
+
+/* Read a date in the "mm/dd/yyyy" format used by the data files. */
+int io_scan_date(char **s, int *mon, int *day, int *year)
+{
+	return io_scan_int(s, mon) && io_scan_char(s, '/') &&
+	    io_scan_int(s, day) && io_scan_char(s, '/') &&
+	    io_scan_int(s, year);
+}
+
+/* Return the next character of a buffer, or EOF at its end. */
+static int io_scan_getc(char **s, const char *end)
+{
+	return *s < end ? (unsigned char)*(*s)++ : EOF;
+}
+
+/*
+ * Cut the rest of the current line out of the buffer in place and move on to
+ * the next one. Returns NULL at the end of the buffer.
+ */
+static char *io_scan_line(char **s, char *end)
+{
+	char *line = *s, *nl;
+
+	if (line >= end)
+		return NULL;
+
+	nl = memchr(line, '\n', end - line);
+	if (nl) {
+		*nl = '\0';
+		*s = nl + 1;
+	} else {
+		*s = end;
+	}
+	return line;
+}
+
+void io_fstat_set(struct io_fstat *fs, struct stat *st)
+{
+	fs->valid = 1;
+	fs->dev = st->st_dev;
+	fs->ino = st->st_ino;
+	fs->size = st->st_size;
+	fs->mtime = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	fs->mtime_nsec = st->st_mtim.tv_nsec;
+#else
+	fs->mtime_nsec = 0;
+#endif
+	fs->checked = time(NULL);
+}
+
+/*
+ * Check whether a file still has the recorded status. A file modified shortly
+ * before its status was recorded could have been changed again since, within
+ * the resolution of the modification time; it is never taken as unchanged.
+ */
+int io_fstat_same(struct io_fstat *fs, struct stat *st)
+{
+	return fs->valid &&
+	    fs->dev == st->st_dev &&
+	    fs->ino == st->st_ino &&
+	    fs->size == st->st_size &&
+	    fs->mtime == st->st_mtime &&
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	    fs->mtime_nsec == st->st_mtim.tv_nsec &&
+#endif
+	    fs->checked > st->st_mtime + 1;
+}
+
+/*
+ * Read a whole data file into memory. The buffer is NUL-terminated so that
+ * the scanning helpers never run past its end. The data is hashed as it is
+ * read, and the status of the file is recorded along with the hash.
+ */
+static char *io_read_file(FILE *fp, size_t *len, char *sha1,
+			  struct io_fstat *fs)
+{
+	struct stat st;
+	size_t size = BUFSIZ, n = 0, r;
+	sha1_ctx_t ctx;
+	char *buf;
+
+	fs->valid = 0;
+	if (fstat(fileno(fp), &st) == 0) {
+		if (st.st_size > 0)
+			size = st.st_size + 2;
+		io_fstat_set(fs, &st);
+	}
+	buf = mem_malloc(size);
+
+	sha1_init(&ctx);
+	while ((r = fread(buf + n, 1, size - n - 1, fp)) > 0) {
+		sha1_update(&ctx, (uint8_t *)buf + n, r);
+		n += r;
+		if (n == size - 1) {
+			size *= 2;
+			buf = mem_realloc(buf, size, 1);
+		}
+	}
+	buf[n] = '\0';
+	sha1_final_hex(&ctx, sha1);
+
+	*len = n;
+	return buf;
+}
+
 static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t io_periodic_save_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -238,106 +402,266 @@ void io_dump_apts(const char *fmt_apt, const char *fmt_rapt,
 	LLIST_FOREACH(&recur_elist, i) {
 		struct recur_event *rev = LLIST_GET_DATA(i);
 		time_t day = DAY(rev->day);
-		print_recur_event(fmt_rev, day, rev);
+		print_recur_event(NULL, fmt_rev, day, rev);
 	}
 
 	LLIST_TS_FOREACH(&recur_alist_p, i) {
 		struct recur_apoint *rapt = LLIST_GET_DATA(i);
 		time_t day = DAY(rapt->start);
-		print_recur_apoint(fmt_rapt, day, rapt->start, rapt);
+		print_recur_apoint(NULL, fmt_rapt, day, rapt->start, rapt);
 	}
 
 	LLIST_TS_FOREACH(&alist_p, i) {
 		struct apoint *apt = LLIST_TS_GET_DATA(i);
 		time_t day = DAY(apt->start);
-		print_apoint(fmt_apt, day, apt);
+		print_apoint(NULL, fmt_apt, day, apt);
 	}
 
 	LLIST_FOREACH(&eventlist, i) {
 		struct event *ev = LLIST_TS_GET_DATA(i);
 		time_t day = DAY(ev->day);
-		print_event(fmt_ev, day, ev);
+		print_event(NULL, fmt_ev, day, ev);
 	}
 }
 
 /*
- * Save the apts data file, which contains the
- * appointments first, and then the events.
- * Recursive items are written first.
+ * Pass the lines of the apts data file to a function, which takes ownership of
+ * them: the recurrent items first, then the appointments and the events.
  */
-unsigned io_save_apts(const char *aptsfile)
+static void io_apts_foreach(void (*fn)(char *, void *), void *arg)
 {
 	llist_item_t *i;
-	FILE *fp;
-
-	if (aptsfile) {
-		if (read_only)
-			return 1;
 
-		if ((fp = fopen(aptsfile, "w")) == NULL)
-			return 0;
-	} else {
-		fp = stdout;
+	LLIST_FOREACH(&recur_elist, i) {
+		struct recur_event *rev = LLIST_GET_DATA(i);
+		fn(recur_event_tostr(rev), arg);
 	}
 
-	recur_save_data(fp);
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_FOREACH(&recur_alist_p, i) {
+		struct recur_apoint *rapt = LLIST_GET_DATA(i);
+		fn(recur_apoint_tostr(rapt), arg);
+	}
+	LLIST_TS_UNLOCK(&recur_alist_p);
 
 	if (ui_mode == UI_CURSES)
 		LLIST_TS_LOCK(&alist_p);
 	LLIST_TS_FOREACH(&alist_p, i) {
 		struct apoint *apt = LLIST_TS_GET_DATA(i);
-		apoint_write(apt, fp);
+		fn(apoint_tostr(apt), arg);
 	}
 	if (ui_mode == UI_CURSES)
 		LLIST_TS_UNLOCK(&alist_p);
 
 	LLIST_FOREACH(&eventlist, i) {
 		struct event *ev = LLIST_TS_GET_DATA(i);
-		event_write(ev, fp);
+		fn(event_tostr(ev), arg);
 	}
-
-	if (aptsfile)
-		file_close(fp, __FILE_POS__);
-
-	return 1;
 }
 
-/* Print all todo items to stdout. */
-void io_dump_todo(const char *fmt_todo)
+/* Pass the lines of the todo data file to a function, see above. */
+static void io_todo_foreach(void (*fn)(char *, void *), void *arg)
 {
 	llist_item_t *i;
 
 	LLIST_FOREACH(&todolist, i) {
 		struct todo *todo = LLIST_TS_GET_DATA(i);
-		print_todo(fmt_todo, todo);
+		fn(todo_tostr(todo), arg);
 	}
 }
 
-/* Save the todo data file. */
-unsigned io_save_todo(const char *todofile)
+/* Return the path a file refers to once symbolic links are followed. */
+char *io_follow_links(const char *path)
 {
-	llist_item_t *i;
-	FILE *fp;
+	char *p = mem_strdup(path), *q, *slash, target[BUFSIZ];
+	struct stat st;
+	ssize_t n;
+	int depth;
 
-	if (todofile) {
-		if (read_only)
-			return 1;
+	for (depth = 0; depth < 32; depth++) {
+		if (lstat(p, &st) != 0 || !S_ISLNK(st.st_mode))
+			break;
+		if ((n = readlink(p, target, sizeof(target) - 1)) < 0)
+			break;
+		target[n] = '\0';
+		if (target[0] != '/' && (slash = strrchr(p, '/')))
+			asprintf(&q, "%.*s/%s", (int)(slash - p), p, target);
+		else
+			q = mem_strdup(target);
+		mem_free(p);
+		p = q;
+	}
+	return p;
+}
 
-		if ((fp = fopen(todofile, "w")) == NULL)
-			return 0;
+/* Sync the directory holding a file, once the file was renamed in it. */
+static void io_sync_dir(const char *path)
+{
+	const char *p = strrchr(path, '/');
+	char *dir;
+	int fd;
+
+	if (!p)
+		dir = mem_strdup(".");
+	else if (p == path)
+		dir = mem_strdup("/");
+	else
+		asprintf(&dir, "%.*s", (int)(p - path), path);
+	if ((fd = open(dir, O_RDONLY)) >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+	mem_free(dir);
+}
+
+/*
+ * Replace a file with new contents. They are written to a temporary file next
+ * to it, which is synced and then renamed over the file, so that a crash never
+ * leaves it truncated. Symbolic links are followed, and the mode of an
+ * existing file is kept; a new file gets the mode creat() would give it. The
+ * status of the new file is stored in st if it is not NULL. Return whether
+ * the file was written.
+ */
+int io_write_file(const char *path, const char *buf, size_t len,
+		  struct stat *st)
+{
+	char *real = io_follow_links(path), *tmp;
+	struct stat st_old;
+	ssize_t n;
+	int fd, ret = 0;
+
+	path = real;
+	asprintf(&tmp, "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp)) < 0)
+		goto cleanup;
+	if (stat(path, &st_old) == 0)
+		fchmod(fd, st_old.st_mode & 07777);
+	else
+		fchmod(fd, 0666 & ~io_umask);
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+	if (len == 0 && fsync(fd) == 0 && (!st || fstat(fd, st) == 0))
+		ret = 1;
+	if (close(fd) != 0)
+		ret = 0;
+	if (ret && rename(tmp, path) != 0)
+		ret = 0;
+	if (ret)
+		io_sync_dir(path);
+	else
+		unlink(tmp);
+
+cleanup:
+	mem_free(real);
+	mem_free(tmp);
+	return ret;
+}
+
+struct io_save {
+	struct string sb;
+	sha1_ctx_t ctx;
+	char sha1[SHA1_DIGESTLEN * 2 + 1];
+};
+
+/* Add an item string to the saved data and its hash, and free it. */
+static void io_save_item(char *str, void *arg)
+{
+	struct io_save *save = arg;
+	int len = strlen(str);
+
+	string_catn(&save->sb, str, len);
+	string_catn(&save->sb, "\n", 1);
+	sha1_update(&save->ctx, (uint8_t *)str, len);
+	sha1_update(&save->ctx, (uint8_t *)"\n", 1);
+	mem_free(str);
+}
+
+/* Build the contents of a data file in memory, along with their hash. */
+static void io_save_build(enum data_file type, struct io_save *save)
+{
+	string_init(&save->sb);
+	sha1_init(&save->ctx);
+	if (type == DATA_APTS)
+		io_apts_foreach(io_save_item, save);
+	else
+		io_todo_foreach(io_save_item, save);
+	sha1_final_hex(&save->ctx, save->sha1);
+}
+
+/*
+ * Save a data file to the given file, or print it if there is none. The data
+ * file itself is left alone if the contents did not change since it was loaded
+ * or saved. Otherwise, the hash of the new contents and the status of the file
+ * are recorded, as when loading it, and its cache is rebuilt.
+ */
+static unsigned io_save_data(enum data_file type, const char *file)
+{
+	const char *path = type == DATA_APTS ? path_apts : path_todo;
+	char *sha1 = type == DATA_APTS ? apts_sha1 : todo_sha1;
+	struct io_fstat *fs = type == DATA_APTS ? &apts_fstat : &todo_fstat;
+	struct io_save save;
+	struct stat st;
+	int data_file = file && strcmp(file, path) == 0;
+	unsigned ret = 1;
+
+	if (file && read_only)
+		return 1;
+
+	io_save_build(type, &save);
+	if (!file) {
+		fwrite(save.sb.buf, 1, save.sb.len, stdout);
+	} else if (data_file && strcmp(save.sha1, sha1) == 0 &&
+		   io_file_changed(path, sha1, fs) == 0) {
+		/* Nothing to write. */
+	} else if (io_write_file(file, save.sb.buf, save.sb.len, &st)) {
+		if (data_file) {
+			strcpy(sha1, save.sha1);
+			io_fstat_set(fs, &st);
+		}
 	} else {
-		fp = stdout;
+		ret = 0;
+		data_file = 0;
 	}
 
+	if (data_file)
+		journal_remove(type);
+	mem_free(save.sb.buf);
+	return ret;
+}
+
+/*
+ * Save the apts data file, which contains the
+ * appointments first, and then the events.
+ * Recursive items are written first.
+ */
+unsigned io_save_apts(const char *aptsfile)
+{
+	return io_save_data(DATA_APTS, aptsfile);
+}
+
+/* Print all todo items to stdout. */
+void io_dump_todo(const char *fmt_todo)
+{
+	llist_item_t *i;
+
 	LLIST_FOREACH(&todolist, i) {
 		struct todo *todo = LLIST_TS_GET_DATA(i);
-		todo_write(todo, fp);
+		print_todo(NULL, fmt_todo, todo);
 	}
+}
 
-	if (todofile)
-		file_close(fp, __FILE_POS__);
-
-	return 1;
+/* Save the todo data file. */
+unsigned io_save_todo(const char *todofile)
+{
+	return io_save_data(DATA_TODO, todofile);
 }
 
 /* Save user-defined keys */
@@ -357,29 +681,72 @@ unsigned io_save_keys(void)
 	return 1;
 }
 
-static int io_compute_hash(const char *path, char *buf)
+static int io_compute_hash(const char *path, char *buf, struct stat *st)
 {
 	FILE *fp = fopen(path, "r");
 
 	if (!fp)
 		return 0;
+	if (fstat(fileno(fp), st) != 0) {
+		fclose(fp);
+		return 0;
+	}
 	sha1_stream(fp, buf);
 	fclose(fp);
 
 	return 1;
 }
 
-/* A merge implies a save operation and must be followed by reload of data. */
-static void io_merge_data(void)
+/*
+ * Check whether a data file has been changed since it was loaded or saved.
+ * The file is only hashed if its status is different. Return -1 if the file
+ * cannot be read.
+ */
+int io_file_changed(const char *path, const char *sha1, struct io_fstat *fs)
 {
-	char *path_apts_new, *path_todo_new;
-	const char *new_ext = ".new";
+	char sha1_new[SHA1_DIGESTLEN * 2 + 1];
+	struct stat st;
 
-	asprintf(&path_apts_new, "%s%s", path_apts, new_ext);
-	asprintf(&path_todo_new, "%s%s", path_todo, new_ext);
+	if (stat(path, &st) == 0 && io_fstat_same(fs, &st))
+		return 0;
+	if (!io_compute_hash(path, sha1_new, &st))
+		return -1;
+	if (strncmp(sha1_new, sha1, SHA1_DIGESTLEN * 2) != 0)
+		return 1;
 
-	io_save_apts(path_apts_new);
-	io_save_todo(path_todo_new);
+	io_fstat_set(fs, &st);
+	return 0;
+}
+
+/*
+ * Write a data file as it is in memory to a new file next to it, for the merge
+ * tool. Return the path of the new file, or NULL if there is nothing to merge.
+ */
+static char *io_merge_prepare(enum data_file type)
+{
+	const char *path = type == DATA_APTS ? path_apts : path_todo;
+	char sha1[SHA1_DIGESTLEN * 2 + 1], *path_new = NULL;
+	struct io_save save;
+	struct stat st;
+
+	io_save_build(type, &save);
+	if (!io_compute_hash(path, sha1, &st) || strcmp(sha1, save.sha1)) {
+		asprintf(&path_new, "%s.new", path);
+		if (read_only || !io_write_file(path_new, save.sb.buf,
+						save.sb.len, NULL)) {
+			mem_free(path_new);
+			path_new = NULL;
+		}
+	}
+	mem_free(save.sb.buf);
+	return path_new;
+}
+
+/* A merge implies a save operation and must be followed by reload of data. */
+static void io_merge_data(void)
+{
+	char *path_apts_new = io_merge_prepare(DATA_APTS);
+	char *path_todo_new = io_merge_prepare(DATA_TODO);
 
 	/*
 	 * We do not directly write to the data files here; however, the
@@ -388,13 +755,13 @@ static void io_merge_data(void)
 	 */
 	run_hook("pre-save");
 
-	if (!io_files_equal(path_apts, path_apts_new)) {
+	if (path_apts_new) {
 		const char *arg_apts[] = { conf.mergetool, path_apts,
 					   path_apts_new, NULL };
 		wins_launch_external(arg_apts);
 	}
 
-	if (!io_files_equal(path_todo, path_todo_new)) {
+	if (path_todo_new) {
 		const char *arg_todo[] = { conf.mergetool, path_todo,
 					   path_todo_new, NULL };
 		wins_launch_external(arg_todo);
@@ -403,6 +770,10 @@ static void io_merge_data(void)
 	mem_free(path_apts_new);
 	mem_free(path_todo_new);
 
+	/* The merged files include the changes saved to the journals. */
+	journal_remove(DATA_APTS);
+	journal_remove(DATA_TODO);
+
 	/*
 	 * We do not directly write to the data files here; however, the
 	 * external merge tool will likely have incorporated changes from the
@@ -462,30 +833,85 @@ static int resolve_save_conflict(void)
 #define NOKNOW		-1
 static int new_data()
 {
-	char sha1_new[SHA1_DIGESTLEN * 2 + 1];
-	int ret = NONEW;
+	int ret = NONEW, changed;
+
+	changed = io_file_changed(path_apts, apts_sha1, &apts_fstat);
+	if (changed == 0)
+		changed = journal_changed(DATA_APTS);
+	if (changed < 0)
+		return NOKNOW;
+	if (changed)
+		ret |= APTS;
+
+	changed = io_file_changed(path_todo, todo_sha1, &todo_fstat);
+	if (changed == 0)
+		changed = journal_changed(DATA_TODO);
+	if (changed < 0)
+		return NOKNOW;
+	if (changed)
+		ret |= TODO;
 
-	if (io_compute_hash(path_apts, sha1_new)) {
-		if (strncmp(sha1_new, apts_sha1, SHA1_DIGESTLEN * 2) != 0) {
-			ret |= APTS;
-		}
-	} else {
-		ret = NOKNOW;
-		goto exit;
-	}
+	return ret;
+}
+
+static void io_collect_item(char *str, void *arg)
+{
+	VECTOR_ADD((vector_t *)arg, str);
+}
+
+/*
+ * Compare the items of a data file with the saved ones, see journal_prepare().
+ * Return 0 if the data file has to be written.
+ */
+static int io_journal_prepare(enum data_file type)
+{
+	const char *path = type == DATA_APTS ? path_apts : path_todo;
+	char *sha1 = type == DATA_APTS ? apts_sha1 : todo_sha1;
+	struct io_fstat *fs = type == DATA_APTS ? &apts_fstat : &todo_fstat;
+	vector_t lines;
+	unsigned i;
+	int ret;
+
+	if (io_file_changed(path, sha1, fs) != 0)
+		return 0;
+
+	VECTOR_INIT(&lines, 1024);
+	if (type == DATA_APTS)
+		io_apts_foreach(io_collect_item, &lines);
+	else
+		io_todo_foreach(io_collect_item, &lines);
+	ret = journal_prepare(type, sha1, fs, &lines);
+	VECTOR_FOREACH(&lines, i)
+		mem_free(VECTOR_NTH(&lines, i));
+	VECTOR_FREE(&lines);
 
-	if (io_compute_hash(path_todo, sha1_new)) {
-		if (strncmp(sha1_new, todo_sha1, SHA1_DIGESTLEN * 2) != 0) {
-			ret |= TODO;
-		}
-	} else {
-		ret = NOKNOW;
-		goto exit;
-	}
-   exit:
 	return ret;
 }
 
+/*
+ * Save a data file, or the changes to its journal if io_journal_prepare()
+ * succeeded.
+ */
+static unsigned io_save_file(enum data_file type, int journal)
+{
+	if (journal)
+		return journal_commit(type);
+	return type == DATA_APTS ? io_save_apts(path_apts) :
+	    io_save_todo(path_todo);
+}
+
+/*
+ * Save both data files from the command line, through their journals if they
+ * are enabled.
+ */
+unsigned io_save_files(void)
+{
+	int apts = conf.journal && io_journal_prepare(DATA_APTS);
+	int todo = conf.journal && io_journal_prepare(DATA_TODO);
+
+	return io_save_file(DATA_APTS, apts) && io_save_file(DATA_TODO, todo);
+}
+
 /*
  * Save the calendar data.
  * The return value tells how a possible save conflict should be/was resolved:
@@ -497,7 +923,7 @@ static int new_data()
  */
 int io_save_cal(enum save_type s_t)
 {
-	int ret, new;
+	int ret, new, apts, todo;
 
 	if (read_only)
 		return IO_SAVE_CANCEL;
@@ -522,297 +948,559 @@ int io_save_cal(enum save_type s_t)
 		}
 
 	ret = IO_SAVE_CTINUE;
-	run_hook("pre-save");
-	if (io_save_todo(path_todo) &&
-	    io_save_apts(path_apts)) {
-		io_compute_hash(path_apts, apts_sha1);
-		io_compute_hash(path_todo, todo_sha1);
+	apts = !new && conf.journal && io_journal_prepare(DATA_APTS);
+	todo = !new && conf.journal && io_journal_prepare(DATA_TODO);
+	/*
+	 * Changes only saved to the journals are not in the data files yet, the
+	 * hooks are run once they are folded back, see io_compact_data().
+	 */
+	if (!apts || !todo)
+		run_hook("pre-save");
+	if (io_save_file(DATA_TODO, todo) && io_save_file(DATA_APTS, apts))
 		io_unset_modified();
-	} else
+	else
 		ret = IO_SAVE_ERROR;
-	run_hook("post-save");
+	if (!apts || !todo)
+		run_hook("post-save");
 
 cleanup:
 	io_mutex_unlock();
 	return ret;
 }
 
+/*
+ * Fold the journals back into the data files before exiting. Unsaved changes
+ * are not written.
+ */
+void io_compact_data(void)
+{
+	if (read_only ||
+	    !(journal_pending(DATA_APTS) || journal_pending(DATA_TODO)))
+		return;
+
+	io_mutex_lock();
+	run_hook("pre-save");
+	journal_compact(DATA_TODO);
+	journal_compact(DATA_APTS);
+	run_hook("post-save");
+	io_mutex_unlock();
+}
+
 static void io_load_error(const char *filename, unsigned line,
 			  const char *mesg)
 {
 	EXIT("%s:%u: %s", filename, line, mesg);
 }
 
+/*
+ * Part of the appointment file, parsed on its own by io_load_chunk(). The
+ * items are collected in vectors and only added to the lists afterwards.
+ */
+struct io_chunk {
+	char *start;		/* first item */
+	char *end;		/* no new item is started from here on */
+	char *bufend;		/* end of the data the items may extend into */
+	struct item_filter *filter;
+	unsigned items;		/* number of items read */
+	char *error;		/* error found in the last item, if any */
+	char *stop;		/* where parsing stopped */
+	vector_t apts, events, rapts, revents;
+	pthread_t thread;
+};
+
+/*
+ * Files are only split when each chunk gets at least this many bytes, and
+ * into at most IO_LOAD_MAXJOBS chunks.
+ */
+#define IO_LOAD_MINCHUNK	(64 * 1024)
+#define IO_LOAD_MAXJOBS		8
+
+static void io_chunk_init(struct io_chunk *ck, char *start, char *end,
+			  char *bufend, struct item_filter *filter)
+{
+	ck->start = start;
+	ck->end = end;
+	ck->bufend = bufend;
+	ck->filter = filter;
+	ck->items = 0;
+	ck->error = NULL;
+	ck->stop = start;
+	VECTOR_INIT(&ck->apts, 16);
+	VECTOR_INIT(&ck->events, 16);
+	VECTOR_INIT(&ck->rapts, 16);
+	VECTOR_INIT(&ck->revents, 16);
+}
+
+/* Add the items of a chunk to the lists. */
+static void io_chunk_add(struct io_chunk *ck)
+{
+	apoint_add_all(&ck->apts);
+	event_add_all(&ck->events);
+	recur_apoint_add_all(&ck->rapts);
+	recur_event_add_all(&ck->revents);
+}
+
+static void io_chunk_free(struct io_chunk *ck, int free_items)
+{
+	if (free_items) {
+		VECTOR_FREE_INNER(&ck->apts, apoint_free);
+		VECTOR_FREE_INNER(&ck->events, event_free);
+		VECTOR_FREE_INNER(&ck->rapts, recur_apoint_free);
+		VECTOR_FREE_INNER(&ck->revents, recur_event_free);
+	}
+	VECTOR_FREE(&ck->apts);
+	VECTOR_FREE(&ck->events);
+	VECTOR_FREE(&ck->rapts);
+	VECTOR_FREE(&ck->revents);
+}
+
 /*
  * Check what type of data is written in the appointment file,
  * and then load either: a new appointment, a new event, or a new
  * recursive item (which can also be either an event or an appointment).
+ * Return an error message, or NULL if the item was read.
  */
-void io_load_app(struct item_filter *filter)
+static char *io_load_item(char **pp, struct io_chunk *ck)
 {
-	FILE *data_file;
+	char *p = *pp, *bufend = ck->bufend;
 	int c, is_appointment, is_event, is_recursive;
-	struct tm start, end, until, lt;
+	struct tm start, end, until;
 	struct rpt rpt;
-	time_t t;
 	int id = 0;
 	char type, state = 0L;
-	char note[MAX_NOTESIZ + 1], *notep;
-	unsigned line = 0;
-	char *scan_error;
+	char *notep, *mesg, *err = NULL;
 
-	t = time(NULL);
-	localtime_r(&t, &lt);
-	start = end = until = lt;
+	is_appointment = is_event = is_recursive = 0;
+	memset(&start, 0, sizeof(start));
+	end = start;
 
-	data_file = fopen(path_apts, "r");
-	EXIT_IF(data_file == NULL, _("failed to open appointment file"));
+	/* Read the date first: it is common to both events
+	 * and appointments.
+	 */
+	if (!io_scan_date(&p, &start.tm_mon, &start.tm_mday, &start.tm_year))
+		return _("syntax error in the item date");
+	io_scan_space(&p);
 
-	sha1_stream(data_file, apts_sha1);
-	rewind(data_file);
+	/* Read the next character : if it is an '@' then we have
+	 * an appointment, else if it is an '[' we have en event.
+	 */
+	c = io_scan_getc(&p, bufend);
 
-	for (;;) {
-		is_appointment = is_event = is_recursive = 0;
-		line++;
-		scan_error = NULL;
+	if (c == '@')
+		is_appointment = 1;
+	else if (c == '[')
+		is_event = 1;
+	else
+		return _("no event nor appointment found");
+
+	/* Read the remaining informations. */
+	if (is_appointment) {
+		if (!io_scan_int(&p, &start.tm_hour) ||
+		    !io_scan_char(&p, ':') ||
+		    !io_scan_int(&p, &start.tm_min) ||
+		    !io_scan_char(&p, '-') ||
+		    io_scan_getc(&p, bufend) != '>' ||
+		    !io_scan_date(&p, &end.tm_mon, &end.tm_mday,
+				  &end.tm_year) ||
+		    !io_scan_char(&p, '@') ||
+		    !io_scan_int(&p, &end.tm_hour) ||
+		    !io_scan_char(&p, ':') ||
+		    !io_scan_int(&p, &end.tm_min))
+			return _("syntax error in item time or duration");
+		io_scan_space(&p);
+	} else {
+		if (!io_scan_int(&p, &id))
+			return _("syntax error in item identifier");
+		io_scan_space(&p);
+		if (io_scan_getc(&p, bufend) != ']')
+			return _("syntax error in item identifier");
+		while (*p == ' ')
+			p++;
+	}
 
-		c = getc(data_file);
-		if (c == EOF)
-			break;
-		ungetc(c, data_file);
-
-		/* Read the date first: it is common to both events
-		 * and appointments.
-		 */
-		if (fscanf(data_file, "%d / %d / %d ",
-			   &start.tm_mon, &start.tm_mday,
-			   &start.tm_year) != 3)
-			io_load_error(path_apts, line,
-				      _("syntax error in the item date"));
-
-		/* Read the next character : if it is an '@' then we have
-		 * an appointment, else if it is an '[' we have en event.
-		 */
-		c = getc(data_file);
-
-		if (c == '@')
-			is_appointment = 1;
-		else if (c == '[')
-			is_event = 1;
-		else
-			io_load_error(path_apts, line,
-				      _("no event nor appointment found"));
-
-		/* Read the remaining informations. */
-		if (is_appointment) {
-			if (fscanf
-			    (data_file,
-			     " %d : %d -> %d / %d / %d @ %d : %d ",
-			     &start.tm_hour, &start.tm_min, &end.tm_mon,
-			     &end.tm_mday, &end.tm_year, &end.tm_hour,
-			     &end.tm_min) != 7)
-				io_load_error(path_apts, line,
-					      _("syntax error in item time or duration"));
-		} else if (is_event) {
-			if (fscanf(data_file, " %d ", &id) != 1
-			    || getc(data_file) != ']')
-				io_load_error(path_apts, line,
-					      _("syntax error in item identifier"));
-			while ((c = getc(data_file)) == ' ') ;
-			ungetc(c, data_file);
-		} else {
-			io_load_error(path_apts, line,
-				      _("wrong format in the appointment or event"));
-			/* NOTREACHED */
+	/* Check if we have a recursive item. */
+	c = io_scan_getc(&p, bufend);
+
+	if (c == '{') {
+		is_recursive = 1;
+		if (!io_scan_int(&p, &rpt.freq) || *p == '\0')
+			return _("syntax error in item repetition");
+		type = *p++;
+		if (!strchr("DWMY", type))
+			return _("unknown character");
+		rpt.type = recur_char2def(type);
+		io_scan_space(&p);
+		c = io_scan_getc(&p, bufend);
+		/* Optional until date */
+		if (c == '-' && io_scan_getc(&p, bufend) == '>') {
+			if (!io_scan_date(&p, &until.tm_mon, &until.tm_mday,
+					  &until.tm_year))
+				return _("syntax error in until date");
+			if (!check_date(until.tm_year, until.tm_mon,
+					until.tm_mday))
+				return _("until date error");
+			struct date d = { until.tm_mday, until.tm_mon,
+					  until.tm_year };
+			rpt.until = date2sec(d, 0, 0);
+			io_scan_space(&p);
+			c = io_scan_getc(&p, bufend);
+		} else
+			rpt.until = 0;
+		LLIST_INIT(&rpt.bymonthday);
+		LLIST_INIT(&rpt.bywday);
+		LLIST_INIT(&rpt.bymonth);
+		recur_exc_init(&rpt.exc);
+		err = NULL;
+		/* Optional bymonthday list */
+		if (c == 'd') {
+			if (rpt.type == RECUR_WEEKLY)
+				return _("BYMONTHDAY illegal with WEEKLY");
+			p--;
+			err = recur_bymonthday(&rpt.bymonthday, &p);
+			c = io_scan_getc(&p, bufend);
 		}
-
-		/* Check if we have a recursive item. */
-		c = getc(data_file);
-
-		if (c == '{') {
-			is_recursive = 1;
-			if (fscanf(data_file, " %d%c ", &rpt.freq, &type) != 2)
-				io_load_error(path_apts, line,
-					      _("syntax error in item repetition"));
-			else
-				rpt.type = recur_char2def(type);
-			c = getc(data_file);
-			/* Optional until date */
-			if (c == '-' && getc(data_file) == '>') {
-				if (fscanf
-				    (data_file, " %d / %d / %d ",
-				     &until.tm_mon, &until.tm_mday,
-				     &until.tm_year) != 3)
-					io_load_error(path_apts, line,
-						      _("syntax error in until date"));
-				if (!check_date(until.tm_year, until.tm_mon,
-						until.tm_mday))
-					io_load_error(path_apts, line,
-						      _("until date error"));
-				until.tm_hour = 0;
-				until.tm_min = 0;
-				until.tm_sec = 0;
-				until.tm_isdst = -1;
-				until.tm_year -= 1900;
-				until.tm_mon--;
-				rpt.until = mktime(&until);
-				c = getc(data_file);
-			} else
-				rpt.until = 0;
-			/* Optional bymonthday list */
-			if (c == 'd') {
-				if (rpt.type == RECUR_WEEKLY)
-					io_load_error(path_apts, line,
-						      _("BYMONTHDAY illegal with WEEKLY"));
-				ungetc(c, data_file);
-				recur_bymonthday(&rpt.bymonthday, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bymonthday);
-			/* Optional bywday list */
-			if (c == 'w') {
-				ungetc(c, data_file);
-				recur_bywday(rpt.type, &rpt.bywday, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bywday);
-			/* Optional bymonth list */
-			if (c == 'm') {
-				ungetc(c, data_file);
-				recur_bymonth(&rpt.bymonth, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.bymonth);
-			/* Optional exception dates */
-			if (c == '!') {
-				ungetc(c, data_file);
-				recur_exc_scan(&rpt.exc, data_file);
-				c = getc(data_file);
-			} else
-				LLIST_INIT(&rpt.exc);
-			/* End of recurrence rule */
-			if (c != '}')
-				io_load_error(path_apts, line,
-					      _("missing end of recurrence"));
-			while ((c = getc(data_file)) == ' ') ;
+		/* Optional bywday list */
+		if (!err && c == 'w') {
+			p--;
+			err = recur_bywday(rpt.type, &rpt.bywday, &p);
+			c = io_scan_getc(&p, bufend);
+		}
+		/* Optional bymonth list */
+		if (!err && c == 'm') {
+			p--;
+			err = recur_bymonth(&rpt.bymonth, &p);
+			c = io_scan_getc(&p, bufend);
+		}
+		if (!err)
+			recur_rpt_compile(&rpt);
+		/* Optional exception dates */
+		if (!err && c == '!') {
+			p--;
+			err = recur_exc_scan(&rpt.exc, &p);
+			c = io_scan_getc(&p, bufend);
 		}
+		/* End of recurrence rule */
+		if (!err && c != '}')
+			err = _("missing end of recurrence");
+		if (err) {
+			recur_free_int_list(&rpt.bymonthday);
+			recur_free_int_list(&rpt.bywday);
+			recur_free_int_list(&rpt.bymonth);
+			recur_free_exc_list(&rpt.exc);
+			return err;
+		}
+		while ((c = io_scan_getc(&p, bufend)) == ' ') ;
+	}
 
-		/* Check if a note is attached to the item. */
-		if (c == '>') {
-			note_read(note, data_file);
-			c = getc(data_file);
-			notep = note;
-		} else
-			notep = NULL;
+	/* Check if a note is attached to the item. */
+	if (c == '>') {
+		notep = note_read(&p);
+		c = io_scan_getc(&p, bufend);
+	} else
+		notep = NULL;
 
-		/*
-		 * Last: read the item description and load it into its
-		 * corresponding linked list, depending on the item type.
-		 */
-		if (is_appointment) {
-			if (c == '!')
-				state |= APOINT_NOTIFY;
-			else if (c == '|')
-				state = 0L;
-			else
-				io_load_error(path_apts, line,
-					      _("syntax error in item state"));
+	/*
+	 * Last: cut the item description out of the buffer and collect
+	 * the item, depending on its type.
+	 */
+	if (is_appointment) {
+		if (c == '!')
+			state |= APOINT_NOTIFY;
+		else if (c == '|')
+			state = 0L;
+		else
+			err = _("syntax error in item state");
 
+		if (!err) {
+			mesg = io_scan_line(&p, bufend);
 			if (is_recursive)
-				scan_error = recur_apoint_scan(data_file, start, end, state,
-						  notep, filter, &rpt);
-			else
-				scan_error = apoint_scan(data_file, start, end, state,
-					    notep, filter);
-		} else if (is_event) {
-			ungetc(c, data_file);
-			if (is_recursive)
-				scan_error = recur_event_scan(data_file, start, id, notep,
-						 filter, &rpt);
+				err = recur_apoint_scan(mesg, start, end,
+							state, notep,
+							ck->filter, &rpt,
+							&ck->rapts);
 			else
-				scan_error = event_scan(data_file, start, id, notep, filter);
-		} else {
-			io_load_error(path_apts, line,
-				      _("wrong format in the appointment or event"));
-			/* NOTREACHED */
+				err = apoint_scan(mesg, start, end, state,
+						  notep, ck->filter,
+						  &ck->apts);
 		}
-		if (scan_error)
-			io_load_error(path_apts, line, scan_error);
+	} else {
+		if (c != EOF)
+			p--;
+		mesg = io_scan_line(&p, bufend);
+		if (is_recursive)
+			err = recur_event_scan(mesg, start, id, notep,
+					       ck->filter, &rpt,
+					       &ck->revents);
+		else
+			err = event_scan(mesg, start, id, notep, ck->filter,
+					 &ck->events);
 	}
+	if (is_recursive) {
+		recur_free_int_list(&rpt.bymonthday);
+		recur_free_int_list(&rpt.bywday);
+		recur_free_int_list(&rpt.bymonth);
+		recur_free_exc_list(&rpt.exc);
+	}
+
+	*pp = p;
+	return err;
+}
+
+/* Read the items starting in a chunk, up to the first error. */
+static void io_load_chunk(struct io_chunk *ck)
+{
+	char *p = ck->start;
+
+	while (p < ck->end) {
+		ck->items++;
+		if ((ck->error = io_load_item(&p, ck)))
+			return;
+	}
+	ck->stop = p;
+}
+
+/*
+ * Worker thread of the parallel loader. The chunk is parsed from a private
+ * copy which ends with it, so that the items of different threads never
+ * touch the same memory. If the last item would have extended beyond the
+ * chunk, it fails to parse: the chunk is then read again by the main thread,
+ * from the original data.
+ */
+static void *io_load_chunk_thread(void *arg)
+{
+	struct io_chunk *ck = arg;
+	char *start = ck->start, *end = ck->end;
+	size_t len = end - start;
+	char *copy = mem_malloc(len + 1);
+
+	memcpy(copy, start, len);
+	copy[len] = '\0';
+	ck->start = copy;
+	ck->end = ck->bufend = copy + len;
+
+	io_load_chunk(ck);
+
+	ck->stop = (ck->stop == ck->end) ? end : NULL;
+	ck->start = start;
+	ck->end = ck->bufend = end;
+	mem_free(copy);
+
+	return NULL;
+}
+
+/*
+ * Split the appointment file at line boundaries and parse the chunks in
+ * parallel. Return the number of chunks, or 0 if the file is read by the
+ * main thread alone.
+ */
+static unsigned io_load_chunks_parallel(struct io_chunk *ck, char *buf,
+					char *bufend,
+					struct item_filter *filter)
+{
+	size_t len = bufend - buf;
+	long ncpu;
+	unsigned i, n;
+	char *start, *end;
+
+#ifdef CALCURSE_MEMORY_DEBUG
+	/* The memory debugging code is not thread-safe. */
+	return 0;
+#endif
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	n = len / IO_LOAD_MINCHUNK;
+	if (ncpu < n)
+		n = ncpu > 0 ? ncpu : 1;
+	if (n > IO_LOAD_MAXJOBS)
+		n = IO_LOAD_MAXJOBS;
+	if (n < 2)
+		return 0;
+
+	for (i = 0, start = buf; i < n && start < bufend; i++) {
+		end = (i == n - 1) ? bufend : buf + len / n * (i + 1);
+		if (end < start)
+			end = start;
+		end = memchr(end, '\n', bufend - end);
+		end = end ? end + 1 : bufend;
+		io_chunk_init(&ck[i], start, end, end, filter);
+		start = end;
+	}
+	n = i;
+
+	/* Chunks without a thread are left to the main thread. */
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&ck[i].thread, NULL, io_load_chunk_thread,
+				   &ck[i]))
+			break;
+	}
+	while (i > 0)
+		pthread_join(ck[--i].thread, NULL);
+
+	return n;
+}
+
+/*
+ * Load the appointment file. Large files are parsed by several threads; the
+ * items are then added to the lists in file order, so that the outcome is the
+ * same as parsing the file in a single pass. This includes the item number
+ * reported with the first error.
+ */
+void io_load_app(struct item_filter *filter)
+{
+	FILE *data_file;
+	char *buf, *p, *bufend;
+	size_t len;
+	unsigned line = 0, i, n;
+	struct io_chunk ck[IO_LOAD_MAXJOBS], seq;
+	int journal = journal_open(DATA_APTS);
+
+	if (!journal &&
+	    cache_load(DATA_APTS, filter, NULL, apts_sha1, &apts_fstat))
+		return;
+
+	data_file = fopen(path_apts, "r");
+	EXIT_IF(data_file == NULL, _("failed to open appointment file"));
+
+	buf = io_read_file(data_file, &len, apts_sha1, &apts_fstat);
 	file_close(data_file, __FILE_POS__);
+
+	if (journal) {
+		journal_replay(DATA_APTS, apts_sha1, &buf, &len);
+	} else if (cache_load(DATA_APTS, filter, apts_sha1, NULL,
+			      &apts_fstat)) {
+		mem_free(buf);
+		return;
+	}
+	p = buf;
+	bufend = buf + len;
+
+	n = io_load_chunks_parallel(ck, buf, bufend, filter);
+
+	/*
+	 * Take the chunks in file order. A chunk which did not end exactly
+	 * at its boundary (or which failed) is read again sequentially;
+	 * chunks covered by that are dropped.
+	 */
+	for (i = 0; i < n; i++) {
+		if (ck[i].end <= p) {
+			io_chunk_free(&ck[i], 1);
+			continue;
+		}
+		if (ck[i].start == p && ck[i].stop == ck[i].end) {
+			io_chunk_add(&ck[i]);
+			io_chunk_free(&ck[i], 0);
+			line += ck[i].items;
+			p = ck[i].end;
+			continue;
+		}
+		io_chunk_free(&ck[i], 1);
+
+		io_chunk_init(&seq, p, ck[i].end, bufend, filter);
+		io_load_chunk(&seq);
+		io_chunk_add(&seq);
+		io_chunk_free(&seq, 0);
+		if (seq.error)
+			io_load_error(path_apts, line + seq.items, seq.error);
+		line += seq.items;
+		p = seq.stop;
+	}
+
+	if (p < bufend) {
+		io_chunk_init(&seq, p, bufend, bufend, filter);
+		io_load_chunk(&seq);
+		io_chunk_add(&seq);
+		io_chunk_free(&seq, 0);
+		if (seq.error)
+			io_load_error(path_apts, line + seq.items, seq.error);
+	}
+
+	mem_free(buf);
+	if (!journal)
+		cache_update(DATA_APTS, filter, apts_sha1, &apts_fstat);
 }
 
 /* Load the todo data */
 void io_load_todo(struct item_filter *filter)
 {
 	FILE *data_file;
-	char *newline;
-	int c, id, completed, cond;
-	char buf[BUFSIZ], e_todo[BUFSIZ], note[MAX_NOTESIZ + 1];
+	int id, completed, cond;
+	char *buf, *p, *bufend, *notep, *e_todo;
+	size_t len;
 	unsigned line = 0;
+	int journal = journal_open(DATA_TODO);
+
+	if (!journal &&
+	    cache_load(DATA_TODO, filter, NULL, todo_sha1, &todo_fstat))
+		return;
 
 	data_file = fopen(path_todo, "r");
 	EXIT_IF(data_file == NULL, _("failed to open todo file"));
 
-	sha1_stream(data_file, todo_sha1);
-	rewind(data_file);
+	buf = io_read_file(data_file, &len, todo_sha1, &todo_fstat);
+	file_close(data_file, __FILE_POS__);
+
+	if (journal) {
+		journal_replay(DATA_TODO, todo_sha1, &buf, &len);
+	} else if (cache_load(DATA_TODO, filter, todo_sha1, NULL,
+			      &todo_fstat)) {
+		mem_free(buf);
+		return;
+	}
+	p = buf;
+	bufend = buf + len;
 
 	for (;;) {
 		line++;
-		c = getc(data_file);
-		if (c == EOF) {
+		if (p >= bufend) {
 			break;
-		} else if (c == '[') {
+		} else if (*p == '[') {
 			/* new style with id */
-			c = getc(data_file);
-			if (c == '-') {
+			p++;
+			if (*p == '-') {
 				completed = 1;
+				p++;
 			} else {
 				completed = 0;
-				ungetc(c, data_file);
 			}
-			if (fscanf(data_file, " %d ", &id) != 1
-			    || getc(data_file) != ']')
+			if (!io_scan_int(&p, &id))
+				io_load_error(path_todo, line,
+					      _("syntax error in item identifier"));
+			io_scan_space(&p);
+			if (io_scan_getc(&p, bufend) != ']')
 				io_load_error(path_todo, line,
 					      _("syntax error in item identifier"));
-			while ((c = getc(data_file)) == ' ') ;
-			ungetc(c, data_file);
+			while (*p == ' ')
+				p++;
 		} else {
 			id = 9;
 			completed = 0;
-			ungetc(c, data_file);
 		}
 		/* Now read the attached note, if any. */
-		c = getc(data_file);
-		if (c == '>') {
-			note_read(note, data_file);
+		if (*p == '>') {
+			p++;
+			notep = note_read(&p);
 		} else {
-			note[0] = '\0';
-			ungetc(c, data_file);
+			notep = NULL;
 		}
-		/* Then read todo description. */
-		if (!fgets(buf, sizeof buf, data_file))
-			buf[0] = '\0';
-		newline = strchr(buf, '\n');
-		if (newline)
-			*newline = '\0';
-		io_extract_data(e_todo, buf, sizeof buf);
+		/* Then cut the todo description out of the buffer. */
+		if (!(e_todo = io_scan_line(&p, bufend)))
+			e_todo = "";
+		for (; *e_todo == ' ' || *e_todo == '\t'; e_todo++) ;
 
 		/* Filter item. */
 		struct todo *todo = NULL;
 		if (filter) {
 			cond = (
 				!(filter->type_mask & TYPE_MASK_TODO) ||
-				(filter->regex && regexec(filter->regex, e_todo, 0, 0, 0)) ||
+				(filter->pattern && !pattern_match(filter->pattern, e_todo)) ||
 				(filter->priority && id != filter->priority) ||
 				(filter->completed && !completed) ||
 				(filter->uncompleted && completed)
 			);
 			if (filter->hash) {
-				todo = todo_add(e_todo, id, completed, note);
-				char *hash = todo_hash(todo);
-				cond = cond || !hash_matches(filter->hash, hash);
-				mem_free(hash);
+				todo = todo_add(e_todo, id, completed, notep);
+				cond = cond || !hash_matches(filter->hash,
+							     todo_hash(todo));
 			}
 
 			if ((!filter->invert && cond) || (filter->invert && !cond)) {
@@ -823,9 +1511,376 @@ void io_load_todo(struct item_filter *filter)
 		}
 
 		if (!todo)
-			todo = todo_add(e_todo, id, completed, note);
+			todo = todo_add(e_todo, id, completed, notep);
+	}
+	mem_free(buf);
+	if (!journal)
+		cache_update(DATA_TODO, filter, todo_sha1, &todo_fstat);
+}
+
+/*
+ * Item of the appointment lists, matched against the lines of the appointment
+ * file when it is reloaded.
+ */
+struct io_reload_item {
+	uint64_t hash;
+	char *str;
+	void *item;
+	int kept;
+};
+
+/* The appointment lists, in the order used by io_apts_foreach(). */
+enum {
+	RELOAD_REVENTS,
+	RELOAD_RAPTS,
+	RELOAD_APTS,
+	RELOAD_EVENTS,
+	RELOAD_LISTS
+};
+
+struct io_reload {
+	struct io_reload_item *items;	/* in list order */
+	struct io_reload_item **sorted;	/* by hash and string */
+	unsigned n, size;
+	unsigned count[RELOAD_LISTS];	/* number of items of each list */
+};
+
+/* Span of time changed by the last load, see io_reload_span(). */
+static time_t reload_start = LONG_MIN, reload_end = LONG_MAX;
+
+static void io_reload_add(struct io_reload *r, void *item, char *str)
+{
+	struct io_reload_item *it;
+
+	if (r->n == r->size) {
+		r->size = r->size ? r->size * 2 : 64;
+		r->items = mem_realloc(r->items, r->size,
+				       sizeof(struct io_reload_item));
+	}
+	it = &r->items[r->n++];
+	it->hash = line_hash(str, strlen(str));
+	it->str = str;
+	it->item = item;
+	it->kept = 0;
+}
+
+static int io_reload_cmp(const void *a, const void *b)
+{
+	const struct io_reload_item *x = *(struct io_reload_item **)a;
+	const struct io_reload_item *y = *(struct io_reload_item **)b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return strcmp(x->str, y->str);
+}
+
+/* Collect the items of the appointment lists with their strings. */
+static void io_reload_collect(struct io_reload *r)
+{
+	llist_item_t *i;
+	unsigned k, n;
+
+	memset(r, 0, sizeof(struct io_reload));
+
+	LLIST_FOREACH(&recur_elist, i) {
+		struct recur_event *rev = LLIST_GET_DATA(i);
+		io_reload_add(r, rev, recur_event_tostr(rev));
+	}
+	r->count[RELOAD_REVENTS] = n = r->n;
+
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_FOREACH(&recur_alist_p, i) {
+		struct recur_apoint *rapt = LLIST_GET_DATA(i);
+		io_reload_add(r, rapt, recur_apoint_tostr(rapt));
+	}
+	LLIST_TS_UNLOCK(&recur_alist_p);
+	r->count[RELOAD_RAPTS] = r->n - n;
+	n = r->n;
+
+	if (ui_mode == UI_CURSES)
+		LLIST_TS_LOCK(&alist_p);
+	LLIST_TS_FOREACH(&alist_p, i) {
+		struct apoint *apt = LLIST_TS_GET_DATA(i);
+		io_reload_add(r, apt, apoint_tostr(apt));
+	}
+	if (ui_mode == UI_CURSES)
+		LLIST_TS_UNLOCK(&alist_p);
+	r->count[RELOAD_APTS] = r->n - n;
+	n = r->n;
+
+	LLIST_FOREACH(&eventlist, i) {
+		struct event *ev = LLIST_GET_DATA(i);
+		io_reload_add(r, ev, event_tostr(ev));
+	}
+	r->count[RELOAD_EVENTS] = r->n - n;
+
+	r->sorted = mem_calloc(r->n ? r->n : 1,
+			       sizeof(struct io_reload_item *));
+	for (k = 0; k < r->n; k++)
+		r->sorted[k] = &r->items[k];
+	qsort(r->sorted, r->n, sizeof(struct io_reload_item *),
+	      io_reload_cmp);
+}
+
+static void io_reload_free(struct io_reload *r)
+{
+	unsigned k;
+
+	for (k = 0; k < r->n; k++)
+		mem_free(r->items[k].str);
+	mem_free(r->items);
+	mem_free(r->sorted);
+}
+
+/*
+ * Find an item which is not kept yet among the ones with the given string,
+ * and keep it. Return whether there was one.
+ */
+static int io_reload_keep(struct io_reload *r, const char *str, size_t len)
+{
+	struct io_reload_item key, *kp = &key, **it;
+	unsigned lo = 0, hi = r->n, mid;
+	char c;
+	int cmp;
+
+	key.hash = line_hash(str, len);
+	key.str = (char *)str;
+
+	/* The string is not NUL-terminated within the file buffer. */
+	c = str[len];
+	key.str[len] = '\0';
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (io_reload_cmp(&r->sorted[mid], &kp) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (it = r->sorted + lo, cmp = 1; it < r->sorted + r->n; it++) {
+		if ((cmp = io_reload_cmp(it, &kp)) != 0 || !(*it)->kept)
+			break;
+	}
+	key.str[len] = c;
+
+	if (cmp != 0 || it == r->sorted + r->n)
+		return 0;
+	(*it)->kept = 1;
+	return 1;
+}
+
+/* Extend the span of time changed by the last load with an item. */
+static void io_reload_span_add(int list, void *item)
+{
+	time_t start, end;
+
+	switch (list) {
+	case RELOAD_REVENTS: {
+		struct recur_event *rev = item;
+		start = rev->day;
+		end = rev->rpt->until ? rev->rpt->until + DAYINSEC : LONG_MAX;
+		break;
+	}
+	case RELOAD_RAPTS: {
+		struct recur_apoint *rapt = item;
+		start = rapt->start;
+		end = rapt->rpt->until ?
+		    rapt->rpt->until + DAYINSEC + rapt->dur : LONG_MAX;
+		break;
+	}
+	case RELOAD_APTS: {
+		struct apoint *apt = item;
+		start = apt->start;
+		end = apt->start + apt->dur;
+		break;
+	}
+	default: {
+		struct event *ev = item;
+		start = ev->day;
+		end = ev->day + DAYINSEC;
+		break;
+	}
+	}
+
+	if (start < reload_start)
+		reload_start = start;
+	if (end > reload_end)
+		reload_end = end;
+}
+
+/* Return the string of an item of one of the lists. */
+static char *io_reload_tostr(int list, void *item)
+{
+	switch (list) {
+	case RELOAD_REVENTS:
+		return recur_event_tostr(item);
+	case RELOAD_RAPTS:
+		return recur_apoint_tostr(item);
+	case RELOAD_APTS:
+		return apoint_tostr(item);
+	default:
+		return event_tostr(item);
+	}
+}
+
+static void io_reload_item_free(int list, void *item)
+{
+	switch (list) {
+	case RELOAD_REVENTS:
+		recur_event_free(item);
+		break;
+	case RELOAD_RAPTS:
+		recur_apoint_free(item);
+		break;
+	case RELOAD_APTS:
+		apoint_free(item);
+		break;
+	default:
+		event_free(item);
+		break;
+	}
+}
+
+/* Remove the items of the lists which were not kept, and free them. */
+static void io_reload_remove(struct io_reload *r)
+{
+	vector_t v;
+	unsigned list, k, n = 0;
+
+	for (list = 0; list < RELOAD_LISTS; list++) {
+		VECTOR_INIT(&v, 16);
+		for (k = n; k < n + r->count[list]; k++) {
+			if (r->items[k].kept)
+				continue;
+			VECTOR_ADD(&v, r->items[k].item);
+			io_reload_span_add(list, r->items[k].item);
+		}
+		n += r->count[list];
+
+		switch (list) {
+		case RELOAD_REVENTS:
+			recur_event_remove_all(&v);
+			break;
+		case RELOAD_RAPTS:
+			recur_apoint_remove_all(&v);
+			break;
+		case RELOAD_APTS:
+			apoint_remove_all(&v);
+			break;
+		default:
+			event_remove_all(&v);
+			break;
+		}
+		VECTOR_FOREACH(&v, k)
+			io_reload_item_free(list, VECTOR_NTH(&v, k));
+		VECTOR_FREE(&v);
+	}
+}
+
+/*
+ * Drop the items read from the file which are in memory already, and extend
+ * the span of time changed with the others.
+ */
+static void io_reload_new(struct io_reload *r, int list, vector_t *v)
+{
+	unsigned i, n = 0;
+	void *item;
+	char *str;
+
+	VECTOR_FOREACH(v, i) {
+		item = VECTOR_NTH(v, i);
+		str = io_reload_tostr(list, item);
+		if (io_reload_keep(r, str, strlen(str))) {
+			io_reload_item_free(list, item);
+		} else {
+			io_reload_span_add(list, item);
+			v->data[n++] = item;
+		}
+		mem_free(str);
+	}
+	v->count = n;
+}
+
+/*
+ * Reload the appointment file by comparing its lines with the items in
+ * memory: only the lines which changed are parsed, only the items which are
+ * gone are removed, and the span of time changed is recorded. Return 0 if the
+ * file needs to be loaded as a whole instead, which is the case when there is
+ * nothing in memory or when an item cannot be read.
+ */
+static int io_reload_app(void)
+{
+	struct io_reload r;
+	struct io_chunk ck;
+	FILE *data_file;
+	char *buf, *delta, *p, *q, *nl, *bufend;
+	size_t len;
+	unsigned lines = 0;
+	int journal;
+
+	io_reload_collect(&r);
+	if (r.n == 0) {
+		io_reload_free(&r);
+		return 0;
 	}
+
+	journal = journal_open(DATA_APTS);
+	data_file = fopen(path_apts, "r");
+	EXIT_IF(data_file == NULL, _("failed to open appointment file"));
+	buf = io_read_file(data_file, &len, apts_sha1, &apts_fstat);
 	file_close(data_file, __FILE_POS__);
+	if (journal)
+		journal_replay(DATA_APTS, apts_sha1, &buf, &len);
+
+	/* Lines which are found in memory are left out. */
+	delta = mem_malloc(len + 2);
+	for (p = buf, q = delta, bufend = buf + len; p < bufend; p = nl + 1) {
+		nl = memchr(p, '\n', bufend - p);
+		if (!nl)
+			nl = bufend;
+		if (io_reload_keep(&r, p, nl - p))
+			continue;
+		memcpy(q, p, nl - p);
+		q += nl - p;
+		*q++ = '\n';
+		lines++;
+	}
+	*q = '\0';
+	mem_free(buf);
+
+	io_chunk_init(&ck, delta, q, q, NULL);
+	io_load_chunk(&ck);
+	mem_free(delta);
+	if (ck.error || ck.items != lines) {
+		io_chunk_free(&ck, 1);
+		io_reload_free(&r);
+		return 0;
+	}
+
+	/* Lines which were written differently may still be in memory. */
+	io_reload_new(&r, RELOAD_REVENTS, &ck.revents);
+	io_reload_new(&r, RELOAD_RAPTS, &ck.rapts);
+	io_reload_new(&r, RELOAD_APTS, &ck.apts);
+	io_reload_new(&r, RELOAD_EVENTS, &ck.events);
+
+	io_reload_remove(&r);
+	io_chunk_add(&ck);
+	io_chunk_free(&ck, 0);
+	io_reload_free(&r);
+
+	if (!journal)
+		cache_update(DATA_APTS, NULL, apts_sha1, &apts_fstat);
+	return 1;
+}
+
+/*
+ * Get the span of time changed by the last load of the appointment file, as
+ * the items added or removed occur between start and end. Nothing has changed
+ * if start is greater than end.
+ */
+void io_reload_span(time_t *start, time_t *end)
+{
+	*start = reload_start;
+	*end = reload_end;
 }
 
 /*
@@ -833,6 +1888,8 @@ void io_load_todo(struct item_filter *filter)
  * Unless told otherwise, the function will only load a file that has changed
  * since last saved or loaded. The new_data() return code is passed on when
  * force is false. When force is true (FORCE), the return code is of no use.
+ * Unless items are filtered, the appointment file is reloaded incrementally,
+ * see io_reload_app().
  */
 int io_load_data(struct item_filter *filter, int force)
 {
@@ -845,7 +1902,9 @@ int io_load_data(struct item_filter *filter, int force)
 	if (force == NOKNOW)
 		goto exit;
 
-	if (force & APTS) {
+	reload_start = LONG_MAX;
+	reload_end = LONG_MIN;
+	if ((force & APTS) && (filter || !io_reload_app())) {
 		apoint_llist_free();
 		event_llist_free();
 		recur_apoint_llist_free();
@@ -854,7 +1913,10 @@ int io_load_data(struct item_filter *filter, int force)
 		event_llist_init();
 		recur_apoint_llist_init();
 		recur_event_llist_init();
+		recur_invalidate_caches();
 		io_load_app(filter);
+		reload_start = LONG_MIN;
+		reload_end = LONG_MAX;
 	}
 	if (force & TODO) {
 		todo_free_list();
@@ -868,6 +1930,21 @@ int io_load_data(struct item_filter *filter, int force)
 	return force;
 }
 
+/*
+ * Check whether the data files changed since they were last loaded. Files
+ * which cannot be read, e.g. while they are being replaced, do not count as
+ * changed: they are checked again once they are written.
+ */
+int io_data_changed(void)
+{
+	int changed;
+
+	io_mutex_lock();
+	changed = new_data();
+	io_mutex_unlock();
+	return changed != NONEW && changed != NOKNOW;
+}
+
 /*
  * The return codes reflect the user choice in case of unsaved in-memory changes.
  */
@@ -1554,32 +2631,6 @@ unsigned io_get_pid(char *file)
 	return pid;
 }
 
-/*
- * Check whether two files are equal.
- */
-int io_files_equal(const char *file1, const char *file2)
-{
-	FILE *fp1, *fp2;
-	int ret = 0;
-
-	if (!file1 || !file2)
-		return 0;
-
-	fp1 = fopen(file1, "rb");
-	fp2 = fopen(file2, "rb");
-
-	while (!feof(fp1) && !feof(fp2)) {
-		if (fgetc(fp1) != fgetc(fp2))
-			goto cleanup;
-	}
-
-	ret = 1;
-cleanup:
-	fclose(fp1);
-	fclose(fp2);
-	return ret;
-}
-
 /*
  * Copy an existing file to a new location.
  */
@@ -1616,9 +2667,11 @@ void io_unset_modified(void)
 	modified = 0;
 }
 
+/* Called after any item was changed, see item_hash_get(). */
 void io_set_modified(void)
 {
 	modified = 1;
+	item_hash_invalidate();
 }
 
 int io_get_modified(void)
@@ -0,0 +1,867 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+#include "sha1.h"
+
+/*
+ * Journal of the changes saved to a data file (see the general.journal
+ * option).
+ *
+ * Instead of rewriting a large data file each time the data is saved, the
+ * lines removed from it and added to it are appended to a journal next to it,
+ * as "-<line>" and "+<line>". A line holding a single "." ends the changes of
+ * one save, and changes after the last one are ignored, so that a save which
+ * was interrupted is not half applied. The first line of the journal holds the
+ * hash of the contents of the data file it applies to; a journal that does not
+ * match the data file, e.g. because the latter was written since, is ignored.
+ *
+ * An item changed in place is recorded as a removed and an added line. The
+ * journal is replayed whenever the data file is loaded, and folded back into
+ * it when calcurse exits or when it grows too large.
+ *
+ * A journal with saves for other contents of the data file, which another
+ * program wrote in the meantime, is stale: it is left alone, with a warning,
+ * rather than applied to the wrong contents or dropped.
+ *
+ * Once a save has compared the lines with the saved ones, the contents of the
+ * data file and of the journal are kept in memory, so that later saves only
+ * write to the journal.
+ */
+
+#define JOURNAL_MAGIC "calcurse-journal "
+#define JOURNAL_HDRLEN (sizeof(JOURNAL_MAGIC) - 1 + SHA1_DIGESTLEN * 2 + 1)
+
+/* A line of the saved data, with its location in the data file or journal. */
+struct journal_line {
+	uint64_t hash;
+	off_t off;
+	unsigned len;
+	unsigned in_journal;
+};
+
+/* A distinct line from a journal, with the number of times it was added. */
+struct journal_op {
+	uint64_t hash;
+	const char *s;
+	unsigned len;
+	long count;
+};
+
+struct journal {
+	int exists;
+	char sha1[SHA1_DIGESTLEN * 2 + 1];	/* of the journal */
+	struct io_fstat fs;
+	char *buf;		/* read by journal_open() */
+	size_t len;
+	int active;		/* applies to the loaded data file */
+	int stale;		/* has saves for other contents of it */
+	char base[SHA1_DIGESTLEN * 2 + 1];	/* of the data file */
+	off_t size;		/* length of the complete saves */
+	sha1_ctx_t ctx;		/* hash of those */
+	struct journal_line *lines;	/* sorted by hash and length */
+	size_t nlines;
+	int indexed;
+	off_t base_size;
+	char *btext, *jtext;	/* saved contents, see journal_line_str() */
+	size_t blen, jlen;
+	char *batch;		/* prepared by journal_prepare() */
+	size_t batch_len;
+	struct journal_line *idx;	/* saved lines once it is written */
+	size_t nidx;
+};
+
+static struct journal journals[2];
+
+static const char *journal_data_path(enum data_file type)
+{
+	return type == DATA_APTS ? path_apts : path_todo;
+}
+
+static char *journal_path(enum data_file type)
+{
+	char *path;
+
+	asprintf(&path, "%s.journal", journal_data_path(type));
+	return path;
+}
+
+static void journal_sum(const char *buf, size_t len, char *sha1)
+{
+	sha1_ctx_t ctx;
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const uint8_t *)buf, len);
+	sha1_final_hex(&ctx, sha1);
+}
+
+/* Read a whole file, NUL-terminated. Return NULL on error. */
+static char *journal_read(int fd, size_t *len, struct stat *st)
+{
+	size_t size, n = 0;
+	ssize_t r;
+	char *buf;
+
+	if (fstat(fd, st) != 0)
+		return NULL;
+	size = st->st_size + 1;
+	buf = mem_malloc(size);
+	while ((r = read(fd, buf + n, size - n - 1)) > 0) {
+		n += r;
+		if (n == size - 1) {
+			size *= 2;
+			buf = mem_realloc(buf, size, 1);
+		}
+	}
+	if (r < 0) {
+		mem_free(buf);
+		return NULL;
+	}
+	buf[n] = '\0';
+	*len = n;
+	return buf;
+}
+
+static char *journal_read_path(const char *path, size_t *len, struct stat *st)
+{
+	int fd = open(path, O_RDONLY);
+	char *buf;
+
+	if (fd < 0)
+		return NULL;
+	buf = journal_read(fd, len, st);
+	close(fd);
+	return buf;
+}
+
+static int journal_op_cmp(const void *a, const void *b)
+{
+	const struct journal_op *x = a, *y = b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	if (x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	return memcmp(x->s, y->s, x->len);
+}
+
+static int journal_line_cmp(const void *a, const void *b)
+{
+	const struct journal_line *x = a, *y = b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	if (x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Check the header of a journal and return the length of its complete saves,
+ * or 0 if it is not a journal. The hash of the data file is stored in base.
+ */
+static size_t journal_check(const char *buf, size_t len, char *base)
+{
+	const char *p, *end = buf + len, *q;
+	size_t complete;
+
+	if (len < JOURNAL_HDRLEN ||
+	    strncmp(buf, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1) ||
+	    buf[JOURNAL_HDRLEN - 1] != '\n')
+		return 0;
+	memcpy(base, buf + sizeof(JOURNAL_MAGIC) - 1, SHA1_DIGESTLEN * 2);
+	base[SHA1_DIGESTLEN * 2] = '\0';
+
+	complete = JOURNAL_HDRLEN;
+	for (p = buf + JOURNAL_HDRLEN; p < end; p = q + 1) {
+		if (!(q = memchr(p, '\n', end - p)))
+			break;
+		if (*p == '.' && q == p + 1)
+			complete = q + 1 - buf;
+		else if (*p != '+' && *p != '-')
+			break;
+	}
+	return complete;
+}
+
+/*
+ * Collect the distinct lines added or removed by the complete saves of a
+ * journal, with their net count.
+ */
+static struct journal_op *journal_ops(const char *buf, size_t len,
+				      size_t *nops)
+{
+	const char *p, *end = buf + len, *q;
+	struct journal_op *ops;
+	size_t n = 0, i, j;
+
+	for (p = buf; p < end; p++) {
+		if (*p == '\n')
+			n++;
+	}
+	ops = mem_malloc((n ? n : 1) * sizeof(struct journal_op));
+
+	n = 0;
+	for (p = buf + JOURNAL_HDRLEN; p < end; p = q + 1) {
+		q = memchr(p, '\n', end - p);
+		if (*p == '.')
+			continue;
+		ops[n].s = p + 1;
+		ops[n].len = q - p - 1;
+		ops[n].hash = line_hash(ops[n].s, ops[n].len);
+		ops[n].count = *p == '+' ? 1 : -1;
+		n++;
+	}
+
+	qsort(ops, n, sizeof(struct journal_op), journal_op_cmp);
+	for (i = j = 0; i < n; i++) {
+		if (j > 0 && journal_op_cmp(&ops[j - 1], &ops[i]) == 0)
+			ops[j - 1].count += ops[i].count;
+		else
+			ops[j++] = ops[i];
+	}
+
+	*nops = j;
+	return ops;
+}
+
+static struct journal_op *journal_op_find(struct journal_op *ops, size_t n,
+					  uint64_t hash, const char *s,
+					  unsigned len)
+{
+	struct journal_op key = { hash, s, len, 0 };
+
+	return bsearch(&key, ops, n, sizeof(struct journal_op),
+		       journal_op_cmp);
+}
+
+/*
+ * Apply the complete saves of a journal to the contents of a data file. The
+ * resulting lines are returned in order, with the remaining lines of the data
+ * file first.
+ */
+static struct journal_line *journal_apply(const char *base, size_t blen,
+					  const char *jbuf, size_t jlen,
+					  size_t *nlines)
+{
+	const char *p, *end = base + blen, *q;
+	struct journal_op *ops, *op;
+	struct journal_line *lines;
+	size_t nops = 0, n = 0, size = 1;
+	uint64_t hash;
+	long k;
+
+	ops = jbuf ? journal_ops(jbuf, jlen, &nops) : NULL;
+	for (p = base; p < end; p++) {
+		if (*p == '\n')
+			size++;
+	}
+	for (op = ops; op < ops + nops; op++) {
+		if (op->count > 0)
+			size += op->count;
+	}
+	lines = mem_malloc(size * sizeof(struct journal_line));
+
+	for (p = base; p < end; p = q + 1) {
+		if (!(q = memchr(p, '\n', end - p)))
+			q = end;
+		hash = line_hash(p, q - p);
+		op = nops ? journal_op_find(ops, nops, hash, p, q - p) : NULL;
+		if (op && op->count < 0) {
+			op->count++;
+			continue;
+		}
+		lines[n].hash = hash;
+		lines[n].off = p - base;
+		lines[n].len = q - p;
+		lines[n].in_journal = 0;
+		n++;
+	}
+
+	for (op = ops; op < ops + nops; op++) {
+		for (k = 0; k < op->count; k++) {
+			lines[n].hash = op->hash;
+			lines[n].off = op->s - jbuf;
+			lines[n].len = op->len;
+			lines[n].in_journal = 1;
+			n++;
+		}
+	}
+
+	mem_free(ops);
+	*nlines = n;
+	return lines;
+}
+
+static void journal_reset(struct journal *j)
+{
+	mem_free(j->buf);
+	mem_free(j->lines);
+	mem_free(j->btext);
+	mem_free(j->jtext);
+	mem_free(j->batch);
+	mem_free(j->idx);
+	memset(j, 0, sizeof(struct journal));
+}
+
+/*
+ * Warn that a journal has saves for other contents of its data file, which it
+ * is kept for, rather than applied or dropped.
+ */
+static void journal_warn_stale(enum data_file type)
+{
+	char *path = journal_path(type);
+
+	WARN_MSG(_("%s was changed by another program, the changes saved "
+		   "to %s are not applied and it is kept"),
+		 journal_data_path(type), path);
+	mem_free(path);
+}
+
+/*
+ * Read the journal of a data file before the file is loaded. Return whether
+ * there is one, in which case journal_replay() must be called with the
+ * contents of the data file.
+ */
+int journal_open(enum data_file type)
+{
+	struct journal *j = &journals[type];
+	char *path = journal_path(type);
+	struct stat st;
+
+	journal_reset(j);
+	j->buf = journal_read_path(path, &j->len, &st);
+	mem_free(path);
+	if (!j->buf)
+		return 0;
+
+	j->exists = 1;
+	journal_sum(j->buf, j->len, j->sha1);
+	io_fstat_set(&j->fs, &st);
+	return 1;
+}
+
+/*
+ * Apply the journal read by journal_open() to the contents of its data file,
+ * whose hash is given. The buffer is replaced with the resulting contents.
+ */
+void journal_replay(enum data_file type, const char *sha1, char **buf,
+		    size_t *len)
+{
+	struct journal *j = &journals[type];
+	struct journal_line *lines;
+	size_t nlines, i, n = 0;
+	char *p;
+
+	j->size = journal_check(j->buf, j->len, j->base);
+	if (j->size > JOURNAL_HDRLEN && strcmp(j->base, sha1) != 0) {
+		j->stale = 1;
+		journal_warn_stale(type);
+	} else if (j->size && !strcmp(j->base, sha1)) {
+		j->active = 1;
+		sha1_init(&j->ctx);
+		sha1_update(&j->ctx, (uint8_t *)j->buf, j->size);
+
+		lines = journal_apply(*buf, *len, j->buf, j->size, &nlines);
+		for (i = 0; i < nlines; i++)
+			n += lines[i].len + 1;
+		p = mem_malloc(n + 1);
+		for (i = n = 0; i < nlines; i++) {
+			memcpy(p + n, (lines[i].in_journal ? j->buf : *buf) +
+			       lines[i].off, lines[i].len);
+			n += lines[i].len;
+			p[n++] = '\n';
+		}
+		p[n] = '\0';
+
+		/* Both files are at hand: index them for the next save. */
+		qsort(lines, nlines, sizeof(struct journal_line),
+		      journal_line_cmp);
+		j->lines = lines;
+		j->nlines = nlines;
+		j->btext = *buf;
+		j->blen = *len;
+		j->base_size = *len;
+		j->jtext = j->buf;
+		j->jlen = j->size;
+		j->buf = NULL;
+		j->indexed = 1;
+
+		*buf = p;
+		*len = n;
+	}
+
+	mem_free(j->buf);
+	j->buf = NULL;
+}
+
+/*
+ * Return whether the data file has a journal to fold back into it, found when
+ * the data file was last loaded or written since.
+ */
+int journal_pending(enum data_file type)
+{
+	return journals[type].exists && !journals[type].stale;
+}
+
+/*
+ * Check whether the journal of a data file has been created, changed or
+ * removed since the data file was loaded or saved. Return -1 if the journal
+ * cannot be read.
+ */
+int journal_changed(enum data_file type)
+{
+	struct journal *j = &journals[type];
+	char *path = journal_path(type);
+	struct stat st;
+	int ret;
+
+	if (stat(path, &st) != 0)
+		ret = j->exists;
+	else if (!j->exists)
+		ret = 1;
+	else
+		ret = io_file_changed(path, j->sha1, &j->fs);
+	mem_free(path);
+
+	return ret;
+}
+
+/*
+ * Build the sorted index of the saved lines, from the data file and the
+ * journal, whose contents are kept. Return 0 if either does not match what
+ * was loaded. The data file is only hashed again if its status changed.
+ */
+static int journal_index(enum data_file type, const char *sha1,
+			 struct io_fstat *fs)
+{
+	struct journal *j = &journals[type];
+	char *base, *jbuf = NULL, *path, sum[SHA1_DIGESTLEN * 2 + 1];
+	size_t blen, jlen = 0;
+	struct stat st;
+
+	if (!(base = journal_read_path(journal_data_path(type), &blen, &st)))
+		return 0;
+	j->base_size = st.st_size;
+	if (!io_fstat_same(fs, &st)) {
+		journal_sum(base, blen, sum);
+		if (strcmp(sum, sha1) != 0)
+			goto fail;
+	}
+
+	if (j->active) {
+		path = journal_path(type);
+		jbuf = journal_read_path(path, &jlen, &st);
+		mem_free(path);
+		if (!jbuf)
+			goto fail;
+		journal_sum(jbuf, jlen, sum);
+		if (strcmp(sum, j->sha1) != 0)
+			goto fail;
+	}
+
+	j->lines = journal_apply(base, blen, jbuf, j->size, &j->nlines);
+	qsort(j->lines, j->nlines, sizeof(struct journal_line),
+	      journal_line_cmp);
+	j->btext = base;
+	j->blen = blen;
+	j->jtext = jbuf;
+	j->jlen = jbuf ? j->size : 0;
+	j->indexed = 1;
+	return 1;
+
+fail:
+	mem_free(base);
+	mem_free(jbuf);
+	return 0;
+}
+
+struct journal_cur {
+	uint64_t hash;
+	unsigned len;
+	char *s;
+};
+
+static int journal_cur_cmp(const void *a, const void *b)
+{
+	const struct journal_cur *x = a, *y = b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	if (x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	return 0;
+}
+
+/* Compare a line to be saved with a saved line, see journal_cur_cmp(). */
+static int journal_cur_line_cmp(const struct journal_cur *c,
+				const struct journal_line *l)
+{
+	if (c->hash != l->hash)
+		return c->hash < l->hash ? -1 : 1;
+	if (c->len != l->len)
+		return c->len < l->len ? -1 : 1;
+	return 0;
+}
+
+static int journal_write(int fd, const char *buf, size_t len, off_t off)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		if ((r = pwrite(fd, buf, len, off)) <= 0)
+			return 0;
+		buf += r;
+		len -= r;
+		off += r;
+	}
+	return 1;
+}
+
+/* Return the contents of a saved line, or NULL if it is out of bounds. */
+static const char *journal_line_str(struct journal *j,
+				    const struct journal_line *l)
+{
+	if (l->in_journal)
+		return l->off + l->len <= (off_t)j->jlen ? j->jtext + l->off :
+		    NULL;
+	return l->off + l->len <= (off_t)j->blen ? j->btext + l->off : NULL;
+}
+
+/* Drop the changes prepared by journal_prepare(). */
+void journal_cancel(enum data_file type)
+{
+	struct journal *j = &journals[type];
+
+	if (j->batch) {
+		mem_free(j->batch);
+		mem_free(j->idx);
+		j->batch = NULL;
+		j->idx = NULL;
+	}
+}
+
+/*
+ * Prepare to save the lines of a data file, whose contents on disk have the
+ * given hash and status, by appending the differences to its journal, see
+ * journal_commit(). Return 0 if the lines must be written to the data file
+ * instead, in which case journal_remove() is to be called afterwards. This
+ * happens when the journal would exceed a quarter of the size of the data
+ * file, or when it is stale.
+ */
+int journal_prepare(enum data_file type, const char *sha1, struct io_fstat *fs,
+		    vector_t *lines)
+{
+	struct journal *j = &journals[type];
+	struct journal_cur *cur;
+	struct journal_line *idx, *l;
+	unsigned n = VECTOR_COUNT(lines), i, ie;
+	size_t *del, ndel = 0, nadd = 0, k, ke, m, len, pos;
+	off_t start;
+	const char *str;
+	char *batch = NULL, *paired;
+	int ret = 0;
+
+	journal_cancel(type);
+	if (j->stale || (j->active && strcmp(j->base, sha1) != 0))
+		return 0;
+	if (!j->indexed && !journal_index(type, sha1, fs))
+		return 0;
+
+	cur = mem_malloc((n ? n : 1) * sizeof(struct journal_cur));
+	for (i = 0; i < n; i++) {
+		cur[i].s = VECTOR_NTH(lines, i);
+		cur[i].len = strlen(cur[i].s);
+		cur[i].hash = line_hash(cur[i].s, cur[i].len);
+	}
+	qsort(cur, n, sizeof(struct journal_cur), journal_cur_cmp);
+
+	/*
+	 * Pair the lines with the saved ones of the same contents, as in
+	 * journal_apply(). Saved lines left over are removed, other lines are
+	 * added.
+	 */
+	del = mem_malloc((j->nlines ? j->nlines : 1) * sizeof(size_t));
+	paired = mem_malloc(j->nlines ? j->nlines : 1);
+	memset(paired, 0, j->nlines);
+	len = 2;
+	for (k = i = 0; k < j->nlines || i < n;) {
+		if (i == n || (k < j->nlines &&
+		    journal_cur_line_cmp(&cur[i], &j->lines[k]) > 0)) {
+			len += j->lines[k].len + 2;
+			del[ndel++] = k++;
+			continue;
+		}
+		if (k == j->nlines ||
+		    journal_cur_line_cmp(&cur[i], &j->lines[k]) < 0) {
+			len += cur[i++].len + 2;
+			nadd++;
+			continue;
+		}
+
+		/* Lines of the same hash and length. */
+		for (ke = k; ke < j->nlines &&
+		     journal_cur_line_cmp(&cur[i], &j->lines[ke]) == 0; ke++)
+			;
+		for (ie = i; ie < n && journal_cur_cmp(&cur[i], &cur[ie]) == 0;
+		     ie++)
+			;
+		for (; i < ie; i++) {
+			for (m = k; m < ke; m++) {
+				if (paired[m])
+					continue;
+				str = journal_line_str(j, &j->lines[m]);
+				if (!str)
+					goto cleanup;
+				if (!memcmp(str, cur[i].s, cur[i].len))
+					break;
+			}
+			if (m < ke) {
+				paired[m] = 1;
+				cur[i].s = NULL;
+			} else {
+				len += cur[i].len + 2;
+				nadd++;
+			}
+		}
+		for (; k < ke; k++) {
+			if (!paired[k]) {
+				len += j->lines[k].len + 2;
+				del[ndel++] = k;
+			}
+		}
+	}
+	if (ndel == 0 && nadd == 0) {
+		ret = 1;
+		goto cleanup;
+	}
+
+	start = j->active ? j->size : 0;
+	if (!j->active)
+		len += JOURNAL_HDRLEN;
+	if ((start + (off_t)len) * 4 > j->base_size)
+		goto cleanup;
+
+	/* Removed lines are copied from the saved contents. */
+	batch = mem_malloc(len);
+	pos = 0;
+	if (!j->active) {
+		pos = sprintf(batch, "%s%s\n", JOURNAL_MAGIC, sha1);
+		strcpy(j->base, sha1);
+	}
+	for (k = 0; k < ndel; k++) {
+		l = &j->lines[del[k]];
+		if (!(str = journal_line_str(j, l)))
+			goto cleanup;
+		batch[pos++] = '-';
+		memcpy(batch + pos, str, l->len);
+		pos += l->len;
+		batch[pos++] = '\n';
+	}
+
+	/* Build the new index while the added lines are copied. */
+	idx = mem_malloc((j->nlines - ndel + nadd + 1) *
+			 sizeof(struct journal_line));
+	l = idx;
+	for (k = i = 0; k < j->nlines; k++) {
+		if (i < ndel && del[i] == k)
+			i++;
+		else
+			*l++ = j->lines[k];
+	}
+	for (i = 0; i < n; i++) {
+		if (!cur[i].s)
+			continue;
+		l->hash = cur[i].hash;
+		l->len = cur[i].len;
+		batch[pos++] = '+';
+		l->off = start + pos;
+		l->in_journal = 1;
+		memcpy(batch + pos, cur[i].s, l->len);
+		pos += l->len;
+		batch[pos++] = '\n';
+		l++;
+	}
+	batch[pos++] = '.';
+	batch[pos++] = '\n';
+
+	j->batch = batch;
+	j->batch_len = pos;
+	j->idx = idx;
+	j->nidx = l - idx;
+	batch = NULL;
+	ret = 1;
+
+cleanup:
+	mem_free(batch);
+	mem_free(cur);
+	mem_free(del);
+	mem_free(paired);
+	return ret;
+}
+
+/*
+ * Append the changes prepared by journal_prepare() to the journal. Return 0
+ * if they could not be written, in which case they are dropped.
+ */
+int journal_commit(enum data_file type)
+{
+	struct journal *j = &journals[type];
+	off_t start = j->active ? j->size : 0;
+	char *path;
+	int fd, ret = 0;
+	struct stat st;
+	sha1_ctx_t ctx;
+
+	if (!j->batch)
+		return 1;
+
+	path = journal_path(type);
+	fd = open(path, O_RDWR | O_CREAT, 0666);
+	mem_free(path);
+	if (fd < 0)
+		goto cleanup;
+	if (ftruncate(fd, start) != 0 ||
+	    !journal_write(fd, j->batch, j->batch_len, start) ||
+	    fstat(fd, &st) != 0) {
+		close(fd);
+		goto cleanup;
+	}
+	close(fd);
+
+	if (!j->active)
+		sha1_init(&j->ctx);
+	sha1_update(&j->ctx, (uint8_t *)j->batch, j->batch_len);
+	ctx = j->ctx;
+	sha1_final_hex(&ctx, j->sha1);
+	io_fstat_set(&j->fs, &st);
+	j->exists = j->active = 1;
+	j->size = start + j->batch_len;
+
+	j->jtext = mem_realloc(j->jtext, j->size + 1, 1);
+	memcpy(j->jtext + start, j->batch, j->batch_len);
+	j->jlen = j->size;
+
+	mem_free(j->lines);
+	j->lines = j->idx;
+	j->nlines = j->nidx;
+	j->idx = NULL;
+	qsort(j->lines, j->nlines, sizeof(struct journal_line),
+	      journal_line_cmp);
+	ret = 1;
+
+cleanup:
+	journal_cancel(type);
+	return ret;
+}
+
+/*
+ * Remove the journal of a data file once the latter has been written. A stale
+ * journal is kept.
+ */
+void journal_remove(enum data_file type)
+{
+	struct journal *j = &journals[type];
+	char *path;
+
+	if (j->stale)
+		return;
+	if (j->exists) {
+		path = journal_path(type);
+		unlink(path);
+		mem_free(path);
+	}
+	journal_reset(j);
+}
+
+/*
+ * Fold the journal of a data file back into it. This only uses the files, so
+ * that changes which were not saved are left out. A journal for other
+ * contents of the data file is kept, see journal_replay().
+ */
+void journal_compact(enum data_file type)
+{
+	struct journal *j = &journals[type];
+	const char *data_path = journal_data_path(type);
+	char *base, *jbuf, *path, sum[SHA1_DIGESTLEN * 2 + 1];
+	char jbase[SHA1_DIGESTLEN * 2 + 1];
+	struct journal_line *lines;
+	size_t blen, jlen, nlines, i, complete;
+	struct string sb;
+	struct stat st;
+	int ok = 1;
+
+	if (!journal_pending(type))
+		return;
+
+	path = journal_path(type);
+	jbuf = journal_read_path(path, &jlen, &st);
+	base = journal_read_path(data_path, &blen, &st);
+	if (!jbuf || !base)
+		goto cleanup;
+
+	journal_sum(base, blen, sum);
+	complete = journal_check(jbuf, jlen, jbase);
+	if (complete > JOURNAL_HDRLEN && strcmp(jbase, sum) != 0) {
+		journal_warn_stale(type);
+		ok = 0;
+	} else if (complete) {
+		lines = journal_apply(base, blen, jbuf, complete, &nlines);
+		string_init(&sb);
+		for (i = 0; i < nlines; i++) {
+			string_catn(&sb, (lines[i].in_journal ? jbuf : base) +
+				    lines[i].off, lines[i].len);
+			string_catn(&sb, "\n", 1);
+		}
+		ok = io_write_file(data_path, sb.buf, sb.len, NULL);
+		mem_free(sb.buf);
+		mem_free(lines);
+	}
+	if (ok)
+		unlink(path);
+	journal_reset(j);
+
+cleanup:
+	mem_free(path);
+	mem_free(jbuf);
+	mem_free(base);
+}
@@ -268,6 +268,99 @@ void llist_add_sorted(llist_t * l, void *data, llist_fn_cmp_t fn_cmp)
 	llist_relink(l, o, fn_cmp);
 }
 
+/*
+ * Stable merge sort of an array of item data, for llist_add_sorted_all().
+ * Halves which are already in order are not merged, so that sorted input only
+ * takes linear time.
+ */
+static void llist_msort(void **a, void **tmp, unsigned n,
+			llist_fn_cmp_t fn_cmp)
+{
+	unsigned mid = n / 2, i, j, k;
+
+	if (n < 2)
+		return;
+
+	llist_msort(a, tmp, mid, fn_cmp);
+	llist_msort(a + mid, tmp, n - mid, fn_cmp);
+	if (fn_cmp(a[mid - 1], a[mid]) <= 0)
+		return;
+
+	memcpy(tmp, a, mid * sizeof(void *));
+	for (i = 0, j = mid, k = 0; i < mid && j < n; k++)
+		a[k] = fn_cmp(a[j], tmp[i]) < 0 ? a[j++] : tmp[i++];
+	while (i < mid)
+		a[k++] = tmp[i++];
+}
+
+/*
+ * Add several items to a sorted list. The result is the same as adding them
+ * one by one, in the given order, with llist_add_sorted(). The array is
+ * sorted in place.
+ */
+void llist_add_sorted_all(llist_t *l, void **data, unsigned n,
+			  llist_fn_cmp_t fn_cmp)
+{
+	llist_item_t *p = NULL, *next, *o;
+	void **tmp;
+	unsigned i;
+
+	if (n == 0)
+		return;
+
+	tmp = mem_malloc((n / 2 + 1) * sizeof(void *));
+	llist_msort(data, tmp, n, fn_cmp);
+	mem_free(tmp);
+
+	/* Items go after the ones which do not compare greater. */
+	if (l->tail && fn_cmp(data[0], l->tail->data) >= 0)
+		p = l->tail;
+	for (i = 0; i < n; i++) {
+		next = p ? p->next : l->head;
+		while (next && fn_cmp(data[i], next->data) >= 0) {
+			p = next;
+			next = next->next;
+		}
+
+		o = mem_malloc(sizeof(llist_item_t));
+		o->data = data[i];
+		o->next = next;
+		if (p)
+			p->next = o;
+		else
+			l->head = o;
+		if (!next)
+			l->tail = o;
+		p = o;
+	}
+}
+
+/*
+ * Remove several items from a list in a single pass. The items must be given
+ * in list order.
+ */
+void llist_remove_all(llist_t *l, void **data, unsigned n)
+{
+	llist_item_t *p = NULL, *i, *next;
+	unsigned k = 0;
+
+	for (i = l->head; i && k < n; i = next) {
+		next = i->next;
+		if (i->data != data[k]) {
+			p = i;
+			continue;
+		}
+		k++;
+		if (p)
+			p->next = next;
+		else
+			l->head = next;
+		if (i == l->tail)
+			l->tail = p;
+		mem_free(i);
+	}
+}
+
 /*
  * Remove an item from a list.
  */
@@ -88,7 +88,11 @@ struct llist_ts {
 /* List manipulation. */
 #define LLIST_TS_ADD(l_ts, data) llist_add ((llist_t *)l_ts, data)
 #define LLIST_TS_REMOVE(l_ts, i) llist_remove ((llist_t *)l_ts, i)
+#define LLIST_TS_REMOVE_ALL(l_ts, data, n)                                    \
+  llist_remove_all ((llist_t *)l_ts, data, n)
 #define LLIST_TS_ADD_SORTED(l_ts, data, fn_cmp)                               \
   llist_add_sorted ((llist_t *)l_ts, data, (llist_fn_cmp_t)fn_cmp)
+#define LLIST_TS_ADD_SORTED_ALL(l_ts, data, n, fn_cmp)                        \
+  llist_add_sorted_all ((llist_t *)l_ts, data, n, (llist_fn_cmp_t)fn_cmp)
 #define LLIST_TS_REORDER(l_ts, data, fn_cmp)                                  \
   llist_reorder((llist_t *)l_ts, data, (llist_fn_cmp_t)fn_cmp)
@@ -34,43 +34,435 @@
  *
  */
 
-#include <unistd.h>
+#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "calcurse.h"
 #include "sha1.h"
 
+/*
+ * Note pack (see the general.notepack option).
+ *
+ * Notes can be stored in an append-only pack file, .pack in the notes
+ * directory, instead of one file per note. Each record is the note name, a
+ * space, the length of the note in decimal and a newline, followed by the
+ * note itself and another newline. A record that is cut short, as by a crash
+ * while it was written, ends the pack.
+ *
+ * The pack is mapped into memory and indexed by note name when a note is
+ * first looked up, and again whenever it has changed. Appending to the pack
+ * and compacting it are done while holding a lock on it. Plain note files are
+ * still read when a note is not found in the pack.
+ */
+
+#define NOTE_PACK_NAME ".pack"
+
+struct note_pack_entry {
+	char name[MAX_NOTESIZ + 1];
+	size_t off;
+	size_t len;
+	int used;
+};
+
 struct note_gc_hash {
 	char *hash;
 	char buf[MAX_NOTESIZ + 1];
-	 HTABLE_ENTRY(note_gc_hash);
 };
 
+static void note_pack_extract_key(struct note_pack_entry *, const char **,
+				  int *);
+static int note_pack_cmp(struct note_pack_entry *, struct note_pack_entry *);
 static void note_gc_extract_key(struct note_gc_hash *, const char **,
 				int *);
 static int note_gc_cmp(struct note_gc_hash *, struct note_gc_hash *);
 
-HTABLE_HEAD(htp, NOTE_GC_HSIZE, note_gc_hash);
-HTABLE_PROTOTYPE(htp, note_gc_hash)
-    HTABLE_GENERATE(htp, note_gc_hash, note_gc_extract_key, note_gc_cmp)
+HTABLE_DYN_HEAD(nph, note_pack_entry);
+HTABLE_DYN_PROTOTYPE(nph, note_pack_entry)
+    HTABLE_DYN_GENERATE(nph, note_pack_entry, note_pack_extract_key,
+			note_pack_cmp)
+
+HTABLE_DYN_HEAD(htp, note_gc_hash);
+HTABLE_DYN_PROTOTYPE(htp, note_gc_hash)
+    HTABLE_DYN_GENERATE(htp, note_gc_hash, note_gc_extract_key, note_gc_cmp)
+
+static struct {
+	int mapped;
+	dev_t dev;
+	ino_t ino;
+	char *data;
+	size_t len;
+	size_t valid;		/* length of the complete records */
+	struct note_pack_entry *entries;
+	unsigned nentries;
+	struct nph index;
+} note_pack;
+
+/* Serializes the lookups of note_get(), which may remap the pack. */
+static pthread_mutex_t note_pack_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* Create note file from a string and return a newly allocated string that
- * contains its name. */
-char *generate_note(const char *str)
+static void
+note_pack_extract_key(struct note_pack_entry *data, const char **key,
+		      int *len)
+{
+	*key = data->name;
+	*len = strlen(data->name);
+}
+
+static int note_pack_cmp(struct note_pack_entry *a,
+			 struct note_pack_entry *b)
+{
+	return strcmp(a->name, b->name);
+}
+
+static char *note_pack_path(void)
+{
+	char *path;
+
+	asprintf(&path, "%s%s", path_notes, NOTE_PACK_NAME);
+	return path;
+}
+
+/* Check that a note name can be stored in the note pack. */
+static int note_pack_name_valid(const char *note)
+{
+	size_t len = strcspn(note, " \n");
+
+	return len > 0 && len <= MAX_NOTESIZ && note[len] == '\0';
+}
+
+static void note_pack_unmap(void)
+{
+	if (!note_pack.mapped)
+		return;
+	if (note_pack.len > 0)
+		munmap(note_pack.data, note_pack.len);
+	if (note_pack.entries)
+		mem_free(note_pack.entries);
+	note_pack.entries = NULL;
+	note_pack.nentries = 0;
+	HTABLE_DYN_FREE(nph, &note_pack.index);
+	note_pack.mapped = 0;
+}
+
+/* Parse the records of the note pack and add them to the index. */
+static void note_pack_scan(void)
+{
+	const char *p = note_pack.data, *end = p + note_pack.len, *q, *digits;
+	struct note_pack_entry *e;
+	unsigned size = 0, i;
+	size_t len;
+
+	while (p < end) {
+		for (q = p; q < end && *q != ' ' && *q != '\n' &&
+		     q - p <= MAX_NOTESIZ; q++) ;
+		if (q == p || q == end || *q != ' ' || q - p > MAX_NOTESIZ)
+			break;
+		if (note_pack.nentries == size) {
+			size = size ? size * 2 : 64;
+			note_pack.entries = mem_realloc(note_pack.entries, size,
+					sizeof(struct note_pack_entry));
+		}
+		e = &note_pack.entries[note_pack.nentries];
+		memcpy(e->name, p, q - p);
+		e->name[q - p] = '\0';
+
+		for (digits = ++q, len = 0; q < end && isdigit(*q) &&
+		     len <= (SIZE_MAX - 9) / 10; q++)
+			len = len * 10 + (*q - '0');
+		if (q == digits || q == end || *q != '\n')
+			break;
+		q++;
+		if (len >= (size_t)(end - q) || q[len] != '\n')
+			break;
+		e->off = q - note_pack.data;
+		e->len = len;
+		e->used = 0;
+		note_pack.nentries++;
+		p = q + len + 1;
+	}
+	note_pack.valid = p - note_pack.data;
+
+	/* The first copy of a note wins, there should not be any other. */
+	HTABLE_DYN_RESERVE(nph, &note_pack.index, note_pack.nentries);
+	for (i = 0; i < note_pack.nentries; i++)
+		HTABLE_DYN_INSERT(nph, &note_pack.index, &note_pack.entries[i]);
+}
+
+/* Map and index the note pack, unless it has not changed since last time. */
+static void note_pack_map(void)
+{
+	char *path = note_pack_path();
+	struct stat st;
+	int fd;
+
+	if (stat(path, &st) != 0) {
+		note_pack_unmap();
+		goto cleanup;
+	}
+	if (note_pack.mapped && note_pack.dev == st.st_dev &&
+	    note_pack.ino == st.st_ino && (off_t)note_pack.len == st.st_size)
+		goto cleanup;
+
+	note_pack_unmap();
+	if ((fd = open(path, O_RDONLY)) < 0)
+		goto cleanup;
+	if (fstat(fd, &st) != 0 || (uintmax_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		goto cleanup;
+	}
+	note_pack.data = NULL;
+	if (st.st_size > 0) {
+		note_pack.data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				      fd, 0);
+		if (note_pack.data == MAP_FAILED) {
+			close(fd);
+			goto cleanup;
+		}
+	}
+	close(fd);
+
+	note_pack.mapped = 1;
+	note_pack.dev = st.st_dev;
+	note_pack.ino = st.st_ino;
+	note_pack.len = st.st_size;
+	note_pack_scan();
+
+cleanup:
+	mem_free(path);
+}
+
+static struct note_pack_entry *note_pack_lookup(const char *note)
+{
+	struct note_pack_entry tmp;
+
+	if (!note_pack.mapped || !note_pack_name_valid(note))
+		return NULL;
+	strcpy(tmp.name, note);
+	return HTABLE_DYN_LOOKUP(nph, &note_pack.index, &tmp);
+}
+
+/* Look a note up in the note pack, mapping it again if it has changed. */
+static struct note_pack_entry *note_pack_find(const char *note)
+{
+	struct note_pack_entry *e;
+
+	if ((e = note_pack_lookup(note)))
+		return e;
+	note_pack_map();
+	return note_pack_lookup(note);
+}
+
+/*
+ * Open and lock the note pack, and map it. Return the file descriptor, which
+ * is to be closed to release the lock, or -1 if the pack could not be opened.
+ */
+static int note_pack_lock(int create)
+{
+	char *path = note_pack_path();
+	struct stat st, st_path;
+	struct flock fl;
+	int fd;
+
+	for (;;) {
+		fd = open(path, create ? O_RDWR | O_APPEND | O_CREAT :
+			  O_RDWR | O_APPEND, 0666);
+		if (fd < 0)
+			break;
+
+		fl.l_type = F_WRLCK;
+		fl.l_whence = SEEK_SET;
+		fl.l_start = 0;
+		fl.l_len = 0;
+		while (fcntl(fd, F_SETLKW, &fl) != 0) {
+			if (errno != EINTR) {
+				close(fd);
+				fd = -1;
+				goto cleanup;
+			}
+		}
+
+		/* The pack may have been replaced while we were waiting. */
+		if (fstat(fd, &st) == 0 && stat(path, &st_path) == 0 &&
+		    st.st_dev == st_path.st_dev && st.st_ino == st_path.st_ino)
+			break;
+		close(fd);
+	}
+
+	if (fd >= 0) {
+		note_pack_map();
+		/* Drop what is left of an interrupted append. */
+		if (note_pack.mapped && note_pack.valid < note_pack.len &&
+		    ftruncate(fd, note_pack.valid) == 0)
+			note_pack_map();
+	}
+
+cleanup:
+	mem_free(path);
+	return fd;
+}
+
+static int note_write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* Append a record to the note pack, which must be locked. */
+static int note_pack_append(int fd, const char *note, const char *buf,
+			    size_t len)
+{
+	struct string sb;
+	int ret;
+
+	string_init(&sb);
+	string_catf(&sb, "%s %lu\n", note, (unsigned long)len);
+	string_catn(&sb, buf, len);
+	string_catn(&sb, "\n", 1);
+	ret = note_write_all(fd, sb.buf, sb.len);
+	mem_free(sb.buf);
+
+	return ret;
+}
+
+/* Add a note to the note pack, unless it is already there. */
+static int note_pack_add(const char *note, const char *buf, size_t len)
+{
+	int fd, ret;
+
+	if (!note_pack_name_valid(note) || (fd = note_pack_lock(1)) < 0)
+		return 0;
+	ret = note_pack_lookup(note) || note_pack_append(fd, note, buf, len);
+	close(fd);
+
+	return ret;
+}
+
+/* Read a whole note file into a NUL-terminated buffer. */
+static char *note_read_file(FILE *fp, size_t *len)
+{
+	size_t size = BUFSIZ, n = 0, r;
+	char *buf = mem_malloc(size);
+
+	while ((r = fread(buf + n, 1, size - n - 1, fp)) > 0) {
+		n += r;
+		if (n == size - 1) {
+			size *= 2;
+			buf = mem_realloc(buf, size, 1);
+		}
+	}
+	buf[n] = '\0';
+
+	*len = n;
+	return buf;
+}
+
+static void note_digest(const char *buf, size_t len, char *sha1)
+{
+	sha1_ctx_t ctx;
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const uint8_t *)buf, len);
+	sha1_final_hex(&ctx, sha1);
+}
+
+/* Store a note in the note pack if it is enabled, or else in its own file. */
+static void note_store(const char *note, const char *buf, size_t len)
 {
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
 	char *notepath;
 	FILE *fp;
 
-	sha1_digest(str, sha1);
-	asprintf(&notepath, "%s%s", path_notes, sha1);
+	if (conf.note_pack && note_pack_add(note, buf, len))
+		return;
+
+	asprintf(&notepath, "%s%s", path_notes, note);
 	fp = fopen(notepath, "w");
 	EXIT_IF(fp == NULL, _("Warning: could not open %s, Aborting..."),
 		notepath);
-	fputs(str, fp);
+	fwrite(buf, 1, len, fp);
 	file_close(fp, __FILE_POS__);
+	mem_free(notepath);
+}
+
+/*
+ * Return a copy of the contents of a note, taken from the note pack or from
+ * the note file, or NULL if the note does not exist. The copy is terminated
+ * by a NUL character that is not included in its length. Safe to call from
+ * several threads.
+ */
+char *note_get(const char *note, size_t *len)
+{
+	struct note_pack_entry *e;
+	char *notepath, *buf;
+	FILE *fp;
 
+	pthread_mutex_lock(&note_pack_mutex);
+	if ((e = note_pack_find(note))) {
+		buf = mem_malloc(e->len + 1);
+		memcpy(buf, note_pack.data + e->off, e->len);
+		buf[e->len] = '\0';
+		*len = e->len;
+		pthread_mutex_unlock(&note_pack_mutex);
+		return buf;
+	}
+	pthread_mutex_unlock(&note_pack_mutex);
+
+	asprintf(&notepath, "%s%s", path_notes, note);
+	fp = fopen(notepath, "r");
 	mem_free(notepath);
+	if (!fp)
+		return NULL;
+	buf = note_read_file(fp, len);
+	fclose(fp);
+
+	return buf;
+}
+
+/* Write the contents of a note to a file. */
+static int note_export(const char *note, const char *path)
+{
+	char *buf;
+	size_t len;
+	FILE *fp;
+	int ret;
+
+	if (!(buf = note_get(note, &len)))
+		return 0;
+	if (!(fp = fopen(path, "w"))) {
+		mem_free(buf);
+		return 0;
+	}
+	ret = fwrite(buf, 1, len, fp) == len;
+	if (fclose(fp) != 0)
+		ret = 0;
+	mem_free(buf);
+
+	return ret;
+}
+
+/* Create a note from a string and return a newly allocated string that
+ * contains its name. */
+char *generate_note(const char *str)
+{
+	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
+
+	sha1_digest(str, sha1);
+	note_store(sha1, str, strlen(str));
+
 	return sha1;
 }
 
@@ -78,31 +470,29 @@ char *generate_note(const char *str)
 void edit_note(char **note, const char *editor)
 {
 	char *tmpprefix = NULL, *tmppath = NULL;
-	char *notepath = NULL;
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
+	char *sha1, *buf;
+	size_t len;
 	FILE *fp;
 
 	asprintf(&tmpprefix, "%s/calcurse-note", get_tempdir());
 	if ((tmppath = new_tempfile(tmpprefix)) == NULL)
 		goto cleanup;
 
-	if (*note != NULL) {
-		asprintf(&notepath, "%s%s", path_notes, *note);
-		io_file_cp(notepath, tmppath);
-	}
+	if (*note != NULL)
+		note_export(*note, tmppath);
 
 	const char *arg[] = { editor, tmppath, NULL };
 	wins_launch_external(arg);
 
 	if ((fp = fopen(tmppath, "r"))) {
-		sha1_stream(fp, sha1);
+		buf = note_read_file(fp, &len);
 		fclose(fp);
-		*note = sha1;
 
-		mem_free(notepath);
-		asprintf(&notepath, "%s%s", path_notes, *note);
-		io_file_cp(tmppath, notepath);
-		mem_free(notepath);
+		sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
+		note_digest(buf, len, sha1);
+		note_store(sha1, buf, len);
+		mem_free(buf);
+		*note = sha1;
 	}
 
 	unlink(tmppath);
@@ -112,19 +502,40 @@ cleanup:
 	mem_free(tmppath);
 }
 
-/* View a note in an external pager. */
+/*
+ * View a note in an external pager. A note from the note pack is copied to a
+ * temporary file first.
+ */
 void view_note(const char *note, const char *pager)
 {
-	char *fullname;
+	char *fullname, *tmpprefix = NULL, *tmppath = NULL;
 
 	if (note == NULL)
 		return;
 	asprintf(&fullname, "%s%s", path_notes, note);
 
-	const char *arg[] = { pager, fullname, NULL };
+	if (note_pack_find(note)) {
+		asprintf(&tmpprefix, "%s/calcurse-note", get_tempdir());
+		if ((tmppath = new_tempfile(tmpprefix)) == NULL)
+			goto cleanup;
+		if (!note_export(note, tmppath)) {
+			unlink(tmppath);
+			goto cleanup;
+		}
+	}
+
+	const char *arg[] = { pager, tmppath ? tmppath : fullname, NULL };
 	wins_launch_external(arg);
 
+	if (tmppath)
+		unlink(tmppath);
+
+cleanup:
 	mem_free(fullname);
+	if (tmpprefix)
+		mem_free(tmpprefix);
+	if (tmppath)
+		mem_free(tmppath);
 }
 
 /* Erase a note previously attached to an item. */
@@ -136,33 +547,96 @@ void erase_note(char **note)
 	*note = NULL;
 }
 
-/* Read a serialized note file name from a stream and deserialize it. */
-void note_read(char *buffer, FILE * fp)
+/*
+ * Read a serialized note file name from a data file buffer. The name is
+ * terminated in place and the buffer position is moved past the separator.
+ */
+char *note_read(char **s)
 {
-	int i;
+	char *note = *s, *p;
 
-	for (i = 0; i < MAX_NOTESIZ; i++) {
-		buffer[i] = getc(fp);
-		if (buffer[i] == ' ') {
-			buffer[i] = '\0';
-			return;
-		}
-	}
+	for (p = note; *p && *p != ' '; p++) ;
+	if (p - note > MAX_NOTESIZ)
+		note[MAX_NOTESIZ] = '\0';
+	if (*p)
+		*p++ = '\0';
 
-	while (getc(fp) != ' ') ;
-	buffer[MAX_NOTESIZ] = '\0';
+	*s = p;
+	return note;
 }
 
-/* Read the contents of a note file */
-void note_read_contents(char *buffer, size_t buffer_len, FILE * fp)
+/*
+ * Read the beginning of a note into a buffer, truncating it with an ellipsis
+ * if it does not fit. Return 0 if the note does not exist.
+ */
+int note_read_contents(const char *note, char *buffer, size_t buffer_len)
 {
-	size_t read_count = fread(buffer, 1, buffer_len, fp);
-	if (read_count != buffer_len)
-		buffer[read_count] = '\0';
-	else
+	char *buf;
+	size_t len;
+
+	if (!(buf = note_get(note, &len)))
+		return 0;
+	if (len < buffer_len) {
+		memcpy(buffer, buf, len);
+		buffer[len] = '\0';
+	} else {
+		memcpy(buffer, buf, buffer_len);
 		memcpy(&buffer[buffer_len - 4], "...\0", 4);
+	}
+	mem_free(buf);
+
+	return 1;
 }
 
+/*
+ * Move the note files into the note pack. Return the number of notes that
+ * were moved.
+ */
+unsigned note_pack_files(void)
+{
+	DIR *dirp;
+	struct dirent *dp;
+	struct stat st;
+	char *notepath, *buf;
+	size_t len;
+	FILE *fp;
+	unsigned n = 0;
+	int fd;
+
+	if ((fd = note_pack_lock(1)) < 0)
+		return 0;
+	if (!(dirp = opendir(path_notes))) {
+		close(fd);
+		return 0;
+	}
+
+	while ((dp = readdir(dirp))) {
+		if (*(dp->d_name) == '.' || !note_pack_name_valid(dp->d_name))
+			continue;
+		asprintf(&notepath, "%s%s", path_notes, dp->d_name);
+		if (stat(notepath, &st) != 0 || !S_ISREG(st.st_mode) ||
+		    !(fp = fopen(notepath, "r"))) {
+			mem_free(notepath);
+			continue;
+		}
+		buf = note_read_file(fp, &len);
+		fclose(fp);
+
+		/* The note may be left over from an interrupted run. */
+		if (note_pack_lookup(dp->d_name) ||
+		    note_pack_append(fd, dp->d_name, buf, len)) {
+			unlink(notepath);
+			n++;
+		}
+		mem_free(buf);
+		mem_free(notepath);
+	}
+
+	closedir(dirp);
+	close(fd);
+
+	return n;
+}
 
 static void
 note_gc_extract_key(struct note_gc_hash *data, const char **key, int *len)
@@ -176,16 +650,62 @@ static int note_gc_cmp(struct note_gc_hash *a, struct note_gc_hash *b)
 	return strcmp(a->hash, b->hash);
 }
 
-/* Spot and unlink unused note files. */
+/* Mark a note as being in use. */
+static void note_gc_use(struct htp *gc_htable, char *note)
+{
+	struct note_gc_hash tmph, *hp;
+	struct note_pack_entry *e;
+
+	tmph.hash = note;
+	if ((hp = HTABLE_DYN_REMOVE(htp, gc_htable, &tmph)))
+		mem_free(hp);
+	if ((e = note_pack_lookup(note)))
+		e->used = 1;
+}
+
+/* Rewrite the note pack without the notes that are not in use. */
+static void note_gc_pack(void)
+{
+	struct note_pack_entry *e;
+	struct string sb;
+	char *path;
+	unsigned i;
+
+	for (i = 0; i < note_pack.nentries && note_pack.entries[i].used; i++) ;
+	if (i == note_pack.nentries && note_pack.valid == note_pack.len)
+		return;
+
+	string_init(&sb);
+	for (i = 0; i < note_pack.nentries; i++) {
+		e = &note_pack.entries[i];
+		if (!e->used || note_pack_lookup(e->name) != e)
+			continue;
+		string_catf(&sb, "%s %lu\n", e->name, (unsigned long)e->len);
+		string_catn(&sb, note_pack.data + e->off, e->len);
+		string_catn(&sb, "\n", 1);
+	}
+
+	path = note_pack_path();
+	if (sb.len > 0)
+		io_write_file(path, sb.buf, sb.len, NULL);
+	else
+		unlink(path);
+	mem_free(path);
+	mem_free(sb.buf);
+}
+
+/* Spot and unlink unused note files, and drop unused notes from the pack. */
 void note_gc(void)
 {
-	struct htp gc_htable = HTABLE_INITIALIZER(&gc_htable);
+	struct htp gc_htable = HTABLE_DYN_INITIALIZER(HTABLE_DYN_MAXLOAD);
 	struct note_gc_hash *hp;
 	DIR *dirp;
 	struct dirent *dp;
 	llist_item_t *i;
-	struct note_gc_hash tmph;
 	char *notepath;
+	uint32_t pos;
+	unsigned n;
+	int fd;
 
 	if (!(dirp = opendir(path_notes)))
 		return;
@@ -199,58 +719,61 @@ void note_gc(void)
 			hp->buf[MAX_NOTESIZ] = '\0';
 			hp->hash = hp->buf;
 
-			HTABLE_INSERT(htp, &gc_htable, hp);
+			if (!HTABLE_DYN_INSERT(htp, &gc_htable, hp))
+				mem_free(hp);
 		}
 	}
 	while (dp);
 
 	closedir(dirp);
 
+	/* Keep the note pack locked until it has been rewritten. */
+	fd = note_pack_lock(0);
+	for (n = 0; fd >= 0 && n < note_pack.nentries; n++)
+		note_pack.entries[n].used = 0;
+
 	/* Remove hashes that are actually in use. */
 	LLIST_TS_FOREACH(&alist_p, i) {
 		struct apoint *apt = LLIST_GET_DATA(i);
-		if (apt->note) {
-			tmph.hash = apt->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+		if (apt->note)
+			note_gc_use(&gc_htable, apt->note);
 	}
 
 	LLIST_FOREACH(&eventlist, i) {
 		struct event *ev = LLIST_GET_DATA(i);
-		if (ev->note) {
-			tmph.hash = ev->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+		if (ev->note)
+			note_gc_use(&gc_htable, ev->note);
 	}
 
 	LLIST_TS_FOREACH(&recur_alist_p, i) {
 		struct recur_apoint *rapt = LLIST_GET_DATA(i);
-		if (rapt->note) {
-			tmph.hash = rapt->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+		if (rapt->note)
+			note_gc_use(&gc_htable, rapt->note);
 	}
 
 	LLIST_FOREACH(&recur_elist, i) {
 		struct recur_event *rev = LLIST_GET_DATA(i);
-		if (rev->note) {
-			tmph.hash = rev->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+		if (rev->note)
+			note_gc_use(&gc_htable, rev->note);
 	}
 
 	LLIST_FOREACH(&todolist, i) {
 		struct todo *todo = LLIST_GET_DATA(i);
-		if (todo->note) {
-			tmph.hash = todo->note;
-			mem_free(HTABLE_REMOVE(htp, &gc_htable, &tmph));
-		}
+		if (todo->note)
+			note_gc_use(&gc_htable, todo->note);
 	}
 
 	/* Unlink unused note files. */
-	HTABLE_FOREACH(hp, htp, &gc_htable) {
+	HTABLE_DYN_FOREACH(hp, htp, &gc_htable, pos) {
 		asprintf(&notepath, "%s%s", path_notes, hp->hash);
 		unlink(notepath);
 		mem_free(notepath);
+		mem_free(hp);
+	}
+	HTABLE_DYN_FREE(htp, &gc_htable);
+
+	if (fd >= 0) {
+		note_gc_pack();
+		close(fd);
 	}
 }
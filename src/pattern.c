@@ -0,0 +1,373 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <ctype.h>
+#include <langinfo.h>
+#include <string.h>
+
+#include "calcurse.h"
+
+/*
+ * Filter patterns, i.e. POSIX extended regular expressions, with a literal
+ * prefilter.
+ *
+ * When a pattern is compiled, each of its top-level alternatives is searched
+ * for the longest string that any match of the alternative must contain. An
+ * item whose description contains none of these strings cannot match, and is
+ * rejected by a plain substring search without running regexec(). The
+ * analysis gives up on any construct it does not know, in which case every
+ * item goes through regexec() as before.
+ *
+ * Set CALCURSE_FILTER_STATS to print how many items the prefilter rejected.
+ */
+
+struct pattern {
+	regex_t reg;
+	char **lits;		/* one required string per alternative */
+	unsigned nlits;
+	int stats;
+	unsigned long tested, rejected;
+	pthread_mutex_t mutex;
+};
+
+struct pattern_parser {
+	const char *s;
+	int utf8;		/* whether characters are UTF-8 sequences */
+	size_t size;		/* size of the literal buffers */
+};
+
+/* A string being built: the current run of literals or the longest one. */
+struct pattern_lit {
+	char *buf;
+	size_t len;
+};
+
+static int pattern_branch(struct pattern_parser *, struct pattern_lit *);
+
+/* Keep the current run if it is the longest one so far, and start over. */
+static void pattern_flush(struct pattern_lit *run, struct pattern_lit *best)
+{
+	if (run->len > best->len) {
+		memcpy(best->buf, run->buf, run->len);
+		best->len = run->len;
+	}
+	run->len = 0;
+}
+
+/*
+ * Skip the quantifiers after an atom. Return 0 if there are none, 1 if the atom
+ * is repeated at least once, 2 if it is optional and -1 on anything unknown.
+ */
+static int pattern_quant(struct pattern_parser *p)
+{
+	int ret = 0, min;
+
+	for (;;) {
+		if (*p->s == '*' || *p->s == '?') {
+			ret = 2;
+			p->s++;
+		} else if (*p->s == '+') {
+			ret = ret ? ret : 1;
+			p->s++;
+		} else if (*p->s == '{') {
+			p->s++;
+			if (!isdigit((unsigned char)*p->s) && *p->s != ',')
+				return -1;
+			for (min = 0; isdigit((unsigned char)*p->s); p->s++)
+				min = min || *p->s != '0';
+			if (*p->s == ',')
+				p->s++;
+			while (isdigit((unsigned char)*p->s))
+				p->s++;
+			if (*p->s++ != '}')
+				return -1;
+			if (!min)
+				ret = 2;
+			else
+				ret = ret ? ret : 1;
+		} else {
+			return ret;
+		}
+	}
+}
+
+/* Skip a bracket expression, return 0 if it is not terminated. */
+static int pattern_bracket(struct pattern_parser *p)
+{
+	char d;
+
+	p->s++;
+	if (*p->s == '^')
+		p->s++;
+	if (*p->s == ']')
+		p->s++;
+	for (;;) {
+		if (!*p->s)
+			return 0;
+		if (*p->s == ']') {
+			p->s++;
+			return 1;
+		}
+		if (*p->s == '[' && (p->s[1] == ':' || p->s[1] == '=' ||
+				     p->s[1] == '.')) {
+			d = p->s[1];
+			for (p->s += 2; *p->s && !(*p->s == d &&
+						   p->s[1] == ']'); p->s++) ;
+			if (!*p->s)
+				return 0;
+			p->s += 2;
+			continue;
+		}
+		p->s++;
+	}
+}
+
+/*
+ * Parse a parenthesized group. If it is neither optional nor made of
+ * alternatives, its longest required string is one of the enclosing branch.
+ */
+static int pattern_group(struct pattern_parser *p, struct pattern_lit *best)
+{
+	struct pattern_lit lit;
+	int n = 0, q, ret = 0;
+
+	lit.buf = mem_malloc(p->size);
+	lit.len = 0;
+	p->s++;
+	for (;;) {
+		if (!pattern_branch(p, &lit))
+			goto cleanup;
+		n++;
+		if (*p->s != '|')
+			break;
+		p->s++;
+	}
+	if (*p->s++ != ')' || (q = pattern_quant(p)) < 0)
+		goto cleanup;
+	if (n == 1 && q != 2 && lit.len > best->len) {
+		memcpy(best->buf, lit.buf, lit.len);
+		best->len = lit.len;
+	}
+	ret = 1;
+
+cleanup:
+	mem_free(lit.buf);
+	return ret;
+}
+
+/*
+ * Parse a branch up to the next '|' or ')' and store the longest string which
+ * any match of it contains. Return 0 if the branch cannot be analyzed.
+ */
+static int pattern_branch(struct pattern_parser *p, struct pattern_lit *best)
+{
+	struct pattern_lit run;
+	const char *atom;
+	size_t len;
+	int q, ret = 0;
+
+	run.buf = mem_malloc(p->size);
+	run.len = 0;
+	best->len = 0;
+	while (*p->s && *p->s != '|' && *p->s != ')') {
+		atom = p->s;
+		len = 1;
+		switch (*p->s) {
+		case '(':
+			pattern_flush(&run, best);
+			if (!pattern_group(p, best))
+				goto cleanup;
+			continue;
+		case '[':
+			if (!pattern_bracket(p))
+				goto cleanup;
+			atom = NULL;
+			break;
+		case '.':
+			p->s++;
+			atom = NULL;
+			break;
+		case '^':
+		case '$':
+			p->s++;
+			pattern_flush(&run, best);
+			if (*p->s && strchr("*+?{", *p->s))
+				goto cleanup;
+			continue;
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			goto cleanup;
+		case '\\':
+			p->s++;
+			if (!*p->s)
+				goto cleanup;
+			/* Other escapes are anchors, classes or references. */
+			atom = strchr(".[]()*+?{}|^$\\", *p->s) ? p->s : NULL;
+			p->s++;
+			break;
+		default:
+			if (p->utf8 && (unsigned char)*p->s >= 0xC0) {
+				while (UTF8_ISCONT(p->s[len]))
+					len++;
+			}
+			p->s += len;
+			break;
+		}
+
+		if ((q = pattern_quant(p)) < 0)
+			goto cleanup;
+		if (!atom || q == 2) {
+			pattern_flush(&run, best);
+			continue;
+		}
+		memcpy(run.buf + run.len, atom, len);
+		run.len += len;
+		if (q == 1)
+			pattern_flush(&run, best);
+	}
+	pattern_flush(&run, best);
+	ret = 1;
+
+cleanup:
+	mem_free(run.buf);
+	return ret;
+}
+
+/* Find the required strings of the alternatives of a pattern, if any. */
+static void pattern_analyze(struct pattern *pat, const char *re)
+{
+	struct pattern_parser p;
+	struct pattern_lit lit;
+
+	/* Other multibyte encodings may use special characters in sequences. */
+	if (MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+		return;
+
+	p.s = re;
+	p.utf8 = MB_CUR_MAX > 1;
+	p.size = strlen(re) + 1;
+	lit.buf = mem_malloc(p.size);
+	for (;;) {
+		if (!pattern_branch(&p, &lit) || lit.len == 0)
+			break;
+		lit.buf[lit.len] = '\0';
+		pat->lits = mem_realloc(pat->lits, pat->nlits + 1,
+					sizeof(char *));
+		pat->lits[pat->nlits++] = mem_strdup(lit.buf);
+		if (*p.s == '\0') {
+			mem_free(lit.buf);
+			return;
+		}
+		if (*p.s++ != '|')
+			break;
+	}
+	mem_free(lit.buf);
+
+	/* Some alternative has no required string. */
+	while (pat->nlits > 0)
+		mem_free(pat->lits[--pat->nlits]);
+	if (pat->lits)
+		mem_free(pat->lits);
+	pat->lits = NULL;
+}
+
+/* Compile a pattern, return NULL if it is not a valid regular expression. */
+struct pattern *pattern_new(const char *re)
+{
+	struct pattern *pat = mem_malloc(sizeof(struct pattern));
+
+	if (regcomp(&pat->reg, re, REG_EXTENDED)) {
+		mem_free(pat);
+		return NULL;
+	}
+	pat->lits = NULL;
+	pat->nlits = 0;
+	pat->stats = getenv("CALCURSE_FILTER_STATS") != NULL;
+	pat->tested = pat->rejected = 0;
+	pthread_mutex_init(&pat->mutex, NULL);
+	pattern_analyze(pat, re);
+
+	return pat;
+}
+
+void pattern_free(struct pattern *pat)
+{
+	if (!pat)
+		return;
+
+	regfree(&pat->reg);
+	while (pat->nlits > 0)
+		mem_free(pat->lits[--pat->nlits]);
+	if (pat->lits)
+		mem_free(pat->lits);
+	pthread_mutex_destroy(&pat->mutex);
+	mem_free(pat);
+}
+
+/* Return whether a string matches a pattern. */
+int pattern_match(struct pattern *pat, const char *str)
+{
+	unsigned i;
+	int found = pat->nlits == 0;
+
+	for (i = 0; !found && i < pat->nlits; i++)
+		found = strstr(str, pat->lits[i]) != NULL;
+
+	if (pat->stats && pat->nlits > 0) {
+		pthread_mutex_lock(&pat->mutex);
+		pat->tested++;
+		if (!found)
+			pat->rejected++;
+		pthread_mutex_unlock(&pat->mutex);
+	}
+
+	return found && regexec(&pat->reg, str, 0, NULL, 0) == 0;
+}
+
+/* Print the prefilter statistics if CALCURSE_FILTER_STATS is set. */
+void pattern_stats(struct pattern *pat)
+{
+	if (!pat->stats)
+		return;
+
+	if (pat->nlits == 0)
+		fprintf(stderr, _("pattern prefilter: not used\n"));
+	else
+		fprintf(stderr, _("pattern prefilter: %lu of %lu rejected\n"),
+			pat->rejected, pat->tested);
+}
@@ -50,28 +50,50 @@ static void pcal_export_footer(FILE *);
 /* Type definition for callbacks to export functions. */
 typedef void (*cb_dump_t) (FILE *, long, long, char *);
 
+/* Days on which an item occurs, as collected by foreach_date_add(). */
+struct date_list {
+	long *tab;
+	unsigned count;
+	unsigned size;
+};
+
+static void foreach_date_add(time_t occurrence, time_t day, void *arg)
+{
+	struct date_list *l = arg;
+
+	if (l->count == l->size) {
+		l->size = l->size ? 2 * l->size : 16;
+		l->tab = mem_realloc(l->tab, l->size, sizeof(long));
+	}
+	l->tab[l->count++] = sec2days(day);
+}
+
 /*
  * Travel through each occurence of an item, and execute the given callback
  * (mainly used to export data).
  */
 static void
-foreach_date_dump(const long date_end, struct rpt *rpt, llist_t * exc,
+foreach_date_dump(const long date_end, struct rpt *rpt, exc_list_t *exc,
 		  long item_start, long item_dur, char *item_mesg,
 		  cb_dump_t cb_dump, FILE * stream)
 {
-	long date, item_time;
-	struct tm lt;
-	time_t t;
-
-	t = item_start;
-	localtime_r(&t, &lt);
-	lt.tm_hour = lt.tm_min = lt.tm_sec = 0;
-	lt.tm_isdst = -1;
-	date = mktime(&lt);
+	long date, item_time, last;
+	struct date_list days = { NULL, 0, 0 };
+	unsigned k = 0;
+
+	date = days2sec(sec2days(item_start), 0, 0);
 	item_time = item_start - date;
 
+	/* Expand the item over the whole period at once. */
+	last = MIN(date_end, rpt->until);
+	if (last >= date)
+		recur_expand_window(item_start, item_dur, rpt, exc, date,
+				    last + 1, foreach_date_add, &days);
+
 	while (date <= date_end && date <= rpt->until) {
-		if (recur_item_inday(item_start, item_dur, rpt, exc, date)) {
+		while (k < days.count && days.tab[k] < sec2days(date))
+			k++;
+		if (k < days.count && days.tab[k] == sec2days(date)) {
 			(*cb_dump) (stream, date + item_time, item_dur,
 				    item_mesg);
 		}
@@ -96,6 +118,8 @@ foreach_date_dump(const long date_end, struct rpt *rpt, llist_t * exc,
 			break;
 		}
 	}
+	if (days.tab)
+		mem_free(days.tab);
 }
 
 static void pcal_export_header(FILE * stream)
@@ -67,6 +67,7 @@ struct event *que_ins(char *mesg, time_t time, int id)
 	ev->day = time;
 	ev->id = id;
 	ev->note = NULL;
+	ev->hash = NULL;
 	pthread_mutex_lock(&que_mutex);
 	LLIST_ADD(&sysqueue, ev);
 	pthread_mutex_unlock(&que_mutex);
@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -46,6 +47,33 @@
 llist_ts_t recur_alist_p;
 llist_t recur_elist;
 
+/*
+ * Occurrence cache of a recurrent item: a small direct-mapped table of days
+ * along with the occurrence found for each of them, if any. Entries from an
+ * older generation are stale. The generation is bumped whenever an item, or
+ * anything else the occurrences depend on, is changed.
+ *
+ * The cache belongs to the item: the cache of a recurrent appointment may only
+ * be used with recur_alist_p locked, since the notification thread looks up
+ * appointments as well, while recurrent events are only used by the main
+ * thread. The statistics are shared, and have a lock of their own.
+ */
+#define RECUR_CACHE_SIZE	16
+
+struct recur_cache {
+	struct {
+		time_t day;
+		time_t occurrence;
+		unsigned gen;
+		unsigned found;
+	} tab[RECUR_CACHE_SIZE];
+};
+
+static unsigned recur_cache_gen = 1;
+static unsigned long recur_cache_hits;
+static unsigned long recur_cache_misses;
+static pthread_mutex_t recur_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void free_int(int *i)
 {
 	mem_free(i);
@@ -74,66 +102,150 @@ void recur_int_list_dup(llist_t *l, llist_t *ilist)
 	}
 }
 
-static int int_cmp(int *list, int *i)
+/*
+ * Compile the BY-lists of a recurrence rule into the bit masks used for
+ * membership tests. Must be called whenever the lists have changed.
+ */
+void recur_rpt_compile(struct rpt *rpt)
+{
+	llist_item_t *i;
+	int v, n;
+
+	rpt->bymonth_mask = 0;
+	LLIST_FOREACH(&rpt->bymonth, i) {
+		v = *(int *)LLIST_GET_DATA(i);
+		if (v >= 1 && v <= YEARINMONTHS)
+			rpt->bymonth_mask |= 1U << v;
+	}
+
+	rpt->bymonthday_pmask = rpt->bymonthday_nmask = 0;
+	LLIST_FOREACH(&rpt->bymonthday, i) {
+		v = *(int *)LLIST_GET_DATA(i);
+		if (v >= 1 && v <= 31)
+			rpt->bymonthday_pmask |= 1U << v;
+		else if (v <= -1 && v >= -31)
+			rpt->bymonthday_nmask |= 1U << -v;
+	}
+
+	memset(rpt->bywday_pmask, 0, sizeof(rpt->bywday_pmask));
+	memset(rpt->bywday_nmask, 0, sizeof(rpt->bywday_nmask));
+	LLIST_FOREACH(&rpt->bywday, i) {
+		v = *(int *)LLIST_GET_DATA(i);
+		n = (v < 0 ? -v : v) / WEEKINDAYS;
+		if (n > 63)
+			continue;
+		if (v < 0)
+			rpt->bywday_nmask[-v % WEEKINDAYS] |= 1ULL << n;
+		else
+			rpt->bywday_pmask[v % WEEKINDAYS] |= 1ULL << n;
+	}
+}
+
+/* Membership tests for the compiled BY-lists. */
+static int bymonth_has(struct rpt *rpt, int mon)
 {
-	return *list == *i;
+	return mon >= 1 && mon <= YEARINMONTHS &&
+	       (rpt->bymonth_mask & (1U << mon));
 }
 
-static void free_exc(struct excp *exc)
+static int bymonthday_has(struct rpt *rpt, int mday)
 {
-	mem_free(exc);
+	if (mday >= 1 && mday <= 31)
+		return (rpt->bymonthday_pmask & (1U << mday)) != 0;
+	if (mday <= -1 && mday >= -31)
+		return (rpt->bymonthday_nmask & (1U << -mday)) != 0;
+	return 0;
 }
 
-void recur_free_exc_list(llist_t * exc)
+static int bywday_has(struct rpt *rpt, int wday)
 {
-	LLIST_FREE_INNER(exc, free_exc);
-	LLIST_FREE(exc);
+	int n = (wday < 0 ? -wday : wday) / WEEKINDAYS;
+
+	if (n > 63)
+		return 0;
+	if (wday < 0)
+		return (rpt->bywday_nmask[-wday % WEEKINDAYS] >> n) & 1;
+	return (rpt->bywday_pmask[wday % WEEKINDAYS] >> n) & 1;
 }
 
-static int exc_cmp_day(struct excp *a, struct excp *b)
+void recur_exc_init(exc_list_t *exc)
 {
-	return a->st < b->st ? -1 : (a->st == b->st ? 0 : 1);
+	exc->tab = NULL;
+	exc->count = exc->size = 0;
 }
 
-static int exc_inday(struct excp *exc, time_t *day_start)
+void recur_free_exc_list(exc_list_t *exc)
 {
-	return (date_cmp_day(exc->st, *day_start) == 0);
+	if (exc->tab)
+		mem_free(exc->tab);
+	recur_exc_init(exc);
 }
 
-static void recur_add_exc(llist_t * exc, time_t day)
+/*
+ * Return the position of the first exception after the given day, i.e. where
+ * an exception on that day is inserted.
+ */
+static unsigned exc_upper_bound(exc_list_t *exc, long day)
 {
-	struct excp *o = mem_malloc(sizeof(struct excp));
-	o->st = day;
+	unsigned lo = 0, hi = exc->count, mid;
 
-	LLIST_ADD_SORTED(exc, o, exc_cmp_day);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (exc->tab[mid].day <= day)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
 }
 
-void recur_exc_dup(llist_t * in, llist_t * exc)
+/* Return true if the given day (see date2days()) is an exception day. */
+static int exc_has_day(exc_list_t *exc, long day)
 {
-	llist_item_t *i;
+	unsigned n = exc_upper_bound(exc, day);
 
-	LLIST_INIT(in);
+	return n > 0 && exc->tab[n - 1].day == day;
+}
 
-	if (exc) {
-		LLIST_FOREACH(exc, i) {
-			struct excp *p = LLIST_GET_DATA(i);
-			recur_add_exc(in, p->st);
-		}
+void recur_add_exc(exc_list_t *exc, time_t day)
+{
+	unsigned n;
+	long d = sec2days(day);
+
+	if (exc->count == exc->size) {
+		exc->size = exc->size ? 2 * exc->size : 4;
+		exc->tab = mem_realloc(exc->tab, exc->size,
+				       sizeof(struct excp));
+	}
+	n = exc_upper_bound(exc, d);
+	memmove(exc->tab + n + 1, exc->tab + n,
+		(exc->count - n) * sizeof(struct excp));
+	exc->tab[n].st = day;
+	exc->tab[n].day = d;
+	exc->count++;
+}
+
+void recur_exc_dup(exc_list_t *in, exc_list_t *exc)
+{
+	recur_exc_init(in);
+
+	if (exc && exc->count) {
+		in->size = in->count = exc->count;
+		in->tab = mem_calloc(in->size, sizeof(struct excp));
+		memcpy(in->tab, exc->tab, in->count * sizeof(struct excp));
 	}
 }
 
 /* Return a string containing the exception days. */
-char *recur_exc2str(llist_t *exc)
+char *recur_exc2str(exc_list_t *exc)
 {
-	llist_item_t *i;
-	struct excp *p;
+	unsigned i;
 	struct string s;
 	struct tm tm;
 
 	string_init(&s);
-	LLIST_FOREACH(exc, i) {
-		p = LLIST_GET_DATA(i);
-		localtime_r(&p->st, &tm);
+	for (i = 0; i < exc->count; i++) {
+		localtime_r(&exc->tab[i].st, &tm);
 		string_catftime(&s, DATEFMT(conf.input_datefmt), &tm);
 		string_catf(&s, "%c", ' ');
 	}
@@ -144,13 +256,13 @@ char *recur_exc2str(llist_t *exc)
  * Update a list of exceptions from a string of days. Any positive number of
  * spaces are allowed before, between and after the days.
  */
-int recur_str2exc(llist_t *exc, char *days)
+int recur_str2exc(exc_list_t *exc, char *days)
 {
 	int updated = 0;
 	char *d;
 	time_t t = get_today();
-	llist_t nexc;
-	LLIST_INIT(&nexc);
+	exc_list_t nexc;
+	recur_exc_init(&nexc);
 
 	while (1) {
 		while (*days == ' ')
@@ -185,6 +297,8 @@ struct recur_event *recur_event_dup(struct recur_event *in)
 	rev->id = in->id;
 	rev->day = in->day;
 	rev->mesg = mem_strdup(in->mesg);
+	rev->cache = NULL;
+	rev->hash = NULL;
 
 	rev->rpt = mem_malloc(sizeof(struct rpt));
 	/* Note. The linked lists are NOT copied and no memory allocated. */
@@ -194,7 +308,8 @@ struct recur_event *recur_event_dup(struct recur_event *in)
 	LLIST_INIT(&rev->rpt->bymonth);
 	LLIST_INIT(&rev->rpt->bywday);
 	LLIST_INIT(&rev->rpt->bymonthday);
-	LLIST_INIT(&rev->rpt->exc);
+	recur_exc_init(&rev->rpt->exc);
+	recur_rpt_compile(rev->rpt);
 
 	recur_exc_dup(&rev->exc, &in->exc);
 
@@ -217,6 +332,8 @@ struct recur_apoint *recur_apoint_dup(struct recur_apoint *in)
 	rapt->dur = in->dur;
 	rapt->state = in->state;
 	rapt->mesg = mem_strdup(in->mesg);
+	rapt->cache = NULL;
+	rapt->hash = NULL;
 
 	rapt->rpt = mem_malloc(sizeof(struct rpt));
 	/* Note. The linked lists are NOT copied and no memory allocated. */
@@ -226,7 +343,8 @@ struct recur_apoint *recur_apoint_dup(struct recur_apoint *in)
 	LLIST_INIT(&rapt->rpt->bymonth);
 	LLIST_INIT(&rapt->rpt->bywday);
 	LLIST_INIT(&rapt->rpt->bymonthday);
-	LLIST_INIT(&rapt->rpt->exc);
+	recur_exc_init(&rapt->rpt->exc);
+	recur_rpt_compile(rapt->rpt);
 
 	recur_exc_dup(&rapt->exc, &in->exc);
 
@@ -261,6 +379,10 @@ void recur_apoint_free(struct recur_apoint *rapt)
 		mem_free(rapt->rpt);
 	}
 	recur_free_exc_list(&rapt->exc);
+	if (rapt->cache)
+		mem_free(rapt->cache);
+	if (rapt->hash)
+		mem_free(rapt->hash);
 	mem_free(rapt);
 }
 
@@ -277,19 +399,243 @@ void recur_event_free(struct recur_event *rev)
 		mem_free(rev->rpt);
 	}
 	recur_free_exc_list(&rev->exc);
+	if (rev->cache)
+		mem_free(rev->cache);
+	if (rev->hash)
+		mem_free(rev->hash);
 	mem_free(rev);
 }
 
+/*
+ * Prefilter for the items of a recurrent item list. For each item, in list
+ * order, it records the days the item can possibly occur on: an interval
+ * between the first and the last day of its occurrences (which stays open if
+ * the rule has no until date), and the days of the week and of the month its
+ * occurrences fall on, when the rule allows to tell. The items are grouped in
+ * blocks, for which the union of the intervals is kept, so that whole blocks
+ * of expired or future rules can be skipped at once.
+ *
+ * The prefilter is rebuilt from the list on the first lookup after a change.
+ */
+#define RECUR_PF_BLOCK	32
+#define RECUR_PF_WDAYS	0x7fU		/* all days of the week */
+#define RECUR_PF_MDAYS	0xfffffffeU	/* all days of the month */
+
+struct recur_pf_item {
+	void *item;
+	long first;		/* first day */
+	long last;		/* last day */
+	unsigned wdays;		/* bit w: day of the week w */
+	unsigned mdays;		/* bit d: day of the month d */
+};
+
+struct recur_pf {
+	int valid;
+	unsigned count;
+	unsigned size;
+	struct recur_pf_item *tab;
+	long *bfirst;		/* first day of each block */
+	long *blast;		/* last day of each block */
+};
+
+static struct recur_pf recur_apoint_pf;
+static struct recur_pf recur_event_pf;
+
+static void recur_pf_set(struct recur_pf_item *p, void *item, time_t start,
+			 long dur, struct rpt *rpt)
+{
+	long span = 0;
+	unsigned wdays;
+	int w, k;
+
+	p->item = item;
+	p->first = sec2days(start);
+
+	/* The number of days an occurrence may stretch into, allowing for DST. */
+	if (dur > 0)
+		span = (start - days2sec(p->first, 0, 0) + dur - 1 + HOURINSEC) /
+		       DAYINSEC;
+	p->last = rpt->until ? sec2days(rpt->until) + 1 + span : LONG_MAX;
+
+	p->wdays = RECUR_PF_WDAYS;
+	p->mdays = RECUR_PF_MDAYS;
+	switch (rpt->type) {
+	case RECUR_WEEKLY:
+		if (!rpt->bywday.head) {
+			p->wdays = 1U << days2wday(p->first);
+			break;
+		}
+		p->wdays = 0;
+		for (w = 0; w < WEEKINDAYS; w++) {
+			if (rpt->bywday_pmask[w] & 1)
+				p->wdays |= 1U << w;
+		}
+		break;
+	case RECUR_MONTHLY:
+	case RECUR_YEARLY:
+		if (rpt->bymonthday.head) {
+			if (!rpt->bymonthday_nmask)
+				p->mdays = rpt->bymonthday_pmask;
+		} else if (rpt->bywday.head) {
+			p->wdays = 0;
+			for (w = 0; w < WEEKINDAYS; w++) {
+				if (rpt->bywday_pmask[w] ||
+				    rpt->bywday_nmask[w])
+					p->wdays |= 1U << w;
+			}
+		} else {
+			p->mdays = 1U << days2date(p->first).dd;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (span > 0) {
+		p->mdays = RECUR_PF_MDAYS;
+		wdays = p->wdays;
+		for (k = 1; k <= span && k < WEEKINDAYS; k++)
+			p->wdays |= ((wdays << k) | (wdays >> (WEEKINDAYS - k))) &
+				    RECUR_PF_WDAYS;
+	}
+}
+
+static void recur_pf_add(struct recur_pf *pf, void *item, time_t start,
+			 long dur, struct rpt *rpt)
+{
+	unsigned b;
+
+	if (pf->count == pf->size) {
+		pf->size = pf->size ? 2 * pf->size : RECUR_PF_BLOCK;
+		pf->tab = mem_realloc(pf->tab, pf->size,
+				      sizeof(struct recur_pf_item));
+		pf->bfirst = mem_realloc(pf->bfirst,
+					 pf->size / RECUR_PF_BLOCK,
+					 sizeof(long));
+		pf->blast = mem_realloc(pf->blast, pf->size / RECUR_PF_BLOCK,
+					sizeof(long));
+	}
+	recur_pf_set(&pf->tab[pf->count], item, start, dur, rpt);
+
+	b = pf->count / RECUR_PF_BLOCK;
+	if (pf->count % RECUR_PF_BLOCK == 0) {
+		pf->bfirst[b] = pf->tab[pf->count].first;
+		pf->blast[b] = pf->tab[pf->count].last;
+	} else {
+		pf->bfirst[b] = MIN(pf->bfirst[b], pf->tab[pf->count].first);
+		pf->blast[b] = MAX(pf->blast[b], pf->tab[pf->count].last);
+	}
+	pf->count++;
+}
+
+static void recur_pf_free(struct recur_pf *pf)
+{
+	if (pf->tab) {
+		mem_free(pf->tab);
+		mem_free(pf->bfirst);
+		mem_free(pf->blast);
+	}
+	pf->tab = NULL;
+	pf->bfirst = pf->blast = NULL;
+	pf->count = pf->size = 0;
+	pf->valid = 0;
+}
+
+/*
+ * Add the items of a prefilter which may occur between the days first and last
+ * to a vector, in list order.
+ */
+static void recur_pf_find(struct recur_pf *pf, long first, long last,
+			  vector_t *v)
+{
+	unsigned wdays = RECUR_PF_WDAYS, mdays = RECUR_PF_MDAYS;
+	unsigned b, i, end;
+	long n;
+
+	if (last - first < WEEKINDAYS - 1) {
+		for (wdays = 0, n = first; n <= last; n++)
+			wdays |= 1U << days2wday(n);
+	}
+	if (last - first < 28) {
+		for (mdays = 0, n = first; n <= last; n++)
+			mdays |= 1U << days2date(n).dd;
+	}
+
+	for (b = 0; b * RECUR_PF_BLOCK < pf->count; b++) {
+		if (pf->bfirst[b] > last || pf->blast[b] < first)
+			continue;
+		end = MIN(pf->count, (b + 1) * RECUR_PF_BLOCK);
+		for (i = b * RECUR_PF_BLOCK; i < end; i++) {
+			struct recur_pf_item *p = &pf->tab[i];
+
+			if (p->first <= last && p->last >= first &&
+			    (p->wdays & wdays) && (p->mdays & mdays))
+				VECTOR_ADD(v, p->item);
+		}
+	}
+}
+
+/*
+ * Mark the prefilters and the occurrence caches as outdated, after an item was
+ * changed in place or anything else the occurrences depend on.
+ */
+void recur_invalidate_caches(void)
+{
+	recur_apoint_pf.valid = 0;
+	recur_event_pf.valid = 0;
+	recur_cache_gen++;
+}
+
+/*
+ * Add the recurrent appointments which may have an occurrence on a day between
+ * from and to (excluded) to a vector, in list order. The list must be locked
+ * by the caller. The candidates still need to be checked.
+ */
+void recur_apoint_find_candidates(time_t from, time_t to, vector_t *v)
+{
+	llist_item_t *i;
+
+	if (!recur_apoint_pf.valid) {
+		recur_apoint_pf.count = 0;
+		LLIST_TS_FOREACH(&recur_alist_p, i) {
+			struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+			recur_pf_add(&recur_apoint_pf, rapt, rapt->start,
+				     rapt->dur, rapt->rpt);
+		}
+		recur_apoint_pf.valid = 1;
+	}
+	recur_pf_find(&recur_apoint_pf, sec2days(from), sec2days(to - 1), v);
+}
+
+/* Same as recur_apoint_find_candidates(), for recurrent events. */
+void recur_event_find_candidates(time_t from, time_t to, vector_t *v)
+{
+	llist_item_t *i;
+
+	if (!recur_event_pf.valid) {
+		recur_event_pf.count = 0;
+		LLIST_FOREACH(&recur_elist, i) {
+			struct recur_event *rev = LLIST_GET_DATA(i);
+			recur_pf_add(&recur_event_pf, rev, rev->day, -1,
+				     rev->rpt);
+		}
+		recur_event_pf.valid = 1;
+	}
+	recur_pf_find(&recur_event_pf, sec2days(from), sec2days(to - 1), v);
+}
+
 void recur_apoint_llist_free(void)
 {
 	LLIST_TS_FREE_INNER(&recur_alist_p, recur_apoint_free);
 	LLIST_TS_FREE(&recur_alist_p);
+	recur_pf_free(&recur_apoint_pf);
 }
 
 void recur_event_llist_free(void)
 {
 	LLIST_FREE_INNER(&recur_elist, recur_event_free);
 	LLIST_FREE(&recur_elist);
+	recur_pf_free(&recur_event_pf);
 }
 
 static int
@@ -317,9 +663,8 @@ static int recur_event_cmp(struct recur_event *a, struct recur_event *b)
 	return strcmp(a->mesg, b->mesg);
 }
 
-/* Insert a new recursive appointment in the general linked list */
-struct recur_apoint *recur_apoint_new(char *mesg, char *note, time_t start,
-				      long dur, char state, struct rpt *rpt)
+struct recur_apoint *recur_apoint_alloc(char *mesg, char *note, time_t start,
+					long dur, char state, struct rpt *rpt)
 {
 	struct recur_apoint *rapt =
 	    mem_malloc(sizeof(struct recur_apoint));
@@ -329,6 +674,8 @@ struct recur_apoint *recur_apoint_new(char *mesg, char *note, time_t start,
 	rapt->start = start;
 	rapt->dur = dur;
 	rapt->state = state;
+	rapt->cache = NULL;
+	rapt->hash = NULL;
 	rapt->rpt = mem_malloc(sizeof(struct rpt));
 	*rapt->rpt = *rpt;
 	recur_int_list_dup(&rapt->rpt->bymonth, &rpt->bymonth);
@@ -337,24 +684,48 @@ struct recur_apoint *recur_apoint_new(char *mesg, char *note, time_t start,
 	recur_free_int_list(&rpt->bywday);
 	recur_int_list_dup(&rapt->rpt->bymonthday, &rpt->bymonthday);
 	recur_free_int_list(&rpt->bymonthday);
+	recur_rpt_compile(rapt->rpt);
 	/*
 	 * Note. The exception dates are in the list rapt->exc.
 	 * The (empty) list rapt->rpt->exc is not used.
 	 */
 	recur_exc_dup(&rapt->exc, &rpt->exc);
 	recur_free_exc_list(&rpt->exc);
-	LLIST_INIT(&rapt->rpt->exc);
+	recur_exc_init(&rapt->rpt->exc);
+
+	return rapt;
+}
+
+/* Insert a new recursive appointment in the general linked list */
+struct recur_apoint *recur_apoint_new(char *mesg, char *note, time_t start,
+				      long dur, char state, struct rpt *rpt)
+{
+	struct recur_apoint *rapt =
+	    recur_apoint_alloc(mesg, note, start, dur, state, rpt);
 
 	LLIST_TS_LOCK(&recur_alist_p);
 	LLIST_TS_ADD_SORTED(&recur_alist_p, rapt, recur_apoint_cmp);
+	recur_apoint_pf.valid = 0;
 	LLIST_TS_UNLOCK(&recur_alist_p);
 
 	return rapt;
 }
 
-/* Insert a new recursive event in the general linked list */
-struct recur_event *recur_event_new(char *mesg, char *note, time_t day,
-				    int id, struct rpt *rpt)
+/*
+ * Insert the recurrent appointments collected by recur_apoint_scan() in the
+ * list, all at once. The vector is left sorted.
+ */
+void recur_apoint_add_all(vector_t *v)
+{
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_ADD_SORTED_ALL(&recur_alist_p, v->data, VECTOR_COUNT(v),
+				recur_apoint_cmp);
+	recur_apoint_pf.valid = 0;
+	LLIST_TS_UNLOCK(&recur_alist_p);
+}
+
+struct recur_event *recur_event_alloc(char *mesg, char *note, time_t day,
+				      int id, struct rpt *rpt)
 {
 	struct recur_event *rev = mem_malloc(sizeof(struct recur_event));
 
@@ -362,6 +733,8 @@ struct recur_event *recur_event_new(char *mesg, char *note, time_t day,
 	rev->note = (note != NULL) ? mem_strdup(note) : 0;
 	rev->day = day;
 	rev->id = id;
+	rev->cache = NULL;
+	rev->hash = NULL;
 	rev->rpt = mem_malloc(sizeof(struct rpt));
 	*rev->rpt = *rpt;
 	recur_int_list_dup(&rev->rpt->bymonth, &rpt->bymonth);
@@ -370,16 +743,38 @@ struct recur_event *recur_event_new(char *mesg, char *note, time_t day,
 	recur_free_int_list(&rpt->bywday);
 	recur_int_list_dup(&rev->rpt->bymonthday, &rpt->bymonthday);
 	recur_free_int_list(&rpt->bymonthday);
+	recur_rpt_compile(rev->rpt);
 	/* Similarly as for recurrent appointment. */
 	recur_exc_dup(&rev->exc, &rpt->exc);
 	recur_free_exc_list(&rpt->exc);
-	LLIST_INIT(&rev->rpt->exc);
+	recur_exc_init(&rev->rpt->exc);
+
+	return rev;
+}
+
+/* Insert a new recursive event in the general linked list */
+struct recur_event *recur_event_new(char *mesg, char *note, time_t day,
+				    int id, struct rpt *rpt)
+{
+	struct recur_event *rev = recur_event_alloc(mesg, note, day, id, rpt);
 
 	LLIST_ADD_SORTED(&recur_elist, rev, recur_event_cmp);
+	recur_event_pf.valid = 0;
 
 	return rev;
 }
 
+/*
+ * Insert the recurrent events collected by recur_event_scan() in the list,
+ * all at once. The vector is left sorted.
+ */
+void recur_event_add_all(vector_t *v)
+{
+	LLIST_ADD_SORTED_ALL(&recur_elist, v->data, VECTOR_COUNT(v),
+			     recur_event_cmp);
+	recur_event_pf.valid = 0;
+}
+
 /*
  * Correspondance between the defines on recursive type,
  * and the letter to be written in file.
@@ -470,16 +865,15 @@ static void bymonth_append(struct string *s, llist_t *l)
 }
 
 /* Write days for which recurrent items should not be repeated. */
-static void recur_exc_append(struct string *s, llist_t *lexc)
+static void recur_exc_append(struct string *s, exc_list_t *lexc)
 {
-	llist_item_t *i;
+	unsigned i;
 	struct tm lt;
 	time_t t;
 	int st_mon, st_day, st_year;
 
-	LLIST_FOREACH(lexc, i) {
-		struct excp *exc = LLIST_GET_DATA(i);
-		t = exc->st;
+	for (i = 0; i < lexc->count; i++) {
+		t = lexc->tab[i].st;
 		localtime_r(&t, &lt);
 		st_mon = lt.tm_mon + 1;
 		st_day = lt.tm_mday;
@@ -489,12 +883,13 @@ static void recur_exc_append(struct string *s, llist_t *lexc)
 }
 
 /* Load the recursive appointment description */
-char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
+char *recur_apoint_scan(char *buf, struct tm start, struct tm end,
 				       char state, char *note,
 				       struct item_filter *filter,
-				       struct rpt *rpt)
+				       struct rpt *rpt, vector_t *items)
 {
-	char buf[BUFSIZ], *nl;
+	struct date dstart = { start.tm_mday, start.tm_mon, start.tm_year };
+	struct date dend = { end.tm_mday, end.tm_mon, end.tm_year };
 	time_t tstart, tend;
 	struct recur_apoint *rapt = NULL;
 	int cond;
@@ -505,24 +900,13 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 	    !check_time(end.tm_hour, end.tm_min))
 		return _("illegal date in appointment");
 
-	/* Read the appointment description */
-	if (!fgets(buf, sizeof buf, f))
+	if (!buf)
 		return _("error in appointment description");
 
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
-	start.tm_sec = end.tm_sec = 0;
-	start.tm_isdst = end.tm_isdst = -1;
-	start.tm_year -= 1900;
-	start.tm_mon--;
-	end.tm_year -= 1900;
-	end.tm_mon--;
-	tstart = mktime(&start);
-	tend = mktime(&end);
+	tstart = date2sec(dstart, start.tm_hour, start.tm_min);
+	tend = date2sec(dend, end.tm_hour, end.tm_min);
 
-	if (tstart == -1 || tend == -1 || tstart > tend)
+	if (tstart > tend)
 		 return _("date error in appointment");
 
 	/* Does it occur on the start day? */
@@ -536,39 +920,39 @@ char *recur_apoint_scan(FILE *f, struct tm start, struct tm end,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_RECUR_APPT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->pattern && !pattern_match(filter->pattern, buf)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			rapt = recur_apoint_new(buf, note, tstart,
-						 tend - tstart, state,
-						 rpt);
-			char *hash = recur_apoint_hash(rapt);
-			cond = cond || !hash_matches(filter->hash, hash);
-			mem_free(hash);
+			rapt = recur_apoint_alloc(buf, note, tstart,
+						  tend - tstart, state,
+						  rpt);
+			cond = cond || !hash_matches(filter->hash,
+						     recur_apoint_hash(rapt));
 		}
 
 		if ((!filter->invert && cond) || (filter->invert && !cond)) {
 			if (filter->hash)
-				recur_apoint_erase(rapt);
+				recur_apoint_free(rapt);
 			return NULL;
 		}
 	}
 	if (!rapt)
-		rapt = recur_apoint_new(buf, note, tstart, tend - tstart, state,
-					 rpt);
+		rapt = recur_apoint_alloc(buf, note, tstart, tend - tstart,
+					  state, rpt);
+	VECTOR_ADD(items, rapt);
 	return NULL;
 }
 
 /* Load the recursive events from file */
-char *recur_event_scan(FILE * f, struct tm start, int id,
+char *recur_event_scan(char *buf, struct tm start, int id,
 				     char *note, struct item_filter *filter,
-				     struct rpt *rpt)
+				     struct rpt *rpt, vector_t *items)
 {
-	char buf[BUFSIZ], *nl;
+	struct date dstart = { start.tm_mday, start.tm_mon, start.tm_year };
 	time_t tstart, tend;
 	struct recur_event *rev = NULL;
 	int cond;
@@ -577,24 +961,10 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 	    !check_time(start.tm_hour, start.tm_min))
 		return _("illegel date in event");
 
-	/* Read the event description */
-	if (!fgets(buf, sizeof buf, f))
+	if (!buf)
 		return _("error in appointment description");
 
-	nl = strchr(buf, '\n');
-	if (nl) {
-		*nl = '\0';
-	}
-	start.tm_hour = 0;
-	start.tm_min = 0;
-	start.tm_sec = 0;
-	start.tm_isdst = -1;
-	start.tm_year -= 1900;
-	start.tm_mon--;
-
-	tstart = mktime(&start);
-	if (tstart == -1)
-		return _("date error in event");
+	tstart = date2sec(dstart, 0, 0);
 	tend = ENDOFDAY(tstart);
 
 	/* Does it occur on the start day? */
@@ -608,28 +978,27 @@ char *recur_event_scan(FILE * f, struct tm start, int id,
 	if (filter) {
 		cond = (
 		    !(filter->type_mask & TYPE_MASK_RECUR_EVNT) ||
-		    (filter->regex && regexec(filter->regex, buf, 0, 0, 0)) ||
+		    (filter->pattern && !pattern_match(filter->pattern, buf)) ||
 		    (filter->start_from != -1 && tstart < filter->start_from) ||
 		    (filter->start_to != -1 && tstart > filter->start_to) ||
 		    (filter->end_from != -1 && tend < filter->end_from) ||
 		    (filter->end_to != -1 && tend > filter->end_to)
 		);
 		if (filter->hash) {
-			rev = recur_event_new(buf, note, tstart, id,
-					       rpt);
-			char *hash = recur_event_hash(rev);
-			cond = cond || !hash_matches(filter->hash, hash);
-			mem_free(hash);
+			rev = recur_event_alloc(buf, note, tstart, id, rpt);
+			cond = cond || !hash_matches(filter->hash,
+						     recur_event_hash(rev));
 		}
 
 		if ((!filter->invert && cond) || (filter->invert && !cond)) {
 			if (filter->hash)
-				recur_event_erase(rev);
+				recur_event_free(rev);
 			return NULL;
 		}
 	}
 	if (!rev)
-		rev = recur_event_new(buf, note, tstart, id, rpt);
+		rev = recur_event_alloc(buf, note, tstart, id, rpt);
+	VECTOR_ADD(items, rev);
 	return NULL;
 }
 
@@ -678,14 +1047,12 @@ char *recur_apoint_tostr(struct recur_apoint *o)
 	return string_buf(&s);
 }
 
-char *recur_apoint_hash(struct recur_apoint *rapt)
+/* Same as apoint_hash(), for recurrent appointments. */
+const char *recur_apoint_hash(struct recur_apoint *rapt)
 {
-	char *raw = recur_apoint_tostr(rapt);
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
-	sha1_digest(raw, sha1);
-	mem_free(raw);
+	const char *hash = item_hash_get(rapt->hash);
 
-	return sha1;
+	return hash ? hash : item_hash_set(&rapt->hash, recur_apoint_tostr(rapt));
 }
 
 void recur_apoint_write(struct recur_apoint *o, FILE * f)
@@ -738,14 +1105,12 @@ char *recur_event_tostr(struct recur_event *o)
 	return string_buf(&s);
 }
 
-char *recur_event_hash(struct recur_event *rev)
+/* Same as apoint_hash(), for recurrent events. */
+const char *recur_event_hash(struct recur_event *rev)
 {
-	char *raw = recur_event_tostr(rev);
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
-	sha1_digest(raw, sha1);
-	mem_free(raw);
+	const char *hash = item_hash_get(rev->hash);
 
-	return sha1;
+	return hash ? hash : item_hash_set(&rev->hash, recur_event_tostr(rev));
 }
 
 void recur_event_write(struct recur_event *o, FILE * f)
@@ -755,24 +1120,6 @@ void recur_event_write(struct recur_event *o, FILE * f)
 	mem_free(str);
 }
 
-/* Write recursive items to file. */
-void recur_save_data(FILE * f)
-{
-	llist_item_t *i;
-
-	LLIST_FOREACH(&recur_elist, i) {
-		struct recur_event *rev = LLIST_GET_DATA(i);
-		recur_event_write(rev, f);
-	}
-
-	LLIST_TS_LOCK(&recur_alist_p);
-	LLIST_TS_FOREACH(&recur_alist_p, i) {
-		struct recur_apoint *rapt = LLIST_GET_DATA(i);
-		recur_apoint_write(rapt, f);
-	}
-	LLIST_TS_UNLOCK(&recur_alist_p);
-}
-
 /*
  * Return the month day counted from the opposite end of the month.
  */
@@ -840,7 +1187,7 @@ static long diff_years(struct tm lt_start, struct tm lt_end)
 
 /*
  * Return true if 'mon' and 'mday' is month and day of t
- * (after a call of mktime()).
+ * (after a call of tm2sec()).
  */
 static int date_chk(time_t t, int mon, int mday)
 {
@@ -855,7 +1202,7 @@ static int date_chk(time_t t, int mon, int mday)
  * Return true if the rrule (start, dur, rpt, exc) has an occurrence on the
  * given day. If so, save that occurrence in a (dynamic or static) buffer.
  */
-static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc,
+static int find_occurrence(time_t start, long dur, struct rpt *rpt, exc_list_t *exc,
 			   time_t day, time_t *occurrence)
 {
 	/*
@@ -926,8 +1273,7 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 	}
 
 	/* Switch to calendar (Unix) time. */
-	lt_occur.tm_isdst = -1;
-	t = mktime(&lt_occur);
+	t = tm2sec(&lt_occur);
 
 	/*
 	 * Impossible dates must be ignored (according to RFC 5545). Changing
@@ -946,13 +1292,13 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 		     lt_occur.tm_mday);
 	if (rpt->bymonthday.head &&
 	    rpt->type == RECUR_DAILY &&
-	    !LLIST_FIND_FIRST(&rpt->bymonthday, &lt_occur.tm_mday, int_cmp) &&
-	    !LLIST_FIND_FIRST(&rpt->bymonthday, &mday, int_cmp))
+	    !bymonthday_has(rpt, lt_occur.tm_mday) &&
+	    !bymonthday_has(rpt, mday))
 		return 0;
 
 	/* BYDAY reduction for DAILY */
 	if (rpt->bywday.head && rpt->type == RECUR_DAILY &&
-	    !LLIST_FIND_FIRST(&rpt->bywday, &lt_occur.tm_wday, int_cmp))
+	    !bywday_has(rpt, lt_occur.tm_wday))
 		return 0;
 
 	/*
@@ -971,9 +1317,9 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 					 lt_occur.tm_wday)
 			- 1;
 		nwday = order * WEEKINDAYS - lt_occur.tm_wday;
-		if (!LLIST_FIND_FIRST(&rpt->bywday, &lt_occur.tm_wday, int_cmp) &&
-		    !LLIST_FIND_FIRST(&rpt->bywday, &pwday, int_cmp) &&
-		    !LLIST_FIND_FIRST(&rpt->bywday, &nwday, int_cmp))
+		if (!bywday_has(rpt, lt_occur.tm_wday) &&
+		    !bywday_has(rpt, pwday) &&
+		    !bywday_has(rpt, nwday))
 			return 0;
 	}
 
@@ -992,9 +1338,9 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 					lt_occur.tm_wday)
 			- 1;
 		nwday = order * WEEKINDAYS - lt_occur.tm_wday;
-		if (!LLIST_FIND_FIRST(&rpt->bywday, &lt_occur.tm_wday, int_cmp) &&
-		    !LLIST_FIND_FIRST(&rpt->bywday, &pwday, int_cmp) &&
-		    !LLIST_FIND_FIRST(&rpt->bywday, &nwday, int_cmp))
+		if (!bywday_has(rpt, lt_occur.tm_wday) &&
+		    !bywday_has(rpt, pwday) &&
+		    !bywday_has(rpt, nwday))
 			return 0;
 	}
 
@@ -1002,12 +1348,16 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 	mon = lt_occur.tm_mon + 1;
 	if (rpt->bymonth.head &&
 	    rpt->type != RECUR_YEARLY &&
-	    !LLIST_FIND_FIRST(&rpt->bymonth, &mon, int_cmp))
+	    !bymonth_has(rpt, mon))
 		return 0;
 
 	/* Exception day? */
-	if (exc && LLIST_FIND_FIRST(exc, &t, exc_inday))
-		return 0;
+	if (exc && exc->count) {
+		struct date d = { lt_occur.tm_mday, lt_occur.tm_mon + 1,
+				  lt_occur.tm_year + 1900 };
+		if (exc_has_day(exc, date2days(d)))
+			return 0;
+	}
 
 	/* Extraneous day? */
 	if (rpt->until && t >= NEXTDAY(rpt->until))
@@ -1034,7 +1384,7 @@ static int find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
  * Return true if the rrule (s, d, r, e) has an occurrence, depending
  * on the frequency, in the year, month or week of day.
  */
-static int freq_chk(time_t day, time_t s, long d, struct rpt *r, llist_t *e)
+static int freq_chk(time_t day, time_t s, long d, struct rpt *r, exc_list_t *e)
 {
 	if (r->type == RECUR_DAILY)
 		EXIT(_("no daily frequency check"));
@@ -1059,14 +1409,14 @@ static int freq_chk(time_t day, time_t s, long d, struct rpt *r, llist_t *e)
 		tm_day.tm_mday = tm_start.tm_mday = 1;
 		if (r->type == RECUR_YEARLY)
 			tm_day.tm_mon = tm_start.tm_mon;
-		tm_day.tm_isdst = tm_start.tm_isdst = -1;
-		fc_day = mktime(&tm_day);
-		fc_s = mktime(&tm_start);
+		fc_day = tm2sec(&tm_day);
+		fc_s = tm2sec(&tm_start);
 	}
 	/* Turn all reductions off. */
 	fc_rpt = *r;
 	fc_rpt.until = 0;
 	fc_rpt.bymonth.head = fc_rpt.bywday.head = fc_rpt.bymonthday.head = NULL;
+	recur_rpt_compile(&fc_rpt);
 
 	return find_occurrence(fc_s, d, &fc_rpt, e, fc_day, NULL);
 }
@@ -1075,7 +1425,7 @@ static int freq_chk(time_t day, time_t s, long d, struct rpt *r, llist_t *e)
  * Return true if the rrule (s, d, r, e) has an occurrence on 'day' after
  * 'first'; if so, return it in occurrence.
  */
-static int test_occurrence(time_t s, long d, struct rpt *r, llist_t *e,
+static int test_occurrence(time_t s, long d, struct rpt *r, exc_list_t *e,
 			   time_t first, time_t day, time_t *occurrence)
 {
 	time_t occ;
@@ -1091,7 +1441,7 @@ static int test_occurrence(time_t s, long d, struct rpt *r, llist_t *e,
 }
 
 #define NO_EXPANSION	-1
-static int expand_weekly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
+static int expand_weekly(time_t start, long dur, struct rpt *rpt, exc_list_t *exc,
 			   time_t day, time_t *occurrence)
 {
 	struct tm tm_start;
@@ -1127,7 +1477,7 @@ static int expand_weekly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 	return 0;
 }
 
-static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
+static int expand_monthly(time_t start, long dur, struct rpt *rpt, exc_list_t *exc,
 			   time_t day, time_t *occurrence)
 {
 	struct tm tm_start, tm_day;
@@ -1161,8 +1511,7 @@ static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 			mon = tm_start.tm_mon;
 
 			tm_start.tm_mday = mday;
-			tm_start.tm_isdst = -1;
-			nstart = mktime(&tm_start);
+			nstart = tm2sec(&tm_start);
 			valid = date_chk(nstart, mon, mday);
 			/* Never valid? */
 			if (!valid && !(rpt->freq % 12))
@@ -1173,8 +1522,7 @@ static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				mon -= rpt->freq;
 				tm_start.tm_mon = mon;
 				tm_start.tm_mday = mday;
-				tm_start.tm_isdst = -1;
-				nstart = mktime(&tm_start);
+				nstart = tm2sec(&tm_start);
 				valid = date_chk(nstart, (mon + 12) % 12, mday);
 			}
 			if (test_occurrence(nstart, dur, rpt, exc,
@@ -1215,10 +1563,9 @@ static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				tm_start.tm_mday = 1;
 				tm_start.tm_mon = tm_day.tm_mon;
 				tm_start.tm_year = tm_day.tm_year;
-				tm_start.tm_isdst = -1;
 				/* Start in the week before the month. */
 				nstart = date_sec_change(
-					next_wday(mktime(&tm_start), wday),
+					next_wday(tm2sec(&tm_start), wday),
 					0,
 					-WEEKINDAYS
 				);
@@ -1250,9 +1597,8 @@ static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				tm_start.tm_mday = 1;
 				tm_start.tm_mon = tm_day.tm_mon;
 				tm_start.tm_year = tm_day.tm_year;
-				tm_start.tm_isdst = -1;
 				nstart = date_sec_change(
-					next_wday(mktime(&tm_start), wday),
+					next_wday(tm2sec(&tm_start), wday),
 					0,
 					-WEEKINDAYS
 				);
@@ -1278,7 +1624,7 @@ static int expand_monthly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 	return 0;
 }
 
-static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
+static int expand_yearly(time_t start, long dur, struct rpt *rpt, exc_list_t *exc,
 			   time_t day, time_t *occurrence)
 {
 	struct tm tm_start, tm_day;
@@ -1300,8 +1646,7 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 			/* Modify rrule start with new month. */
 			localtime_r(&start, &tm_start);
 			tm_start.tm_mon = *m - 1;
-			tm_start.tm_isdst = -1;
-			nstart = mktime(&tm_start);
+			nstart = tm2sec(&tm_start);
 			if (!date_chk(nstart, *m - 1, tm_start.tm_mday))
 				continue;
 			if (find_occurrence(nstart, dur, rpt, exc, day,
@@ -1356,9 +1701,8 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				else
 					tm_start.tm_mon = 0;
 				tm_start.tm_year = tm_day.tm_year;
-				tm_start.tm_isdst = -1;
 				nstart = date_sec_change(
-					next_wday(mktime(&tm_start), wday),
+					next_wday(tm2sec(&tm_start), wday),
 					0,
 					-WEEKINDAYS
 				);
@@ -1401,9 +1745,8 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				else
 					tm_start.tm_mon = 0;
 				tm_start.tm_year = tm_day.tm_year;
-				tm_start.tm_isdst = -1;
 				nstart = date_sec_change(
-					next_wday(mktime(&tm_start), wday),
+					next_wday(tm2sec(&tm_start), wday),
 					0,
 					-WEEKINDAYS
 				);
@@ -1434,8 +1777,7 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 			/* Modify rrule start with new monthday. */
 			localtime_r(&start, &tm_start);
 			tm_start.tm_mday = mday;
-			tm_start.tm_isdst = -1;
-			nstart = mktime(&tm_start);
+			nstart = tm2sec(&tm_start);
 			if (!date_chk(nstart, tm_start.tm_mon, mday))
 				continue;
 			if (find_occurrence(nstart, dur, rpt, exc, day,
@@ -1467,8 +1809,7 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
 				}
 				tm_start.tm_mday = mday;
 				tm_start.tm_mon = *m - 1;
-				tm_start.tm_isdst = -1;
-				nstart = mktime(&tm_start);
+				nstart = tm2sec(&tm_start);
 				if (!date_chk(nstart, *m - 1, mday))
 					continue;
 				if (find_occurrence(nstart, dur, rpt, exc, day,
@@ -1498,7 +1839,7 @@ static int expand_yearly(time_t start, long dur, struct rpt *rpt, llist_t *exc,
  * find_occurrence(), possibly with change of type, frequency and start.
  */
 unsigned
-recur_item_find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc,
+recur_item_find_occurrence(time_t start, long dur, struct rpt *rpt, exc_list_t *exc,
 			   time_t day, time_t *occurrence)
 {
 	int res;
@@ -1533,26 +1874,71 @@ recur_item_find_occurrence(time_t start, long dur, struct rpt *rpt, llist_t *exc
 }
 #undef NO_EXPANSION
 
+/* Same as recur_item_find_occurrence(), going through an occurrence cache. */
+static unsigned
+recur_cache_find_occurrence(struct recur_cache **cache, time_t start, long dur,
+			    struct rpt *rpt, exc_list_t *exc, time_t day,
+			    time_t *occurrence)
+{
+	unsigned k = (unsigned long long)day / DAYINSEC % RECUR_CACHE_SIZE;
+	int hit;
+
+	if (!*cache)
+		*cache = mem_calloc(1, sizeof(struct recur_cache));
+
+	hit = (*cache)->tab[k].gen == recur_cache_gen &&
+	      (*cache)->tab[k].day == day;
+	pthread_mutex_lock(&recur_cache_mutex);
+	if (hit)
+		recur_cache_hits++;
+	else
+		recur_cache_misses++;
+	pthread_mutex_unlock(&recur_cache_mutex);
+
+	if (!hit) {
+		(*cache)->tab[k].found = recur_item_find_occurrence(start, dur,
+			rpt, exc, day, &(*cache)->tab[k].occurrence);
+		(*cache)->tab[k].day = day;
+		(*cache)->tab[k].gen = recur_cache_gen;
+	}
+
+	if ((*cache)->tab[k].found && occurrence)
+		*occurrence = (*cache)->tab[k].occurrence;
+	return (*cache)->tab[k].found;
+}
+
+/* Print the occurrence cache statistics if CALCURSE_CACHE_STATS is set. */
+void recur_cache_stats(void)
+{
+	if (!getenv("CALCURSE_CACHE_STATS"))
+		return;
+
+	fprintf(stderr, _("occurrence cache: %lu hits, %lu misses\n"),
+		recur_cache_hits, recur_cache_misses);
+}
+
 unsigned
 recur_apoint_find_occurrence(struct recur_apoint *rapt, time_t day_start,
 			     time_t *occurrence)
 {
-	return recur_item_find_occurrence(rapt->start, rapt->dur, rapt->rpt,
-					  &rapt->exc, day_start, occurrence);
+	return recur_cache_find_occurrence(&rapt->cache, rapt->start,
+					   rapt->dur, rapt->rpt, &rapt->exc,
+					   day_start, occurrence);
 }
 
 unsigned
 recur_event_find_occurrence(struct recur_event *rev, time_t day_start,
 			    time_t *occurrence)
 {
-	return recur_item_find_occurrence(rev->day, -1, rev->rpt, &rev->exc,
-					  day_start, occurrence);
+	return recur_cache_find_occurrence(&rev->cache, rev->day, -1,
+					   rev->rpt, &rev->exc, day_start,
+					   occurrence);
 }
 
 /* Check if a recurrent item belongs to the selected day. */
 unsigned
 recur_item_inday(time_t start, long dur,
-		 struct rpt *rpt, llist_t * exc,
+		 struct rpt *rpt, exc_list_t *exc,
 		 time_t day_start)
 {
 	/* We do not need the (real) start time of the occurrence here, so just
@@ -1563,20 +1949,19 @@ recur_item_inday(time_t start, long dur,
 
 unsigned recur_apoint_inday(struct recur_apoint *rapt, time_t *day_start)
 {
-	return recur_item_inday(rapt->start, rapt->dur, rapt->rpt, &rapt->exc,
-				*day_start);
+	return recur_apoint_find_occurrence(rapt, *day_start, NULL);
 }
 
 unsigned recur_event_inday(struct recur_event *rev, time_t *day_start)
 {
-	return recur_item_inday(rev->day, -1, rev->rpt, &rev->exc,
-				*day_start);
+	return recur_event_find_occurrence(rev, *day_start, NULL);
 }
 
 /* Add an exception to a recurrent event. */
 void recur_event_add_exc(struct recur_event *rev, time_t date)
 {
 	recur_add_exc(&rev->exc, date);
+	recur_cache_gen++;
 }
 
 /* Add an exception to a recurrent appointment. */
@@ -1587,6 +1972,7 @@ void recur_apoint_add_exc(struct recur_apoint *rapt, time_t date)
 	if (notify_bar())
 		need_check_notify = notify_same_recur_item(rapt);
 	recur_add_exc(&rapt->exc, date);
+	recur_cache_gen++;
 	if (need_check_notify)
 		notify_check_next_app(0);
 }
@@ -1603,6 +1989,8 @@ void recur_event_erase(struct recur_event *rev)
 		EXIT(_("event not found"));
 
 	LLIST_REMOVE(&recur_elist, i);
+	recur_event_pf.valid = 0;
+	recur_cache_gen++;
 }
 
 /*
@@ -1622,98 +2010,121 @@ void recur_apoint_erase(struct recur_apoint *rapt)
 	if (notify_bar())
 		need_check_notify = notify_same_recur_item(rapt);
 	LLIST_TS_REMOVE(&recur_alist_p, i);
+	recur_apoint_pf.valid = 0;
+	recur_cache_gen++;
 	if (need_check_notify)
 		notify_check_next_app(0);
 
 	LLIST_TS_UNLOCK(&recur_alist_p);
 }
 
-/* Read monthday list. */
-void recur_bymonthday(llist_t *l, FILE *data_file)
+/*
+ * Remove several recurrent events from the list at once, see
+ * apoint_remove_all().
+ */
+void recur_event_remove_all(vector_t *v)
+{
+	LLIST_REMOVE_ALL(&recur_elist, v->data, VECTOR_COUNT(v));
+	recur_event_pf.valid = 0;
+	recur_cache_gen++;
+}
+
+/* Same as recur_event_remove_all(), for recurrent appointments. */
+void recur_apoint_remove_all(vector_t *v)
+{
+	LLIST_TS_LOCK(&recur_alist_p);
+	LLIST_TS_REMOVE_ALL(&recur_alist_p, v->data, VECTOR_COUNT(v));
+	recur_apoint_pf.valid = 0;
+	recur_cache_gen++;
+	LLIST_TS_UNLOCK(&recur_alist_p);
+}
+
+/* Read monthday list. Return an error message, or NULL on success. */
+char *recur_bymonthday(llist_t *l, char **s)
 {
-	int c = 0, d;
+	int d;
 
 	LLIST_INIT(l);
-	while ((c = getc(data_file)) == 'd') {
-		ungetc(c, data_file);
-		if (fscanf(data_file, "d%d ", &d) != 1)
-			EXIT(_("syntax error in bymonthday"));
+	while (**s == 'd') {
+		(*s)++;
+		if (!io_scan_int(s, &d))
+			return _("syntax error in bymonthday");
+		io_scan_space(s);
 		int *i = mem_malloc(sizeof(int));
 		*i = d;
 		LLIST_ADD(l, i);
 	}
-	ungetc(c, data_file);
+	return NULL;
 }
 
-/* Read weekday list. */
-void recur_bywday(enum recur_type type, llist_t *l, FILE *data_file)
+/* Read weekday list. Return an error message, or NULL on success. */
+char *recur_bywday(enum recur_type type, llist_t *l, char **s)
 {
-	int c = 0, w;
+	int w;
 
 	type = !(type == RECUR_MONTHLY || type == RECUR_YEARLY);
 
 	LLIST_INIT(l);
-	while ((c = getc(data_file)) == 'w') {
-		ungetc(c, data_file);
-		if (fscanf(data_file, "w%d ", &w) != 1)
-			EXIT(_("syntax error in bywday"));
+	while (**s == 'w') {
+		(*s)++;
+		if (!io_scan_int(s, &w))
+			return _("syntax error in bywday");
+		io_scan_space(s);
 		if (type && (w < 0 || w > 6))
-			EXIT(_("illegal BYDAY value"));
+			return _("illegal BYDAY value");
 		int *i = mem_malloc(sizeof(int));
 		*i = w;
 		LLIST_ADD(l, i);
 	}
-	ungetc(c, data_file);
+	return NULL;
 }
 
-/* Read month list. */
-void recur_bymonth(llist_t *l, FILE *data_file)
+/* Read month list. Return an error message, or NULL on success. */
+char *recur_bymonth(llist_t *l, char **s)
 {
-	int c = 0, m;
+	int m;
 
 	LLIST_INIT(l);
-	while ((c = getc(data_file)) == 'm') {
-		ungetc(c, data_file);
-		if (fscanf(data_file, "m%d ", &m) != 1)
-			EXIT(_("syntax error in bymonth"));
-		EXIT_IF(m < 1 || m > 12, _("illegal bymonth value"));
+	while (**s == 'm') {
+		(*s)++;
+		if (!io_scan_int(s, &m))
+			return _("syntax error in bymonth");
+		io_scan_space(s);
+		if (m < 1 || m > 12)
+			return _("illegal bymonth value");
 		int *i = mem_malloc(sizeof(int));
 		*i = m;
 		LLIST_ADD(l, i);
 	}
-	ungetc(c, data_file);
+	return NULL;
 }
 
 /*
  * Read days for which recurrent items must not be repeated
- * (such days are called exceptions).
+ * (such days are called exceptions). Return an error message, or NULL on
+ * success.
  */
-void recur_exc_scan(llist_t * lexc, FILE * data_file)
+char *recur_exc_scan(exc_list_t *lexc, char **s)
 {
-	int c = 0;
-	struct tm day;
+	struct date day;
+	int mon, mday, year;
 
-	LLIST_INIT(lexc);
-	while ((c = getc(data_file)) == '!') {
-		ungetc(c, data_file);
-		if (fscanf(data_file, "!%d / %d / %d ",
-			   &day.tm_mon, &day.tm_mday, &day.tm_year) != 3) {
-			EXIT(_("syntax error in item date"));
-		}
+	recur_exc_init(lexc);
+	while (**s == '!') {
+		(*s)++;
+		if (!io_scan_date(s, &mon, &mday, &year))
+			return _("syntax error in item date");
+		io_scan_space(s);
 
-		EXIT_IF(!check_date(day.tm_year, day.tm_mon, day.tm_mday),
-			_("date error in item exception"));
+		if (!check_date(year, mon, mday))
+			return _("date error in item exception");
 
-		day.tm_hour = 0;
-		day.tm_min = day.tm_sec = 0;
-		day.tm_isdst = -1;
-		day.tm_year -= 1900;
-		day.tm_mon--;
-		struct excp *exc = mem_malloc(sizeof(struct excp));
-		exc->st = mktime(&day);
-		LLIST_ADD(lexc, exc);
+		day.dd = mday;
+		day.mm = mon;
+		day.yyyy = year;
+		recur_add_exc(lexc, date2sec(day, 0, 0));
 	}
-	ungetc(c, data_file);
+	return NULL;
 }
 
 /*
@@ -1769,7 +2180,7 @@ void recur_apoint_switch_notify(struct recur_apoint *rapt)
 void recur_event_paste_item(struct recur_event *rev, time_t date)
 {
 	long time_shift;
-	llist_item_t *i;
+	unsigned i;
 
 	time_shift = date - rev->day;
 	rev->day += time_shift;
@@ -1777,19 +2188,22 @@ void recur_event_paste_item(struct recur_event *rev, time_t date)
 	if (rev->rpt->until != 0)
 		rev->rpt->until += time_shift;
 
-	LLIST_FOREACH(&rev->exc, i) {
-		struct excp *exc = LLIST_GET_DATA(i);
+	for (i = 0; i < rev->exc.count; i++) {
+		struct excp *exc = &rev->exc.tab[i];
 		exc->st += time_shift;
+		exc->day = sec2days(exc->st);
 	}
 
 	LLIST_ADD_SORTED(&recur_elist, rev, recur_event_cmp);
+	recur_event_pf.valid = 0;
+	recur_cache_gen++;
 }
 
 void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 {
 	time_t ostart = rapt->start;
 	int days;
-	llist_item_t *i;
+	unsigned i;
 	struct tm t;
 
 	localtime_r((time_t *)&rapt->start, &t);
@@ -1801,13 +2215,16 @@ void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 	if (rapt->rpt->until != 0)
 		rapt->rpt->until = date_sec_change(rapt->rpt->until, 0, days);
 
-	LLIST_FOREACH(&rapt->exc, i) {
-		struct excp *exc = LLIST_GET_DATA(i);
+	for (i = 0; i < rapt->exc.count; i++) {
+		struct excp *exc = &rapt->exc.tab[i];
 		exc->st = date_sec_change(exc->st, 0, days);
+		exc->day += days;
 	}
 
 	LLIST_TS_LOCK(&recur_alist_p);
 	LLIST_TS_ADD_SORTED(&recur_alist_p, rapt, recur_apoint_cmp);
+	recur_apoint_pf.valid = 0;
+	recur_cache_gen++;
 	LLIST_TS_UNLOCK(&recur_alist_p);
 
 	if (notify_bar())
@@ -1815,47 +2232,409 @@ void recur_apoint_paste_item(struct recur_apoint *rapt, time_t date)
 }
 
 /*
- * Finds the next occurrence of a recurrent item and returns it in the provided
- * buffer. Useful for test of a repeated item.
+ * Occurrence iterator.
+ *
+ * The iterator moves from day to day, but only stops at candidate days, i.e.
+ * days that may be the start day of an occurrence considering the type,
+ * frequency and BY-lists of the rrule. Periods (weeks, months, years) that do
+ * not match the frequency are skipped as a whole using day arithmetic. Every
+ * candidate is confirmed by recur_item_find_occurrence() which has the final
+ * word; hence the candidates need only be a superset of the occurrences.
  */
-int recur_next_occurrence(time_t s, long d, struct rpt *r, llist_t *e,
-			  time_t day, time_t *next)
+
+/*
+ * The Gregorian calendar repeats itself every 400 years (146097 days). Without
+ * an until date, the search for an occurrence is given up after that many
+ * days in addition to one frequency period.
+ */
+#define RECUR_ITER_HORIZON	146097
+
+/* Number of days in a frequency period of the rrule. */
+static long iter_period(struct recur_iter *it)
+{
+	switch (it->rpt->type) {
+	case RECUR_DAILY:
+		return it->rpt->freq;
+	case RECUR_WEEKLY:
+		return it->rpt->freq * WEEKINDAYS;
+	case RECUR_MONTHLY:
+		return it->rpt->freq * 31;
+	case RECUR_YEARLY:
+		return it->rpt->freq * 366;
+	default:
+		EXIT(_("unknown item type"));
+	}
+	return 0;
+}
+
+/*
+ * Set up the iterator for the rrule (start, dur, rpt, exc). The iterator is
+ * positioned at the start day.
+ */
+void recur_iter_init(struct recur_iter *it, time_t start, long dur,
+		     struct rpt *rpt, exc_list_t *exc)
+{
+	int w;
+
+	it->start = start;
+	it->dur = dur;
+	it->rpt = rpt;
+	it->exc = exc;
+	it->sdate = sec2date(start);
+	it->first = date2days(it->sdate);
+	it->week = it->first - WDAY(days2wday(it->first));
+	it->day = it->first;
+
+	/* Week days with order (monthly and yearly rules) are reduced. */
+	it->wdays = 0;
+	for (w = 0; w < WEEKINDAYS; w++) {
+		if (rpt->type == RECUR_DAILY || rpt->type == RECUR_WEEKLY) {
+			if (rpt->bywday_pmask[w] & 1)
+				it->wdays |= 1U << w;
+		} else if (rpt->bywday_pmask[w] || rpt->bywday_nmask[w]) {
+			it->wdays |= 1U << w;
+		}
+	}
+}
+
+/* Position the iterator at the day of t. */
+void recur_iter_seek(struct recur_iter *it, time_t t)
+{
+	it->day = sec2days(t);
+}
+
+/* Is the month (of a candidate day) compatible with the rrule? */
+static int iter_month_ok(struct recur_iter *it, struct date *d)
 {
+	struct rpt *rpt = it->rpt;
+	long diff;
+
+	if (rpt->bymonth_mask && !bymonth_has(rpt, d->mm))
+		return 0;
+
+	switch (rpt->type) {
+	case RECUR_MONTHLY:
+		diff = ((long)d->yyyy - it->sdate.yyyy) * YEARINMONTHS +
+		       (long)d->mm - it->sdate.mm;
+		return diff % rpt->freq == 0;
+	case RECUR_YEARLY:
+		if (((long)d->yyyy - it->sdate.yyyy) % rpt->freq)
+			return 0;
+		/* Without expansion to other months, use the start month. */
+		if (!rpt->bymonth_mask &&
+		    !(it->wdays && !rpt->bymonthday_pmask &&
+		      !rpt->bymonthday_nmask))
+			return d->mm == it->sdate.mm;
+		return 1;
+	default:
+		return 1;
+	}
+}
+
+/* Is the month day of a candidate day in the BYMONTHDAY list? */
+static int iter_mday_ok(struct recur_iter *it, struct date *d)
+{
+	int mlen = days[d->mm - 1] + (d->mm == 2 && ISLEAP(d->yyyy));
+
+	return bymonthday_has(it->rpt, d->dd) ||
+	       bymonthday_has(it->rpt, d->dd - mlen - 1);
+}
+
+/* Is the day n (with date d) a candidate day? */
+static int iter_day_ok(struct recur_iter *it, long n, struct date *d)
+{
+	struct rpt *rpt = it->rpt;
+	int wday = days2wday(n);
+
+	switch (rpt->type) {
+	case RECUR_DAILY:
+		if ((n - it->first) % rpt->freq)
+			return 0;
+		if ((rpt->bymonthday_pmask || rpt->bymonthday_nmask) &&
+		    !iter_mday_ok(it, d))
+			return 0;
+		return !it->wdays || (it->wdays & (1U << wday));
+	case RECUR_WEEKLY:
+		if (!it->wdays)
+			return (n - it->first) % (rpt->freq * WEEKINDAYS) == 0;
+		if (!(it->wdays & (1U << wday)))
+			return 0;
+		return (n - WDAY(wday) - it->week) / WEEKINDAYS %
+		       rpt->freq == 0;
+	case RECUR_MONTHLY:
+	case RECUR_YEARLY:
+		if (rpt->bymonthday_pmask || rpt->bymonthday_nmask)
+			return iter_mday_ok(it, d);
+		if (it->wdays)
+			return (it->wdays & (1U << wday)) != 0;
+		return d->dd == it->sdate.dd;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Find the first candidate day from day n onwards (dir > 0) or backwards
+ * (dir < 0) within [lo, hi]. Return true and the day in n if found.
+ */
+static int iter_candidate(struct recur_iter *it, long *n, int dir, long lo,
+			  long hi)
+{
+	struct date d, m;
+	long p = iter_period(it);
+
+	while (*n >= lo && *n <= hi) {
+		d = days2date(*n);
+		if (!iter_month_ok(it, &d)) {
+			/* Skip the rest of the month. */
+			m = d;
+			m.dd = 1;
+			if (dir > 0) {
+				m.mm = d.mm % YEARINMONTHS + 1;
+				m.yyyy = d.yyyy + (d.mm == YEARINMONTHS);
+				*n = date2days(m);
+			} else {
+				*n = date2days(m) - 1;
+			}
+			continue;
+		}
+		if (it->rpt->type == RECUR_DAILY ||
+		    (it->rpt->type == RECUR_WEEKLY && !it->wdays)) {
+			/* Skip to the nearest multiple of the frequency. */
+			long r = (*n - it->first) % p;
+			if (r < 0)
+				r += p;
+			if (r) {
+				*n += dir > 0 ? p - r : -r;
+				continue;
+			}
+		}
+		if (iter_day_ok(it, *n, &d))
+			return 1;
+		*n += dir;
+	}
+	return 0;
+}
+
+/* Return the (midnight) time of a day number. */
+static time_t iter_day2sec(long n)
+{
+	return days2sec(n, 0, 0);
+}
+
+/*
+ * Advance the iterator to the next occurrence starting on a day after the
+ * current position and not after day last. Return true and the occurrence if
+ * found.
+ */
+static int iter_next(struct recur_iter *it, long last, time_t *occurrence)
+{
+	struct rpt *rpt = it->rpt;
+	time_t day, occ;
+	long n, hi;
 	int ret = 0;
 
-	if (r->until && r->until <= day)
-		return ret;
+	day = iter_day2sec(it->day);
+	if (rpt->until && rpt->until <= day)
+		return 0;
+
+	hi = MIN(last, it->day + RECUR_ITER_HORIZON + iter_period(it));
+	if (rpt->until)
+		hi = MIN(hi, sec2days(rpt->until) + 1);
+	if (YEAR1902_2037) {
+		struct date last = { 31, 12, 2037 };
+		hi = MIN(hi, date2days(last));
+	}
 
-	while (!r->until || day < r->until) {
-		day = NEXTDAY(day);
-		if (!check_sec(&day))
+	n = MAX(it->day + 1, it->first);
+	for (; iter_candidate(it, &n, 1, it->first, hi); n++) {
+		day = iter_day2sec(n);
+		/* Skip multi-day occurrences starting on an earlier day. */
+		if (recur_item_find_occurrence(it->start, it->dur, rpt,
+					       it->exc, day, &occ) &&
+		    occ >= day) {
+			it->day = n;
+			*occurrence = occ;
+			ret = 1;
 			break;
-		if (recur_item_find_occurrence(s, d, r, e, day, next)) {
+		}
+	}
+	return ret;
+}
+
+/*
+ * Advance the iterator to the next occurrence starting on a day after the
+ * current position. Return true and the occurrence if found.
+ */
+int recur_iter_next(struct recur_iter *it, time_t *occurrence)
+{
+	return iter_next(it, LONG_MAX, occurrence);
+}
+
+/*
+ * Move the iterator back to the most recent occurrence starting on a day
+ * before the current position. Return true and the occurrence if found.
+ */
+int recur_iter_prev(struct recur_iter *it, time_t *occurrence)
+{
+	time_t day, occ;
+	long n;
+	int ret = 0;
+
+	for (n = it->day - 1; iter_candidate(it, &n, -1, it->first, it->day);
+	     n--) {
+		day = iter_day2sec(n);
+		if (recur_item_find_occurrence(it->start, it->dur, it->rpt,
+					       it->exc, day, &occ)) {
 			/* Multi-day appointment. */
-			if (*next < day)
+			if (it->dur != -1 && occ < day && day < occ + it->dur)
 				continue;
+			it->day = n;
+			*occurrence = occ;
 			ret = 1;
 			break;
 		}
 	}
 	return ret;
 }
+#undef RECUR_ITER_HORIZON
+
+/*
+ * Set up a window over the days from, NEXTDAY(from), ... before to for the
+ * rrule (start, dur, rpt, exc), to be queried day by day in that order with
+ * recur_window_day(). The result for a day is that of
+ * recur_item_find_occurrence(), but the occurrences are generated in a single
+ * pass.
+ *
+ * Occurrences are taken from an iterator. A day on which no occurrence starts
+ * is looked up separately only if it may be spanned by an occurrence from an
+ * earlier day (possibly before from): that occurrence need not be the one
+ * found for the day (it might, for instance, be followed by an exception day).
+ */
+void recur_window_init(struct recur_window *w, time_t start, long dur,
+		       struct rpt *rpt, exc_list_t *exc, time_t from, time_t to)
+{
+	w->from = from;
+	w->prev = w->next = 0;
+	w->last = from < to ? sec2days(to - 1) : sec2days(from) - 1;
+
+	/*
+	 * Can an occurrence reach into the next day? Days may be shorter
+	 * (from the time of the occurrence on) around time zone transitions,
+	 * including those of the days before from.
+	 */
+	w->span = dur > 0 && get_item_time(start) + dur >
+		  DAYINSEC - tz_max_gain(from - dur - DAYINSEC, to);
+	/* Is the result for a day not necessarily the latest occurrence? */
+	w->expand = rpt->type != RECUR_DAILY &&
+		    (rpt->bywday.head || rpt->bymonthday.head ||
+		     rpt->bymonth.head);
+
+	recur_iter_init(&w->it, start, dur, rpt, exc);
+	w->it.day = sec2days(from) - 1;
+	w->more = !(w->span && w->expand) &&
+		  iter_next(&w->it, w->last, &w->next);
+}
+
+/* Move the iterator to the first occurrence starting on day n or later. */
+static void window_catch_up(struct recur_window *w, long n)
+{
+	while (w->more && w->it.day < n) {
+		w->prev = w->next;
+		w->more = iter_next(&w->it, w->last, &w->next);
+	}
+}
+
+/*
+ * Look up the occurrence on a day of the window. Days must be passed in
+ * increasing order, but any of them may be left out.
+ */
+int recur_window_day(struct recur_window *w, time_t day, time_t *occurrence)
+{
+	long n = sec2days(day);
+
+	window_catch_up(w, n);
+	if (!(w->span && w->expand) && day == iter_day2sec(n)) {
+		if (w->more && w->it.day == n) {
+			*occurrence = w->next;
+			return 1;
+		}
+		if (!w->span || (w->prev + w->it.dur <= day &&
+				 w->from + w->it.dur <= day))
+			return 0;
+	}
+	return recur_item_find_occurrence(w->it.start, w->it.dur, w->it.rpt,
+					  w->it.exc, day, occurrence);
+}
+
+/*
+ * Return the first day after day n that may have an occurrence, provided that
+ * it is passed to recur_window_day() as its midnight; LONG_MAX if there is
+ * none.
+ */
+long recur_window_due(struct recur_window *w, long n)
+{
+	if (w->span && w->expand)
+		return n + 1;
+
+	window_catch_up(w, n + 1);
+	if (w->span && n + 1 <= sec2days(MAX(w->prev, w->from) +
+					 w->it.dur - 1))
+		return n + 1;
+	return w->more ? w->it.day : LONG_MAX;
+}
+
+/*
+ * Call fn for each of the days from, NEXTDAY(from), ... before to on which the
+ * rrule (start, dur, rpt, exc) has an occurrence, with the occurrence and the
+ * day; an occurrence spanning several days is passed on for each of them.
+ */
+void recur_expand_window(time_t start, long dur, struct rpt *rpt,
+			 exc_list_t *exc, time_t from, time_t to,
+			 recur_window_fn_t fn, void *arg)
+{
+	struct recur_window w;
+	time_t day, occ;
+
+	if (from >= to)
+		return;
+
+	recur_window_init(&w, start, dur, rpt, exc, from, to);
+	for (day = from; day < to; day = NEXTDAY(day)) {
+		if (recur_window_day(&w, day, &occ))
+			fn(occ, day, arg);
+	}
+}
+
+/*
+ * Finds the next occurrence of a recurrent item and returns it in the provided
+ * buffer. Useful for test of a repeated item.
+ */
+int recur_next_occurrence(time_t s, long d, struct rpt *r, exc_list_t *e,
+			  time_t day, time_t *next)
+{
+	struct recur_iter it;
+
+	recur_iter_init(&it, s, d, r, e);
+	recur_iter_seek(&it, day);
+	return recur_iter_next(&it, next);
+}
 
 /*
  * Finds the nth occurrence (incl. start)  of a recurrence rule (s, d, r, e)
  * and returns it in the provided buffer.
  */
-int recur_nth_occurrence(time_t s, long d, struct rpt *r, llist_t *e, int n,
+int recur_nth_occurrence(time_t s, long d, struct rpt *r, exc_list_t *e, int n,
 			 time_t *nth)
 {
-	time_t day;
+	struct recur_iter it;
 
 	if (n <= 0)
 		return 0;
 
+	recur_iter_init(&it, s, d, r, e);
 	for (n--, *nth = s; n > 0; n--) {
-		day = DAY(*nth);
-		if (!recur_next_occurrence(s, d, r, e, day, nth))
+		if (!recur_iter_next(&it, nth))
 			break;
 	}
 	return !n;
@@ -1865,23 +2644,15 @@ int recur_nth_occurrence(time_t s, long d, struct rpt *r, llist_t *e, int n,
  * Finds the previous occurrence - the most recent before day - and returns it
  * in the provided buffer.
  */
-int recur_prev_occurrence(time_t s, long d, struct rpt *r, llist_t *e,
+int recur_prev_occurrence(time_t s, long d, struct rpt *r, exc_list_t *e,
 			  time_t day, time_t *prev)
 {
-	int ret = 0;
+	struct recur_iter it;
 
 	if (day <= DAY(s))
-		return ret;
+		return 0;
 
-	while (DAY(s) < day) {
-		day = PREVDAY(day);
-		if (recur_item_find_occurrence(s, d, r, e, day, prev)) {
-			/* Multi-day appointment. */
-			if (d != -1 && *prev < day && day < *prev + d)
-				continue;
-			ret = 1;
-			break;
-		}
-	}
-	return ret;
+	recur_iter_init(&it, s, d, r, e);
+	recur_iter_seek(&it, day);
+	return recur_iter_prev(&it, prev);
 }
@@ -0,0 +1,810 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+
+extern char **environ;
+
+/*
+ * Query server.
+ *
+ * The server keeps the data files loaded and answers the non-interactive
+ * queries of clients run with --client. A client sends its arguments along
+ * with its standard output and error over a Unix domain socket in the data
+ * directory. The server forks a process per request, which runs parse_args()
+ * on the arguments in place of the client, writing to the descriptors of the
+ * client, and sends its exit status back. The request process also takes the
+ * working directory and the locale of the client. The items in memory depend
+ * on the time zone, so requests from a client in another one are declined.
+ *
+ * The request process only filters the items in memory instead of loading
+ * the data files (see serve_filter()), and is otherwise isolated from the
+ * server: it may change any setting or exit at any point. If it cannot answer
+ * a request, e.g. one which modifies the data files, it exits with SERVE_LOCAL
+ * and the client runs the command by itself.
+ */
+
+#define SERVE_LOCAL	125
+
+#define SERVE_MAXLEN	65536	/* maximum size of the arguments */
+#define SERVE_CLIENTS	32	/* maximum number of pending requests */
+#define SERVE_TIMEOUT	1	/* seconds to wait for the arguments */
+
+/* Files a request refers to: the appointments, todo and configuration. */
+#define SERVE_FILES	3
+
+struct serve_file {
+	dev_t dev;
+	ino_t ino;
+};
+
+/* Followed by the arguments and the environment, see serve_env_var(). */
+struct serve_hdr {
+	uint32_t len;
+	uint32_t envlen;
+	struct serve_file files[SERVE_FILES];
+};
+
+struct serve_client {
+	pid_t pid;
+	int fd;
+};
+
+static struct serve_client serve_clients[SERVE_CLIENTS];
+static unsigned serve_nclients;
+static int serve_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t serve_quit;
+static int serve_req;
+
+/* Digest indexes of the items, see serve_index(). */
+static struct {
+	struct hashidx *apt, *ev, *rapt, *rev;
+} serve_idx;
+
+/* Return whether this is a request process of the server. */
+int serve_request(void)
+{
+	return serve_req;
+}
+
+static void serve_files(struct serve_file *files)
+{
+	const char *path[SERVE_FILES] = { path_apts, path_todo, path_conf };
+	struct stat st;
+	unsigned i;
+
+	for (i = 0; i < SERVE_FILES; i++) {
+		if (stat(path[i], &st) == 0) {
+			files[i].dev = st.st_dev;
+			files[i].ino = st.st_ino;
+		} else {
+			files[i].dev = 0;
+			files[i].ino = 0;
+		}
+	}
+}
+
+/* Return whether a variable of the environment is sent with a request. */
+static int serve_env_var(const char *s)
+{
+	return !strncmp(s, "TZ=", 3) || !strncmp(s, "LANG=", 5) ||
+	       !strncmp(s, "LANGUAGE=", 9) || !strncmp(s, "LC_", 3);
+}
+
+/*
+ * Replace the locale variables of the environment with those of the client.
+ * Return 0 if the time zone of the client differs.
+ */
+static int serve_env(char *env, size_t len)
+{
+	const char *tz = NULL, *stz = getenv("TZ");
+	char **ep, *p, *q;
+
+	for (p = env; p < env + len; p += strlen(p) + 1) {
+		if (!strncmp(p, "TZ=", 3))
+			tz = p + 3;
+	}
+	if (!tz != !stz || (tz && strcmp(tz, stz) != 0))
+		return 0;
+
+	for (ep = environ; *ep;) {
+		if (serve_env_var(*ep) && strncmp(*ep, "TZ=", 3) != 0) {
+			p = mem_strdup(*ep);
+			*strchr(p, '=') = '\0';
+			unsetenv(p);
+			mem_free(p);
+			ep = environ;
+		} else {
+			ep++;
+		}
+	}
+	for (p = env; p < env + len; p += strlen(p) + 1) {
+		if (!(q = strchr(p, '=')) || !strncmp(p, "TZ=", 3))
+			continue;
+		*q = '\0';
+		setenv(p, q + 1, 1);
+		*q = '=';
+	}
+#if ENABLE_NLS
+	setlocale(LC_ALL, "");
+#endif /* ENABLE_NLS */
+	return 1;
+}
+
+static int serve_addr(struct sockaddr_un *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	if (strlen(path_ssock) >= sizeof(sa->sun_path))
+		return 0;
+	strcpy(sa->sun_path, path_ssock);
+	return 1;
+}
+
+static int serve_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, p, len)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int serve_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int serve_cond(struct item_filter *filter, int mask, const char *mesg,
+		      time_t start, time_t end)
+{
+	return !(filter->type_mask & mask) ||
+	    (filter->pattern && !pattern_match(filter->pattern, mesg)) ||
+	    (filter->start_from != -1 && start < filter->start_from) ||
+	    (filter->start_to != -1 && start > filter->start_to) ||
+	    (filter->end_from != -1 && end < filter->end_from) ||
+	    (filter->end_to != -1 && end > filter->end_to);
+}
+
+/*
+ * Return whether all items of a type are dropped (1) or kept (0), or -1 if they
+ * have to be checked one by one.
+ */
+static int serve_all(struct item_filter *filter, int mask)
+{
+	int cond;
+
+	if (!(filter->type_mask & mask))
+		cond = 1;
+	else if (filter->pattern || filter->hash ||
+		 filter->start_from != -1 || filter->start_to != -1 ||
+		 filter->end_from != -1 || filter->end_to != -1 ||
+		 (mask == TYPE_MASK_TODO && (filter->priority ||
+		  filter->completed || filter->uncompleted)))
+		return -1;
+	else
+		cond = 0;
+	return filter->invert ? !cond : cond;
+}
+
+/* Return whether to drop an item, given its hash if the filter needs it. */
+static int serve_drop(struct item_filter *filter, int cond,
+		      const char *hash)
+{
+	if (hash)
+		cond = cond || !hash_matches(filter->hash, hash);
+	return filter->invert ? !cond : cond;
+}
+
+/*
+ * Index the items by digest, which also computes the digests once in the
+ * server rather than in every request process. This needs to be done again
+ * whenever the items are reloaded.
+ */
+static void serve_index(void)
+{
+	llist_item_t *i;
+
+	hashidx_free(serve_idx.apt);
+	hashidx_free(serve_idx.ev);
+	hashidx_free(serve_idx.rapt);
+	hashidx_free(serve_idx.rev);
+	serve_idx.apt = hashidx_new();
+	serve_idx.ev = hashidx_new();
+	serve_idx.rapt = hashidx_new();
+	serve_idx.rev = hashidx_new();
+
+	LLIST_TS_FOREACH(&alist_p, i) {
+		struct apoint *apt = LLIST_TS_GET_DATA(i);
+		hashidx_add(serve_idx.apt, apoint_hash(apt), apt);
+	}
+	LLIST_FOREACH(&eventlist, i) {
+		struct event *ev = LLIST_GET_DATA(i);
+		hashidx_add(serve_idx.ev, event_hash(ev), ev);
+	}
+	LLIST_TS_FOREACH(&recur_alist_p, i) {
+		struct recur_apoint *rapt = LLIST_TS_GET_DATA(i);
+		hashidx_add(serve_idx.rapt, recur_apoint_hash(rapt), rapt);
+	}
+	LLIST_FOREACH(&recur_elist, i) {
+		struct recur_event *rev = LLIST_GET_DATA(i);
+		hashidx_add(serve_idx.rev, recur_event_hash(rev), rev);
+	}
+	LLIST_FOREACH(&todolist, i)
+		todo_hash(LLIST_GET_DATA(i));
+
+	/* Sort the indexes here, rather than in each request process. */
+	hashidx_sort(serve_idx.apt);
+	hashidx_sort(serve_idx.ev);
+	hashidx_sort(serve_idx.rapt);
+	hashidx_sort(serve_idx.rev);
+}
+
+/*
+ * Get the candidates of a filter on a digest prefix from an index. Return 0 if
+ * the filter cannot use the index, in which case all items are candidates.
+ */
+static int serve_lookup(struct item_filter *filter, struct hashidx *idx,
+			vector_t *c)
+{
+	if (!idx || !filter->hash || filter->hash[0] == '!' || filter->invert)
+		return 0;
+	hashidx_find(idx, filter->hash, c);
+	return 1;
+}
+
+static void serve_apoint(struct item_filter *filter, struct apoint *apt,
+			 vector_t *v)
+{
+	int cond = serve_cond(filter, TYPE_MASK_APPT, apt->mesg, apt->start,
+			      apt->start + apt->dur);
+
+	if (!serve_drop(filter, cond, filter->hash ? apoint_hash(apt) : NULL))
+		VECTOR_ADD(v, apt);
+}
+
+static void serve_event(struct item_filter *filter, struct event *ev,
+			vector_t *v)
+{
+	int cond = serve_cond(filter, TYPE_MASK_EVNT, ev->mesg, ev->day,
+			      ENDOFDAY(ev->day));
+
+	if (!serve_drop(filter, cond, filter->hash ? event_hash(ev) : NULL))
+		VECTOR_ADD(v, ev);
+}
+
+static void serve_recur_apoint(struct item_filter *filter,
+			       struct recur_apoint *rapt, vector_t *v)
+{
+	int cond = serve_cond(filter, TYPE_MASK_RECUR_APPT, rapt->mesg,
+			      rapt->start, rapt->start + rapt->dur);
+
+	if (!serve_drop(filter, cond,
+			filter->hash ? recur_apoint_hash(rapt) : NULL))
+		VECTOR_ADD(v, rapt);
+}
+
+static void serve_recur_event(struct item_filter *filter,
+			      struct recur_event *rev, vector_t *v)
+{
+	int cond = serve_cond(filter, TYPE_MASK_RECUR_EVNT, rev->mesg,
+			      rev->day, ENDOFDAY(rev->day));
+
+	if (!serve_drop(filter, cond,
+			filter->hash ? recur_event_hash(rev) : NULL))
+		VECTOR_ADD(v, rev);
+}
+
+/*
+ * Drop the items which do not match a filter from the lists, as the loaders
+ * skip them when the data files are read (see apoint_scan() and
+ * io_load_todo()). The lists are rebuilt from the remaining items, which is
+ * cheaper than removing most of them from the day indexes. This is only done
+ * by request processes, which exit soon: the items are not freed.
+ */
+void serve_filter(struct item_filter *filter)
+{
+	llist_item_t *i;
+	vector_t v, c;
+	unsigned n;
+	int all, cond;
+
+	VECTOR_INIT(&v, 64);
+	VECTOR_INIT(&c, 64);
+	if ((all = serve_all(filter, TYPE_MASK_APPT)) == -1) {
+		if (serve_lookup(filter, serve_idx.apt, &c)) {
+			VECTOR_FOREACH(&c, n)
+				serve_apoint(filter, VECTOR_NTH(&c, n), &v);
+		} else {
+			LLIST_TS_FOREACH(&alist_p, i)
+				serve_apoint(filter, LLIST_TS_GET_DATA(i), &v);
+		}
+	}
+	if (all != 0) {
+		apoint_llist_init();
+		apoint_add_all(&v);
+		v.count = 0;
+	}
+	c.count = 0;
+
+	if ((all = serve_all(filter, TYPE_MASK_EVNT)) == -1) {
+		if (serve_lookup(filter, serve_idx.ev, &c)) {
+			VECTOR_FOREACH(&c, n)
+				serve_event(filter, VECTOR_NTH(&c, n), &v);
+		} else {
+			LLIST_FOREACH(&eventlist, i)
+				serve_event(filter, LLIST_GET_DATA(i), &v);
+		}
+	}
+	if (all != 0) {
+		event_llist_init();
+		event_add_all(&v);
+		v.count = 0;
+	}
+	c.count = 0;
+
+	if ((all = serve_all(filter, TYPE_MASK_RECUR_APPT)) == -1) {
+		if (serve_lookup(filter, serve_idx.rapt, &c)) {
+			VECTOR_FOREACH(&c, n)
+				serve_recur_apoint(filter, VECTOR_NTH(&c, n),
+						   &v);
+		} else {
+			LLIST_TS_FOREACH(&recur_alist_p, i)
+				serve_recur_apoint(filter,
+						   LLIST_TS_GET_DATA(i), &v);
+		}
+	}
+	if (all != 0) {
+		recur_apoint_llist_init();
+		recur_apoint_add_all(&v);
+		v.count = 0;
+	}
+	c.count = 0;
+
+	if ((all = serve_all(filter, TYPE_MASK_RECUR_EVNT)) == -1) {
+		if (serve_lookup(filter, serve_idx.rev, &c)) {
+			VECTOR_FOREACH(&c, n)
+				serve_recur_event(filter, VECTOR_NTH(&c, n),
+						  &v);
+		} else {
+			LLIST_FOREACH(&recur_elist, i)
+				serve_recur_event(filter, LLIST_GET_DATA(i),
+						  &v);
+		}
+	}
+	if (all != 0) {
+		recur_event_llist_init();
+		recur_event_add_all(&v);
+		v.count = 0;
+	}
+	VECTOR_FREE(&c);
+	recur_invalidate_caches();
+
+	/* The todo list has no index, the items are removed in place. */
+	if ((all = serve_all(filter, TYPE_MASK_TODO)) == -1) {
+		LLIST_FOREACH(&todolist, i) {
+			struct todo *todo = LLIST_GET_DATA(i);
+			cond = !(filter->type_mask & TYPE_MASK_TODO) ||
+			    (filter->pattern &&
+			     !pattern_match(filter->pattern, todo->mesg)) ||
+			    (filter->priority &&
+			     todo->id != filter->priority) ||
+			    (filter->completed && !todo->completed) ||
+			    (filter->uncompleted && todo->completed);
+			if (serve_drop(filter, cond,
+				       filter->hash ? todo_hash(todo) : NULL))
+				VECTOR_ADD(&v, todo);
+		}
+		todo_remove_all(&v);
+	} else if (all == 1) {
+		todo_init_list();
+	}
+	VECTOR_FREE(&v);
+}
+
+/*
+ * Have the server run a command. This returns if there is no server, or if it
+ * cannot answer the request, so that the command is run locally.
+ */
+void serve_client(int argc, char **argv)
+{
+	struct sockaddr_un sa;
+	struct serve_hdr hdr;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct cmsghdr *cmsg;
+	struct string env;
+	int fd, fds[3] = { STDOUT_FILENO, STDERR_FILENO, -1 };
+	int32_t status;
+	char **ep;
+	int i;
+
+	hdr.len = 0;
+	for (i = 0; i < argc; i++)
+		hdr.len += strlen(argv[i]) + 1;
+	if (hdr.len > SERVE_MAXLEN || !serve_addr(&sa))
+		return;
+	if ((fds[2] = open(".", O_RDONLY)) < 0)
+		return;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		close(fds[2]);
+		return;
+	}
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(fds[2]);
+		close(fd);
+		return;
+	}
+	serve_files(hdr.files);
+	string_init(&env);
+	for (ep = environ; *ep; ep++) {
+		if (serve_env_var(*ep))
+			string_catn(&env, *ep, strlen(*ep) + 1);
+	}
+	hdr.envlen = env.len;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	fflush(stdout);
+	fflush(stderr);
+	while (sendmsg(fd, &msg, 0) < 0) {
+		if (errno != EINTR) {
+			mem_free(env.buf);
+			close(fds[2]);
+			close(fd);
+			return;
+		}
+	}
+	close(fds[2]);
+	for (i = 0; i < argc; i++) {
+		EXIT_IF(!serve_write(fd, argv[i], strlen(argv[i]) + 1),
+			_("lost connection to the server"));
+	}
+	EXIT_IF(!serve_write(fd, env.buf, env.len) ||
+		!serve_read(fd, &status, sizeof(status)),
+		_("lost connection to the server"));
+	mem_free(env.buf);
+	close(fd);
+
+	if (status >= 0)
+		exit(status);
+}
+
+/* Run a request in a new process, see above. */
+static void serve_run(int lfd, int fd)
+{
+	struct serve_hdr hdr;
+	struct serve_file files[SERVE_FILES];
+	struct timeval tv = { SERVE_TIMEOUT, 0 };
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct cmsghdr *cmsg;
+	int fds[3] = { -1, -1, -1 };
+	char *args = NULL, **argv = NULL, *p;
+	int argc, status;
+	ssize_t n;
+	pid_t pid;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+	while ((n = recvmsg(fd, &msg, 0)) < 0 && errno == EINTR) ;
+	if (n <= 0)
+		goto cleanup;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS &&
+		    cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	}
+	if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0 ||
+	    (msg.msg_flags & MSG_CTRUNC))
+		goto cleanup;
+	if (!serve_read(fd, (char *)&hdr + n, sizeof(hdr) - n))
+		goto cleanup;
+	if (hdr.len == 0 || hdr.len > SERVE_MAXLEN ||
+	    hdr.envlen > SERVE_MAXLEN)
+		goto cleanup;
+	args = mem_malloc(hdr.len + hdr.envlen);
+	if (!serve_read(fd, args, hdr.len + hdr.envlen) ||
+	    args[hdr.len - 1] != '\0' ||
+	    (hdr.envlen && args[hdr.len + hdr.envlen - 1] != '\0'))
+		goto cleanup;
+
+	/* The request process must not inherit a cache being written. */
+	cache_wait();
+	if ((pid = fork()) < 0)
+		goto cleanup;
+	if (pid > 0) {
+		serve_clients[serve_nclients].pid = pid;
+		serve_clients[serve_nclients].fd = fd;
+		serve_nclients++;
+		fd = -1;
+		goto cleanup;
+	}
+
+	/* Request process. */
+	close(lfd);
+	close(fd);
+	close(serve_pipe[0]);
+	close(serve_pipe[1]);
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGUSR1, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+	dup2(fds[0], STDOUT_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+	close(fds[0]);
+	close(fds[1]);
+
+	/* The client may use other data or configuration files. */
+	serve_files(files);
+	if (memcmp(files, hdr.files, sizeof(files)) != 0)
+		_exit(SERVE_LOCAL);
+	if (fchdir(fds[2]) != 0 ||
+	    !serve_env(args + hdr.len, hdr.envlen))
+		_exit(SERVE_LOCAL);
+	close(fds[2]);
+
+	for (argc = 0, p = args; p < args + hdr.len; p += strlen(p) + 1)
+		argc++;
+	argv = mem_malloc((argc + 1) * sizeof(char *));
+	for (argc = 0, p = args; p < args + hdr.len; p += strlen(p) + 1)
+		argv[argc++] = p;
+	argv[argc] = NULL;
+
+	serve_req = 1;
+	optind = 1;
+	status = parse_args(argc, argv) ? EXIT_SUCCESS : SERVE_LOCAL;
+	fflush(stdout);
+	fflush(stderr);
+	_exit(status);
+
+cleanup:
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	if (fds[2] >= 0)
+		close(fds[2]);
+	if (fd >= 0)
+		close(fd);
+	if (args)
+		mem_free(args);
+}
+
+/* Send the exit status of the finished requests to the clients. */
+static void serve_reap(int hang)
+{
+	int32_t status;
+	unsigned i;
+	pid_t pid;
+	int st;
+
+	while ((pid = waitpid(-1, &st, hang ? 0 : WNOHANG)) > 0) {
+		hang = 0;
+		for (i = 0; i < serve_nclients; i++) {
+			if (serve_clients[i].pid == pid)
+				break;
+		}
+		if (i == serve_nclients)
+			continue;
+
+		if (WIFSIGNALED(st))
+			status = 128 + WTERMSIG(st);
+		else if (WEXITSTATUS(st) == SERVE_LOCAL)
+			status = -1;
+		else
+			status = WEXITSTATUS(st);
+		serve_write(serve_clients[i].fd, &status, sizeof(status));
+		close(serve_clients[i].fd);
+		serve_clients[i] = serve_clients[--serve_nclients];
+	}
+}
+
+static void serve_sigs_hdlr(int sig)
+{
+	int err = errno;
+	ssize_t n;
+
+	if (sig == SIGUSR1)
+		want_reload = 1;
+	else if (sig != SIGCHLD)
+		serve_quit = 1;
+	/* Wake up the server loop, unless the pipe is full already. */
+	n = write(serve_pipe[1], "", 1);
+	(void)n;
+	errno = err;
+}
+
+static void serve_cleanup(void)
+{
+	unlink(path_ssock);
+	unlink(path_spid);
+}
+
+/* Load the data files and answer the requests of the clients until stopped. */
+void serve_start(void)
+{
+	struct sockaddr_un sa;
+	struct pollfd pfd[2];
+	char buf[64];
+	mode_t mask;
+	int lfd, fd, pid;
+
+	pid = io_get_pid(path_spid);
+	EXIT_IF(pid && (kill(pid, 0) == 0 || errno != ESRCH),
+		_("calcurse server is running (pid = %d)"), pid);
+	/* The server changes its working directory. */
+	EXIT_IF(*path_apts != '/' || *path_todo != '/' || *path_conf != '/' ||
+		*path_notes != '/', _("the server needs absolute paths"));
+	EXIT_IF(!serve_addr(&sa), _("path too long: %s"), path_ssock);
+
+	apoint_llist_init();
+	recur_apoint_llist_init();
+	event_llist_init();
+	recur_event_llist_init();
+	todo_init_list();
+	io_load_data(NULL, FORCE);
+	serve_index();
+
+	unlink(path_ssock);
+	EXIT_IF((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0,
+		_("could not create socket: %s"), strerror(errno));
+	/* Only the owner may connect. */
+	mask = umask(0177);
+	EXIT_IF(bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+		listen(lfd, SOMAXCONN) < 0,
+		_("could not listen on %s: %s"), path_ssock, strerror(errno));
+	umask(mask);
+	EXIT_IF(pipe(serve_pipe) < 0, _("could not create pipe: %s"),
+		strerror(errno));
+	fcntl(lfd, F_SETFD, FD_CLOEXEC);
+	fcntl(serve_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(serve_pipe[1], F_SETFL, O_NONBLOCK);
+
+	if (!dmon_daemonize(EXIT_SUCCESS) ||
+	    !sigs_set_hdlr(SIGCHLD, serve_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGUSR1, serve_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGTERM, serve_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGINT, serve_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGQUIT, serve_sigs_hdlr) ||
+	    !sigs_set_hdlr(SIGPIPE, SIG_IGN) ||
+	    !io_dump_pid(path_spid)) {
+		serve_cleanup();
+		exit(EXIT_FAILURE);
+	}
+	watch_start_thread();
+
+	pfd[0].fd = lfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = serve_pipe[0];
+	pfd[1].events = POLLIN;
+	while (!serve_quit) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno != EINTR)
+				break;
+			continue;
+		}
+		while (read(serve_pipe[0], buf, sizeof(buf)) > 0) ;
+		serve_reap(0);
+
+		if (want_reload) {
+			want_reload = 0;
+			if (watch_changes() & WATCH_CONF)
+				config_load();
+			io_reload_data();
+			serve_index();
+		}
+
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+		if ((fd = accept(lfd, NULL, NULL)) < 0)
+			continue;
+		/* Do not wait for the watcher to answer with fresh data. */
+		if (io_data_changed()) {
+			io_reload_data();
+			serve_index();
+		}
+		if (serve_nclients == SERVE_CLIENTS)
+			serve_reap(1);
+		serve_run(lfd, fd);
+	}
+
+	serve_cleanup();
+	exit(EXIT_SUCCESS);
+}
@@ -196,8 +196,11 @@ void sha1_update(sha1_ctx_t * ctx, const uint8_t * data, unsigned int len)
 	if (j + len > 63) {
 		memcpy(&ctx->buffer[j], data, (i = 64 - j));
 		sha1_transform(ctx->state, ctx->buffer);
-		for (; i + 63 < len; i += 64)
-			sha1_transform(ctx->state, &data[i]);
+		/* The transform scrambles its input, never pass it data. */
+		for (; i + 63 < len; i += 64) {
+			memcpy(ctx->buffer, &data[i], 64);
+			sha1_transform(ctx->state, ctx->buffer);
+		}
 		j = 0;
 	} else {
 		i = 0;
@@ -233,21 +236,28 @@ void sha1_final(sha1_ctx_t * ctx, uint8_t digest[SHA1_DIGESTLEN])
 	memset(&finalcount, 0, 8);
 }
 
-void sha1_digest(const char *data, char *buffer)
+/* Finish a hash and write it to a buffer, in hexadecimal. */
+void sha1_final_hex(sha1_ctx_t * ctx, char *buffer)
 {
-	char *buf = strdup(data);
-	sha1_ctx_t ctx;
 	uint8_t digest[SHA1_DIGESTLEN];
 	int i;
 
-	sha1_init(&ctx);
-	sha1_update(&ctx, (const uint8_t *)buf, strlen(buf));
-	sha1_final(&ctx, (uint8_t *) digest);
+	sha1_final(ctx, (uint8_t *) digest);
 
 	for (i = 0; i < SHA1_DIGESTLEN; i++) {
 		snprintf(buffer, 3, "%02x", digest[i]);
 		buffer += sizeof(char) * 2;
 	}
+}
+
+void sha1_digest(const char *data, char *buffer)
+{
+	char *buf = strdup(data);
+	sha1_ctx_t ctx;
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const uint8_t *)buf, strlen(buf));
+	sha1_final_hex(&ctx, buffer);
 
 	free(buf);
 }
@@ -257,8 +267,6 @@ void sha1_stream(FILE * fp, char *buffer)
 	sha1_ctx_t ctx;
 	uint8_t data[BUFSIZ];
 	size_t bytes_read;
-	uint8_t digest[SHA1_DIGESTLEN];
-	int i;
 
 	sha1_init(&ctx);
 
@@ -267,10 +275,5 @@ void sha1_stream(FILE * fp, char *buffer)
 		sha1_update(&ctx, data, bytes_read);
 	}
 
-	sha1_final(&ctx, (uint8_t *) digest);
-
-	for (i = 0; i < SHA1_DIGESTLEN; i++) {
-		snprintf(buffer, 3, "%02x", digest[i]);
-		buffer += sizeof(char) * 2;
-	}
+	sha1_final_hex(&ctx, buffer);
 }
@@ -53,5 +53,6 @@ typedef struct {
 void sha1_init(sha1_ctx_t *);
 void sha1_update(sha1_ctx_t *, const uint8_t *, unsigned int);
 void sha1_final(sha1_ctx_t *, uint8_t[SHA1_DIGESTLEN]);
+void sha1_final_hex(sha1_ctx_t *, char *);
 void sha1_digest(const char *, char *);
 void sha1_stream(FILE *, char *);
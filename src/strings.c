@@ -35,6 +35,7 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
 
 #include "calcurse.h"
 
@@ -72,6 +73,17 @@ char *string_buf(struct string *sb)
 	return sb->buf;
 }
 
+/* Append n bytes to a string. */
+int string_catn(struct string *sb, const char *s, int n)
+{
+	string_grow(sb, sb->len + n + 1);
+	memcpy(sb->buf + sb->len, s, n);
+	sb->len += n;
+	sb->buf[sb->len] = '\0';
+
+	return n;
+}
+
 int string_vcatf(struct string *sb, const char *format, va_list ap)
 {
 	va_list ap2;
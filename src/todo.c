@@ -94,6 +94,7 @@ struct todo *todo_add(char *mesg, int id, int completed, char *note)
 	todo->completed = completed;
 	todo->note = (note != NULL
 		      && note[0] != '\0') ? mem_strdup(note) : NULL;
+	todo->hash = NULL;
 
 	LLIST_ADD_SORTED(&todolist, todo, todo_cmp);
 
@@ -114,14 +115,12 @@ char *todo_tostr(struct todo *todo)
 	return res;
 }
 
-char *todo_hash(struct todo *todo)
+/* Same as apoint_hash(), for todo items. */
+const char *todo_hash(struct todo *todo)
 {
-	char *raw = todo_tostr(todo);
-	char *sha1 = mem_malloc(SHA1_DIGESTLEN * 2 + 1);
-	sha1_digest(raw, sha1);
-	mem_free(raw);
+	const char *hash = item_hash_get(todo->hash);
 
-	return sha1;
+	return hash ? hash : item_hash_set(&todo->hash, todo_tostr(todo));
 }
 
 void todo_write(struct todo *todo, FILE * f)
@@ -148,9 +147,13 @@ void todo_delete(struct todo *todo)
 		EXIT(_("no such todo"));
 
 	LLIST_REMOVE(&todolist, i);
-	mem_free(todo->mesg);
-	erase_note(&todo->note);
-	mem_free(todo);
+	todo_free(todo);
+}
+
+/* Remove several items from the list at once, see apoint_remove_all(). */
+void todo_remove_all(vector_t *v)
+{
+	LLIST_REMOVE_ALL(&todolist, v->data, VECTOR_COUNT(v));
 }
 
 /*
@@ -210,6 +213,8 @@ void todo_free(struct todo *todo)
 {
 	mem_free(todo->mesg);
 	erase_note(&todo->note);
+	if (todo->hash)
+		mem_free(todo->hash);
 	mem_free(todo);
 }
 
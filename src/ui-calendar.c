@@ -154,6 +154,7 @@ void ui_calendar_set_first_day_of_week(enum wday first_day)
 		ERROR_MSG(_("ERROR setting first day of week"));
 		wday_start = 0;
 	}
+	recur_invalidate_caches();
 }
 
 /* Swap first day of week in calendar. */
@@ -162,6 +163,7 @@ void ui_calendar_change_first_day_of_week(void)
 	wday_start++;
 	if(wday_start >= WEEKINDAYS)
 		wday_start = 0;
+	recur_invalidate_caches();
 }
 
 /* Return 1 if week begins on monday, 0 otherwise. */
@@ -215,6 +217,26 @@ void ui_calendar_monthly_view_cache_set_invalid(void)
 	monthly_view_cache_valid = 0;
 }
 
+/*
+ * Invalidate the monthly view cache only if the time between start and end
+ * may be shown, including the days of the adjacent months.
+ */
+void ui_calendar_monthly_view_cache_invalidate(time_t start, time_t end)
+{
+	struct date d;
+	time_t first;
+
+	if (!monthly_view_cache_valid || start > end)
+		return;
+
+	d.dd = 1;
+	d.mm = (monthly_view_cache_month - 1) % YEARINMONTHS + 1;
+	d.yyyy = (monthly_view_cache_month - 1) / YEARINMONTHS;
+	first = date2sec(d, 0, 0);
+	if (start < first + 6 * WEEKINSEC && end >= first - WEEKINSEC)
+		monthly_view_cache_valid = 0;
+}
+
 static int weeknum(const struct tm *t, int wday_start)
 {
 	int wday, wnum;
@@ -415,6 +437,15 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 
 	++ofs_y;
 
+	/* check which days contain an event or an appointment */
+	if (!monthly_view_cache_valid) {
+		c_day.dd = t_first.tm_mday;
+		c_day.mm = t_first.tm_mon + 1;
+		c_day.yyyy = t_first.tm_year + 1900;
+		day_check_if_items(c_day, last_day - first_day,
+				   monthly_view_cache + first_day);
+	}
+
 	/* print the dates */
 	for (j = first_day, t = t_first, w_day = 0;
 	     j < last_day;
@@ -446,12 +477,7 @@ draw_monthly_view(struct scrollwin *sw, struct date *current_day)
 		bc = slctd ? ']' : ' ';
 
 		/* check if the day contains an event or an appointment */
-		if (monthly_view_cache_valid) {
-			day_attr = monthly_view_cache[j];
-		} else {
-			day_attr = monthly_view_cache[j] =
-			    day_check_if_item(c_day);
-		}
+		day_attr = monthly_view_cache[j];
 
 		/* Set day colours. */
 		if (date_cmp(&c_day, current_day) == 0)
@@ -288,11 +288,11 @@ static void update_desc(char **desc)
 }
 
 /* Edit a list of exception days for a recurrent item. */
-static int edit_exc(llist_t *exc)
+static int edit_exc(exc_list_t *exc)
 {
 	int updated = 0;
 
-	if (!exc->head)
+	if (!exc->count)
 		return !updated;
 	char *days;
 	enum getstr ret;
@@ -654,7 +654,7 @@ static int edit_ilist(llist_t *ilist, int_list_t list_type, int rule_type)
 	return updated;
 }
 
-static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
+static int update_rept(time_t start, long dur, struct rpt **rpt, exc_list_t *exc,
 			int simple)
 {
 	int updated = 0, count;
@@ -666,10 +666,11 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 	char *outstr = NULL;
 	const char *msg_cont = _("Press any key to continue.");
 
-	LLIST_INIT(&nrpt.exc);
+	recur_exc_init(&nrpt.exc);
 	LLIST_INIT(&nrpt.bywday);
 	LLIST_INIT(&nrpt.bymonth);
 	LLIST_INIT(&nrpt.bymonthday);
+	recur_rpt_compile(&nrpt);
 
 	/* Edit repetition type. */
 	const char *msg_prefix = _("Base period:");
@@ -870,6 +871,7 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 		if (!edit_ilist(&nrpt.bymonthday, BYMONTHDAY, nrpt.type))
 			goto cleanup;
 	}
+	recur_rpt_compile(&nrpt);
 
 	/* The new until may no longer be valid. */
 	if (count) {
@@ -916,6 +918,7 @@ static int update_rept(time_t start, long dur, struct rpt **rpt, llist_t *exc,
 
 	recur_free_int_list(&(*rpt)->bymonthday);
 	recur_int_list_dup(&(*rpt)->bymonthday, &nrpt.bymonthday);
+	recur_rpt_compile(*rpt);
 
 	updated = 1;
 cleanup:
@@ -939,6 +942,8 @@ void ui_day_item_edit(void)
 	struct event *e;
 	struct recur_apoint *ra;
 	struct apoint *a;
+	time_t a_start;
+	long a_dur;
 	int need_check_notify = 0;
 
 	if (day_item_count(0) <= 0)
@@ -1008,6 +1013,8 @@ void ui_day_item_edit(void)
 		break;
 	case APPT:
 		a = p->item.apt;
+		a_start = a->start;
+		a_dur = a->dur;
 		const char *choice_appt[4] = {
 			_("Start time"),
 			_("End time"),
@@ -1036,10 +1043,12 @@ void ui_day_item_edit(void)
 		default:
 			return;
 		}
+		apoint_reindex(a, a_start, a_dur);
 		break;
 	default:
 		break;
 	}
+	recur_invalidate_caches();
 	io_set_modified();
 	ui_calendar_monthly_view_cache_set_invalid();
 
@@ -1280,9 +1289,11 @@ void ui_day_item_delete(unsigned reg)
 		if (p->type == RECUR_EVNT) {
 			day_item_add_exc(p, ui_day_sel_date());
 		} else {
+			LLIST_TS_LOCK(&recur_alist_p);
 			recur_apoint_find_occurrence(p->item.rapt,
 						     ui_day_sel_date(),
 						     &occurrence);
+			LLIST_TS_UNLOCK(&recur_alist_p);
 			day_item_add_exc(p, occurrence);
 		}
 		/* Keep the selection on the same day. */
@@ -1357,7 +1368,8 @@ void ui_day_item_repeat(void)
 	LLIST_INIT(&rpt.bymonth);
 	LLIST_INIT(&rpt.bywday);
 	LLIST_INIT(&rpt.bymonthday);
-	LLIST_INIT(&rpt.exc);
+	recur_exc_init(&rpt.exc);
+	recur_rpt_compile(&rpt);
 	r = &rpt;
 	if (!update_rept(p->start, dur, &r, &rpt.exc, simple))
 		return;
@@ -322,20 +322,13 @@ void ui_todo_popup_item(void)
 		const char *note_heading = _("Note:");
 		size_t note_size = 3500;
 		char note[note_size];
-		char *notepath, *msg;
-		FILE *fp;
+		char *msg;
 
-		asprintf(&notepath, "%s%s", path_notes, item->note);
-		fp = fopen(notepath, "r");
-		if (fp == NULL) {
+		if (!note_read_contents(item->note, note, note_size)) {
 			item_in_popup(NULL, NULL, item->mesg, _("TODO:"));
 			return;
 		}
 
-		note_read_contents(note, note_size, fp);
-		fclose(fp);
-		mem_free(notepath);
-
 		asprintf(&msg, "%s\n\n%s\n%s", item->mesg, note_heading, note);
 		item_in_popup(NULL, NULL, msg, _("TODO:"));
 		mem_free(msg);
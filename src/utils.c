@@ -78,6 +78,7 @@ void exit_calcurse(int status)
 		notify_stop_main_thread();
 		ui_calendar_stop_date_thread();
 		io_stop_psave_thread();
+		watch_stop_thread();
 
 		clear();
 		wins_refresh();
@@ -88,8 +89,14 @@ void exit_calcurse(int status)
 		was_interactive = 0;
 	}
 
+	if (was_interactive)
+		io_compact_data();
+
+	cache_wait();
 	free_user_data();
 	keys_free();
+	print_free_formats();
+	recur_cache_stats();
 	mem_stats();
 
 	if (was_interactive) {
@@ -382,6 +389,251 @@ int get_item_min(time_t date)
 	return lt.tm_min;
 }
 
+/* Same as date2days(), but the month may be outside the range 1-12. */
+static long months2days(long year, long month, unsigned day)
+{
+	struct date d;
+
+	month += year * 12 - 1;
+	year = (month >= 0 ? month : month - 11) / 12;
+	d.yyyy = year;
+	d.mm = month - year * 12 + 1;
+	d.dd = day;
+
+	return date2days(d);
+}
+
+/* Return the day number of a time in seconds, ignoring time zones. */
+static long sec2days_utc(time_t t)
+{
+	return t >= 0 ? t / DAYINSEC : -((-(t + 1)) / DAYINSEC) - 1;
+}
+
+/*
+ * UTC offsets of the local time zone.
+ *
+ * Converting between seconds and local dates with localtime_r() and mktime()
+ * is expensive, and the date helpers are called in the innermost loops of the
+ * day and recurrence code. Instead, the offsets and transitions of the local
+ * time zone are obtained from localtime_r() once per (UTC) year, when the year
+ * is first needed, and conversions are done by day number arithmetic.
+ *
+ * Years outside the table, or with too many transitions, are converted by the
+ * C library. So is everything if CALCURSE_TZ_NOCACHE is set in the
+ * environment; the test suite uses it to compare both methods.
+ */
+#define TZ_FIRST_YEAR	1900
+#define TZ_LAST_YEAR	2199
+#define TZ_MAXTRANS	8
+
+enum tz_state {
+	TZ_UNKNOWN,
+	TZ_CACHED,
+	TZ_LIBC
+};
+
+struct tz_year {
+	enum tz_state state;
+	long off;			/* offset at the start of the year */
+	unsigned ntrans;		/* number of transitions */
+	time_t trans[TZ_MAXTRANS];	/* time of each transition */
+	long toff[TZ_MAXTRANS];		/* offset from that time on */
+};
+
+#define TZ_NYEARS	(TZ_LAST_YEAR - TZ_FIRST_YEAR + 1)
+
+static struct tz_year tz_years[TZ_NYEARS];
+static pthread_mutex_t tz_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * A year is loaded once, under tz_mutex. Each thread remembers which years it
+ * has seen loaded, so that it only needs to take the mutex the first time it
+ * looks at a year; the offsets can be used from several threads at once.
+ */
+static pthread_key_t tz_seen_key;
+static pthread_once_t tz_seen_once = PTHREAD_ONCE_INIT;
+
+static void tz_seen_init(void)
+{
+	pthread_key_create(&tz_seen_key, free);
+}
+
+/* Obtain the UTC offset of the local time zone at time t from the C library. */
+static int tz_libc_offset(time_t t, long *off)
+{
+	struct tm lt;
+	struct date d;
+
+	if (!localtime_r(&t, &lt))
+		return 0;
+	d.dd = lt.tm_mday;
+	d.mm = lt.tm_mon + 1;
+	d.yyyy = lt.tm_year + 1900;
+	*off = (time_t)date2days(d) * DAYINSEC + lt.tm_hour * HOURINSEC +
+	       lt.tm_min * MININSEC + lt.tm_sec - t;
+
+	return 1;
+}
+
+/*
+ * Fill in the offsets of a year. The offset is sampled daily; a transition is
+ * located to the second by bisection.
+ */
+static void tz_load(struct tz_year *ty, long year)
+{
+	struct date d = { 1, 1, 0 };
+	time_t t, lo, hi, mid, end;
+	long off, o;
+
+	ty->state = TZ_LIBC;
+	if (getenv("CALCURSE_TZ_NOCACHE"))
+		return;
+
+	d.yyyy = year;
+	t = (time_t)date2days(d) * DAYINSEC;
+	d.yyyy = year + 1;
+	end = (time_t)date2days(d) * DAYINSEC - 1;
+	if (!tz_libc_offset(t, &off))
+		return;
+	ty->off = off;
+	ty->ntrans = 0;
+
+	for (; t < end; t = hi) {
+		hi = end - t > DAYINSEC ? t + DAYINSEC : end;
+		if (!tz_libc_offset(hi, &o))
+			return;
+		if (o == off)
+			continue;
+		for (lo = t; hi - lo > 1;) {
+			mid = lo + (hi - lo) / 2;
+			if (!tz_libc_offset(mid, &o))
+				return;
+			if (o == off)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		if (ty->ntrans == TZ_MAXTRANS || !tz_libc_offset(hi, &off))
+			return;
+		ty->trans[ty->ntrans] = hi;
+		ty->toff[ty->ntrans] = off;
+		ty->ntrans++;
+	}
+	ty->state = TZ_CACHED;
+}
+
+/* Return the UTC offset of the local time zone at time t. */
+static long tz_offset(time_t t)
+{
+	long year = (long)days2date(sec2days_utc(t)).yyyy;
+	struct tz_year *ty;
+	char *seen;
+	long off = 0;
+	unsigned i;
+
+	if (year < TZ_FIRST_YEAR || year > TZ_LAST_YEAR) {
+		tz_libc_offset(t, &off);
+		return off;
+	}
+
+	ty = &tz_years[year - TZ_FIRST_YEAR];
+	pthread_once(&tz_seen_once, tz_seen_init);
+	seen = pthread_getspecific(tz_seen_key);
+	if (!seen) {
+		/* Not mem_calloc(): it is freed on thread exit, by free(). */
+		seen = calloc(TZ_NYEARS, 1);
+		if (seen)
+			pthread_setspecific(tz_seen_key, seen);
+	}
+	if (!seen || !seen[year - TZ_FIRST_YEAR]) {
+		pthread_mutex_lock(&tz_mutex);
+		if (ty->state == TZ_UNKNOWN)
+			tz_load(ty, year);
+		pthread_mutex_unlock(&tz_mutex);
+		if (seen)
+			seen[year - TZ_FIRST_YEAR] = 1;
+	}
+	if (ty->state != TZ_CACHED) {
+		tz_libc_offset(t, &off);
+		return off;
+	}
+
+	off = ty->off;
+	for (i = 0; i < ty->ntrans && t >= ty->trans[i]; i++)
+		off = ty->toff[i];
+
+	return off;
+}
+
+/*
+ * Convert local time (in seconds, as if it were UTC) to Unix time. A local
+ * time which occurs twice is taken to be the first one; a local time skipped
+ * by a transition is taken to use the offset in force before the transition,
+ * as in RFC 5545 (and as done by mktime() with tm_isdst set to -1).
+ */
+static time_t tz_local2sec(time_t local)
+{
+	time_t t = local - tz_offset(local);
+	long before = tz_offset(t - DAYINSEC);
+	long after = tz_offset(t + DAYINSEC);
+
+	if (tz_offset(local - before) == before)
+		return local - before;
+	if (tz_offset(local - after) == after)
+		return local - after;
+	return local - before;
+}
+
+/* Return the day number (see date2days()) of the local date of a time. */
+long sec2days(time_t t)
+{
+	return sec2days_utc(t + tz_offset(t));
+}
+
+/* Return the time of the given local time of day n, see date2days(). */
+time_t days2sec(long n, unsigned hour, unsigned min)
+{
+	return tz_local2sec((time_t)n * DAYINSEC + hour * HOURINSEC +
+			    min * MININSEC);
+}
+
+/*
+ * Return the largest amount by which the UTC offset of the local time zone
+ * grows within a day, for the transitions between from and to. Counting from
+ * any time of a day, the rest of that day is at most that much shorter than
+ * usual. If it is not known, a whole day is returned.
+ */
+long tz_max_gain(time_t from, time_t to)
+{
+	long year = (long)days2date(sec2days_utc(from)).yyyy;
+	long last = (long)days2date(sec2days_utc(to)).yyyy;
+	long gain = 0, before;
+	struct tz_year *ty;
+	struct date d = { 1, 1, 0 };
+	unsigned i;
+
+	for (; year <= last; year++) {
+		if (year < TZ_FIRST_YEAR || year > TZ_LAST_YEAR)
+			return DAYINSEC;
+		/* Load the year, if needed. */
+		d.yyyy = year;
+		tz_offset((time_t)date2days(d) * DAYINSEC);
+		ty = &tz_years[year - TZ_FIRST_YEAR];
+		if (ty->state != TZ_CACHED)
+			return DAYINSEC;
+
+		for (i = 0; i < ty->ntrans; i++) {
+			if (ty->trans[i] < from || ty->trans[i] > to)
+				continue;
+			before = MIN(i > 0 ? ty->toff[i - 1] : ty->off,
+				     tz_offset(ty->trans[i] - DAYINSEC));
+			gain = MAX(gain, ty->toff[i] - before);
+		}
+	}
+
+	return gain;
+}
+
 struct tm date2tm(struct date day, unsigned hour, unsigned min)
 {
 	time_t t = now();
@@ -402,25 +654,13 @@ struct tm date2tm(struct date day, unsigned hour, unsigned min)
 
 time_t date2sec(struct date day, unsigned hour, unsigned min)
 {
-	struct tm start = date2tm(day, hour, min);
-	time_t t = mktime(&start);
-
-	EXIT_IF(t == -1, _("failure in mktime"));
-
-	return t;
+	return days2sec(months2days(day.yyyy, day.mm, day.dd), hour, min);
 }
 
 /* Return the (calcurse) date of a (Unix) time in seconds. */
 struct date sec2date(time_t t)
 {
-	struct tm tm;
-	struct date d;
-
-	localtime_r(&t, &tm);
-	d.dd = tm.tm_mday;
-	d.mm = tm.tm_mon + 1;
-	d.yyyy = tm.tm_year + 1900;
-	return d;
+	return days2date(sec2days(t));
 }
 
 time_t tzdate2sec(struct date day, unsigned hour, unsigned min, char *tznew)
@@ -437,7 +677,10 @@ time_t tzdate2sec(struct date day, unsigned hour, unsigned min, char *tznew)
 	setenv("TZ", tznew, 1);
 	tzset();
 
-	t = date2sec(day, hour, min);
+	/* The cached offsets are those of the local time zone. */
+	struct tm start = date2tm(day, hour, min);
+	t = mktime(&start);
+	EXIT_IF(t == -1, _("failure in mktime"));
 
 	if (tzold) {
 		setenv("TZ", tzold, 1);
@@ -471,25 +714,52 @@ int date_cmp(struct date *d1, struct date *d2)
 /* Compare two dates (without comparing times). */
 int date_cmp_day(time_t d1, time_t d2)
 {
-	struct tm lt1, lt2;
+	long n1 = sec2days(d1), n2 = sec2days(d2);
 
-	localtime_r((time_t *)&d1, &lt1);
-	localtime_r((time_t *)&d2, &lt2);
+	return n1 < n2 ? -1 : (n1 > n2 ? 1 : 0);
+}
 
-	if (lt1.tm_year < lt2.tm_year)
-		return -1;
-	if (lt1.tm_year > lt2.tm_year)
-		return 1;
-	if (lt1.tm_mon < lt2.tm_mon)
-		return -1;
-	if (lt1.tm_mon > lt2.tm_mon)
-		return 1;
-	if (lt1.tm_mday < lt2.tm_mday)
-		return -1;
-	if (lt1.tm_mday > lt2.tm_mday)
-		return 1;
+/*
+ * Return the number of days from 1 January 1970 to the given date in the
+ * proleptic Gregorian calendar (negative for earlier dates). Only integer
+ * arithmetic is used; the era based algorithm is due to Howard Hinnant.
+ */
+long date2days(struct date d)
+{
+	long y = (long)d.yyyy - (d.mm <= 2);
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (d.mm + (d.mm > 2 ? -3 : 9)) + 2) / 5 + d.dd - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
 
-	return 0;
+	return era * 146097 + doe - 719468;
+}
+
+/* Inverse of date2days(). */
+struct date days2date(long n)
+{
+	struct date d;
+	long era, doe, yoe, doy, mp, y;
+
+	n += 719468;
+	era = (n >= 0 ? n : n - 146096) / 146097;
+	doe = n - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	y = yoe + era * 400;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	d.dd = doy - (153 * mp + 2) / 5 + 1;
+	d.mm = mp < 10 ? mp + 3 : mp - 9;
+	d.yyyy = y + (d.mm <= 2);
+
+	return d;
+}
+
+/* Return the week day (0 for Sunday) of a day number, see date2days(). */
+int days2wday(long n)
+{
+	/* 1 January 1970 was a Thursday. */
+	return (int)((n % WEEKINDAYS + WEEKINDAYS + THURSDAY) % WEEKINDAYS);
 }
 
 /* Generic function to format date. */
@@ -545,17 +815,29 @@ int date_change(struct tm *date, int delta_month, int delta_day)
  */
 time_t date_sec_change(time_t date, int delta_month, int delta_day)
 {
-	struct tm lt;
-	time_t t;
+	time_t local = date + tz_offset(date);
+	long n = sec2days_utc(local);
+	time_t sec = local - (time_t)n * DAYINSEC;
+	struct date d = days2date(n);
 
-	t = date;
-	localtime_r(&t, &lt);
-	lt.tm_mon += delta_month;
-	lt.tm_mday += delta_day;
-	lt.tm_isdst = -1;
-	t = mktime(&lt);
-	EXIT_IF(t == -1, _("failure in mktime"));
+	if (delta_month)
+		n = months2days(d.yyyy, (long)d.mm + delta_month, d.dd);
+
+	return tz_local2sec((time_t)(n + delta_day) * DAYINSEC + sec);
+}
+
+/*
+ * Same as mktime() with tm_isdst set to -1: the day, month and year may be out
+ * of range and are normalized. Unlike mktime(), whose choice depends on earlier
+ * calls, a local time which occurs twice is always the first one.
+ */
+time_t tm2sec(struct tm *tm)
+{
+	long n = months2days(tm->tm_year + 1900L, tm->tm_mon + 1L, 1) +
+	    tm->tm_mday - 1;
+	time_t t = days2sec(n, tm->tm_hour, tm->tm_min) + tm->tm_sec;
 
+	localtime_r(&t, tm);
 	return t;
 }
 
@@ -564,17 +846,11 @@ time_t date_sec_change(time_t date, int delta_month, int delta_day)
  */
 static time_t update_date_in_date(time_t date, int day, int month, int year)
 {
-	struct tm lt;
-
-	localtime_r(&date, &lt);
-	lt.tm_mday = day;
-	lt.tm_mon = month - 1;
-	lt.tm_year = year - 1900;
-	lt.tm_isdst = -1;
-	date = mktime(&lt);
-	EXIT_IF(date == -1, _("error in mktime"));
+	time_t local = date + tz_offset(date);
+	time_t sec = local - (time_t)sec2days_utc(local) * DAYINSEC;
 
-	return date;
+	return tz_local2sec((time_t)months2days(year, month, day) * DAYINSEC +
+			    sec);
 }
 
 /*
@@ -582,17 +858,7 @@ static time_t update_date_in_date(time_t date, int day, int month, int year)
  */
 time_t update_time_in_date(time_t date, unsigned hr, unsigned mn)
 {
-	struct tm lt;
-
-	localtime_r(&date, &lt);
-	lt.tm_hour = hr;
-	lt.tm_min = mn;
-	lt.tm_sec = 0;
-	lt.tm_isdst = -1;
-	date = mktime(&lt);
-	EXIT_IF(date == -1, _("error in mktime"));
-
-	return date;
+	return days2sec(sec2days(date), hr, mn);
 }
 
 /*
@@ -1521,14 +1787,13 @@ void press_any_key(void)
  *
  * (patch submitted by Erik Saule).
  */
-static void print_notefile(FILE * out, const char *filename, int nbtab)
+static void print_notefile(struct string *out, const char *filename,
+			   int nbtab)
 {
-	char *path_to_notefile;
-	FILE *notefile;
 	char linestarter[BUFSIZ];
-	char buffer[BUFSIZ];
+	char *note, *p, *q, *end;
+	size_t len;
 	int i;
-	int printlinestarter = 1;
 
 	if (nbtab < BUFSIZ) {
 		for (i = 0; i < nbtab; i++)
@@ -1538,71 +1803,60 @@ static void print_notefile(FILE * out, const char *filename, int nbtab)
 		linestarter[0] = '\0';
 	}
 
-	asprintf(&path_to_notefile, "%s/%s", path_notes, filename);
-	notefile = fopen(path_to_notefile, "r");
-	mem_free(path_to_notefile);
-	if (notefile) {
-		while (fgets(buffer, BUFSIZ, notefile) != 0) {
-			if (printlinestarter) {
-				fputs(linestarter, out);
-				printlinestarter = 0;
-			}
-			fputs(buffer, out);
-			if (buffer[strlen(buffer) - 1] == '\n')
-				printlinestarter = 1;
+	if ((note = note_get(filename, &len))) {
+		for (p = note, end = note + len; p < end; p = q) {
+			q = memchr(p, '\n', end - p);
+			q = q ? q + 1 : end;
+			string_catn(out, linestarter, nbtab);
+			string_catn(out, p, q - p);
 		}
-		fputs("\n", out);
-		file_close(notefile, __FILE_POS__);
+		string_catn(out, "\n", 1);
+		mem_free(note);
 	} else {
-		fputs(linestarter, out);
-		fputs(_("No note file found\n"), out);
+		string_catn(out, linestarter, nbtab);
+		string_catf(out, "%s", _("No note file found\n"));
 	}
 }
 
-/* Print an escape sequence and return its length. */
-static int print_escape(const char *s)
+/*
+ * Parse an escape sequence. Return the character it stands for, or -1 if it
+ * stands for nothing.
+ */
+static int parse_escape(const char **s)
 {
-	switch (*(s + 1)) {
+	const char *p = *s + 1;
+
+	if (*p == '\0')
+		return -1;
+	(*s)++;
+
+	switch (*p) {
 	case 'a':
-		putchar('\a');
-		return 1;
+		return '\a';
 	case 'b':
-		putchar('\b');
-		return 1;
+		return '\b';
 	case 'f':
-		putchar('\f');
-		return 1;
+		return '\f';
 	case 'n':
-		putchar('\n');
-		return 1;
+		return '\n';
 	case 'r':
-		putchar('\r');
-		return 1;
+		return '\r';
 	case 't':
-		putchar('\t');
-		return 1;
+		return '\t';
 	case 'v':
-		putchar('\v');
-		return 1;
+		return '\v';
 	case '0':
-		putchar('\0');
-		return 1;
+		return '\0';
 	case '\'':
-		putchar('\'');
-		return 1;
+		return '\'';
 	case '"':
-		putchar('"');
-		return 1;
+		return '"';
 	case '\?':
-		putchar('?');
-		return 1;
+		return '?';
 	case '\\':
-		putchar('\\');
-		return 1;
-	case '\0':
-		return 0;
+		return '\\';
 	default:
-		return 1;
+		return -1;
 	}
 }
 
@@ -1695,309 +1949,537 @@ static enum format_specifier parse_fs(const char **s, char *extformat)
 }
 
 /*
- * Print date to stdout, formatted to be displayed for day.
- * The "day" argument may be any time belonging to that day.
+ * Compiled format strings.
+ *
+ * The format strings of the command line are turned into a list of operations
+ * the first time they are used, so that printing an item does not parse them
+ * again: literal text (with the escape sequences resolved), dates with their
+ * mode (epoch, default or strftime() pattern), time differences split into
+ * units, and the other fields. Items are printed into a buffer, which is
+ * written to stdout at once, or into a string given by the caller.
  */
-static void print_date(time_t date, time_t day, const char *extformat)
+
+#define PRINT_FORMATS	8
+
+enum print_op_type {
+	PRINT_LITERAL,
+	PRINT_DATE,
+	PRINT_DIFF,
+	PRINT_FIELD
+};
+
+enum print_mode {
+	PRINT_EPOCH,
+	PRINT_DEFAULT,
+	PRINT_STRFTIME
+};
+
+/* A unit of a time difference, or a literal character if div is 0. */
+struct print_unit {
+	long div;
+	long mod;
+	int pad;
+	char c;
+};
+
+struct print_op {
+	enum print_op_type type;
+	enum format_specifier fs;
+	enum print_mode mode;
+	char *s;			/* literal text or strftime() pattern */
+	int len;
+	struct print_unit *units;
+	int nunits;
+};
+
+struct print_fmt {
+	char *src;
+	struct print_op *ops;
+	int nops;
+};
+
+static struct print_fmt print_fmts[PRINT_FORMATS];
+static unsigned print_nfmts, print_next;
+static struct string print_out;
+
+static struct print_op *print_op_add(struct print_fmt *fmt,
+				     enum print_op_type type,
+				     enum format_specifier fs)
 {
-	char buf[BUFSIZ];
+	struct print_op *op;
 
-	if (!strcmp(extformat, "epoch")) {
-		printf("%ld", (long)date);
-	} else {
-		time_t day_start = DAY(day);
-		time_t day_end = date_sec_change(day_start, 0, 1);
-		struct tm lt;
+	fmt->ops = mem_realloc(fmt->ops, fmt->nops + 1,
+			       sizeof(struct print_op));
+	op = &fmt->ops[fmt->nops++];
+	op->type = type;
+	op->fs = fs;
+	op->mode = PRINT_DEFAULT;
+	op->s = NULL;
+	op->len = 0;
+	op->units = NULL;
+	op->nunits = 0;
 
-		localtime_r((time_t *) &date, &lt);
+	return op;
+}
 
-		if (extformat[0] == '\0' || !strcmp(extformat, "default")) {
-			if (date >= day_start && date <= day_end)
-				strftime(buf, BUFSIZ, "%H:%M", &lt);
-			else
-				strftime(buf, BUFSIZ, "..:..", &lt);
-		} else {
-			strftime(buf, BUFSIZ, extformat, &lt);
-		}
+/* Add literal text, which is merged with the text before if possible. */
+static void print_op_literal(struct print_fmt *fmt, const char *s, int len)
+{
+	struct print_op *op = fmt->nops ? &fmt->ops[fmt->nops - 1] : NULL;
 
-		printf("%s", buf);
-	}
+	if (!op || op->type != PRINT_LITERAL)
+		op = print_op_add(fmt, PRINT_LITERAL, FS_UNKNOWN);
+	op->s = mem_realloc(op->s, op->len + len, 1);
+	memcpy(op->s + op->len, s, len);
+	op->len += len;
 }
 
-/* Print a time difference to stdout. */
-static void print_datediff(long difference, const char *extformat)
+static void print_unit_add(struct print_op *op, long div, long mod, int pad,
+			   char c)
 {
-	const char *p;
-	const char *numfmt;
-	bool usetotal;
-	long value;
+	struct print_unit *u;
 
-	if (!strcmp(extformat, "epoch")) {
-		printf("%ld", difference);
-	} else {
-		if (extformat[0] == '\0' || !strcmp(extformat, "default")) {
-			/* Set a default format if none specified. */
-			p = "%EH:%M";
-		} else {
-			p = extformat;
+	op->units = mem_realloc(op->units, op->nunits + 1,
+				sizeof(struct print_unit));
+	u = &op->units[op->nunits++];
+	u->div = div;
+	u->mod = mod;
+	u->pad = pad;
+	u->c = c;
+}
+
+/*
+ * Split the format of a time difference into units. The default is to
+ * zero-pad, and assume the user wants the time unit modulo the next biggest
+ * time unit.
+ */
+static void print_compile_diff(struct print_op *op, const char *p)
+{
+	int pad, total;
+
+	if (!strcmp(p, "epoch")) {
+		op->mode = PRINT_EPOCH;
+		return;
+	}
+	if (*p == '\0' || !strcmp(p, "default"))
+		p = "%EH:%M";
+
+	for (; *p; p++) {
+		if (*p != '%') {
+			print_unit_add(op, 0, 0, 0, *p);
+			continue;
 		}
-		while (*p) {
-			if (*p == '%') {
-				p++;
-				/* Default is to zero-pad, and assume
-				 * the user wants the time unit modulo
-				 * the next biggest time unit. */
-				numfmt = "%02d";
-				usetotal = FALSE;
-				if (*p == '-') {
-					numfmt = "%d";
-					p++;
-				}
-				if (*p == 'E') {
-					usetotal = TRUE;
-					p++;
-				}
-				switch (*p) {
-				case '\0':
-					return;
-				case 'd':
-					value = difference / DAYINSEC;
-					printf(numfmt, value);
-					break;
-				case 'H':
-					value = difference / HOURINSEC;
-					if (!usetotal)
-						value %= DAYINHOURS;
-					printf(numfmt, value);
-					break;
-				case 'M':
-					value = difference / MININSEC;
-					if (!usetotal)
-						value %= HOURINMIN;
-					printf(numfmt, value);
-					break;
-				case 'S':
-					value = difference;
-					if (!usetotal)
-						value %= MININSEC;
-					printf(numfmt, value);
-					break;
-				case '%':
-					putchar('%');
-					break;
-				default:
-					putchar('?');
-					break;
-				}
-			} else {
-				putchar(*p);
-			}
+		p++;
+		pad = 1;
+		total = 0;
+		if (*p == '-') {
+			pad = 0;
+			p++;
+		}
+		if (*p == 'E') {
+			total = 1;
 			p++;
 		}
+		switch (*p) {
+		case '\0':
+			return;
+		case 'd':
+			print_unit_add(op, DAYINSEC, 0, pad, 0);
+			break;
+		case 'H':
+			print_unit_add(op, HOURINSEC, total ? 0 : DAYINHOURS,
+				       pad, 0);
+			break;
+		case 'M':
+			print_unit_add(op, MININSEC, total ? 0 : HOURINMIN,
+				       pad, 0);
+			break;
+		case 'S':
+			print_unit_add(op, 1, total ? 0 : MININSEC, pad, 0);
+			break;
+		case '%':
+			print_unit_add(op, 0, 0, 0, '%');
+			break;
+		default:
+			print_unit_add(op, 0, 0, 0, '?');
+			break;
+		}
 	}
 }
 
-/* Print a formatted appointment to stdout. */
-static void print_apoint_helper(const char *format, time_t day,
-				struct apoint *apt, struct recur_apoint *rapt)
+static void print_compile(struct print_fmt *fmt, const char *format)
 {
 	const char *p;
 	char extformat[FS_EXT_MAXLEN];
+	enum format_specifier fs;
+	struct print_op *op;
+	char c;
+	int esc;
+
+	fmt->src = mem_strdup(format);
+	fmt->ops = NULL;
+	fmt->nops = 0;
 
 	for (p = format; *p; p++) {
-		if (*p == '%') {
-			p++;
-			switch (parse_fs(&p, extformat)) {
-			case FS_STARTDATE:
-				print_date(apt->start, day, extformat);
-				break;
-			case FS_DURATION:
-				/* Backwards compatibility: Use epoch by
-				 * default. */
-				if (*extformat == '\0')
-					strcpy(extformat, "epoch");
-				print_datediff(apt->dur, extformat);
-				break;
-			case FS_ENDDATE:
-				print_date(apt->start + apt->dur, day,
-					   extformat);
-				break;
-			case FS_REMAINING:
-				print_datediff(difftime(apt->start, now()),
-				               extformat);
-				break;
-			case FS_MESSAGE:
-				printf("%s", apt->mesg);
-				break;
-			case FS_NOTE:
-				printf("%s", apt->note);
-				break;
-			case FS_NOTEFILE:
-				print_notefile(stdout, apt->note, 1);
-				break;
-			case FS_RAW:
-				if (rapt)
-					recur_apoint_write(rapt, stdout);
-				else
-					apoint_write(apt, stdout);
-				break;
-			case FS_HASH:
-				if (rapt)
-					printf("%s", recur_apoint_hash(rapt));
-				else
-					printf("%s", apoint_hash(apt));
-				break;
-			case FS_PSIGN:
-				putchar('%');
-				break;
-			case FS_EOF:
-				return;
-				break;
-			default:
-				putchar('?');
-				break;
+		if (*p == '\\') {
+			if ((esc = parse_escape(&p)) >= 0) {
+				c = esc;
+				print_op_literal(fmt, &c, 1);
 			}
-		} else if (*p == '\\') {
-			p += print_escape(p);
+			continue;
+		} else if (*p != '%') {
+			print_op_literal(fmt, p, 1);
+			continue;
+		}
+
+		p++;
+		switch ((fs = parse_fs(&p, extformat))) {
+		case FS_STARTDATE:
+		case FS_ENDDATE:
+			op = print_op_add(fmt, PRINT_DATE, fs);
+			if (!strcmp(extformat, "epoch")) {
+				op->mode = PRINT_EPOCH;
+			} else if (extformat[0] != '\0' &&
+				   strcmp(extformat, "default")) {
+				op->mode = PRINT_STRFTIME;
+				op->s = mem_strdup(extformat);
+			}
+			break;
+		case FS_DURATION:
+			/* Backwards compatibility: Use epoch by default. */
+			if (*extformat == '\0')
+				strcpy(extformat, "epoch");
+			/* FALLTHROUGH */
+		case FS_REMAINING:
+			op = print_op_add(fmt, PRINT_DIFF, fs);
+			print_compile_diff(op, extformat);
+			break;
+		case FS_PSIGN:
+			print_op_literal(fmt, "%", 1);
+			break;
+		case FS_UNKNOWN:
+			print_op_literal(fmt, "?", 1);
+			break;
+		case FS_EOF:
+			return;
+		default:
+			print_op_add(fmt, PRINT_FIELD, fs);
+			break;
+		}
+	}
+}
+
+static void print_fmt_free(struct print_fmt *fmt)
+{
+	int i;
+
+	for (i = 0; i < fmt->nops; i++) {
+		if (fmt->ops[i].s)
+			mem_free(fmt->ops[i].s);
+		if (fmt->ops[i].units)
+			mem_free(fmt->ops[i].units);
+	}
+	if (fmt->ops)
+		mem_free(fmt->ops);
+	mem_free(fmt->src);
+}
+
+/* Return the compiled version of a format string. */
+static struct print_fmt *print_fmt_get(const char *format)
+{
+	struct print_fmt *fmt;
+	unsigned i;
+
+	for (i = 0; i < print_nfmts; i++) {
+		if (!strcmp(print_fmts[i].src, format))
+			return &print_fmts[i];
+	}
+
+	if (print_nfmts < PRINT_FORMATS) {
+		fmt = &print_fmts[print_nfmts++];
+	} else {
+		fmt = &print_fmts[print_next];
+		print_next = (print_next + 1) % PRINT_FORMATS;
+		print_fmt_free(fmt);
+	}
+	print_compile(fmt, format);
+	if (!print_out.buf)
+		string_init(&print_out);
+
+	return fmt;
+}
+
+/*
+ * Compile a format string ahead of printing. The formats an item is printed
+ * with from several threads at once must have been compiled beforehand.
+ */
+void print_prepare_format(const char *format)
+{
+	print_fmt_get(format);
+}
+
+/* Free the compiled format strings. */
+void print_free_formats(void)
+{
+	unsigned i;
+
+	for (i = 0; i < print_nfmts; i++)
+		print_fmt_free(&print_fmts[i]);
+	print_nfmts = print_next = 0;
+	if (print_out.buf)
+		mem_free(print_out.buf);
+	print_out.buf = NULL;
+}
+
+/* Write the printed item to stdout. */
+static void print_flush(void)
+{
+	fwrite(print_out.buf, 1, print_out.len, stdout);
+	print_out.len = 0;
+}
+
+/* Print a date, formatted to be displayed for day. */
+static void print_date(struct string *out, struct print_op *op, time_t date,
+		       time_t day)
+{
+	char buf[BUFSIZ];
+	time_t day_start, day_end;
+	struct tm lt;
+
+	switch (op->mode) {
+	case PRINT_EPOCH:
+		string_catf(out, "%ld", (long)date);
+		break;
+	case PRINT_DEFAULT:
+		day_start = DAY(day);
+		day_end = date_sec_change(day_start, 0, 1);
+		if (date >= day_start && date <= day_end) {
+			localtime_r(&date, &lt);
+			string_catf(out, "%02d:%02d", lt.tm_hour,
+				    lt.tm_min);
 		} else {
-			putchar(*p);
+			string_catn(out, "..:..", 5);
 		}
+		break;
+	case PRINT_STRFTIME:
+		localtime_r(&date, &lt);
+		buf[0] = '\0';
+		strftime(buf, BUFSIZ, op->s, &lt);
+		string_catn(out, buf, strlen(buf));
+		break;
 	}
 }
 
-/* Print a formatted event to stdout. */
-static void print_event_helper(const char *format, time_t day, struct event *ev,
-			       struct recur_event *rev)
+/* Print a time difference. */
+static void print_datediff(struct string *out, struct print_op *op,
+			   long difference)
 {
-	const char *p;
-	char extformat[FS_EXT_MAXLEN];
+	struct print_unit *u;
+	long value;
+	int i;
 
-	for (p = format; *p; p++) {
-		if (*p == '%') {
-			p++;
-			switch (parse_fs(&p, extformat)) {
-			case FS_MESSAGE:
-				printf("%s", ev->mesg);
-				break;
-			case FS_NOTE:
-				printf("%s", ev->note);
-				break;
-			case FS_NOTEFILE:
-				print_notefile(stdout, ev->note, 1);
-				break;
-			case FS_PSIGN:
-				putchar('%');
-				break;
-			case FS_RAW:
-				if (rev)
-					recur_event_write(rev, stdout);
-				else
-					event_write(ev, stdout);
-				break;
-			case FS_HASH:
-				if (rev)
-					printf("%s", recur_event_hash(rev));
-				else
-					printf("%s", event_hash(ev));
-				break;
-			case FS_EOF:
-				return;
+	if (op->mode == PRINT_EPOCH) {
+		string_catf(out, "%ld", difference);
+		return;
+	}
+
+	for (i = 0; i < op->nunits; i++) {
+		u = &op->units[i];
+		if (!u->div) {
+			string_catn(out, &u->c, 1);
+			continue;
+		}
+		value = difference / u->div;
+		if (u->mod)
+			value %= u->mod;
+		string_catf(out, u->pad ? "%02d" : "%d", (int)value);
+	}
+}
+
+/* An item to print, see print_item(). */
+struct print_item {
+	time_t day;
+	struct apoint *apt;
+	struct recur_apoint *rapt;
+	struct event *ev;
+	struct recur_event *rev;
+	struct todo *todo;
+};
+
+/* Print a string, the way printf() prints it. */
+static void print_cat(struct string *out, const char *s)
+{
+	if (!s)
+		s = "(null)";
+	string_catn(out, s, strlen(s));
+}
+
+static void print_str(struct string *out, char *s)
+{
+	print_cat(out, s);
+	mem_free(s);
+}
+
+static void print_field(struct string *out, struct print_op *op,
+			struct print_item *it)
+{
+	const char *mesg, *note;
+
+	if (it->apt) {
+		mesg = it->apt->mesg;
+		note = it->apt->note;
+	} else if (it->ev) {
+		mesg = it->ev->mesg;
+		note = it->ev->note;
+	} else {
+		mesg = it->todo->mesg;
+		note = it->todo->note;
+	}
+
+	switch (op->fs) {
+	case FS_MESSAGE:
+		print_cat(out, mesg);
+		break;
+	case FS_NOTE:
+		print_cat(out, note);
+		break;
+	case FS_NOTEFILE:
+		print_notefile(out, note, 1);
+		break;
+	case FS_PRIORITY:
+		if (!it->todo)
+			goto unknown;
+		string_catf(out, "%d", abs(it->todo->id));
+		break;
+	case FS_RAW:
+		if (it->rapt)
+			print_str(out, recur_apoint_tostr(it->rapt));
+		else if (it->apt)
+			print_str(out, apoint_tostr(it->apt));
+		else if (it->rev)
+			print_str(out, recur_event_tostr(it->rev));
+		else if (it->ev)
+			print_str(out, event_tostr(it->ev));
+		else
+			print_str(out, todo_tostr(it->todo));
+		string_catn(out, "\n", 1);
+		break;
+	case FS_HASH:
+		if (it->rapt)
+			print_cat(out, recur_apoint_hash(it->rapt));
+		else if (it->apt)
+			print_cat(out, apoint_hash(it->apt));
+		else if (it->rev)
+			print_cat(out, recur_event_hash(it->rev));
+		else if (it->ev)
+			print_cat(out, event_hash(it->ev));
+		else
+			print_cat(out, todo_hash(it->todo));
+		break;
+	default:
+	unknown:
+		string_catn(out, "?", 1);
+		break;
+	}
+}
+
+/* Print a formatted item to a string or, if that is NULL, to stdout. */
+static void print_item(struct string *s, const char *format,
+		       struct print_item *it)
+{
+	struct print_fmt *fmt = print_fmt_get(format);
+	struct string *out = s ? s : &print_out;
+	struct print_op *op;
+	int i;
+
+	for (i = 0; i < fmt->nops; i++) {
+		op = &fmt->ops[i];
+		switch (op->type) {
+		case PRINT_LITERAL:
+			string_catn(out, op->s, op->len);
+			break;
+		case PRINT_DATE:
+			if (!it->apt) {
+				string_catn(out, "?", 1);
 				break;
-			default:
-				putchar('?');
+			}
+			print_date(out, op, op->fs == FS_STARTDATE ?
+				   it->apt->start :
+				   it->apt->start + it->apt->dur, it->day);
+			break;
+		case PRINT_DIFF:
+			if (!it->apt) {
+				string_catn(out, "?", 1);
 				break;
 			}
-		} else if (*p == '\\') {
-			p += print_escape(p);
-		} else {
-			putchar(*p);
+			print_datediff(out, op, op->fs == FS_DURATION ?
+				       it->apt->dur :
+				       difftime(it->apt->start, now()));
+			break;
+		case PRINT_FIELD:
+			print_field(out, op, it);
+			break;
 		}
 	}
+	if (!s)
+		print_flush();
 }
 
-/* Print a formatted appointment to stdout. */
-void print_apoint(const char *format, time_t day, struct apoint *apt)
+/* Print a formatted appointment, see print_item(). */
+void print_apoint(struct string *out, const char *format, time_t day,
+		  struct apoint *apt)
 {
-	print_apoint_helper(format, day, apt, NULL);
+	struct print_item it = { day, apt, NULL, NULL, NULL, NULL };
+
+	print_item(out, format, &it);
 }
 
-/* Print a formatted event to stdout. */
-void print_event(const char *format, time_t day, struct event *ev)
+/* Print a formatted event, see print_item(). */
+void print_event(struct string *out, const char *format, time_t day,
+		 struct event *ev)
 {
-	print_event_helper(format, day, ev, NULL);
+	struct print_item it = { day, NULL, NULL, ev, NULL, NULL };
+
+	print_item(out, format, &it);
 }
 
-/* Print a formatted recurrent appointment to stdout. */
+/* Print a formatted recurrent appointment, see print_item(). */
 void
-print_recur_apoint(const char *format, time_t day, time_t occurrence,
-		   struct recur_apoint *rapt)
+print_recur_apoint(struct string *out, const char *format, time_t day,
+		   time_t occurrence, struct recur_apoint *rapt)
 {
 	struct apoint apt;
+	struct print_item it = { day, &apt, rapt, NULL, NULL, NULL };
 
 	apt.start = occurrence;
 	apt.dur = rapt->dur;
 	apt.mesg = rapt->mesg;
 	apt.note = rapt->note;
+	apt.hash = NULL;
 
-	print_apoint_helper(format, day, &apt, rapt);
+	print_item(out, format, &it);
 }
 
-/* Print a formatted recurrent event to stdout. */
-void print_recur_event(const char *format, time_t day,
+/* Print a formatted recurrent event, see print_item(). */
+void print_recur_event(struct string *out, const char *format, time_t day,
 		       struct recur_event *rev)
 {
 	struct event ev;
+	struct print_item it = { day, NULL, NULL, &ev, rev, NULL };
 
 	ev.mesg = rev->mesg;
 	ev.note = rev->note;
+	ev.hash = NULL;
 
-	print_event_helper(format, day, &ev, rev);
+	print_item(out, format, &it);
 }
 
-/* Print a formatted todo item to stdout. */
-void print_todo(const char *format, struct todo *todo)
+/* Print a formatted todo item, see print_item(). */
+void print_todo(struct string *out, const char *format, struct todo *todo)
 {
-	const char *p;
-	char extformat[FS_EXT_MAXLEN];
+	struct print_item it = { 0, NULL, NULL, NULL, NULL, todo };
 
-	for (p = format; *p; p++) {
-		if (*p == '%') {
-			p++;
-			switch (parse_fs(&p, extformat)) {
-			case FS_PRIORITY:
-				printf("%d", abs(todo->id));
-				break;
-			case FS_MESSAGE:
-				printf("%s", todo->mesg);
-				break;
-			case FS_NOTE:
-				printf("%s", todo->note);
-				break;
-			case FS_NOTEFILE:
-				print_notefile(stdout, todo->note, 1);
-				break;
-			case FS_RAW:
-				todo_write(todo, stdout);
-				break;
-			case FS_HASH:
-				printf("%s", todo_hash(todo));
-				break;
-			case FS_PSIGN:
-				putchar('%');
-				break;
-			case FS_EOF:
-				return;
-				break;
-			default:
-				putchar('?');
-				break;
-			}
-		} else if (*p == '\\') {
-			p += print_escape(p);
-		} else {
-			putchar(*p);
-		}
-	}
+	print_item(out, format, &it);
 }
 
 int
@@ -2040,6 +2522,66 @@ int hash_matches(const char *pattern, const char *hash)
 	return (starts_with(hash, pattern) != invert);
 }
 
+/*
+ * Item digests (see apoint_hash() and the like) are computed once and cached
+ * in the items. A cached digest is only valid in the generation it was
+ * computed in, which moves on whenever any item is changed.
+ */
+static unsigned item_hash_gen = 1;
+static pthread_mutex_t item_hash_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void item_hash_invalidate(void)
+{
+	pthread_mutex_lock(&item_hash_mutex);
+	item_hash_gen++;
+	pthread_mutex_unlock(&item_hash_mutex);
+}
+
+/* Return a cached digest, or NULL if it needs to be computed. */
+const char *item_hash_get(struct item_hash *h)
+{
+	const char *digest = NULL;
+
+	pthread_mutex_lock(&item_hash_mutex);
+	if (h && h->gen == item_hash_gen)
+		digest = h->digest;
+	pthread_mutex_unlock(&item_hash_mutex);
+
+	return digest;
+}
+
+/* Cache the digest of the raw form of an item, which is freed. */
+const char *item_hash_set(struct item_hash **h, char *raw)
+{
+	char digest[sizeof((*h)->digest)];
+
+	sha1_digest(raw, digest);
+	mem_free(raw);
+
+	pthread_mutex_lock(&item_hash_mutex);
+	if (!*h)
+		*h = mem_calloc(1, sizeof(struct item_hash));
+	if ((*h)->gen != item_hash_gen) {
+		memcpy((*h)->digest, digest, sizeof(digest));
+		(*h)->gen = item_hash_gen;
+	}
+	pthread_mutex_unlock(&item_hash_mutex);
+
+	return (*h)->digest;
+}
+
+/* Hash a line of a data file (64-bit FNV-1a). */
+uint64_t line_hash(const char *s, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
 /*
  * Overflow check for addition with positive second term.
  */
@@ -89,6 +89,8 @@ char *path_keys = NULL;
 char *path_cpid = NULL;
 char *path_dpid = NULL;
 char *path_dmon_log = NULL;
+char *path_spid = NULL;
+char *path_ssock = NULL;
 char *path_hooks = NULL;
 
 /* Variable to store global configuration. */
@@ -134,6 +136,9 @@ void vars_init(void)
 	conf.auto_gc = 0;
 	conf.periodic_save = 0;
 	conf.systemevents = 1;
+	conf.data_cache = 0;
+	conf.journal = 0;
+	conf.note_pack = 0;
 	conf.default_panel = CAL;
 	conf.compact_panels = 0;
 	strncpy(conf.output_datefmt, "%D", 3);
@@ -0,0 +1,266 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calcurse.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/*
+ * Watch the data files, the configuration file and the notes directory for
+ * changes made by other programs, e.g. a synchronization hook or an editor.
+ *
+ * The directories holding the files are watched with inotify, so that files
+ * which are replaced (rather than written in place) are still noticed. Bursts
+ * of changes are merged: they are only reported once the files have been left
+ * alone for WATCH_QUIET milliseconds, or WATCH_MAXDELAY milliseconds after the
+ * first one. The thread to notify is then woken up with SIGUSR1, and finds out
+ * what changed with watch_changes().
+ */
+
+#define WATCH_QUIET	500
+#define WATCH_MAXDELAY	5000
+
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int watch_pending;
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* A watched file, or any file of a watched directory if name is NULL. */
+struct watch_file {
+	int wd;
+	char *name;
+	int change;
+};
+
+#define WATCH_FILES	4
+
+static struct watch_file watch_files[WATCH_FILES];
+static unsigned watch_nfiles;
+static int watch_fd = -1;
+static pthread_t watch_t_main, watch_t_notify;
+
+static void watch_add(const char *path, int dir, int change)
+{
+	struct watch_file *wf = &watch_files[watch_nfiles];
+	char *real = io_follow_links(path), *slash = strrchr(real, '/');
+	const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE |
+	    IN_CREATE;
+
+	if (dir) {
+		wf->name = NULL;
+		wf->wd = inotify_add_watch(watch_fd, real, mask);
+	} else if (slash) {
+		wf->name = mem_strdup(slash + 1);
+		*(slash == real ? slash + 1 : slash) = '\0';
+		wf->wd = inotify_add_watch(watch_fd, real, mask);
+	} else {
+		wf->name = mem_strdup(real);
+		wf->wd = inotify_add_watch(watch_fd, ".", mask);
+	}
+	wf->change = change;
+	if (wf->wd >= 0)
+		watch_nfiles++;
+	else
+		mem_free(wf->name);
+	mem_free(real);
+}
+
+/* Return what an event is about. The journals count as the data files. */
+static int watch_match(struct inotify_event *ev)
+{
+	struct watch_file *wf;
+	size_t len;
+	unsigned i;
+
+	if (ev->mask & IN_Q_OVERFLOW)
+		return WATCH_DATA | WATCH_CONF;
+
+	for (i = 0; i < watch_nfiles; i++) {
+		wf = &watch_files[i];
+		if (wf->wd != ev->wd)
+			continue;
+		if (!wf->name)
+			return wf->change;
+		if (!ev->len)
+			continue;
+		len = strlen(wf->name);
+		if (!strncmp(ev->name, wf->name, len) &&
+		    (ev->name[len] == '\0' ||
+		     (wf->change == WATCH_DATA &&
+		      !strcmp(ev->name + len, ".journal"))))
+			return wf->change;
+	}
+	return 0;
+}
+
+static long watch_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void watch_report(int changes)
+{
+	pthread_mutex_lock(&watch_mutex);
+	watch_pending |= changes;
+	pthread_mutex_unlock(&watch_mutex);
+	pthread_kill(watch_t_notify, SIGUSR1);
+}
+
+/* Thread reading the inotify events. */
+static void *watch_thread(void *arg)
+{
+	union {
+		struct inotify_event ev;
+		char buf[BUFSIZ];
+	} u;
+	struct pollfd pfd;
+	struct inotify_event *ev;
+	int changes = 0, n;
+	long first = 0;
+	ssize_t len;
+	char *p;
+
+	pfd.fd = watch_fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		n = poll(&pfd, 1, changes ? WATCH_QUIET : -1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		if (n > 0) {
+			if ((len = read(watch_fd, u.buf, sizeof(u.buf))) < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (p = u.buf; p < u.buf + len;
+			     p += sizeof(struct inotify_event) + ev->len) {
+				ev = (struct inotify_event *)p;
+				if (!changes)
+					first = watch_clock();
+				changes |= watch_match(ev);
+			}
+		}
+		if (changes && (n == 0 ||
+				watch_clock() - first >= WATCH_MAXDELAY)) {
+			watch_report(changes);
+			changes = 0;
+		}
+	}
+
+	return NULL;
+}
+
+static void watch_close(void)
+{
+	unsigned i;
+
+	for (i = 0; i < watch_nfiles; i++)
+		mem_free(watch_files[i].name);
+	watch_nfiles = 0;
+	close(watch_fd);
+	watch_fd = -1;
+}
+
+/*
+ * Start watching the files. Changes are reported to the calling thread, see
+ * above.
+ */
+void watch_start_thread(void)
+{
+	if (watch_fd >= 0)
+		return;
+	if ((watch_fd = inotify_init()) < 0)
+		return;
+
+	watch_add(path_apts, 0, WATCH_DATA);
+	watch_add(path_todo, 0, WATCH_DATA);
+	watch_add(path_notes, 1, WATCH_DATA);
+	watch_add(path_conf, 0, WATCH_CONF);
+
+	watch_t_notify = pthread_self();
+	if (!watch_nfiles ||
+	    pthread_create(&watch_t_main, NULL, watch_thread, NULL))
+		watch_close();
+}
+
+/* Stop watching the files. */
+void watch_stop_thread(void)
+{
+	if (watch_fd < 0)
+		return;
+
+	pthread_cancel(watch_t_main);
+	pthread_join(watch_t_main, NULL);
+	watch_close();
+}
+
+#else
+
+void watch_start_thread(void)
+{
+}
+
+void watch_stop_thread(void)
+{
+}
+
+#endif
+
+/* Return the changes reported since the last call (WATCH_* flags). */
+int watch_changes(void)
+{
+	int changes;
+
+	pthread_mutex_lock(&watch_mutex);
+	changes = watch_pending;
+	watch_pending = 0;
+	pthread_mutex_unlock(&watch_mutex);
+
+	return changes;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-appointment-023" \
+    -s01/09/2013 -r5
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/09/13:
+ - ..:.. -> ..:..
+	Quarter
+
+01/10/13:
+ - ..:.. -> ..:..
+	Quarter
+ - 22:00 -> ..:..
+	Three days
+
+01/11/13:
+ * Event
+ - ..:.. -> ..:..
+	Quarter
+ - ..:.. -> ..:..
+	Three days
+ - 12:00 -> 12:00
+	Instant
+
+01/12/13:
+ - ..:.. -> ..:..
+	Quarter
+ - ..:.. -> 02:00
+	Three days
+
+01/13/13:
+ * Later event
+ - ..:.. -> ..:..
+	Quarter
+EOD
+else
+  ./run-test "$0"
+fi
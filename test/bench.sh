@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Run the calcurse benchmark suite on a synthetic calendar.
+#
+# The size of the generated calendar is controlled by the BENCH_APPTS,
+# BENCH_EVENTS, BENCH_RULES and BENCH_TODOS environment variables. Results are
+# printed as tab-separated name/seconds pairs, or written to BENCH_OUTPUT if
+# set. If BENCH_BASELINE names a previous result file, both sets are compared
+# and the script fails when a benchmark got slower than BENCH_THRESHOLD times
+# the baseline.
+
+CALCURSE=${CALCURSE:-../src/calcurse}
+DATA_DIR=${DATA_DIR:-data/}
+RUN_BENCH=${RUN_BENCH:-./run-bench}
+
+BENCH_APPTS=${BENCH_APPTS:-100000}
+BENCH_EVENTS=${BENCH_EVENTS:-10000}
+BENCH_RULES=${BENCH_RULES:-10000}
+BENCH_TODOS=${BENCH_TODOS:-1000}
+BENCH_SEED=${BENCH_SEED:-1}
+BENCH_REPEAT=${BENCH_REPEAT:-3}
+BENCH_THRESHOLD=${BENCH_THRESHOLD:-1.25}
+
+case "$CALCURSE" in
+	/*) ;;
+	*) CALCURSE="${PWD}/${CALCURSE}" ;;
+esac
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/calcurse-bench.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' EXIT INT TERM
+
+"$RUN_BENCH" gen -a "$BENCH_APPTS" -e "$BENCH_EVENTS" -r "$BENCH_RULES" \
+	-t "$BENCH_TODOS" -s "$BENCH_SEED" "$dir/cal" || exit 1
+cp "$DATA_DIR/conf" "$dir/cal/conf"
+mkdir "$dir/import"
+cp "$DATA_DIR/conf" "$dir/import/conf"
+printf '%s\r\n' BEGIN:VCALENDAR VERSION:2.0 BEGIN:VEVENT \
+	'DTSTART;VALUE=DATE:19990101' SUMMARY:Bench END:VEVENT \
+	END:VCALENDAR >"$dir/event.ics"
+# Exceptions of recurring events do not survive an iCal round trip.
+"$CALCURSE" --read-only -D "$dir/cal" --export=ical \
+	--filter-type event,apt,recur-apt,todo >"$dir/export.ics"
+
+bench() {
+	"$RUN_BENCH" time -n "$BENCH_REPEAT" "$@" || exit 1
+}
+
+run() {
+	cal="$CALCURSE --read-only -D $dir/cal"
+
+	bench load $cal -Q --from 01/01/2000 --days 1
+	# Each run adds an item to a fresh copy, so that the files are written.
+	bench save sh -c "rm -rf '$dir/save' && cp -R '$dir/cal' '$dir/save' &&
+		'$CALCURSE' -q -D '$dir/save' -i '$dir/event.ics'"
+	bench range $cal -s01/01/2022 -r365
+	bench next $cal -n
+	bench query-pattern $cal -Q --from 01/01/2021 --days 365 \
+		--filter-pattern '(room|topic) 4[0-9]'
+	bench query-type $cal -Q --from 01/01/2021 --days 365 \
+		--filter-type recur
+	bench query-todo $cal -t --filter-priority 1-3
+	bench export-ical $cal --export=ical
+	bench export-pcal $cal --export=pcal
+	bench import-ical sh -c "rm -f '$dir/import/apts' '$dir/import/todo' &&
+		'$CALCURSE' -q -D '$dir/import' -i '$dir/export.ics'"
+	# The monthly view covers six weeks around the selected month.
+	bench month-view $cal -Q --filter-type cal --from 02/24/2022 \
+		--days 42
+}
+
+echo "# calcurse benchmark: appts=$BENCH_APPTS events=$BENCH_EVENTS" \
+	"rules=$BENCH_RULES todos=$BENCH_TODOS seed=$BENCH_SEED" >"$dir/results"
+run >>"$dir/results"
+
+if [ -n "$BENCH_OUTPUT" ]; then
+	cp "$dir/results" "$BENCH_OUTPUT"
+else
+	cat "$dir/results"
+fi
+
+if [ -n "$BENCH_BASELINE" ]; then
+	"$RUN_BENCH" compare -t "$BENCH_THRESHOLD" "$BENCH_BASELINE" \
+		"$dir/results"
+fi
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Insert, look up and remove items of a self-resizing hash table.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  ./run-htable
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+maximum load: 75%
+inserted: 2000 items, 4096 slots, 9 resizes
+mixed: 956 items, 4096 slots, wrapped runs
+removed: 0 items, 4096 slots
+reserved: 256 slots for 100 items
+EOD
+else
+  ./run-test "$0"
+fi
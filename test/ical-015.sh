@@ -0,0 +1,25 @@
+#!/bin/sh
+# Recurrence rules with a COUNT: the until date is the last occurrence.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  "$CALCURSE" -D "$tmpdir" -i "$DATA_DIR/ical-015.ical"
+  cat "$tmpdir/apts"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+Import process report: 0039 lines read
+5 apps / 1 event / 0 todos / 0 skipped
+02/29/2020 [1] {1Y -> 02/29/2028} Leap day, count 3
+01/01/2021 @ 10:00 -> 01/01/2021 @ 10:30 {1M -> 04/02/2021 w12 w-12} |First and last Friday of the month, count 7
+01/05/2021 @ 14:00 -> 01/05/2021 @ 16:00 {3W -> 03/30/2021 w2 w4} |Every third week on Tuesday and Thursday, count 9
+01/10/2021 @ 12:00 -> 01/10/2021 @ 13:00 {2M -> 07/10/2021 d10 d-3 !03/10/2021} |Bimonthly on the 10th and third-to-last day, count 6
+01/15/2021 @ 09:00 -> 01/15/2021 @ 10:00 {1Y -> 04/15/2023 m1 m4 m7 m10} |Quarterly report, count 10
+01/31/2021 @ 08:00 -> 01/31/2021 @ 08:15 {1D -> 05/31/2021 d-1} |Last day of the month, count 5
+EOD
+else
+  ./run-test "$0"
+fi
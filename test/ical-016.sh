@@ -0,0 +1,61 @@
+#!/bin/sh
+# Exception dates are kept in order, whatever the order of the EXDATE lists.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  "$CALCURSE" -D "$tmpdir" -i "$DATA_DIR/ical-016.ical"
+  cat "$tmpdir/apts"
+  "$CALCURSE" --read-only -D "$tmpdir" -Q --filter-type cal \
+    --from 03/01/2021 --days 17 --format-recur-apt '%S %m\n' \
+    --format-recur-event '%m\n'
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+Import process report: 0017 lines read
+1 app / 1 event / 0 todos / 0 skipped
+03/01/2021 [1] {1W -> 03/17/2021 w1 w3 !03/03/2021 !03/15/2021 !03/15/2021} Weekly with a repeated exception
+03/01/2021 @ 09:00 -> 03/01/2021 @ 10:00 {1D -> 03/14/2021 !03/02/2021 !03/04/2021 !03/05/2021 !03/08/2021} |Daily with unordered exceptions
+03/01/21:
+Weekly with a repeated exception
+09:00 Daily with unordered exceptions
+
+03/03/21:
+09:00 Daily with unordered exceptions
+
+03/06/21:
+09:00 Daily with unordered exceptions
+
+03/07/21:
+09:00 Daily with unordered exceptions
+
+03/08/21:
+Weekly with a repeated exception
+
+03/09/21:
+09:00 Daily with unordered exceptions
+
+03/10/21:
+Weekly with a repeated exception
+09:00 Daily with unordered exceptions
+
+03/11/21:
+09:00 Daily with unordered exceptions
+
+03/12/21:
+09:00 Daily with unordered exceptions
+
+03/13/21:
+09:00 Daily with unordered exceptions
+
+03/14/21:
+09:00 Daily with unordered exceptions
+
+03/17/21:
+Weekly with a repeated exception
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,18 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-io-007" -G \
+    --filter-type cal
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/03/2020 [1] {1W w5 w1 !01/10/2020} Weekly event
+01/06/2020 @ 12:00 -> 01/06/2020 @ 12:30 {2M -> 12/31/2020 d6 d-1 m1 m3} |Monthly
+01/01/2020 @ 08:00 -> 01/01/2020 @ 09:00>0123456789abcdef0123456789abcdef01234567 |With note
+01/02/2020 @ 10:00 -> 01/02/2020 @ 11:30!Spaced out
+01/07/2020 [1] No trailing newline
+EOD
+else
+  ./run-test "$0"
+fi
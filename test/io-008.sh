@@ -0,0 +1,38 @@
+#!/bin/sh
+# Load an appointment file large enough to be split between several threads,
+# with some items spread over two lines.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+genapts() {
+  awk -v bad="$1" 'BEGIN {
+    for (i = 0; i < 20000; i++) {
+      d = sprintf("01/%02d/2020", i % 28 + 1)
+      sep = (i % 7 == 3) ? "\n" : " "
+      at = (i == bad) ? "#" : "@"
+      printf("%s%s%s 10:00 -> %s @ 11:00 |Item %05d\n", d, sep, at, d, i)
+    }
+  }'
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  : >"$tmpdir/todo"
+  genapts -1 >"$tmpdir/apts"
+  "$CALCURSE" --read-only -D "$tmpdir" -G >"$tmpdir/out"
+  wc -l <"$tmpdir/out" | tr -d ' '
+  sed -n '1p;$p' "$tmpdir/out"
+  genapts 14999 >"$tmpdir/apts"
+  "$CALCURSE" --read-only -D "$tmpdir" -G 2>&1 | sed 's/^.*apts:/apts:/'
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+20000
+01/01/2020 @ 10:00 -> 01/01/2020 @ 11:00|Item 00000
+01/28/2020 @ 10:00 -> 01/28/2020 @ 11:00|Item 19991
+apts:15000: no event nor appointment found
+EOD
+else
+  ./run-test "$0"
+fi
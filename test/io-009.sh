@@ -0,0 +1,45 @@
+#!/bin/sh
+# Load the data files through the binary cache, and check that a stale or
+# damaged cache is never used.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+load() {
+  "$CALCURSE" -D "$tmpdir" -G >"$tmpdir/out.$1"
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$DATA_DIR/todo" "$tmpdir" || exit 1
+  cat "$DATA_DIR/apts" "$DATA_DIR/apts-recur" >"$tmpdir/apts"
+  echo 'general.datacache=yes' >>"$tmpdir/conf"
+  load 0
+  [ -f "$tmpdir/apts.cache" ] && [ -f "$tmpdir/todo.cache" ] && echo cached
+  load 1
+  cmp "$tmpdir/out.0" "$tmpdir/out.1" && echo same
+  mkdir "$tmpdir/old"
+  cp "$tmpdir/apts.cache" "$tmpdir/todo.cache" "$tmpdir/old"
+  dd if=/dev/zero of="$tmpdir/apts.cache" bs=1 seek=200 count=64 \
+    conv=notrunc 2>/dev/null
+  printf 'garbage' >"$tmpdir/todo.cache"
+  load 2
+  cmp "$tmpdir/out.0" "$tmpdir/out.2" && echo same
+  head -c 15 "$tmpdir/apts.cache" "$tmpdir/todo.cache" | grep -c calcurse-cache
+  cp "$tmpdir/old/apts.cache" "$tmpdir/old/todo.cache" "$tmpdir"
+  echo '01/01/2021 [1] Stale' >>"$tmpdir/apts"
+  echo '[2] Stale' >>"$tmpdir/todo"
+  load 3
+  grep Stale "$tmpdir/out.3"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+cached
+same
+same
+2
+[2] Stale
+01/01/2021 [1] Stale
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,63 @@
+#!/bin/sh
+# Replay the journals of the data files, and fold them back into the files.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+journal() {
+  sum=$( (sha1sum || shasum) <"$1" 2>/dev/null | cut -c1-40)
+  printf 'calcurse-journal %s\n' "$sum" >"$1.journal"
+  cat >>"$1.journal"
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  cat >"$tmpdir/apts" <<EOD
+01/01/2021 [1] Event A
+01/02/2021 [1] Event B
+01/02/2021 [1] Event B
+EOD
+  cat >"$tmpdir/todo" <<EOD
+[1] Task A
+[2] Task B
+EOD
+  journal "$tmpdir/apts" <<EOD
++01/03/2021 [1] Event C
+-01/02/2021 [1] Event B
+.
+-01/03/2021 [1] Event C
++01/04/2021 [1] Event D
+.
+-01/01/2021 [1] Event A
+EOD
+  journal "$tmpdir/todo" <<EOD
+-[2] Task B
++[3] Task C
+.
+EOD
+  "$CALCURSE" -D "$tmpdir" -G
+  echo '[4] Task D' >>"$tmpdir/todo"
+  "$CALCURSE" -D "$tmpdir" -t
+  "$CALCURSE" -D "$tmpdir" -P --filter-pattern nothing
+  [ -f "$tmpdir/apts.journal" ] || echo 'no journal'
+  cat "$tmpdir/apts"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+[1] Task A
+[3] Task C
+01/01/2021 [1] Event A
+01/02/2021 [1] Event B
+01/04/2021 [1] Event D
+to do:
+1. Task A
+2. Task B
+4. Task D
+no journal
+01/01/2021 [1] Event A
+01/02/2021 [1] Event B
+01/04/2021 [1] Event D
+EOD
+else
+  ./run-test "$0"
+fi
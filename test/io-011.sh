@@ -0,0 +1,60 @@
+#!/bin/sh
+# Save the data files only when they changed, without breaking symlinks.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+written() {
+  if [ -n "$(find "$1" -newer "$tmpdir/ref")" ]; then
+    echo "$1 written"
+  else
+    echo "$1 unchanged"
+  fi
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  mkdir "$tmpdir/data"
+  cat >"$tmpdir/data/apts" <<EOD
+01/01/2021 [1] Event A
+01/02/2021 [1] Event B
+EOD
+  cat >"$tmpdir/data/todo" <<EOD
+[1] Task A
+EOD
+  chmod 640 "$tmpdir/data/apts"
+  ln -s data/apts "$tmpdir/apts"
+  ln -s data/todo "$tmpdir/todo"
+  touch -t 200001010000 "$tmpdir/data/apts" "$tmpdir/data/todo"
+  touch -t 200001010100 "$tmpdir/ref"
+  cd "$tmpdir" || exit 1
+  "$CALCURSE" -D . -P --filter-pattern nothing
+  written data/apts
+  written data/todo
+  echo '01/03/2021   [1]   Event C' >>data/apts
+  touch -t 200001010000 data/apts
+  "$CALCURSE" -D . -P --filter-pattern nothing
+  written data/apts
+  written data/todo
+  [ -L apts ] && echo 'apts is a symlink'
+  ls -l data/apts | cut -c1-10
+  ls data
+  cat apts
+  cd / && rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+data/apts unchanged
+data/todo unchanged
+data/apts written
+data/todo unchanged
+apts is a symlink
+-rw-r-----
+apts
+todo
+01/01/2021 [1] Event A
+01/02/2021 [1] Event B
+01/03/2021 [1] Event C
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,97 @@
+#!/bin/sh
+# Read notes from note files and from the note pack.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  "$CALCURSE" -D "$tmpdir" -Q --from 01/01/2021 --days 2 --format-event '%m\n%N'
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  mkdir "$tmpdir/notes"
+  printf 'First note\n' >"$tmpdir/notes/n1"
+  printf 'Second\nnote\n' >"$tmpdir/notes/n2"
+  printf 'Unused note\n' >"$tmpdir/notes/n3"
+  cat >"$tmpdir/apts" <<EOD
+01/01/2021 [1] >n1 Event A
+01/02/2021 [1] >n2 Event B
+EOD
+  : >"$tmpdir/todo"
+  query
+  "$CALCURSE" -D "$tmpdir" --pack-notes
+  ls "$tmpdir/notes"
+  query
+  printf 'n4 100\npartial' >>"$tmpdir/notes/.pack"
+  echo "general.notepack=yes" >>"$tmpdir/conf"
+  cat >"$tmpdir/ical" <<EOD
+BEGIN:VCALENDAR
+VERSION:2.0
+BEGIN:VEVENT
+SUMMARY:Event C
+DTSTART;VALUE=DATE:20210102
+DESCRIPTION:Imported note
+END:VEVENT
+END:VCALENDAR
+EOD
+  "$CALCURSE" -D "$tmpdir" -q -i "$tmpdir/ical"
+  ls "$tmpdir/notes"
+  query
+  "$CALCURSE" -D "$tmpdir" -g
+  grep -c '^n3 ' "$tmpdir/notes/.pack"
+  query
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/01/21:
+Event A
+	First note
+
+
+01/02/21:
+Event B
+	Second
+	note
+
+01/01/21:
+Event A
+	First note
+
+
+01/02/21:
+Event B
+	Second
+	note
+
+01/01/21:
+Event A
+	First note
+
+
+01/02/21:
+Event B
+	Second
+	note
+
+Event C
+	Imported note
+
+0
+01/01/21:
+Event A
+	First note
+
+
+01/02/21:
+Event B
+	Second
+	note
+
+Event C
+	Imported note
+
+EOD
+else
+  ./run-test "$0"
+fi
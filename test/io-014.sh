@@ -0,0 +1,61 @@
+#!/bin/sh
+# Filter items by digest in the query server.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  "$CALCURSE" -D "$tmpdir" --client -Q --from 01/01/2021 --days 1 \
+    --format-event '%m\n' --format-apt '%m\n' --format-recur-apt '%m\n' "$@"
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  cat >"$tmpdir/apts" <<EOD
+01/01/2021 [1] Event A
+01/01/2021 [1] Event B
+01/01/2021 @ 10:00 -> 01/01/2021 @ 11:00 |Appointment A
+01/01/2021 @ 10:00 -> 01/01/2021 @ 11:00 {1D} |Appointment B
+EOD
+  : >"$tmpdir/todo"
+  "$CALCURSE" -D "$tmpdir" --serve
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] && break
+    sleep 1
+  done
+  query --filter-hash f1
+  query --filter-hash 95b7fbe07375534e2d85712c6721b1d3872d5924
+  query --filter-hash a011
+  query --filter-hash '!f1'
+  query --filter-hash 5a --filter-invert
+  query --filter-hash 0
+  echo "01/01/2021 [1] Event C" >>"$tmpdir/apts"
+  query --filter-hash d6
+  kill "$(cat "$tmpdir/.server.pid")"
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] || break
+    sleep 1
+  done
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/01/21:
+Event B
+01/01/21:
+Appointment B
+01/01/21:
+Appointment A
+01/01/21:
+Event A
+Appointment A
+Appointment B
+01/01/21:
+Event B
+Appointment A
+Appointment B
+01/01/21:
+Event C
+EOD
+else
+  ./run-test "$0"
+fi
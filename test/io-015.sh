@@ -0,0 +1,91 @@
+#!/bin/sh
+# Save imported items to the journals of the data files.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+import() {
+  cat >"$tmpdir/import.ical" <<EOD
+BEGIN:VCALENDAR
+VERSION:2.0
+BEGIN:VEVENT
+DTSTART;VALUE=DATE:$1
+SUMMARY:$2
+END:VEVENT
+BEGIN:VTODO
+PRIORITY:2
+SUMMARY:$2
+END:VTODO
+END:VCALENDAR
+EOD
+  "$CALCURSE" -D "$tmpdir" -i "$tmpdir/import.ical" >/dev/null
+}
+
+journal() {
+  if [ -f "$tmpdir/$1.journal" ]; then
+    tail -n +2 "$tmpdir/$1.journal"
+  else
+    echo "no $1 journal"
+  fi
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  echo 'general.journal=yes' >>"$tmpdir/conf"
+  for m in 01 02; do
+    for d in 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28; do
+      echo "$m/$d/2021 [1] Event $d"
+    done
+  done >"$tmpdir/apts"
+  echo '01/10/2021 [1] Event 10' >>"$tmpdir/apts"
+  echo '[1] Task' >"$tmpdir/todo"
+  cp "$tmpdir/apts" "$tmpdir/apts.orig"
+  # Only the new line is saved, the same line being in the file twice.
+  import 20210110 'Event 10'
+  journal apts
+  cmp "$tmpdir/apts" "$tmpdir/apts.orig" && echo unchanged
+  # The todo file is too small for a journal.
+  journal todo
+  import 20210110 'Event 10'
+  journal apts
+  "$CALCURSE" -D "$tmpdir" -G | grep -c "^01/10/2021"
+  # A journal which does not apply to the data file is kept, with a warning,
+  # and the data file is written instead.
+  echo '03/01/2021 [1] Event 1' >>"$tmpdir/apts"
+  import 20210302 'Event 2' 2>&1 | sed "s|$tmpdir/||g"
+  journal apts
+  grep -c Event "$tmpdir/apts"
+  rm "$tmpdir/apts.journal"
+  import 20210303 'Event 3'
+  journal apts
+  # The journal would be too large.
+  desc='An event with a description which is much longer than the others'
+  import 20210304 "$desc $desc $desc"
+  journal apts
+  grep -c Event "$tmpdir/apts"
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
++01/10/2021 [1] Event 10
+.
+unchanged
+no todo journal
++01/10/2021 [1] Event 10
+.
++01/10/2021 [1] Event 10
+.
+4
+apts was changed by another program, the changes saved to apts.journal are not applied and it is kept
++01/10/2021 [1] Event 10
+.
++01/10/2021 [1] Event 10
+.
+41
++03/03/2021 [1] Event 3
+.
+no apts journal
+42
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Answer queries in the time zone and working directory of the client.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  "$CALCURSE" -D "$1" --client -Q --from 10/28/2018 \
+    --format-apt '%(start:epoch)\n'
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  echo "10/28/2018 @ 12:00 -> 10/28/2018 @ 13:00 |Noon" >"$tmpdir/apts"
+  : >"$tmpdir/todo"
+  TZ=UTC "$CALCURSE" -D "$tmpdir" --serve
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] && break
+    sleep 1
+  done
+  TZ=UTC query "$tmpdir"
+  TZ=Asia/Tokyo query "$tmpdir"
+  (cd "$tmpdir" && TZ=UTC query .)
+  kill "$(cat "$tmpdir/.server.pid")"
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] || break
+    sleep 1
+  done
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+10/28/18:
+1540728000
+10/28/18:
+1540695600
+10/28/18:
+1540728000
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Reload the data files in the query server when the watcher reports changes.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  "$CALCURSE" -D "$tmpdir" --client -Q --from 01/01/2021 --days 2 \
+    --format-event '%m\n'
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  echo "01/01/2021 [1] Event A" >"$tmpdir/apts"
+  : >"$tmpdir/todo"
+  "$CALCURSE" -D "$tmpdir" --serve
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] && break
+    sleep 1
+  done
+  query
+  # The change is only seen if it is reloaded before the file goes away.
+  echo "01/02/2021 [1] Event B" >>"$tmpdir/apts"
+  sleep 2
+  mv "$tmpdir/apts" "$tmpdir/apts.new"
+  sleep 2
+  query
+  echo "01/02/2021 [1] Event C" >>"$tmpdir/apts.new"
+  mv "$tmpdir/apts.new" "$tmpdir/apts"
+  sleep 2
+  query
+  kill "$(cat "$tmpdir/.server.pid")"
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] || break
+    sleep 1
+  done
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/01/21:
+Event A
+01/01/21:
+Event A
+
+01/02/21:
+Event B
+01/01/21:
+Event A
+
+01/02/21:
+Event B
+Event C
+EOD
+else
+  ./run-test "$0"
+fi
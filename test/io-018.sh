@@ -0,0 +1,131 @@
+#!/bin/sh
+# Reload changed appointments incrementally in the query server.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  "$CALCURSE" -D "$tmpdir" "$@" -Q --from 12/30/2020 --days 20 \
+    --format-apt '%S-%E %m\n' --format-recur-apt '%S-%E %m\n' \
+    --format-event '%m\n' --format-recur-event '%m\n'
+}
+
+# Compare the answer of the server with a full load of the file.
+check() {
+  query --client >"$tmpdir/served"
+  query --read-only >"$tmpdir/loaded"
+  if cmp -s "$tmpdir/served" "$tmpdir/loaded"; then
+    echo "$1: same"
+  else
+    echo "$1: different"
+    diff "$tmpdir/loaded" "$tmpdir/served"
+  fi
+}
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR/conf" "$tmpdir" || exit 1
+  cat >"$tmpdir/apts" <<EOD
+01/01/2021 @ 10:00 -> 01/03/2021 @ 12:00 |Three days
+01/02/2021 @ 09:00 -> 01/02/2021 @ 10:00 {1D -> 01/10/2021} |Daily
+01/04/2021 [1] {1W} Weekly event
+01/05/2021 [1] Event
+01/06/2021 @ 08:00 -> 01/06/2021 @ 09:00 |Appointment
+01/07/2021 @ 22:00 -> 01/08/2021 @ 02:00 {2D} !01/09/2021 |Overnight
+EOD
+  : >"$tmpdir/todo"
+  "$CALCURSE" -D "$tmpdir" --serve
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] && break
+    sleep 1
+  done
+  check loaded
+  sed -i 's/|Three days/|Three days, edited/' "$tmpdir/apts"
+  check edited
+  sed -i 's/01\/10\/2021} |Daily/01\/05\/2021} |Daily/' "$tmpdir/apts"
+  check 'end of the recurrence'
+  cat >>"$tmpdir/apts" <<EOD
+12/31/2020 @ 20:00 -> 01/02/2021 @ 08:00 {1W} !01/07/2021 |Weekend
+01/08/2021 [1] {1D -> 01/12/2021} Daily event
+01/06/2021 @ 08:00 -> 01/06/2021 @ 09:00 |Appointment
+EOD
+  check added
+  sed -i '/|Overnight/d; /Weekly event/d' "$tmpdir/apts"
+  check removed
+  sed -i '0,/|Appointment/{/|Appointment/d}' "$tmpdir/apts"
+  check 'one of two'
+  sed -i 's/!01\/07\/2021 //' "$tmpdir/apts"
+  check 'exception removed'
+  cat "$tmpdir/served"
+  kill "$(cat "$tmpdir/.server.pid")"
+  for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$tmpdir/.server.sock" ] || break
+    sleep 1
+  done
+  rm -rf "$tmpdir" || exit 1
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+loaded: same
+edited: same
+end of the recurrence: same
+added: same
+removed: same
+one of two: same
+exception removed: same
+12/31/20:
+20:00-..:.. Weekend
+
+01/01/21:
+..:..-..:.. Weekend
+10:00-..:.. Three days, edited
+
+01/02/21:
+..:..-08:00 Weekend
+..:..-..:.. Three days, edited
+09:00-10:00 Daily
+
+01/03/21:
+..:..-12:00 Three days, edited
+09:00-10:00 Daily
+
+01/04/21:
+09:00-10:00 Daily
+
+01/05/21:
+Event
+09:00-10:00 Daily
+
+01/06/21:
+08:00-09:00 Appointment
+
+01/07/21:
+20:00-..:.. Weekend
+
+01/08/21:
+Daily event
+..:..-..:.. Weekend
+
+01/09/21:
+Daily event
+..:..-08:00 Weekend
+
+01/10/21:
+Daily event
+
+01/11/21:
+Daily event
+
+01/12/21:
+Daily event
+
+01/14/21:
+20:00-..:.. Weekend
+
+01/15/21:
+..:..-..:.. Weekend
+
+01/16/21:
+..:..-08:00 Weekend
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,16 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-next-004" -n |
+    sed -e 's/\[..:..\] Midnight$/[..:..] Daily/' \
+        -e 's/\[..:..\] Noon$/[..:..] Daily/'
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+next appointment:
+   [..:..] Daily
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-recur" \
+    -Q --from 01/06/2000 --to 01/09/2000 --filter-type recur-apt
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/06/00:
+ - ..:.. -> 00:00
+	Another recurrent appointment
+ - ..:.. -> 02:00
+	Recurrent appointment
+ - 00:00 -> ..:..
+	Third recurrent appointment
+
+01/07/00:
+ - 00:00 -> ..:..
+	Third recurrent appointment
+ - 16:00 -> ..:..
+	Recurrent appointment
+
+01/08/00:
+ - ..:.. -> 02:00
+	Recurrent appointment
+ - 00:00 -> ..:..
+	Another recurrent appointment
+ - 00:00 -> ..:..
+	Third recurrent appointment
+
+01/09/00:
+ - ..:.. -> ..:..
+	Another recurrent appointment
+ - 00:00 -> ..:..
+	Third recurrent appointment
+ - 16:00 -> ..:..
+	Recurrent appointment
+EOD
+else
+  ./run-test "$0"
+fi
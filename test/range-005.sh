@@ -0,0 +1,47 @@
+#!/bin/sh
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  "$CALCURSE" --read-only -D "$DATA_DIR"/ -c "$DATA_DIR/apts-recur" \
+    -Q --from 01/06/2000 --to 01/09/2000 --filter-type recur-apt --jobs 3 \
+    --limit 5
+  TZ=Europe/Berlin "$CALCURSE" --read-only -D "$DATA_DIR"/ \
+    -c "$DATA_DIR/apts-dst-ambiguous" -Q --from 10/28/2018 --to 10/30/2018 \
+    --filter-type cal --jobs 3
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+01/06/00:
+ - ..:.. -> 00:00
+	Another recurrent appointment
+ - ..:.. -> 02:00
+	Recurrent appointment
+ - 00:00 -> ..:..
+	Third recurrent appointment
+
+01/07/00:
+ - 00:00 -> ..:..
+	Third recurrent appointment
+ - 16:00 -> ..:..
+	Recurrent appointment
+
+01/08/00:
+
+01/09/00:
+10/28/18:
+ - 02:30 -> 05:30
+	daily - ambiguous start on 28/10
+ - 02:30 -> 02:30
+	weekly - ambiguous start on 28/10
+
+10/29/18:
+ - 02:30 -> 06:30
+	daily - ambiguous start on 28/10
+
+10/30/18:
+ - 02:30 -> 06:30
+	daily - ambiguous start on 28/10
+EOD
+else
+  ./run-test "$0"
+fi
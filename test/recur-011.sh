@@ -0,0 +1,63 @@
+#!/bin/sh
+# Single-day queries on rules which have expired, stretch beyond their until
+# date or can only occur on some days of the week or of the month.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  tmpdir=$(mktemp -d)
+  cp "$DATA_DIR"/conf "$DATA_DIR"/todo "$tmpdir"
+  cat >"$tmpdir"/apts <<EOD
+01/07/2000 @ 10:00 -> 01/07/2000 @ 11:00 {1W -> 03/01/2000} |Expired
+03/01/2013 @ 20:00 -> 03/04/2013 @ 08:00 {1W -> 03/15/2013} |Weekend
+01/31/2013 @ 09:00 -> 01/31/2013 @ 10:00 {1M} |Month end
+03/05/2013 @ 23:00 -> 03/06/2013 @ 01:00 {2W w2 w4} |Late
+EOD
+  for day in 03/14/2013 03/15/2013 03/16/2013 03/17/2013 03/18/2013 \
+             03/19/2013 03/20/2013 03/21/2013 03/22/2013 03/31/2013 \
+             04/30/2013 05/31/2013; do
+    "$CALCURSE" --read-only -D "$tmpdir" -Q --filter-type cal \
+      --from "$day" --days 1
+  done
+  rm -rf "$tmpdir"
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+03/15/13:
+ - 20:00 -> ..:..
+	Weekend
+03/16/13:
+ - ..:.. -> ..:..
+	Weekend
+03/17/13:
+ - ..:.. -> ..:..
+	Weekend
+03/18/13:
+ - ..:.. -> 08:00
+	Weekend
+03/19/13:
+ - 23:00 -> ..:..
+	Late
+03/20/13:
+ - ..:.. -> 01:00
+	Late
+03/21/13:
+ - 23:00 -> ..:..
+	Late
+03/22/13:
+ - ..:.. -> 01:00
+	Late
+03/31/13:
+ - 09:00 -> 10:00
+	Month end
+04/30/13:
+ - 23:00 -> ..:..
+	Late
+05/31/13:
+ - ..:.. -> 01:00
+	Late
+ - 09:00 -> 10:00
+	Month end
+EOD
+else
+  ./run-test "$0"
+fi
@@ -0,0 +1,484 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+/*
+ * Benchmark helper: generate synthetic calendars, time commands and compare
+ * result sets. See bench.sh for the driver that ties everything together.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BENCH_MAXRES 256
+
+struct result {
+	char name[64];
+	double secs;
+};
+
+/* First day of generated data (2020-01-01) and number of days covered. */
+#define GEN_EPOCH 18262
+#define GEN_DAYS  1827
+
+static unsigned long long rng_state;
+
+/* Print error message and bail out. */
+static void die(const char *format, ...)
+{
+	va_list arg;
+
+	va_start(arg, format);
+	fprintf(stderr, "error: ");
+	vfprintf(stderr, format, arg);
+	va_end(arg);
+
+	exit(1);
+}
+
+/* Print usage message. */
+static void usage(void)
+{
+	printf("usage: run-bench gen [-a appts] [-e events] [-r rules] "
+	       "[-t todos] [-s seed] <dir>\n"
+	       "       run-bench time [-n repeat] <name> <command> "
+	       "[<arg>...]\n"
+	       "       run-bench compare [-t threshold] <baseline> "
+	       "<results>\n");
+}
+
+/* Deterministic pseudo-random numbers (xorshift64*). */
+static unsigned rng(unsigned n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned)((rng_state * 2685821657736338717ULL) >> 33) % n;
+}
+
+/* Convert a number of days since the epoch to a civil date. */
+static void days2ymd(long days, int *y, int *m, int *d)
+{
+	long era, doe, yoe, doy, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+static int days2wday(long days)
+{
+	return (days + 4) % 7;
+}
+
+static void fprint_date(FILE *fp, long days)
+{
+	int y, m, d;
+
+	days2ymd(days, &y, &m, &d);
+	fprintf(fp, "%02d/%02d/%04d", m, d, y);
+}
+
+static void fprint_note(FILE *fp, const char *dir)
+{
+	char hash[41], path[BUFSIZ];
+	FILE *note;
+	int i;
+
+	for (i = 0; i < 40; i++)
+		hash[i] = "0123456789abcdef"[rng(16)];
+	hash[40] = '\0';
+	fprintf(fp, ">%s ", hash);
+
+	if (snprintf(path, BUFSIZ, "%s/notes/%s", dir, hash) >= BUFSIZ)
+		die("file name too long\n");
+	if (!(note = fopen(path, "w")))
+		die("failed to create %s: %s\n", path, strerror(errno));
+	for (i = rng(8) + 1; i > 0; i--)
+		fprintf(note, "Note line %u of a generated item.\n", rng(1000));
+	fclose(note);
+}
+
+static void fprint_head(FILE *fp, unsigned freq, char type, long until)
+{
+	fprintf(fp, "{%u%c", freq, type);
+	if (until) {
+		fputs(" -> ", fp);
+		fprint_date(fp, until);
+	}
+}
+
+/*
+ * Print a recurrence rule that starts on the given day. Rules are chosen so
+ * that the start day is always an occurrence, which calcurse insists on.
+ */
+static void fprint_rule(FILE *fp, long start)
+{
+	int y, m, d, wday = days2wday(start);
+	long until = rng(3) == 0 ? start + 30 + rng(GEN_DAYS) : 0;
+	int i, n;
+
+	days2ymd(start, &y, &m, &d);
+
+	switch (rng(6)) {
+	case 0:
+		fprint_head(fp, rng(3) + 1, 'D', until);
+		break;
+	case 1:
+		fprint_head(fp, rng(2) + 1, 'W', until);
+		fprintf(fp, " w%d", wday);
+		for (i = rng(3); i > 0; i--)
+			fprintf(fp, " w%u", (wday + rng(6) + 1) % 7);
+		break;
+	case 2:
+		fprint_head(fp, 1, 'M', until);
+		fprintf(fp, " d%d", d);
+		for (i = rng(3); i > 0; i--)
+			fprintf(fp, " d%d", rng(2) ? (int)rng(28) + 1 :
+				-(int)rng(7) - 1);
+		break;
+	case 3:
+		n = (d - 1) / 7 + 1;
+		fprint_head(fp, 1, 'M', until);
+		fprintf(fp, " w%d", n * 7 + wday);
+		if (rng(2))
+			fprintf(fp, " w-%u", 7 + rng(7));
+		break;
+	case 4:
+		fprint_head(fp, 1, 'Y', until);
+		fprintf(fp, " w%d m%d", wday, m);
+		for (i = rng(3); i > 0; i--)
+			fprintf(fp, " m%u", (m + rng(11)) % 12 + 1);
+		break;
+	default:
+		fprint_head(fp, 1, 'Y', until);
+		fprintf(fp, " m%d", m);
+		for (i = rng(4); i > 0; i--)
+			fprintf(fp, " m%u", (m + rng(11)) % 12 + 1);
+		break;
+	}
+
+	for (i = rng(4) == 0 ? rng(5) + 1 : 0; i > 0; i--) {
+		fputs(" !", fp);
+		fprint_date(fp, start + 7 * (rng(100) + 1));
+	}
+
+	fputs("}", fp);
+}
+
+/*
+ * Write appointments in the order calcurse saves them (by start time, then by
+ * description), spread evenly over the covered days between 7am and 7pm.
+ * Loading is much slower for unsorted files which calcurse never writes.
+ */
+static void gen_apts(FILE *fp, const char *dir, unsigned n, int recurring)
+{
+	long day, slot;
+	int min, dur;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		slot = (long long)i * GEN_DAYS * 720 / n;
+		day = GEN_EPOCH + slot / 720;
+		min = 420 + slot % 720;
+		dur = rng(100) == 0 ? 1440 * (rng(5) + 1) : 15 * (rng(16) + 1);
+
+		fprint_date(fp, day);
+		fprintf(fp, " @ %02d:%02d -> ", min / 60, min % 60);
+		min += dur;
+		fprint_date(fp, day + min / 1440);
+		fprintf(fp, " @ %02d:%02d ", min % 1440 / 60, min % 60);
+		if (recurring) {
+			fprint_rule(fp, day);
+			fputc(' ', fp);
+		}
+		if (rng(10) == 0)
+			fprint_note(fp, dir);
+		fprintf(fp, "%c%s %07u, room %u\n", rng(20) ? '|' : '!',
+			recurring ? "Recurring appointment" : "Appointment", i,
+			rng(100));
+	}
+}
+
+/* Write events, sorted by day and description like gen_apts() does. */
+static void gen_events(FILE *fp, const char *dir, unsigned n, int recurring)
+{
+	long day;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		day = GEN_EPOCH + (long long)i * GEN_DAYS / n;
+
+		fprint_date(fp, day);
+		fputs(" [1] ", fp);
+		if (recurring) {
+			fprint_rule(fp, day);
+			fputc(' ', fp);
+		}
+		if (rng(10) == 0)
+			fprint_note(fp, dir);
+		fprintf(fp, "%s %07u, topic %u\n",
+			recurring ? "Recurring event" : "Event", i, rng(100));
+	}
+}
+
+/* Write a synthetic calendar to the given directory. */
+static int gen(int argc, char **argv)
+{
+	unsigned appts = 1000, events = 100, rules = 100, todos = 100;
+	char path[BUFSIZ];
+	FILE *fp;
+	unsigned i;
+	int ch;
+
+	rng_state = 1;
+	while ((ch = getopt(argc, argv, "a:e:r:t:s:")) != -1) {
+		switch (ch) {
+		case 'a':
+			appts = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			events = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rules = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			todos = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rng_state = strtoull(optarg, NULL, 10) * 2 + 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	if (snprintf(path, BUFSIZ, "%s/notes", argv[optind]) >= BUFSIZ)
+		die("file name too long\n");
+	mkdir(argv[optind], 0755);
+	mkdir(path, 0755);
+
+	snprintf(path, BUFSIZ, "%s/apts", argv[optind]);
+	if (!(fp = fopen(path, "w")))
+		die("failed to create %s: %s\n", path, strerror(errno));
+
+	gen_apts(fp, argv[optind], appts, 0);
+	gen_apts(fp, argv[optind], rules / 2, 1);
+	gen_events(fp, argv[optind], events, 0);
+	gen_events(fp, argv[optind], rules - rules / 2, 1);
+	fclose(fp);
+
+	snprintf(path, BUFSIZ, "%s/todo", argv[optind]);
+	if (!(fp = fopen(path, "w")))
+		die("failed to create %s: %s\n", path, strerror(errno));
+	for (i = 0; i < todos; i++) {
+		fprintf(fp, "[%d] ", (int)rng(19) - 9);
+		if (rng(10) == 0)
+			fprint_note(fp, argv[optind]);
+		fprintf(fp, "Task %d, item %u\n", i, rng(100));
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Run a command with its standard output discarded and print the best wall
+ * clock time out of a number of runs.
+ */
+static int time_cmd(int argc, char **argv)
+{
+	double best = -1, t;
+	int repeat = 1;
+	int ch, i, pid, fd, stat;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			repeat = atoi(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind > argc - 2 || repeat < 1) {
+		usage();
+		return 1;
+	}
+
+	for (i = 0; i < repeat; i++) {
+		t = now();
+		if ((pid = fork()) < 0)
+			die("fork failed: %s\n", strerror(errno));
+		if (pid == 0) {
+			if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+				dup2(fd, STDOUT_FILENO);
+				close(fd);
+			}
+			execvp(argv[optind + 1], argv + optind + 1);
+			_exit(127);
+		}
+		waitpid(pid, &stat, 0);
+		t = now() - t;
+		if (!WIFEXITED(stat) || WEXITSTATUS(stat) != 0)
+			die("%s: command failed\n", argv[optind]);
+		if (best < 0 || t < best)
+			best = t;
+	}
+
+	printf("%s\t%.6f\n", argv[optind], best);
+	return 0;
+}
+
+/* Read a result set as produced by "run-bench time". */
+static int read_results(const char *path, struct result *res)
+{
+	char buf[BUFSIZ];
+	FILE *fp;
+	int n = 0;
+
+	if (!(fp = fopen(path, "r")))
+		die("failed to open %s: %s\n", path, strerror(errno));
+	while (n < BENCH_MAXRES && fgets(buf, BUFSIZ, fp)) {
+		if (*buf == '#')
+			continue;
+		if (sscanf(buf, "%63s %lf", res[n].name, &res[n].secs) == 2)
+			n++;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+/*
+ * Compare two result sets. Fails if any benchmark got slower by more than the
+ * given ratio.
+ */
+static int compare(int argc, char **argv)
+{
+	static struct result base[BENCH_MAXRES], cur[BENCH_MAXRES];
+	double threshold = 1.25, ratio;
+	int nbase, ncur, ch, i, j, ret = 0;
+
+	while ((ch = getopt(argc, argv, "t:")) != -1) {
+		switch (ch) {
+		case 't':
+			threshold = atof(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind != argc - 2) {
+		usage();
+		return 1;
+	}
+
+	nbase = read_results(argv[optind], base);
+	ncur = read_results(argv[optind + 1], cur);
+
+	printf("%-20s %12s %12s %8s\n", "name", "baseline", "current",
+	       "ratio");
+	for (i = 0; i < ncur; i++) {
+		for (j = 0; j < nbase; j++) {
+			if (strcmp(base[j].name, cur[i].name) == 0)
+				break;
+		}
+		if (j == nbase) {
+			printf("%-20s %12s %12.6f %8s\n", cur[i].name, "-",
+			       cur[i].secs, "-");
+			continue;
+		}
+		ratio = base[j].secs > 0 ? cur[i].secs / base[j].secs : 1;
+		printf("%-20s %12.6f %12.6f %8.3f%s\n", cur[i].name,
+		       base[j].secs, cur[i].secs, ratio,
+		       ratio > threshold ? " REGRESSION" : "");
+		if (ratio > threshold)
+			ret = 1;
+	}
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (!argv[1])
+		die("no command specified, bailing out\n");
+	else if (strcmp(argv[1], "-h") == 0
+		 || strcmp(argv[1], "--help") == 0) {
+		usage();
+		return 0;
+	}
+
+	if (strcmp(argv[1], "gen") == 0)
+		return gen(argc - 1, argv + 1);
+	else if (strcmp(argv[1], "time") == 0)
+		return time_cmd(argc - 1, argv + 1);
+	else if (strcmp(argv[1], "compare") == 0)
+		return compare(argc - 1, argv + 1);
+
+	usage();
+	return 1;
+}
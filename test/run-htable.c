@@ -0,0 +1,261 @@
+/*
+ * Calcurse - text-based organizer
+ *
+ * Copyright (c) 2004-2023 calcurse Development Team <misc@calcurse.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the
+ *        following disclaimer in the documentation and/or other
+ *        materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Send your feedback or comments to : misc@calcurse.org
+ * Calcurse home page : http://calcurse.org
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Exercise the self-resizing hash tables of htable.h against a plain array.
+ * The hash of an item is chosen by the test, so that the items pile up at the
+ * start and at the end of the table: runs are long and wrap around, which is
+ * where insertion, lookup and removal by backward shift are easiest to get
+ * wrong.
+ */
+
+#define mem_calloc calloc
+#define mem_free free
+
+/* The hash of an item is the first four bytes of its key. */
+#define HASH_TEST(key, keylen, num_bkts, bkt) do {                            \
+  memcpy (&(bkt), (key), sizeof (uint32_t));                                  \
+} while (0)
+#define HASH_FUNCTION HASH_TEST
+
+#include "htable.h"
+
+#define NITEMS 2000
+#define NOPS 20000
+
+struct item {
+	uint32_t hash;
+	unsigned id;
+};
+
+static void item_key(struct item *item, const char **key, int *len)
+{
+	*key = (const char *)item;
+	*len = sizeof(struct item);
+}
+
+static int item_cmp(struct item *a, struct item *b)
+{
+	return a->id != b->id;
+}
+
+HTABLE_DYN_HEAD(ht, item);
+HTABLE_DYN_PROTOTYPE(ht, item)
+    HTABLE_DYN_GENERATE(ht, item, item_key, item_cmp)
+
+static struct item items[NITEMS];
+static int present[NITEMS];
+static unsigned npresent;
+static unsigned long long rng_state = 1;
+
+/* Print error message and bail out. */
+static void die(const char *format, ...)
+{
+	va_list arg;
+
+	va_start(arg, format);
+	fprintf(stderr, "error: ");
+	vfprintf(stderr, format, arg);
+	va_end(arg);
+
+	exit(1);
+}
+
+/* Deterministic pseudo-random numbers (xorshift64*), as in run-bench. */
+static unsigned rng(unsigned n)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned)((rng_state * 2685821657736338717ULL) >> 33) % n;
+}
+
+/*
+ * Check the table against the array. Every item must be found from its home
+ * slot without crossing a free slot. Return the number of items stored past
+ * the end of the table, in a run which wrapped around.
+ */
+static unsigned check(struct ht *h)
+{
+	struct item *item;
+	uint32_t mask = h->size - 1, home, pos, i, n = 0, wrapped = 0;
+
+	if (HTABLE_DYN_COUNT(h) != npresent)
+		die("%u items stored, %u expected\n", HTABLE_DYN_COUNT(h),
+		    npresent);
+	if (h->size & mask)
+		die("size %u is not a power of two\n", h->size);
+	if ((uint64_t)h->noitems * 100 > (uint64_t)h->size * h->maxload)
+		die("load %.1f%% above %u%%\n", HTABLE_DYN_LOAD(h),
+		    h->maxload);
+
+	for (pos = 0; pos < h->size; pos++) {
+		if (!(item = h->slots[pos].elm))
+			continue;
+		n++;
+		home = item->hash & mask;
+		for (i = home; i != pos; i = (i + 1) & mask) {
+			if (!h->slots[i].elm)
+				die("item %u cut off from its home slot\n",
+				    item->id);
+		}
+		if (pos < home)
+			wrapped++;
+	}
+	if (n != npresent)
+		die("%u slots in use, %u expected\n", n, npresent);
+
+	for (i = 0; i < NITEMS; i++) {
+		item = HTABLE_DYN_LOOKUP(ht, h, &items[i]);
+		if (item != (present[i] ? &items[i] : NULL))
+			die("lookup of item %u failed\n", i);
+	}
+
+	return wrapped;
+}
+
+static void insert(struct ht *h, unsigned i)
+{
+	struct item dup = items[i];
+
+	if (HTABLE_DYN_INSERT(ht, h, &items[i]) != &items[i])
+		die("insertion of item %u failed\n", i);
+	if (HTABLE_DYN_INSERT(ht, h, &dup) != NULL)
+		die("item %u inserted twice\n", i);
+	present[i] = 1;
+	npresent++;
+}
+
+static void remove_item(struct ht *h, unsigned i)
+{
+	struct item key = items[i];
+
+	if (HTABLE_DYN_REMOVE(ht, h, &key) != &items[i])
+		die("removal of item %u failed\n", i);
+	if (HTABLE_DYN_REMOVE(ht, h, &key) != NULL)
+		die("item %u removed twice\n", i);
+	present[i] = 0;
+	npresent--;
+}
+
+int main(void)
+{
+	struct ht h;
+	struct item *item;
+	uint32_t pos, size;
+	unsigned i, n, resizes = 0, wrapped = 0;
+
+	for (i = 0; i < NITEMS; i++) {
+		items[i].id = i;
+		/* A quarter of the items at both ends of the table. */
+		switch (rng(8)) {
+		case 0:
+			items[i].hash = rng(32);
+			break;
+		case 1:
+			items[i].hash = UINT32_MAX - rng(32);
+			break;
+		default:
+			items[i].hash = rng(UINT32_MAX);
+		}
+	}
+
+	/* The limit on the load has to leave free slots. */
+	HTABLE_DYN_INIT(&h, 100);
+	insert(&h, 0);
+	printf("maximum load: %u%%\n", h.maxload);
+	remove_item(&h, 0);
+	HTABLE_DYN_FREE(ht, &h);
+
+	HTABLE_DYN_INIT(&h, 50);
+	for (i = 0; i < NITEMS; i++) {
+		size = HTABLE_DYN_SIZE(&h);
+		insert(&h, i);
+		if (HTABLE_DYN_SIZE(&h) != size)
+			resizes++;
+		if (i % 100 == 0 && check(&h))
+			wrapped++;
+	}
+	printf("inserted: %u items, %u slots, %u resizes\n",
+	       HTABLE_DYN_COUNT(&h), HTABLE_DYN_SIZE(&h), resizes);
+
+	for (n = 0; n < NOPS; n++) {
+		i = rng(NITEMS);
+		if (present[i])
+			remove_item(&h, i);
+		else
+			insert(&h, i);
+		if (n % 100 == 0 && check(&h))
+			wrapped++;
+	}
+	printf("mixed: %u items, %u slots, %s\n", HTABLE_DYN_COUNT(&h),
+	       HTABLE_DYN_SIZE(&h), wrapped ? "wrapped runs" : "no wrap");
+
+	n = 0;
+	HTABLE_DYN_FOREACH(item, ht, &h, pos) {
+		if (!present[item->id])
+			die("item %u found by iteration\n", item->id);
+		n++;
+	}
+	if (n != npresent)
+		die("%u items found by iteration, %u expected\n", n, npresent);
+
+	for (i = 0; i < NITEMS; i++) {
+		if (present[i])
+			remove_item(&h, i);
+		if (i % 100 == 0)
+			check(&h);
+	}
+	check(&h);
+	printf("removed: %u items, %u slots\n", HTABLE_DYN_COUNT(&h),
+	       HTABLE_DYN_SIZE(&h));
+
+	size = HTABLE_DYN_SIZE(&h);
+	HTABLE_DYN_RESERVE(ht, &h, NITEMS);
+	if (HTABLE_DYN_SIZE(&h) != size)
+		die("reserved table grew to %u slots\n", HTABLE_DYN_SIZE(&h));
+	HTABLE_DYN_FREE(ht, &h);
+	HTABLE_DYN_RESERVE(ht, &h, 100);
+	printf("reserved: %u slots for 100 items\n", HTABLE_DYN_SIZE(&h));
+	HTABLE_DYN_FREE(ht, &h);
+
+	return 0;
+}
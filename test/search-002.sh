@@ -0,0 +1,22 @@
+#!/bin/sh
+# Filter by patterns with alternatives, groups and optional characters.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+if [ "$1" = 'actual' ]; then
+  for pattern in 'Manuel|Sandbox' '[Gg]lori(fied|ously)' 'Beef(burger)?' \
+    'processs?or'; do
+    "$CALCURSE" --read-only -D "$DATA_DIR"/ -G --filter-pattern "$pattern"
+  done
+elif [ "$1" = 'expected' ]; then
+  cat <<EOD
+12/06/1942 @ 09:46 -> 12/07/1942 @ 04:33|Manuel glorified four
+05/28/1985 [1] Sandbox processor's overdraft's
+[9] Gloriously slams
+12/06/1942 @ 09:46 -> 12/07/1942 @ 04:33|Manuel glorified four
+[9] Beefburger's
+05/28/1985 [1] Sandbox processor's overdraft's
+EOD
+else
+  ./run-test "$0"
+fi
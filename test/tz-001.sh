@@ -0,0 +1,53 @@
+#!/bin/sh
+# The cached time zone offsets give the same dates as the C library, and a
+# local time which occurs twice is always taken to be the first one.
+
+. "${TEST_INIT:-./test-init.sh}"
+
+query() {
+  for tz in Europe/Copenhagen America/New_York America/Sao_Paulo \
+            Australia/Lord_Howe; do
+    echo "$tz"
+    TZ="$tz" "$CALCURSE" --read-only -D "$DATA_DIR"/ \
+      -c "$DATA_DIR/apts-dst" -Q --from 03/01/2019 --to 12/31/2020
+    TZ="$tz" "$CALCURSE" --read-only -D "$DATA_DIR"/ \
+      -c "$DATA_DIR/rfc5545" -Q --from 01/01/1997 --to 12/31/2000 \
+      --filter-type recur
+  done
+}
+
+ambiguous() {
+  for nocache in '' 1; do
+    TZ=Europe/Berlin CALCURSE_TZ_NOCACHE=$nocache "$CALCURSE" --read-only \
+      -D "$DATA_DIR"/ -c "$DATA_DIR/apts-dst-ambiguous" -d10/28/2018
+    TZ=Europe/Berlin CALCURSE_TZ_NOCACHE=$nocache "$CALCURSE" --read-only \
+      -D "$DATA_DIR"/ -c "$DATA_DIR/apts-dst-ambiguous" -s10/27/2018 -r2
+  done
+}
+
+if [ "$1" = 'actual' ]; then
+  query
+  ambiguous
+elif [ "$1" = 'expected' ]; then
+  CALCURSE_TZ_NOCACHE=1 query
+  for i in 1 2; do
+    cat <<EOD
+10/28/18:
+ - 02:30 -> 05:30
+	daily - ambiguous start on 28/10
+ - 02:30 -> 02:30
+	weekly - ambiguous start on 28/10
+10/27/18:
+ - 02:30 -> 06:30
+	daily - ambiguous start on 28/10
+
+10/28/18:
+ - 02:30 -> 05:30
+	daily - ambiguous start on 28/10
+ - 02:30 -> 02:30
+	weekly - ambiguous start on 28/10
+EOD
+  done
+else
+  ./run-test "$0"
+fi